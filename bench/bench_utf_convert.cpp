@@ -0,0 +1,582 @@
+/*
+ * Throughput of every public conversion over several corpora and sizes.
+ *
+ * The same source is built twice: bench_utf_convert links the library with
+ * the vectorized kernels, and bench_utf_convert_scalar links it built with
+ * UTF_CONVERT_NO_SIMD. Benchmark names start with the implementation, so the
+ * outputs of both line up. Build with -DCMAKE_BUILD_TYPE=Release, and select
+ * with --benchmark_filter, e.g. --benchmark_filter=convert_utf8_to_utf16/cjk.
+ *
+ * Sizes are of the utf-8 form of the corpus, the utf-16 and utf-32 inputs
+ * hold the same text, and the Latin-1 one too with '?' for what it lacks.
+ * Throughput is given in bytes of input and characters per second.
+ */
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include "utf_convert.hpp"
+
+using namespace utf_convert;
+
+namespace {
+struct corpus {
+    std::string    latin1;
+    std::string    u8;
+    std::u16string u16;
+    std::u32string u32;
+};
+
+struct corpus_seed {
+    const char *name;
+    const char *text;
+};
+
+const corpus_seed corpus_seeds[] = {
+    {"ascii", "The quick brown fox jumps over the lazy dog. 0123456789\n"},
+    {"latin1", "Gr\xc3\xb6\xc3\x9f" "e \xc3\xbc" "ber \xc3\x86r\xc3\xb8, "
+               "fa\xc3\xa7" "ade d\xc3\xa9j\xc3\xa0 vu, se\xc3\xb1or "
+               "ni\xc3\xb1o. "},
+    {"cjk", "\xe7\xb5\xb1\xe4\xb8\x80\xe7\xa2\xbc\xe8\x81\xaf\xe7\x9b\x9f"
+            "\xe7\x9a\x84\xe7\x9b\xae\xe6\xa8\x99\xe6\x98\xaf\xe7\x82\xba"
+            "\xe4\xb8\x96\xe7\x95\x8c\xe6\x96\x87\xe5\xad\x97\xe3\x80\x82"},
+    {"emoji", "\xf0\x9f\x98\x80\xf0\x9f\x98\x83\xf0\x9f\x9a\x80\xf0\x9f\x8c"
+              "\x8d\xf0\x9f\x8e\x89\xf0\x9f\x91\x8d \xf0\x9d\x90\x80\xf0\x9d"
+              "\x90\x81"},
+    {"mixed", "Hello \xe4\xb8\x96\xe7\x95\x8c, caf\xc3\xa9 \xf0\x9f\x98\x80 "
+              "\xd0\x9f\xd1\x80\xd0\xb8\xd0\xb2\xd0\xb5\xd1\x82 "
+              "\xf0\x90\x8d\x88 ok.\n"},
+    // Mostly ascii with runs of cjk, the blocks the kernels mix up the most.
+    {"ascii_cjk", "See \xe7\xb5\xb1\xe4\xb8\x80\xe7\xa2\xbc (Unicode) in the "
+                  "\xe4\xb8\x96\xe7\x95\x8c\xe6\x96\x87\xe5\xad\x97 spec, "
+                  "section 3.9: \xe7\x9b\xae\xe6\xa8\x99.\n"},
+};
+
+/*!
+ * Repeat the seed up to size bytes of utf-8, cut at a character boundary,
+ * and convert it to little endian utf-16 and utf-32, and to Latin-1.
+ */
+corpus make_corpus(const corpus_seed &seed, size_t size) {
+    corpus res;
+    res.u8.reserve(size);
+    while (res.u8.size() < size) {
+        res.u8 += seed.text;
+    }
+    size_t end = size;
+    while ((res.u8[end] & 0xc0) == 0x80) {
+        end--;
+    }
+    res.u8.resize(end);
+
+    to_u16string(res.u8, res.u16, UTF_ENDIAN_LITTLE_ENDIAN);
+    to_u32string(res.u8, res.u32, UTF_ENDIAN_LITTLE_ENDIAN);
+    utf8_to_latin1(res.u8, res.latin1, UTF_MODE_REPLACE);
+    return res;
+}
+
+template <typename Input, typename Function>
+void run(benchmark::State &state,
+         const Input &     input,
+         size_t            chars,
+         const Function &  function) {
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(function());
+        benchmark::ClobberMemory();
+    }
+    state.SetBytesProcessed(int64_t(state.iterations()) *
+                            int64_t(input.size()) *
+                            int64_t(sizeof(typename Input::value_type)));
+    state.counters["chars/s"] = benchmark::Counter(
+        double(chars), benchmark::Counter::kIsIterationInvariantRate);
+}
+
+/*!
+ * Cut the utf-8 form of a corpus into cells of about 16 bytes, at character
+ * boundaries, as the input of the batch conversions.
+ */
+struct cells {
+    explicit cells(const std::string &u8) {
+        for (size_t pos = 0; pos < u8.size();) {
+            size_t end = std::min<size_t>(pos + 16, u8.size());
+            while (end < u8.size() && (u8[end] & 0xc0) == 0x80) {
+                end++;
+            }
+            strs.push_back(u8.substr(pos, end - pos));
+            pos = end;
+        }
+        for (size_t i = 0; i < strs.size(); i++) {
+            data.push_back(strs[i].data());
+            lengths.push_back(strs[i].size());
+        }
+    }
+
+    std::vector<std::string>  strs;
+    std::vector<const char *> data;
+    std::vector<size_t>       lengths;
+};
+
+struct conversion {
+    const char *name;
+    void (*run)(benchmark::State &state, const corpus &c);
+};
+
+const UTF_ENDIAN little = UTF_ENDIAN_LITTLE_ENDIAN;
+
+const conversion conversions[] = {
+    // Allocation-free buffer API, the conversion kernels alone.
+    {"convert_utf8_to_utf32",
+     [](benchmark::State &state, const corpus &c) {
+         std::vector<char32_t> out(c.u32.size());
+         run(state, c.u8, c.u32.size(), [&] {
+             return convert_utf8_to_utf32(
+                        c.u8.data(), c.u8.size(), out.data(), out.size(),
+                        little)
+                 .count;
+         });
+     }},
+    {"convert_utf8_to_utf16",
+     [](benchmark::State &state, const corpus &c) {
+         std::vector<char16_t> out(c.u16.size());
+         run(state, c.u8, c.u32.size(), [&] {
+             return convert_utf8_to_utf16(
+                        c.u8.data(), c.u8.size(), out.data(), out.size(),
+                        little)
+                 .count;
+         });
+     }},
+    {"convert_utf16_to_utf8",
+     [](benchmark::State &state, const corpus &c) {
+         std::vector<char> out(c.u8.size());
+         run(state, c.u16, c.u32.size(), [&] {
+             return convert_utf16_to_utf8(
+                        c.u16.data(), c.u16.size(), out.data(), out.size(),
+                        little)
+                 .count;
+         });
+     }},
+    {"convert_utf16_to_utf32",
+     [](benchmark::State &state, const corpus &c) {
+         std::vector<char32_t> out(c.u32.size());
+         run(state, c.u16, c.u32.size(), [&] {
+             return convert_utf16_to_utf32(c.u16.data(), c.u16.size(),
+                                           out.data(), out.size(), little,
+                                           little)
+                 .count;
+         });
+     }},
+    {"convert_utf32_to_utf8",
+     [](benchmark::State &state, const corpus &c) {
+         std::vector<char> out(c.u8.size());
+         run(state, c.u32, c.u32.size(), [&] {
+             return convert_utf32_to_utf8(
+                        c.u32.data(), c.u32.size(), out.data(), out.size(),
+                        little)
+                 .count;
+         });
+     }},
+    {"convert_utf32_to_utf16",
+     [](benchmark::State &state, const corpus &c) {
+         std::vector<char16_t> out(c.u16.size());
+         run(state, c.u32, c.u32.size(), [&] {
+             return convert_utf32_to_utf16(c.u32.data(), c.u32.size(),
+                                           out.data(), out.size(), little,
+                                           little)
+                 .count;
+         });
+     }},
+
+    // The same conversions with the case folded on the way, block by block.
+    {"convert_utf8_to_utf16_fold_latin1",
+     [](benchmark::State &state, const corpus &c) {
+         std::vector<char16_t> out(c.u16.size());
+         run(state, c.u8, c.u32.size(), [&] {
+             return convert_utf8_to_utf16(
+                        c.u8.data(), c.u8.size(), out.data(), out.size(),
+                        little, UTF_MODE_LENIENT, UTF_FOLD_LATIN1)
+                 .count;
+         });
+     }},
+    {"convert_utf16_to_utf8_fold_latin1",
+     [](benchmark::State &state, const corpus &c) {
+         std::vector<char> out(c.u8.size());
+         run(state, c.u16, c.u32.size(), [&] {
+             return convert_utf16_to_utf8(
+                        c.u16.data(), c.u16.size(), out.data(), out.size(),
+                        little, UTF_MODE_LENIENT, UTF_FOLD_LATIN1)
+                 .count;
+         });
+     }},
+
+    // Latin-1. The widening to utf-16 writes as much as copying the utf-16
+    // form of the text, which is the bound it should get close to.
+    {"convert_latin1_to_utf16",
+     [](benchmark::State &state, const corpus &c) {
+         std::vector<char16_t> out(c.latin1.size());
+         run(state, c.latin1, c.latin1.size(), [&] {
+             return convert_latin1_to_utf16(c.latin1.data(), c.latin1.size(),
+                                            out.data(), out.size(), little)
+                 .count;
+         });
+     }},
+    {"memcpy_utf16",
+     [](benchmark::State &state, const corpus &c) {
+         std::vector<char16_t> out(c.u16.size());
+         run(state, c.u16, c.u32.size(), [&] {
+             std::memcpy(out.data(), c.u16.data(), c.u16.size() * 2);
+             return out.size();
+         });
+     }},
+    {"convert_latin1_to_utf8",
+     [](benchmark::State &state, const corpus &c) {
+         std::vector<char> out(2 * c.latin1.size());
+         run(state, c.latin1, c.latin1.size(), [&] {
+             return convert_latin1_to_utf8(c.latin1.data(), c.latin1.size(),
+                                           out.data(), out.size())
+                 .count;
+         });
+     }},
+    {"convert_utf8_to_latin1",
+     [](benchmark::State &state, const corpus &c) {
+         std::vector<char> out(c.u8.size());
+         run(state, c.u8, c.u32.size(), [&] {
+             return convert_utf8_to_latin1(c.u8.data(), c.u8.size(),
+                                           out.data(), out.size(),
+                                           UTF_MODE_REPLACE)
+                 .count;
+         });
+     }},
+    {"convert_utf16_to_latin1",
+     [](benchmark::State &state, const corpus &c) {
+         std::vector<char> out(c.u16.size());
+         run(state, c.u16, c.u32.size(), [&] {
+             return convert_utf16_to_latin1(c.u16.data(), c.u16.size(),
+                                            out.data(), out.size(), little,
+                                            UTF_MODE_REPLACE)
+                 .count;
+         });
+     }},
+
+    // Byte swap in place, bound by memory like the copy above.
+    {"swap_endian_inplace_utf16",
+     [](benchmark::State &state, const corpus &c) {
+         std::u16string str = c.u16;
+         run(state, c.u16, c.u32.size(), [&] {
+             swap_endian_inplace(str);
+             return str.size();
+         });
+     }},
+    {"swap_endian_inplace_utf32",
+     [](benchmark::State &state, const corpus &c) {
+         std::u32string str = c.u32;
+         run(state, c.u32, c.u32.size(), [&] {
+             swap_endian_inplace(str);
+             return str.size();
+         });
+     }},
+
+    // Length pre-passes.
+    {"utf32_length_from_utf8",
+     [](benchmark::State &state, const corpus &c) {
+         run(state, c.u8, c.u32.size(), [&] {
+             return utf32_length_from_utf8(c.u8.data(), c.u8.size());
+         });
+     }},
+    {"utf16_length_from_utf8",
+     [](benchmark::State &state, const corpus &c) {
+         run(state, c.u8, c.u32.size(), [&] {
+             return utf16_length_from_utf8(c.u8.data(), c.u8.size());
+         });
+     }},
+    {"utf8_length_from_utf16",
+     [](benchmark::State &state, const corpus &c) {
+         run(state, c.u16, c.u32.size(), [&] {
+             return utf8_length_from_utf16(c.u16.data(), c.u16.size(), little);
+         });
+     }},
+    {"utf32_length_from_utf16",
+     [](benchmark::State &state, const corpus &c) {
+         run(state, c.u16, c.u32.size(), [&] {
+             return utf32_length_from_utf16(c.u16.data(), c.u16.size(),
+                                            little);
+         });
+     }},
+    {"utf8_length_from_utf32",
+     [](benchmark::State &state, const corpus &c) {
+         run(state, c.u32, c.u32.size(), [&] {
+             return utf8_length_from_utf32(c.u32.data(), c.u32.size(), little);
+         });
+     }},
+    {"utf16_length_from_utf32",
+     [](benchmark::State &state, const corpus &c) {
+         run(state, c.u32, c.u32.size(), [&] {
+             return utf16_length_from_utf32(c.u32.data(), c.u32.size(),
+                                            little);
+         });
+     }},
+    {"codepoint_offset",
+     [](benchmark::State &state, const corpus &c) {
+         run(state, c.u8, c.u32.size(), [&] {
+             return codepoint_offset(c.u8.data(), c.u8.size(),
+                                     c.u32.size() - 1);
+         });
+     }},
+    {"display_width_utf8",
+     [](benchmark::State &state, const corpus &c) {
+         run(state, c.u8, c.u32.size(),
+             [&] { return display_width(c.u8.data(), c.u8.size()); });
+     }},
+    {"display_width_utf16",
+     [](benchmark::State &state, const corpus &c) {
+         run(state, c.u16, c.u32.size(), [&] {
+             return display_width(c.u16.data(), c.u16.size(), little);
+         });
+     }},
+
+    // Validation without decoding.
+    {"validate_utf8",
+     [](benchmark::State &state, const corpus &c) {
+         run(state, c.u8, c.u32.size(), [&] {
+             return validate_utf8(c.u8.data(), c.u8.size()).count;
+         });
+     }},
+
+    {"validate_utf16",
+     [](benchmark::State &state, const corpus &c) {
+         run(state, c.u16, c.u32.size(), [&] {
+             return validate_utf16(c.u16.data(), c.u16.size(), little).count;
+         });
+     }},
+    {"validate_utf32",
+     [](benchmark::State &state, const corpus &c) {
+         run(state, c.u32, c.u32.size(), [&] {
+             return validate_utf32(c.u32.data(), c.u32.size(), little).count;
+         });
+     }},
+    {"is_ascii",
+     [](benchmark::State &state, const corpus &c) {
+         run(state, c.u8, c.u32.size(), [&] {
+             return size_t(is_ascii(c.u8.data(), c.u8.size()));
+         });
+     }},
+
+    // Conversions validating in the same pass.
+    {"convert_utf8_to_utf16_strict",
+     [](benchmark::State &state, const corpus &c) {
+         std::vector<char16_t> out(c.u16.size());
+         run(state, c.u8, c.u32.size(), [&] {
+             return convert_utf8_to_utf16(c.u8.data(), c.u8.size(),
+                                          out.data(), out.size(), little,
+                                          UTF_MODE_STRICT)
+                 .count;
+         });
+     }},
+    {"convert_utf16_to_utf8_strict",
+     [](benchmark::State &state, const corpus &c) {
+         std::vector<char> out(c.u8.size());
+         run(state, c.u16, c.u32.size(), [&] {
+             return convert_utf16_to_utf8(c.u16.data(), c.u16.size(),
+                                          out.data(), out.size(), little,
+                                          UTF_MODE_STRICT)
+                 .count;
+         });
+     }},
+
+    {"convert_utf8_to_utf16_replace",
+     [](benchmark::State &state, const corpus &c) {
+         std::vector<char16_t> out(c.u16.size());
+         run(state, c.u8, c.u32.size(), [&] {
+             return convert_utf8_to_utf16(c.u8.data(), c.u8.size(),
+                                          out.data(), out.size(), little,
+                                          UTF_MODE_REPLACE)
+                 .count;
+         });
+     }},
+
+    // Hashing and counting the output in the same pass, or in a second one.
+    {"convert_utf16_to_utf8_digest",
+     [](benchmark::State &state, const corpus &c) {
+         std::vector<char> out(c.u8.size());
+         run(state, c.u16, c.u32.size(), [&] {
+             utf8_digest digest;
+             convert_utf16_to_utf8(c.u16.data(), c.u16.size(), out.data(),
+                                   out.size(), little, digest);
+             return digest.hash() + digest.codepoints();
+         });
+     }},
+    {"convert_utf16_to_utf8_then_digest",
+     [](benchmark::State &state, const corpus &c) {
+         std::vector<char> out(c.u8.size());
+         run(state, c.u16, c.u32.size(), [&] {
+             utf8_digest  digest;
+             const size_t size =
+                 convert_utf16_to_utf8(c.u16.data(), c.u16.size(), out.data(),
+                                       out.size(), little)
+                     .count;
+             digest.update(out.data(), size);
+             return digest.hash() + digest.codepoints();
+         });
+     }},
+    // Into a sink copying each block out, as a buffered writer would.
+    {"write_utf16_as_utf8",
+     [](benchmark::State &state, const corpus &c) {
+         std::vector<char> out(c.u8.size());
+         run(state, c.u16, c.u32.size(), [&] {
+             char *pos  = out.data();
+             auto  sink = [&](const char *data, size_t size) {
+                 std::memcpy(pos, data, size);
+                 pos += size;
+                 return true;
+             };
+             return write_utf16_as_utf8(c.u16.data(), c.u16.size(), little,
+                                        sink)
+                 .count;
+         });
+     }},
+
+    // String wrappers, measuring and converting into a reused target.
+    {"to_u32string_from_utf8",
+     [](benchmark::State &state, const corpus &c) {
+         std::u32string out;
+         run(state, c.u8, c.u32.size(),
+             [&] { return to_u32string(c.u8, out, little); });
+     }},
+    {"to_u16string_from_utf8",
+     [](benchmark::State &state, const corpus &c) {
+         std::u16string out;
+         run(state, c.u8, c.u32.size(),
+             [&] { return to_u16string(c.u8, out, little); });
+     }},
+    {"to_u8string_from_utf16",
+     [](benchmark::State &state, const corpus &c) {
+         std::string out;
+         run(state, c.u16, c.u32.size(),
+             [&] { return to_u8string(c.u16, little, out); });
+     }},
+    {"to_u32string_from_utf16",
+     [](benchmark::State &state, const corpus &c) {
+         std::u32string out;
+         run(state, c.u16, c.u32.size(),
+             [&] { return to_u32string(c.u16, little, out, little); });
+     }},
+    {"to_u8string_from_utf32",
+     [](benchmark::State &state, const corpus &c) {
+         std::string out;
+         run(state, c.u32, c.u32.size(),
+             [&] { return to_u8string(c.u32, little, out); });
+     }},
+    {"to_u16string_from_utf32",
+     [](benchmark::State &state, const corpus &c) {
+         std::u16string out;
+         run(state, c.u32, c.u32.size(),
+             [&] { return to_u16string(c.u32, little, out, little); });
+     }},
+
+    // Many short strings, in one batch or one call each.
+    {"batch_to_u16string_from_utf8",
+     [](benchmark::State &state, const corpus &c) {
+         cells               in(c.u8);
+         std::u16string      out;
+         std::vector<size_t> offsets;
+         run(state, c.u8, c.u32.size(), [&] {
+             return batch_to_u16string(in.data.data(), in.lengths.data(),
+                                       in.data.size(), out, offsets, little);
+         });
+     }},
+    {"to_u16string_per_cell_from_utf8",
+     [](benchmark::State &state, const corpus &c) {
+         cells                       in(c.u8);
+         std::vector<std::u16string> out(in.strs.size());
+         run(state, c.u8, c.u32.size(), [&] {
+             bool ok = true;
+             for (size_t i = 0; i < in.strs.size(); i++) {
+                 ok &= to_u16string(in.strs[i], out[i], little);
+             }
+             return ok;
+         });
+     }},
+
+    // Multi-threaded wrappers, on one thread per hardware thread.
+    {"parallel_to_u32string_from_utf8",
+     [](benchmark::State &state, const corpus &c) {
+         std::u32string out;
+         run(state, c.u8, c.u32.size(),
+             [&] { return parallel_to_u32string(c.u8, out, little); });
+     }},
+    {"parallel_to_u8string_from_utf16",
+     [](benchmark::State &state, const corpus &c) {
+         std::string out;
+         run(state, c.u16, c.u32.size(),
+             [&] { return parallel_to_u8string(c.u16, little, out); });
+     }},
+    {"parallel_to_u32string_from_utf16",
+     [](benchmark::State &state, const corpus &c) {
+         std::u32string out;
+         run(state, c.u16, c.u32.size(), [&] {
+             return parallel_to_u32string(c.u16, little, out, little);
+         });
+     }},
+    {"parallel_to_u8string_from_utf32",
+     [](benchmark::State &state, const corpus &c) {
+         std::string out;
+         run(state, c.u32, c.u32.size(),
+             [&] { return parallel_to_u8string(c.u32, little, out); });
+     }},
+
+    // Incremental coders, fed 64 KiB at a time.
+    {"stream_decoder_utf8_to_utf32",
+     [](benchmark::State &state, const corpus &c) {
+         stream_decoder decoder;
+         std::u32string out;
+         run(state, c.u8, c.u32.size(), [&] {
+             bool ok = true;
+             for (size_t pos = 0; pos < c.u8.size(); pos += 1 << 16) {
+                 size_t n = std::min<size_t>(1 << 16, c.u8.size() - pos);
+                 ok &= decoder.decode(c.u8.data() + pos, n, out);
+             }
+             return ok && decoder.finish();
+         });
+     }},
+    {"stream_encoder_utf16_to_utf8",
+     [](benchmark::State &state, const corpus &c) {
+         stream_encoder encoder;
+         std::string    out;
+         run(state, c.u16, c.u32.size(), [&] {
+             bool ok = true;
+             for (size_t pos = 0; pos < c.u16.size(); pos += 1 << 15) {
+                 size_t n = std::min<size_t>(1 << 15, c.u16.size() - pos);
+                 ok &= encoder.encode(c.u16.data() + pos, n, out);
+             }
+             return ok && encoder.finish();
+         });
+     }},
+};
+}  // namespace
+
+int main(int argc, char **argv) {
+    benchmark::Initialize(&argc, argv);
+    if (benchmark::ReportUnrecognizedArguments(argc, argv))
+        return 1;
+
+    for (const conversion &conv : conversions) {
+        for (const corpus_seed &seed : corpus_seeds) {
+            std::string name = std::string(active_implementation()) +
+                               "/" + conv.name + "/" + seed.name;
+            benchmark::RegisterBenchmark(
+                name.c_str(),
+                [&conv, &seed](benchmark::State &state) {
+                    corpus c = make_corpus(seed, size_t(state.range(0)));
+                    conv.run(state, c);
+                })
+                ->RangeMultiplier(16)
+                ->Range(16, 256 << 20);
+        }
+    }
+
+    benchmark::RunSpecifiedBenchmarks();
+    benchmark::Shutdown();
+    return 0;
+}
@@ -0,0 +1,1197 @@
+/*
+ * Differential fuzzing of the converters against ICU and iconv, and their
+ * throughput next to these libraries and simdutf.
+ *
+ * Every input is read three ways: as utf-8, as utf-16 and as utf-32, after a
+ * first byte which chooses the endian of the last two, the character set for
+ * the Latin-1 conversions and the buffer sizes. ICU tells what the input is:
+ * where its first ill-formed sequence starts, the text before it, and the
+ * text with every maximal subpart of an ill-formed sequence replaced with
+ * U+FFFD. Every conversion is checked against that in every mode, through the
+ * string, buffer, sink and stream APIs, and iconv must agree on which inputs
+ * are valid. A mismatch prints what failed and aborts.
+ *
+ * Built with UTF_CONVERT_LIBFUZZER, this is a libFuzzer target. Otherwise it
+ * generates its own inputs, mostly valid text with a few ill-formed sequences
+ * put in, and can replay inputs from files such as libFuzzer crashes:
+ *
+ *     fuzz_utf_convert [--runs N] [--seed S] [--bench BYTES] [FILE...]
+ *
+ * With --bench, valid corpora of BYTES bytes of utf-8 are converted by every
+ * library after the checks, and the throughput is printed in MB/s of input.
+ * utf_convert converts in UTF_MODE_STRICT there, since the other libraries
+ * validate what they convert. simdutf is measured when it is found by CMake.
+ */
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <string>
+#include <vector>
+
+#include <iconv.h>
+#include <unicode/ucnv.h>
+#include <unicode/ucnv_err.h>
+#include <unicode/utf16.h>
+#include <unicode/ustring.h>
+
+#if defined(UTF_CONVERT_FUZZ_SIMDUTF)
+#include <simdutf.h>
+#endif
+
+#include "utf_convert.hpp"
+
+using namespace utf_convert;
+
+namespace {
+const uint8_t *current_input;
+size_t         current_size;
+
+/*!
+ * Stop at the first mismatch, in every build type. The input is saved for
+ * the standalone driver, libFuzzer saves its own.
+ */
+void require(bool ok, const char *what) {
+    if (ok)
+        return;
+    std::fprintf(stderr, "fuzz_utf_convert: %s\n", what);
+#if !defined(UTF_CONVERT_LIBFUZZER)
+    std::FILE *file = std::fopen("fuzz_utf_convert_failure.bin", "wb");
+    if (file != NULL) {
+        std::fwrite(current_input, 1, current_size, file);
+        std::fclose(file);
+        std::fprintf(stderr,
+                     "fuzz_utf_convert: input saved to "
+                     "fuzz_utf_convert_failure.bin\n");
+    }
+#endif
+    std::abort();
+}
+
+template <typename String>
+String in_endian(String str, UTF_ENDIAN endian) {
+    if (endian != UTF_ENDIAN_NATIVE)
+        swap_endian_inplace(str);
+    return str;
+}
+
+/*
+ * ICU, the reference. Converters are opened once per name, reset before each
+ * use and closed at exit.
+ */
+struct converter_cache {
+    struct entry {
+        const char *name;
+        UConverter *converter;
+    };
+    std::vector<entry> entries;
+
+    ~converter_cache() {
+        for (size_t i = 0; i < entries.size(); i++)
+            ucnv_close(entries[i].converter);
+    }
+};
+
+UConverter *converter(const char *name) {
+    static converter_cache cache;
+
+    for (size_t i = 0; i < cache.entries.size(); i++) {
+        if (std::strcmp(cache.entries[i].name, name) == 0) {
+            ucnv_reset(cache.entries[i].converter);
+            return cache.entries[i].converter;
+        }
+    }
+    UErrorCode  error = U_ZERO_ERROR;
+    UConverter *res   = ucnv_open(name, &error);
+    require(U_SUCCESS(error), "ICU can not open a converter");
+    const converter_cache::entry e = {name, res};
+    cache.entries.push_back(e);
+    return res;
+}
+
+/*!
+ * What ICU makes of an input, with the text in utf-16 of the host.
+ */
+struct expected {
+    bool                 valid;
+    size_t               stop;     // Code units before the first ill-formed one.
+    std::u16string       prefix;   // Text before stop, all of it if valid.
+    std::vector<int32_t> offsets;  // Byte offset in the input of each unit.
+    std::u16string       replaced; // Text with U+FFFD for what is ill-formed.
+};
+
+/*!
+ * Decode bytes in charset up to the first ill-formed sequence, with code
+ * units of unit bytes.
+ */
+void icu_decode(const char *charset,
+                const char *bytes,
+                size_t      size,
+                size_t      unit,
+                expected &  res) {
+    UConverter *cnv   = converter(charset);
+    UErrorCode  error = U_ZERO_ERROR;
+    ucnv_setToUCallBack(cnv, UCNV_TO_U_CALLBACK_STOP, NULL, NULL, NULL, &error);
+
+    std::vector<UChar>   out(size + 1);
+    std::vector<int32_t> offsets(out.size());
+    UChar *              target = out.data();
+    const char *         source = bytes;
+    ucnv_toUnicode(cnv, &target, target + out.size(), &source, bytes + size,
+                   offsets.data(), true, &error);
+
+    res.valid = U_SUCCESS(error);
+    size_t stop = size;
+    if (!res.valid) {
+        char       invalid[32];
+        int8_t     length = sizeof(invalid);
+        UErrorCode ignore = U_ZERO_ERROR;
+        ucnv_getInvalidChars(cnv, invalid, &length, &ignore);
+        stop = (source - bytes) - length;
+    }
+    res.stop = stop / unit;
+    res.prefix.assign(out.data(), target);
+    res.offsets.assign(offsets.data(), offsets.data() + (target - out.data()));
+}
+
+std::string icu_to_utf8(const std::u16string &text) {
+    std::string str(text.size() * 3 + 1, '\0');
+    int32_t     length = 0;
+    UErrorCode  error  = U_ZERO_ERROR;
+    u_strToUTF8(&str[0], str.size(), &length, text.data(), text.size(), &error);
+    require(U_SUCCESS(error), "ICU can not encode utf-8");
+    str.resize(length);
+    return str;
+}
+
+std::u32string icu_to_utf32(const std::u16string &text, UTF_ENDIAN endian) {
+    std::u32string str(text.size() + 1, 0);
+    int32_t        length = 0;
+    UErrorCode     error  = U_ZERO_ERROR;
+    u_strToUTF32(reinterpret_cast<UChar32 *>(&str[0]), str.size(), &length,
+                 text.data(), text.size(), &error);
+    require(U_SUCCESS(error), "ICU can not encode utf-32");
+    str.resize(length);
+    return in_endian(str, endian);
+}
+
+std::u16string icu_from_utf8(const std::string &str) {
+    std::u16string text(str.size() + 1, 0);
+    int32_t        length = 0;
+    UErrorCode     error  = U_ZERO_ERROR;
+    u_strFromUTF8WithSub(&text[0], text.size(), &length, str.data(),
+                         str.size(), 0xfffd, NULL, &error);
+    require(U_SUCCESS(error), "ICU can not decode utf-8");
+    text.resize(length);
+    return text;
+}
+
+/*!
+ * Encode text in Latin-1 or Windows-1252 up to the first character the
+ * character set does not have, or with '?' for each of them when replace.
+ * The characters are those ICU decodes the 256 bytes to: its encoders are
+ * not used, since they drop default ignorable characters such as U+FEFF.
+ *
+ * @return the number of utf-16 units of text encoded.
+ */
+size_t encode_latin1(UTF_CHARSET           charset,
+                     const std::u16string &text,
+                     bool                  replace,
+                     std::string &         str) {
+    static std::map<UChar32, char> tables[2];
+    std::map<UChar32, char> &      table = tables[charset];
+    if (table.empty()) {
+        std::string bytes;
+        for (int i = 0; i < 256; i++)
+            bytes.push_back(char(i));
+        expected all;
+        icu_decode(charset == UTF_CHARSET_LATIN1 ? "ISO-8859-1"
+                                                 : "windows-1252",
+                   bytes.data(), bytes.size(), 1, all);
+        require(all.valid && all.prefix.size() == 256,
+                "ICU can not decode Latin-1");
+        for (int i = 0; i < 256; i++)
+            table[all.prefix[i]] = char(i);
+    }
+
+    str.clear();
+    for (size_t i = 0; i < text.size();) {
+        const size_t start = i;
+        UChar32      ch    = 0;
+        U16_NEXT(text.data(), i, text.size(), ch);
+        const std::map<UChar32, char>::const_iterator it = table.find(ch);
+        if (it != table.end())
+            str.push_back(it->second);
+        else if (replace)
+            str.push_back('?');
+        else
+            return start;
+    }
+    return text.size();
+}
+
+/*
+ * iconv, which must agree with ICU about valid input.
+ */
+bool iconv_convert(const char *       to,
+                   const char *       from,
+                   const std::string &in,
+                   std::string &      out) {
+    iconv_t cd = iconv_open(to, from);
+    require(cd != iconv_t(-1), "iconv can not open a converter");
+
+    out.assign(in.size() * 4 + 4, '\0');
+    char * src      = const_cast<char *>(in.data());
+    size_t src_left = in.size();
+    char * dst      = &out[0];
+    size_t dst_left = out.size();
+    const bool ok   = iconv(cd, &src, &src_left, &dst, &dst_left) !=
+                    size_t(-1);
+    iconv_close(cd);
+    out.resize(out.size() - dst_left);
+    return ok;
+}
+
+template <typename String>
+std::string bytes_of(const String &str) {
+    return std::string(reinterpret_cast<const char *>(str.data()),
+                       str.size() * sizeof(typename String::value_type));
+}
+
+/*!
+ * Options of one input, taken from its first byte.
+ */
+struct options {
+    UTF_ENDIAN  endian;
+    UTF_CHARSET charset;
+    size_t      cap_extra;  // Added to the smallest buffer size of the resumed
+                            // conversions.
+    size_t      chunk_size; // Of the stream conversions.
+};
+
+/*!
+ * Check a string conversion in every mode: strict keeps the text before the
+ * first ill-formed sequence, replace is the same as ICU, and lenient is only
+ * defined for valid input.
+ */
+template <typename String, typename Convert>
+void check_modes(const char *    what,
+                 const expected &exp,
+                 const String &  prefix,
+                 const String &  replaced,
+                 const Convert & convert) {
+    String target;
+    require(convert(UTF_MODE_STRICT, target) == exp.valid, what);
+    require(target == prefix, what);
+    require(convert(UTF_MODE_REPLACE, target), what);
+    require(target == replaced, what);
+    if (exp.valid) {
+        require(convert(UTF_MODE_LENIENT, target), what);
+        require(target == prefix, what);
+    }
+}
+
+/*!
+ * Check a conversion into a buffer, which convert(mode, begin, end, out, cap)
+ * does for the input units [begin, end): at once into a buffer of bound
+ * units, and again into small buffers one after another, each conversion
+ * going on where the last one stopped.
+ */
+template <typename String, typename Convert>
+void check_buffer(const char *    what,
+                  const options & opts,
+                  const expected &exp,
+                  size_t          size,
+                  const String &  prefix,
+                  const String &  replaced,
+                  size_t          bound,
+                  size_t          max_units,
+                  const Convert & convert) {
+    typedef typename String::value_type Unit;
+    std::vector<Unit>                   out(bound + 1), whole(bound + 1);
+
+    result res = convert(UTF_MODE_STRICT, 0, size, out.data(), bound);
+    require(res.error == (exp.valid ? UTF_ERROR_NONE
+                                    : UTF_ERROR_INVALID_SEQUENCE),
+            what);
+    require(res.count == (exp.valid ? prefix.size() : exp.stop), what);
+    require(String(out.data(), prefix.size()) == prefix, what);
+
+    res = convert(UTF_MODE_REPLACE, 0, size, out.data(), bound);
+    require(res.error == UTF_ERROR_NONE && res.count == replaced.size(), what);
+    require(String(out.data(), replaced.size()) == replaced, what);
+
+    const UTF_MODE modes[] = {UTF_MODE_REPLACE, UTF_MODE_STRICT};
+    for (size_t m = 0; m < (exp.valid ? 2 : 1); m++) {
+        const size_t cap = max_units + opts.cap_extra;
+        String       joined;
+        for (size_t pos = 0;;) {
+            res = convert(modes[m], pos, size, out.data(), cap);
+            if (res.error == UTF_ERROR_NONE) {
+                joined.append(out.data(), res.count);
+                break;
+            }
+            require(res.error == UTF_ERROR_OUTPUT_TOO_SMALL, what);
+            require(res.count > 0, what);
+
+            // What was written is what the input read converts to.
+            const result part = convert(modes[m], pos, pos + res.count,
+                                        whole.data(), bound);
+            require(part.error == UTF_ERROR_NONE && part.count <= cap, what);
+            require(std::equal(whole.data(), whole.data() + part.count,
+                               out.data()),
+                    what);
+            joined.append(out.data(), part.count);
+            pos += res.count;
+        }
+        require(joined == replaced, what);
+    }
+}
+
+/*!
+ * Check the conversions to Latin-1 or Windows-1252, which stop at the first
+ * character the character set does not have as well. convert(mode, target)
+ * converts into target with the string API, and gives the result of the
+ * buffer API, which tells where the conversion stopped.
+ */
+template <typename Convert>
+void check_latin1(const char *    what,
+                  const options & opts,
+                  const expected &exp,
+                  size_t          unit,
+                  const Convert & convert) {
+    std::string  prefix, replaced;
+    const size_t encoded =
+        encode_latin1(opts.charset, exp.prefix, false, prefix);
+    encode_latin1(opts.charset, exp.replaced, true, replaced);
+
+    const bool   valid = exp.valid && encoded == exp.prefix.size();
+    const size_t stop  = encoded == exp.prefix.size()
+                             ? exp.stop
+                             : exp.offsets[encoded] / unit;
+
+    std::string target;
+    result      res = convert(UTF_MODE_STRICT, target);
+    require(res.error == (valid ? UTF_ERROR_NONE : UTF_ERROR_INVALID_SEQUENCE),
+            what);
+    require(res.count == (valid ? prefix.size() : stop) && target == prefix,
+            what);
+    res = convert(UTF_MODE_REPLACE, target);
+    require(res.error == UTF_ERROR_NONE && res.count == replaced.size(), what);
+    require(target == replaced, what);
+}
+
+struct collect_sink {
+    std::string output;
+
+    bool operator()(const char *data, size_t size) {
+        require(size <= sink_block_size, "sink block too large");
+        output.append(data, size);
+        return true;
+    }
+};
+
+void check_utf8(const std::string &u8str, const options &opts) {
+    expected exp;
+    icu_decode("UTF-8", u8str.data(), u8str.size(), 1, exp);
+    exp.replaced = icu_from_utf8(u8str);
+
+    std::string  ignored;
+    const bool   iconv_valid = iconv_convert("UTF-16LE", "UTF-8", u8str,
+                                             ignored);
+    require(iconv_valid == exp.valid, "iconv and ICU disagree on utf-8");
+    require(!exp.valid ||
+                ignored == bytes_of(in_endian(exp.prefix,
+                                              UTF_ENDIAN_LITTLE_ENDIAN)),
+            "iconv and ICU decode utf-8 differently");
+
+    const result valid = validate_utf8(u8str.data(), u8str.size());
+    require((valid.error == UTF_ERROR_NONE) == exp.valid, "validate_utf8");
+    require(valid.count == (exp.valid ? u8str.size() : exp.stop),
+            "validate_utf8 position");
+    bool ascii = true;
+    for (size_t i = 0; i < u8str.size(); i++)
+        ascii = ascii && static_cast<unsigned char>(u8str[i]) < 0x80;
+    require(is_ascii(u8str.data(), u8str.size()) == ascii, "is_ascii");
+
+    const UTF_ENDIAN     endian     = opts.endian;
+    const std::u16string prefix16   = in_endian(exp.prefix, endian);
+    const std::u16string replaced16 = in_endian(exp.replaced, endian);
+    const std::u32string prefix32   = icu_to_utf32(exp.prefix, endian);
+    const std::u32string replaced32 = icu_to_utf32(exp.replaced, endian);
+    if (exp.valid) {
+        require(utf16_length_from_utf8(u8str.data(), u8str.size()) ==
+                    prefix16.size(),
+                "utf16_length_from_utf8");
+        require(utf32_length_from_utf8(u8str.data(), u8str.size()) ==
+                    prefix32.size(),
+                "utf32_length_from_utf8");
+    }
+
+    check_modes("to_u16string from utf-8", exp, prefix16, replaced16,
+                [&](UTF_MODE mode, std::u16string &target) {
+                    return to_u16string(u8str, target, endian, false, mode);
+                });
+    check_modes("to_u32string from utf-8", exp, prefix32, replaced32,
+                [&](UTF_MODE mode, std::u32string &target) {
+                    return to_u32string(u8str, target, endian, false, mode);
+                });
+    // A batch which fails ends before the string, with nothing of it.
+    const char *        data   = u8str.data();
+    const size_t        length = u8str.size();
+    std::u16string      batch;
+    std::vector<size_t> offsets;
+    require(batch_to_u16string(&data, &length, 1, batch, offsets, endian,
+                               UTF_MODE_STRICT) == exp.valid,
+            "batch_to_u16string validity");
+    require(batch == (exp.valid ? prefix16 : std::u16string()),
+            "batch_to_u16string");
+    require(batch_to_u16string(&data, &length, 1, batch, offsets, endian,
+                               UTF_MODE_REPLACE) &&
+                batch == replaced16,
+            "batch_to_u16string with UTF_MODE_REPLACE");
+    if (exp.valid) {
+        std::u32string target;
+        require(parallel_to_u32string(u8str, target, endian) &&
+                    target == prefix32,
+                "parallel_to_u32string from utf-8");
+    }
+
+    check_buffer("convert_utf8_to_utf16", opts, exp, u8str.size(), prefix16,
+                 replaced16, u8str.size(), 2,
+                 [&](UTF_MODE mode, size_t begin, size_t end, char16_t *out,
+                     size_t cap) {
+                     return convert_utf8_to_utf16(u8str.data() + begin,
+                                                  end - begin, out, cap,
+                                                  endian, mode);
+                 });
+    check_buffer("convert_utf8_to_utf32", opts, exp, u8str.size(), prefix32,
+                 replaced32, u8str.size(), 1,
+                 [&](UTF_MODE mode, size_t begin, size_t end, char32_t *out,
+                     size_t cap) {
+                     return convert_utf8_to_utf32(u8str.data() + begin,
+                                                  end - begin, out, cap,
+                                                  endian, mode);
+                 });
+
+    check_latin1("convert_utf8_to_latin1", opts, exp, 1,
+                 [&](UTF_MODE mode, std::string &target) {
+                     utf8_to_latin1(u8str, target, mode, opts.charset);
+                     std::string buffer(u8str.size() + 1, '\0');
+                     return convert_utf8_to_latin1(u8str.data(), u8str.size(),
+                                                   &buffer[0], buffer.size(),
+                                                   mode, opts.charset);
+                 });
+
+    // The same bytes cut into chunks anywhere.
+    stream_decoder decoder(endian);
+    std::u16string streamed, chunk;
+    bool           ok = true;
+    for (size_t pos = 0; pos < u8str.size() && ok; pos += opts.chunk_size) {
+        const size_t size = std::min(opts.chunk_size, u8str.size() - pos);
+        ok = decoder.decode(u8str.data() + pos, size, chunk);
+        streamed += chunk;
+    }
+    ok = decoder.finish() && ok;
+    // The decoder is lenient, like UTF_MODE_LENIENT.
+    require(!exp.valid || (ok && streamed == prefix16), "stream_decoder");
+
+    // And as Latin-1 or Windows-1252, which every byte string is.
+    const char *charset = opts.charset == UTF_CHARSET_LATIN1 ? "ISO-8859-1"
+                                                             : "windows-1252";
+    expected latin1;
+    icu_decode(charset, u8str.data(), u8str.size(), 1, latin1);
+    require(latin1.valid, "ICU can not decode Latin-1");
+    const std::string from_latin1 = icu_to_utf8(latin1.prefix);
+    std::string       target;
+    require(latin1_to_utf8(u8str, target, opts.charset) &&
+                target == from_latin1,
+            "latin1_to_utf8");
+    require(utf8_length_from_latin1(u8str.data(), u8str.size(),
+                                    opts.charset) == from_latin1.size(),
+            "utf8_length_from_latin1");
+    std::u16string target16;
+    require(latin1_to_utf16(u8str, target16, endian, opts.charset) &&
+                target16 == in_endian(latin1.prefix, endian),
+            "latin1_to_utf16");
+    std::u32string target32;
+    require(latin1_to_utf32(u8str, target32, endian, opts.charset) &&
+                target32 == icu_to_utf32(latin1.prefix, endian),
+            "latin1_to_utf32");
+}
+
+void check_utf16(const std::string &bytes, const options &opts) {
+    const UTF_ENDIAN endian = opts.endian;
+    std::u16string   u16str(bytes.size() / 2, 0);
+    std::memcpy(&u16str[0], bytes.data(), u16str.size() * 2);
+    const std::string data = bytes_of(u16str);
+
+    const char *name =
+        endian == UTF_ENDIAN_BIG_ENDIAN ? "UTF-16BE" : "UTF-16LE";
+    expected exp;
+    icu_decode(name, data.data(), data.size(), 2, exp);
+    {
+        const std::u16string native = in_endian(u16str, endian);
+        std::string          u8str(native.size() * 3 + 1, '\0');
+        int32_t              length = 0;
+        UErrorCode           error  = U_ZERO_ERROR;
+        u_strToUTF8WithSub(&u8str[0], u8str.size(), &length, native.data(),
+                           native.size(), 0xfffd, NULL, &error);
+        require(U_SUCCESS(error), "ICU can not encode utf-16");
+        u8str.resize(length);
+        exp.replaced = icu_from_utf8(u8str);
+    }
+
+    std::string ignored;
+    require(iconv_convert("UTF-8", name, data, ignored) == exp.valid,
+            "iconv and ICU disagree on utf-16");
+    require(!exp.valid || ignored == icu_to_utf8(exp.prefix),
+            "iconv and ICU decode utf-16 differently");
+
+    const result valid = validate_utf16(u16str.data(), u16str.size(), endian);
+    require((valid.error == UTF_ERROR_NONE) == exp.valid, "validate_utf16");
+    require(valid.count == (exp.valid ? u16str.size() : exp.stop),
+            "validate_utf16 position");
+
+    const std::string    prefix8    = icu_to_utf8(exp.prefix);
+    const std::string    replaced8  = icu_to_utf8(exp.replaced);
+    const std::u32string prefix32   = icu_to_utf32(exp.prefix, endian);
+    const std::u32string replaced32 = icu_to_utf32(exp.replaced, endian);
+    if (exp.valid) {
+        require(utf8_length_from_utf16(u16str.data(), u16str.size(),
+                                       endian) == prefix8.size(),
+                "utf8_length_from_utf16");
+        require(utf32_length_from_utf16(u16str.data(), u16str.size(),
+                                        endian) == prefix32.size(),
+                "utf32_length_from_utf16");
+
+        std::string target;
+        require(parallel_to_u8string(u16str, endian, target) &&
+                    target == prefix8,
+                "parallel_to_u8string from utf-16");
+        std::u32string target32;
+        require(parallel_to_u32string(u16str, endian, target32, endian) &&
+                    target32 == prefix32,
+                "parallel_to_u32string from utf-16");
+    }
+
+    check_modes("to_u8string from utf-16", exp, prefix8, replaced8,
+                [&](UTF_MODE mode, std::string &target) {
+                    return to_u8string(u16str, endian, target, mode);
+                });
+    check_modes("to_u32string from utf-16", exp, prefix32, replaced32,
+                [&](UTF_MODE mode, std::u32string &target) {
+                    return to_u32string(u16str, endian, target, endian, false,
+                                        mode);
+                });
+    check_modes("write_utf16_as_utf8", exp, prefix8, replaced8,
+                [&](UTF_MODE mode, std::string &target) {
+                    collect_sink sink;
+                    const result res = write_utf16_as_utf8(
+                        u16str.data(), u16str.size(), endian, sink, mode);
+                    target = sink.output;
+                    return res.error == UTF_ERROR_NONE;
+                });
+
+    check_buffer("convert_utf16_to_utf8", opts, exp, u16str.size(), prefix8,
+                 replaced8, u16str.size() * 3, 4,
+                 [&](UTF_MODE mode, size_t begin, size_t end, char *out,
+                     size_t cap) {
+                     return convert_utf16_to_utf8(u16str.data() + begin,
+                                                  end - begin, out, cap,
+                                                  endian, mode);
+                 });
+    check_buffer("convert_utf16_to_utf32", opts, exp, u16str.size(), prefix32,
+                 replaced32, u16str.size(), 1,
+                 [&](UTF_MODE mode, size_t begin, size_t end, char32_t *out,
+                     size_t cap) {
+                     return convert_utf16_to_utf32(u16str.data() + begin,
+                                                   end - begin, out, cap,
+                                                   endian, endian, mode);
+                 });
+
+    check_latin1("convert_utf16_to_latin1", opts, exp, 2,
+                 [&](UTF_MODE mode, std::string &target) {
+                     utf16_to_latin1(u16str, endian, target, mode,
+                                     opts.charset);
+                     std::string buffer(u16str.size() + 1, '\0');
+                     return convert_utf16_to_latin1(
+                         u16str.data(), u16str.size(), &buffer[0],
+                         buffer.size(), endian, mode, opts.charset);
+                 });
+
+    stream_encoder encoder(endian);
+    std::string    streamed, chunk;
+    const size_t   chunk_size = (opts.chunk_size + 1) / 2;
+    bool           ok         = true;
+    for (size_t pos = 0; pos < u16str.size() && ok; pos += chunk_size) {
+        const size_t size = std::min(chunk_size, u16str.size() - pos);
+        ok = encoder.encode(u16str.data() + pos, size, chunk);
+        streamed += chunk;
+    }
+    ok = encoder.finish() && ok;
+    // The encoder only rejects high surrogates without a low one.
+    require(!exp.valid || (ok && streamed == prefix8), "stream_encoder");
+}
+
+void check_utf32(const std::string &bytes, const options &opts) {
+    const UTF_ENDIAN endian = opts.endian;
+    std::u32string   u32str(bytes.size() / 4, 0);
+    std::memcpy(&u32str[0], bytes.data(), u32str.size() * 4);
+    const std::string data = bytes_of(u32str);
+
+    const char *name =
+        endian == UTF_ENDIAN_BIG_ENDIAN ? "UTF-32BE" : "UTF-32LE";
+    expected exp;
+    icu_decode(name, data.data(), data.size(), 4, exp);
+    {
+        const std::u32string native = in_endian(u32str, endian);
+        std::u16string       text(native.size() * 2 + 1, 0);
+        int32_t              length = 0;
+        UErrorCode           error  = U_ZERO_ERROR;
+        u_strFromUTF32WithSub(&text[0], text.size(), &length,
+                              reinterpret_cast<const UChar32 *>(native.data()),
+                              native.size(), 0xfffd, NULL, &error);
+        require(U_SUCCESS(error), "ICU can not decode utf-32");
+        text.resize(length);
+        exp.replaced = text;
+    }
+
+    std::string ignored;
+    require(iconv_convert("UTF-8", name, data, ignored) == exp.valid,
+            "iconv and ICU disagree on utf-32");
+    require(!exp.valid || ignored == icu_to_utf8(exp.prefix),
+            "iconv and ICU decode utf-32 differently");
+
+    const result valid = validate_utf32(u32str.data(), u32str.size(), endian);
+    require((valid.error == UTF_ERROR_NONE) == exp.valid, "validate_utf32");
+    require(valid.count == (exp.valid ? u32str.size() : exp.stop),
+            "validate_utf32 position");
+
+    const std::string    prefix8    = icu_to_utf8(exp.prefix);
+    const std::string    replaced8  = icu_to_utf8(exp.replaced);
+    const std::u16string prefix16   = in_endian(exp.prefix, endian);
+    const std::u16string replaced16 = in_endian(exp.replaced, endian);
+    if (exp.valid) {
+        require(utf8_length_from_utf32(u32str.data(), u32str.size(),
+                                       endian) == prefix8.size(),
+                "utf8_length_from_utf32");
+        require(utf16_length_from_utf32(u32str.data(), u32str.size(),
+                                        endian) == prefix16.size(),
+                "utf16_length_from_utf32");
+
+        std::string target;
+        require(parallel_to_u8string(u32str, endian, target) &&
+                    target == prefix8,
+                "parallel_to_u8string from utf-32");
+    }
+
+    check_modes("to_u8string from utf-32", exp, prefix8, replaced8,
+                [&](UTF_MODE mode, std::string &target) {
+                    return to_u8string(u32str, endian, target, mode);
+                });
+    check_modes("to_u16string from utf-32", exp, prefix16, replaced16,
+                [&](UTF_MODE mode, std::u16string &target) {
+                    return to_u16string(u32str, endian, target, endian, false,
+                                        mode);
+                });
+    check_modes("write_utf32_as_utf8", exp, prefix8, replaced8,
+                [&](UTF_MODE mode, std::string &target) {
+                    collect_sink sink;
+                    const result res = write_utf32_as_utf8(
+                        u32str.data(), u32str.size(), endian, sink, mode);
+                    target = sink.output;
+                    return res.error == UTF_ERROR_NONE;
+                });
+
+    check_buffer("convert_utf32_to_utf8", opts, exp, u32str.size(), prefix8,
+                 replaced8, u32str.size() * 4, 4,
+                 [&](UTF_MODE mode, size_t begin, size_t end, char *out,
+                     size_t cap) {
+                     return convert_utf32_to_utf8(u32str.data() + begin,
+                                                  end - begin, out, cap,
+                                                  endian, mode);
+                 });
+    check_buffer("convert_utf32_to_utf16", opts, exp, u32str.size(), prefix16,
+                 replaced16, u32str.size() * 2, 2,
+                 [&](UTF_MODE mode, size_t begin, size_t end, char16_t *out,
+                     size_t cap) {
+                     return convert_utf32_to_utf16(u32str.data() + begin,
+                                                   end - begin, out, cap,
+                                                   endian, endian, mode);
+                 });
+
+    check_latin1("convert_utf32_to_latin1", opts, exp, 4,
+                 [&](UTF_MODE mode, std::string &target) {
+                     utf32_to_latin1(u32str, endian, target, mode,
+                                     opts.charset);
+                     std::string buffer(u32str.size() + 1, '\0');
+                     return convert_utf32_to_latin1(
+                         u32str.data(), u32str.size(), &buffer[0],
+                         buffer.size(), endian, mode, opts.charset);
+                 });
+}
+
+}  // namespace
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
+    if (size == 0)
+        return 0;
+    current_input = data;
+    current_size  = size;
+
+    options opts;
+    opts.endian  = data[0] & 1 ? UTF_ENDIAN_BIG_ENDIAN : UTF_ENDIAN_LITTLE_ENDIAN;
+    opts.charset = data[0] & 2 ? UTF_CHARSET_WINDOWS_1252 : UTF_CHARSET_LATIN1;
+    opts.cap_extra  = (data[0] >> 2) & 7;
+    opts.chunk_size = 1 + (data[0] >> 5) * 3;
+
+    const std::string payload(reinterpret_cast<const char *>(data) + 1,
+                              size - 1);
+    check_utf8(payload, opts);
+    check_utf16(payload, opts);
+    check_utf32(payload, opts);
+    return 0;
+}
+
+#if !defined(UTF_CONVERT_LIBFUZZER)
+namespace {
+/*!
+ * Small fast generator, so that a seed gives the same inputs everywhere.
+ */
+struct random_source {
+    uint64_t state;
+
+    uint32_t next() {
+        state ^= state << 13;
+        state ^= state >> 7;
+        state ^= state << 17;
+        return uint32_t(state >> 32);
+    }
+
+    uint32_t below(uint32_t n) { return next() % n; }
+};
+
+uint32_t random_codepoint(random_source &rng) {
+    static const uint32_t edges[] = {0x7f,   0x80,    0x7ff,    0x800,
+                                     0xd7ff, 0xe000,  0xfffd,   0xfffe,
+                                     0xffff, 0x10000, 0x10ffff, 0xfeff};
+    switch (rng.below(8)) {
+    case 0: return 0x80 + rng.below(0x780);
+    case 1: return 0x800 + rng.below(0xd000);
+    case 2: return 0xe000 + rng.below(0x2000);
+    case 3: return 0x10000 + rng.below(0x100000);
+    case 4: return edges[rng.below(sizeof(edges) / sizeof(edges[0]))];
+    default: return 0x20 + rng.below(0x60);
+    }
+}
+
+void append_u8(std::string &str, uint32_t ch) {
+    if (ch < 0x80) {
+        str.push_back(ch);
+    } else if (ch < 0x800) {
+        str.push_back(0xc0 | (ch >> 6));
+        str.push_back(0x80 | (ch & 0x3f));
+    } else if (ch < 0x10000) {
+        str.push_back(0xe0 | (ch >> 12));
+        str.push_back(0x80 | ((ch >> 6) & 0x3f));
+        str.push_back(0x80 | (ch & 0x3f));
+    } else {
+        str.push_back(0xf0 | (ch >> 18));
+        str.push_back(0x80 | ((ch >> 12) & 0x3f));
+        str.push_back(0x80 | ((ch >> 6) & 0x3f));
+        str.push_back(0x80 | (ch & 0x3f));
+    }
+}
+
+/*!
+ * Valid text of about size code points, in runs of ascii long enough for the
+ * vector kernels and of other characters.
+ */
+std::vector<uint32_t> random_text(random_source &rng, size_t size) {
+    std::vector<uint32_t> text;
+    while (text.size() < size) {
+        const size_t run = 1 + rng.below(rng.below(4) == 0 ? 80 : 8);
+        const bool   ascii = rng.below(2) == 0;
+        for (size_t i = 0; i < run; i++)
+            text.push_back(ascii ? 0x20 + rng.below(0x5f)
+                                 : random_codepoint(rng));
+    }
+    return text;
+}
+
+/*!
+ * Build an input for the utf-8, utf-16 or utf-32 view, with a few ill-formed
+ * sequences in half of them.
+ */
+std::string random_input(random_source &rng) {
+    const uint8_t selector = rng.next() & 0xff;
+    const size_t  size     = rng.below(20) == 0   ? rng.below(5000)
+                             : rng.below(4) == 0 ? rng.below(400)
+                                                 : rng.below(50);
+    const std::vector<uint32_t> text   = random_text(rng, size);
+    const UTF_ENDIAN            endian = selector & 1 ? UTF_ENDIAN_BIG_ENDIAN
+                                                      : UTF_ENDIAN_LITTLE_ENDIAN;
+    const size_t                form   = rng.below(3);
+    const size_t                errors = rng.below(2) ? 0 : 1 + rng.below(3);
+
+    std::string payload;
+    if (form == 0) {
+        for (size_t i = 0; i < text.size(); i++)
+            append_u8(payload, text[i]);
+
+        static const char *const bad[] = {
+            "\x80",         "\xbf",     "\xc0\xaf", "\xc1\xbf",
+            "\xe0\x80\x80", "\xed\xa0\x80", "\xed\xbf\xbf",
+            "\xf0\x80\x80\x80", "\xf4\x90\x80\x80", "\xf5", "\xff",
+            "\xe2\x82",     "\xf0\x9f\x98", "\xc3"};
+        for (size_t e = 0; e < errors; e++) {
+            const size_t pos = rng.below(payload.size() + 1);
+            payload.insert(pos, bad[rng.below(sizeof(bad) / sizeof(bad[0]))]);
+        }
+    } else if (form == 1) {
+        std::u16string u16str;
+        for (size_t i = 0; i < text.size(); i++) {
+            if (text[i] >= 0x10000) {
+                u16str.push_back(0xd800 + ((text[i] - 0x10000) >> 10));
+                u16str.push_back(0xdc00 + ((text[i] - 0x10000) & 0x3ff));
+            } else {
+                u16str.push_back(text[i]);
+            }
+        }
+        for (size_t e = 0; e < errors; e++) {
+            const size_t pos = rng.below(u16str.size() + 1);
+            u16str.insert(pos, 1, 0xd800 + rng.below(0x800));
+        }
+        payload = bytes_of(in_endian(u16str, endian));
+    } else {
+        std::u32string u32str(text.begin(), text.end());
+        static const uint32_t bad[] = {0xd800, 0xdbff, 0xdc00, 0xdfff,
+                                       0x110000, 0x7fffffff, 0x80000000,
+                                       0xffffffff};
+        for (size_t e = 0; e < errors; e++) {
+            const size_t pos = rng.below(u32str.size() + 1);
+            u32str.insert(pos, 1, bad[rng.below(8)]);
+        }
+        payload = bytes_of(in_endian(u32str, endian));
+    }
+
+    // Now and then a byte changed anywhere.
+    if (!payload.empty() && rng.below(8) == 0)
+        payload[rng.below(payload.size())] ^= 1 << rng.below(8);
+    return std::string(1, char(selector)) + payload;
+}
+
+/*
+ * Throughput of the conversions of valid text in every library.
+ */
+struct corpus {
+    const char *   name;
+    std::string    u8;
+    std::u16string u16;
+    std::u32string u32;
+};
+
+corpus make_corpus(const char *name, uint32_t max, size_t size) {
+    random_source rng = {0x9e3779b97f4a7c15ull};
+    corpus        res;
+    res.name = name;
+    while (res.u8.size() < size) {
+        uint32_t ch = 0;
+        do {
+            ch = rng.below(max);
+        } while ((ch >= 0xd800 && ch < 0xe000) || ch < 0x20);
+        append_u8(res.u8, ch);
+    }
+    to_u16string(res.u8, res.u16, UTF_ENDIAN_LITTLE_ENDIAN);
+    to_u32string(res.u8, res.u32, UTF_ENDIAN_LITTLE_ENDIAN);
+    return res;
+}
+
+/*!
+ * Run function until a tenth of a second has passed.
+ *
+ * @return MB of input per second.
+ */
+template <typename Function>
+double measure(size_t bytes, const Function &function) {
+    typedef std::chrono::steady_clock clock;
+
+    size_t                  runs  = 0;
+    volatile size_t         sink  = 0;
+    const clock::time_point start = clock::now();
+    double                  seconds = 0;
+    do {
+        sink = sink + function();
+        runs++;
+        seconds = std::chrono::duration<double>(clock::now() - start).count();
+    } while (seconds < 0.1 || runs < 3);
+    return double(bytes) * runs / seconds / 1e6;
+}
+
+/*!
+ * Convert with a cached ICU converter pair, for the conversions ICU has no
+ * direct function for.
+ */
+size_t icu_convert(const char *to,
+                   const char *from,
+                   const char *in,
+                   size_t      size,
+                   char *      out,
+                   size_t      cap) {
+    UConverter *source = converter(from);
+    UConverter *target = converter(to);
+    UErrorCode  error  = U_ZERO_ERROR;
+    char *      dst    = out;
+    const char *src    = in;
+    ucnv_convertEx(target, source, &dst, out + cap, &src, in + size, NULL,
+                   NULL, NULL, NULL, true, true, &error);
+    return dst - out;
+}
+
+size_t iconv_measure(iconv_t cd, const char *in, size_t size, char *out,
+                     size_t cap) {
+    char * src      = const_cast<char *>(in);
+    size_t src_left = size;
+    char * dst      = out;
+    size_t dst_left = cap;
+    iconv(cd, NULL, NULL, NULL, NULL);
+    iconv(cd, &src, &src_left, &dst, &dst_left);
+    return cap - dst_left;
+}
+
+void print_row(const char *conversion, const char *name, double ours,
+               double icu, double iconv_rate, double simdutf) {
+    std::printf("%-14s %-7s %9.0f %9.0f %9.0f", conversion, name, ours, icu,
+                iconv_rate);
+    if (simdutf > 0)
+        std::printf(" %9.0f", simdutf);
+    else
+        std::printf(" %9s", "-");
+    std::printf("   %5.2fx %5.2fx", ours / icu, ours / iconv_rate);
+    if (simdutf > 0)
+        std::printf(" %5.2fx", ours / simdutf);
+    std::printf("\n");
+}
+
+void bench(size_t size) {
+    const corpus corpora[] = {
+        make_corpus("ascii", 0x80, size),
+        make_corpus("latin", 0x180, size),
+        make_corpus("cjk", 0x10000, size),
+        make_corpus("mixed", 0x110000, size),
+    };
+
+    std::vector<char> out(size * 4 + 64);
+    char *const       dst = out.data();
+    const size_t      cap = out.size();
+    iconv_t           to_u16 = iconv_open("UTF-16LE", "UTF-8");
+    iconv_t           from_u16 = iconv_open("UTF-8", "UTF-16LE");
+    iconv_t           to_u32 = iconv_open("UTF-32LE", "UTF-8");
+    iconv_t           from_u32 = iconv_open("UTF-8", "UTF-32LE");
+
+    std::printf("implementation: %s\n", active_implementation());
+    std::printf("%-14s %-7s %9s %9s %9s %9s   %s\n", "MB/s", "corpus",
+                "utf_conv", "icu", "iconv", "simdutf",
+                "utf_convert vs icu, iconv, simdutf");
+    for (size_t c = 0; c < sizeof(corpora) / sizeof(corpora[0]); c++) {
+        const corpus &k   = corpora[c];
+        const size_t  u8  = k.u8.size();
+        const size_t  u16 = k.u16.size() * 2;
+        const size_t  u32 = k.u32.size() * 4;
+        char16_t *    d16 = reinterpret_cast<char16_t *>(dst);
+        double        simd = 0;
+
+#if defined(UTF_CONVERT_FUZZ_SIMDUTF)
+        simd = measure(u8, [&] {
+            return simdutf::convert_utf8_to_utf16le(k.u8.data(), k.u8.size(),
+                                                    d16);
+        });
+#endif
+        print_row(
+            "utf8->utf16", k.name,
+            measure(u8,
+                    [&] {
+                        return convert_utf8_to_utf16(
+                                   k.u8.data(), k.u8.size(), d16, cap / 2,
+                                   UTF_ENDIAN_LITTLE_ENDIAN, UTF_MODE_STRICT)
+                            .count;
+                    }),
+            measure(u8,
+                    [&] {
+                        int32_t    length = 0;
+                        UErrorCode error  = U_ZERO_ERROR;
+                        u_strFromUTF8(d16, cap / 2, &length, k.u8.data(),
+                                      k.u8.size(), &error);
+                        return size_t(length);
+                    }),
+            measure(u8,
+                    [&] {
+                        return iconv_measure(to_u16, k.u8.data(), u8, dst,
+                                             cap);
+                    }),
+            simd);
+
+#if defined(UTF_CONVERT_FUZZ_SIMDUTF)
+        simd = measure(u16, [&] {
+            return simdutf::convert_utf16le_to_utf8(k.u16.data(),
+                                                    k.u16.size(), dst);
+        });
+#endif
+        print_row(
+            "utf16->utf8", k.name,
+            measure(u16,
+                    [&] {
+                        return convert_utf16_to_utf8(
+                                   k.u16.data(), k.u16.size(), dst, cap,
+                                   UTF_ENDIAN_LITTLE_ENDIAN, UTF_MODE_STRICT)
+                            .count;
+                    }),
+            measure(u16,
+                    [&] {
+                        int32_t    length = 0;
+                        UErrorCode error  = U_ZERO_ERROR;
+                        u_strToUTF8(dst, cap, &length, k.u16.data(),
+                                    k.u16.size(), &error);
+                        return size_t(length);
+                    }),
+            measure(u16,
+                    [&] {
+                        return iconv_measure(
+                            from_u16,
+                            reinterpret_cast<const char *>(k.u16.data()), u16,
+                            dst, cap);
+                    }),
+            simd);
+
+#if defined(UTF_CONVERT_FUZZ_SIMDUTF)
+        simd = measure(u8, [&] {
+            return simdutf::convert_utf8_to_utf32(
+                k.u8.data(), k.u8.size(), reinterpret_cast<char32_t *>(dst));
+        });
+#endif
+        print_row(
+            "utf8->utf32", k.name,
+            measure(u8,
+                    [&] {
+                        return convert_utf8_to_utf32(
+                                   k.u8.data(), k.u8.size(),
+                                   reinterpret_cast<char32_t *>(dst), cap / 4,
+                                   UTF_ENDIAN_LITTLE_ENDIAN, UTF_MODE_STRICT)
+                            .count;
+                    }),
+            measure(u8,
+                    [&] {
+                        return icu_convert("UTF-32LE", "UTF-8", k.u8.data(),
+                                           u8, dst, cap);
+                    }),
+            measure(u8,
+                    [&] {
+                        return iconv_measure(to_u32, k.u8.data(), u8, dst,
+                                             cap);
+                    }),
+            simd);
+
+#if defined(UTF_CONVERT_FUZZ_SIMDUTF)
+        simd = measure(u32, [&] {
+            return simdutf::convert_utf32_to_utf8(k.u32.data(), k.u32.size(),
+                                                  dst);
+        });
+#endif
+        print_row(
+            "utf32->utf8", k.name,
+            measure(u32,
+                    [&] {
+                        return convert_utf32_to_utf8(
+                                   k.u32.data(), k.u32.size(), dst, cap,
+                                   UTF_ENDIAN_LITTLE_ENDIAN, UTF_MODE_STRICT)
+                            .count;
+                    }),
+            measure(u32,
+                    [&] {
+                        return icu_convert(
+                            "UTF-8", "UTF-32LE",
+                            reinterpret_cast<const char *>(k.u32.data()), u32,
+                            dst, cap);
+                    }),
+            measure(u32,
+                    [&] {
+                        return iconv_measure(
+                            from_u32,
+                            reinterpret_cast<const char *>(k.u32.data()), u32,
+                            dst, cap);
+                    }),
+            simd);
+    }
+
+    iconv_close(to_u16);
+    iconv_close(from_u16);
+    iconv_close(to_u32);
+    iconv_close(from_u32);
+}
+void usage(const char *program) {
+    std::fprintf(stderr,
+                 "usage: %s [--runs N] [--seed S] [--bench BYTES] [FILE...]\n",
+                 program);
+}
+}  // namespace
+
+int main(int argc, char **argv) {
+    size_t                    runs       = 10000;
+    uint64_t                  seed       = 1;
+    size_t                    bench_size = 0;
+    bool                      runs_given = false;
+    std::vector<const char *> paths;
+    for (int i = 1; i < argc; i++) {
+        if (std::strcmp(argv[i], "--runs") == 0 && i + 1 < argc) {
+            runs       = std::strtoull(argv[++i], NULL, 10);
+            runs_given = true;
+        } else if (std::strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+            seed       = std::strtoull(argv[++i], NULL, 10);
+            runs_given = true;
+        } else if (std::strcmp(argv[i], "--bench") == 0 && i + 1 < argc) {
+            bench_size = std::strtoull(argv[++i], NULL, 10);
+        } else if (argv[i][0] != '-') {
+            paths.push_back(argv[i]);
+        } else {
+            usage(argv[0]);
+            return 2;
+        }
+    }
+
+    for (size_t i = 0; i < paths.size(); i++) {
+        std::FILE *file = std::fopen(paths[i], "rb");
+        if (file == NULL) {
+            std::fprintf(stderr, "%s: can not open %s\n", argv[0], paths[i]);
+            return 1;
+        }
+        std::string input;
+        char        buffer[4096];
+        size_t      size = 0;
+        while ((size = std::fread(buffer, 1, sizeof(buffer), file)) > 0)
+            input.append(buffer, size);
+        std::fclose(file);
+        LLVMFuzzerTestOneInput(
+            reinterpret_cast<const uint8_t *>(input.data()), input.size());
+    }
+
+    // Random inputs without files, or with files when asked for.
+    if (paths.empty() || runs_given) {
+        random_source rng = {seed * 0x9e3779b97f4a7c15ull + 1};
+        for (size_t i = 0; i < runs; i++) {
+            const std::string input = random_input(rng);
+            LLVMFuzzerTestOneInput(
+                reinterpret_cast<const uint8_t *>(input.data()), input.size());
+        }
+        std::printf("%zu random inputs checked\n", runs);
+    }
+
+    if (bench_size > 0)
+        bench(bench_size);
+    return 0;
+}
+#endif
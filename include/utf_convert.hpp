@@ -1,12 +1,80 @@
 #ifndef UTF_CONVERT_HPP
 #define UTF_CONVERT_HPP
 
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <iosfwd>
 #include <string>
+#include <vector>
+
+#if __cplusplus >= 201703L
+#include <string_view>
+#define UTF_CONVERT_HAS_STRING_VIEW 1
+#endif
 
 namespace utf_convert {
 enum UTF_ENDIAN {
     UTF_ENDIAN_LITTLE_ENDIAN,
     UTF_ENDIAN_BIG_ENDIAN,
+    // The endian of the host, which is one of the two above. Its code units
+    // are read and written with plain loads and stores.
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    UTF_ENDIAN_NATIVE = UTF_ENDIAN_BIG_ENDIAN,
+#else
+    UTF_ENDIAN_NATIVE = UTF_ENDIAN_LITTLE_ENDIAN,
+#endif
+};
+
+enum UTF_ERROR {
+    UTF_ERROR_NONE,
+    UTF_ERROR_INVALID_SEQUENCE,    // The input can not be converted.
+    UTF_ERROR_OUTPUT_TOO_SMALL,    // The output buffer is full.
+    UTF_ERROR_UNSUPPORTED_ENDIAN,  // The endian is not a UTF_ENDIAN value.
+    UTF_ERROR_FILE_IO,             // A file can not be read or written.
+};
+
+enum UTF_ENCODING {
+    UTF_ENCODING_UTF8,
+    UTF_ENCODING_UTF16_LITTLE_ENDIAN,
+    UTF_ENCODING_UTF16_BIG_ENDIAN,
+    UTF_ENCODING_UTF32_LITTLE_ENDIAN,
+    UTF_ENCODING_UTF32_BIG_ENDIAN,
+};
+
+enum UTF_MODE {
+    UTF_MODE_LENIENT,  // Only what can not be converted at all is rejected.
+    UTF_MODE_STRICT,   // Ill-formed input is rejected like validate_utf* do.
+    UTF_MODE_REPLACE,  // Ill-formed input is replaced with U+FFFD.
+};
+
+enum UTF_CHARSET {
+    UTF_CHARSET_LATIN1,        // ISO-8859-1, the first 256 characters.
+    UTF_CHARSET_WINDOWS_1252,  // Latin-1 with punctuation in 0x80 ~ 0x9f.
+};
+
+/*
+ * Case folding of the converted characters, done on each block of the output
+ * right after it is written. Only characters with a single lowercase form in
+ * the same block are folded, so the converted length does not change.
+ */
+enum UTF_FOLD {
+    UTF_FOLD_NONE,    // The characters are written as they are.
+    UTF_FOLD_ASCII,   // A ~ Z are written as a ~ z.
+    UTF_FOLD_LATIN1,  // Also U+00C0 ~ U+00DE but U+00D7 as U+00E0 ~ U+00FE.
+};
+
+/*!
+ * Result of a conversion into a caller provided buffer.
+ *
+ * On success, count is the number of code units written to the buffer. On
+ * failure, count is the position of the input code unit the conversion stopped
+ * at, and the buffer holds the conversion of the input before it, which takes
+ * exactly as many units as the utf*_length functions give for that prefix.
+ */
+struct result {
+    UTF_ERROR error;
+    size_t    count;
 };
 
 /*!
@@ -17,15 +85,22 @@ enum UTF_ENDIAN {
  * @param u32str_endian Encode endian of the utf-32 string, must be one of
  * UTF_ENDIAN_LITTLE_ENDIAN or UTF_ENDIAN_BIG_ENDIAN.
  * @param[out] target the converted string.
+ * @param mode how ill-formed input is handled, like for the buffer API. With
+ * UTF_MODE_REPLACE, only an unsupported endian makes the conversion fail.
+ * @param fold case folding of the converted characters.
  * @return true if succeeded.
  */
 bool to_u8string(const std::u32string &u32str,
                  UTF_ENDIAN            u32str_endian,
-                 std::string &         target);
+                 std::string &         target,
+                 UTF_MODE              mode = UTF_MODE_LENIENT,
+                 UTF_FOLD              fold = UTF_FOLD_NONE);
 
 bool to_u8string(const std::u16string &u16str,
                  UTF_ENDIAN            u16str_endian,
-                 std::string &         target);
+                 std::string &         target,
+                 UTF_MODE              mode = UTF_MODE_LENIENT,
+                 UTF_FOLD              fold = UTF_FOLD_NONE);
 
 /*!
  * Convert utf-32 string to utf-8 string. The endian is specified with BOM. You
@@ -46,12 +121,1535 @@ bool to_u8string(const std::u16string &u16str_with_bom, std::string &target);
  * @param[out] target the converted utf-32 string.
  * @param target_endian endian for the converted utf-32 string.
  * @param add_bom add BOM to the converted utf-32 string if true.
+ * @param mode how ill-formed input is handled, like for to_u8string.
+ * @param fold case folding of the converted characters, like for to_u8string.
  * @return true if succeeded.
  */
 bool to_u32string(const std::string &u8str,
                   std::u32string &   target,
                   UTF_ENDIAN         target_endian,
-                  bool               add_bom = false);
+                  bool               add_bom = false,
+                  UTF_MODE           mode    = UTF_MODE_LENIENT,
+                  UTF_FOLD           fold    = UTF_FOLD_NONE);
+
+/*!
+ * Convert utf-16 string to utf-32 string. The utf-16 string should not contain
+ * BOM.
+ *
+ * @param[in] u16str utf-16 string to be converted.
+ * @param u16str_endian Encode endian of the utf-16 string.
+ * @param[out] target the converted utf-32 string.
+ * @param target_endian endian for the converted utf-32 string.
+ * @param add_bom add BOM to the converted utf-32 string if true.
+ * @return true if succeeded.
+ */
+bool to_u32string(const std::u16string &u16str,
+                  UTF_ENDIAN            u16str_endian,
+                  std::u32string &      target,
+                  UTF_ENDIAN            target_endian,
+                  bool                  add_bom = false,
+                  UTF_MODE              mode    = UTF_MODE_LENIENT,
+                  UTF_FOLD              fold    = UTF_FOLD_NONE);
+
+/*!
+ * Convert utf-8 string to utf-16 string. Characters from 0x10000 on are
+ * written as surrogate pairs.
+ *
+ * @param[in] u8str utf-8 string to be converted.
+ * @param[out] target the converted utf-16 string.
+ * @param target_endian endian for the converted utf-16 string.
+ * @param add_bom add BOM to the converted utf-16 string if true.
+ * @return true if succeeded.
+ */
+bool to_u16string(const std::string &u8str,
+                  std::u16string &   target,
+                  UTF_ENDIAN         target_endian,
+                  bool               add_bom = false,
+                  UTF_MODE           mode    = UTF_MODE_LENIENT,
+                  UTF_FOLD           fold    = UTF_FOLD_NONE);
+
+/*!
+ * Convert utf-32 string to utf-16 string. The utf-32 string should not contain
+ * BOM.
+ *
+ * @param[in] u32str utf-32 string to be converted.
+ * @param u32str_endian Encode endian of the utf-32 string.
+ * @param[out] target the converted utf-16 string.
+ * @param target_endian endian for the converted utf-16 string.
+ * @param add_bom add BOM to the converted utf-16 string if true.
+ * @return true if succeeded.
+ */
+bool to_u16string(const std::u32string &u32str,
+                  UTF_ENDIAN            u32str_endian,
+                  std::u16string &      target,
+                  UTF_ENDIAN            target_endian,
+                  bool                  add_bom = false,
+                  UTF_MODE              mode    = UTF_MODE_LENIENT,
+                  UTF_FOLD              fold    = UTF_FOLD_NONE);
+
+/*!
+ * Convert utf-32 string to utf-8 string like to_u8string, on several threads
+ * for large strings. The string is split into chunks which are measured and
+ * converted at the same time, straight into target. Strings of less than a
+ * few MB are converted on the calling thread.
+ *
+ * @param[in] u32str utf-32 string to be converted, without BOM.
+ * @param u32str_endian Encode endian of the utf-32 string.
+ * @param[out] target the converted string, the same as to_u8string gives,
+ * also on failure.
+ * @param thread_count most threads to use, 0 for one per hardware thread.
+ * @return true if succeeded.
+ */
+bool parallel_to_u8string(const std::u32string &u32str,
+                          UTF_ENDIAN            u32str_endian,
+                          std::string &         target,
+                          size_t                thread_count = 0);
+
+/*!
+ * Convert utf-16 string to utf-8 string like to_u8string, on several threads
+ * for large strings. The string is never split between a high surrogate and
+ * the unit after it.
+ */
+bool parallel_to_u8string(const std::u16string &u16str,
+                          UTF_ENDIAN            u16str_endian,
+                          std::string &         target,
+                          size_t                thread_count = 0);
+
+/*!
+ * Convert utf-8 string to utf-32 string like to_u32string, on several threads
+ * for large strings. The string is only split before bytes which start a
+ * sequence.
+ *
+ * @param[in] u8str utf-8 string to be converted.
+ * @param[out] target the converted utf-32 string.
+ * @param target_endian endian for the converted utf-32 string.
+ * @param thread_count most threads to use, 0 for one per hardware thread.
+ * @return true if succeeded.
+ */
+bool parallel_to_u32string(const std::string &u8str,
+                           std::u32string &   target,
+                           UTF_ENDIAN         target_endian,
+                           size_t             thread_count = 0);
+
+bool parallel_to_u32string(const std::u16string &u16str,
+                           UTF_ENDIAN            u16str_endian,
+                           std::u32string &      target,
+                           UTF_ENDIAN            target_endian,
+                           size_t                thread_count = 0);
+
+/*!
+ * Convert many utf-8 strings to utf-16 in one call, for lots of short strings
+ * such as the cells of a table. The converted strings are written one after
+ * another into target, which is sized once for all of them, and string i is
+ * target[offsets[i], offsets[i + 1]) like in an Apache Arrow column. No BOM is
+ * written.
+ *
+ * @param[in] u8strs utf-8 strings to be converted.
+ * @param[in] lengths number of bytes in each string.
+ * @param count number of strings.
+ * @param[out] target the converted strings.
+ * @param[out] offsets count + 1 offsets of the converted strings in target,
+ * starting with 0.
+ * @param target_endian endian for the converted utf-16 strings.
+ * @param mode UTF_MODE_STRICT to also reject ill-formed strings, or
+ * UTF_MODE_REPLACE to replace what is ill-formed in them with U+FFFD.
+ * @return true if succeeded. On failure, target and offsets end with the
+ * string before the one which failed, so offsets.size() - 1 is its index.
+ */
+bool batch_to_u16string(const char *const *  u8strs,
+                        const size_t *       lengths,
+                        size_t               count,
+                        std::u16string &     target,
+                        std::vector<size_t> &offsets,
+                        UTF_ENDIAN           target_endian,
+                        UTF_MODE             mode = UTF_MODE_LENIENT);
+
+/*!
+ * Convert many utf-8 strings to utf-32 in one call, the same way as
+ * batch_to_u16string.
+ */
+bool batch_to_u32string(const char *const *  u8strs,
+                        const size_t *       lengths,
+                        size_t               count,
+                        std::u32string &     target,
+                        std::vector<size_t> &offsets,
+                        UTF_ENDIAN           target_endian,
+                        UTF_MODE             mode = UTF_MODE_LENIENT);
+
+/*!
+ * Convert many utf-16 strings to utf-8 in one call, the same way as
+ * batch_to_u16string.
+ *
+ * @param[in] u16strs utf-16 strings to be converted, without BOM.
+ * @param[in] lengths number of code units in each string.
+ * @param count number of strings.
+ * @param u16strs_endian Encode endian of the utf-16 strings.
+ * @param[out] target the converted strings.
+ * @param[out] offsets count + 1 offsets of the converted strings in target.
+ * @return true if succeeded.
+ */
+bool batch_to_u8string(const char16_t *const *u16strs,
+                       const size_t *         lengths,
+                       size_t                 count,
+                       UTF_ENDIAN             u16strs_endian,
+                       std::string &          target,
+                       std::vector<size_t> &  offsets,
+                       UTF_MODE               mode = UTF_MODE_LENIENT);
+
+bool batch_to_u8string(const char32_t *const *u32strs,
+                       const size_t *         lengths,
+                       size_t                 count,
+                       UTF_ENDIAN             u32strs_endian,
+                       std::string &          target,
+                       std::vector<size_t> &  offsets,
+                       UTF_MODE               mode = UTF_MODE_LENIENT);
+
+/*!
+ * Get the length of a utf-32 string after converted to utf-8, which is exact
+ * for valid strings. For an invalid string, it's never less than what
+ * to_u8string writes before it fails.
+ *
+ * @param[in] u32str utf-32 string without BOM.
+ * @param length number of characters in u32str.
+ * @param u32str_endian Encode endian of the utf-32 string.
+ * @return number of bytes in the utf-8 string.
+ */
+size_t utf8_length_from_utf32(const char32_t *u32str,
+                              size_t          length,
+                              UTF_ENDIAN      u32str_endian);
+
+/*!
+ * Get the length of a utf-16 string after converted to utf-8. Like
+ * utf8_length_from_utf32, it is exact for valid strings and big enough for
+ * invalid ones.
+ *
+ * @param[in] u16str utf-16 string without BOM.
+ * @param length number of code units in u16str.
+ * @param u16str_endian Encode endian of the utf-16 string.
+ * @return number of bytes in the utf-8 string.
+ */
+size_t utf8_length_from_utf16(const char16_t *u16str,
+                              size_t          length,
+                              UTF_ENDIAN      u16str_endian);
+
+/*!
+ * Get the length of a utf-8 string after converted to utf-32, without BOM. It
+ * is the number of bytes other than continuation bytes, which is exact for
+ * valid strings and big enough for invalid ones.
+ *
+ * @param[in] u8str utf-8 string.
+ * @param length number of bytes in u8str.
+ * @return number of characters in the utf-32 string.
+ */
+size_t utf32_length_from_utf8(const char *u8str, size_t length);
+
+/*!
+ * Get the length of a utf-8 string after converted to utf-16, without BOM. It
+ * is the number of bytes other than continuation bytes, plus one for every
+ * four-byte sequence which becomes a surrogate pair.
+ *
+ * @param[in] u8str utf-8 string.
+ * @param length number of bytes in u8str.
+ * @return number of code units in the utf-16 string.
+ */
+size_t utf16_length_from_utf8(const char *u8str, size_t length);
+
+/*!
+ * Get the length of a utf-16 string after converted to utf-32, without BOM.
+ *
+ * @param[in] u16str utf-16 string without BOM.
+ * @param length number of code units in u16str.
+ * @param u16str_endian Encode endian of the utf-16 string.
+ * @return number of characters in the utf-32 string.
+ */
+size_t utf32_length_from_utf16(const char16_t *u16str,
+                               size_t          length,
+                               UTF_ENDIAN      u16str_endian);
+
+/*!
+ * Get the length of a utf-32 string after converted to utf-16, without BOM.
+ *
+ * @param[in] u32str utf-32 string without BOM.
+ * @param length number of characters in u32str.
+ * @param u32str_endian Encode endian of the utf-32 string.
+ * @return number of code units in the utf-16 string.
+ */
+size_t utf16_length_from_utf32(const char32_t *u32str,
+                               size_t          length,
+                               UTF_ENDIAN      u32str_endian);
+
+/*!
+ * Check whether a string is well-formed utf-8, without decoding it. Unlike the
+ * converters, which only look at lead bytes, this rejects every ill-formed
+ * sequence: stray or missing continuation bytes, overlong forms, surrogates
+ * and values above 0x10ffff.
+ *
+ * @param[in] u8str utf-8 string to be checked.
+ * @param length number of bytes in u8str.
+ * @return length if the string is valid. On UTF_ERROR_INVALID_SEQUENCE, the
+ * position of the first byte of the first ill-formed sequence.
+ */
+result validate_utf8(const char *u8str, size_t length);
+
+/*!
+ * Check whether a string is well-formed utf-16, that is every high surrogate
+ * is followed by a low one and every low surrogate follows a high one. The
+ * converters encode a low surrogate on its own like any other unit.
+ *
+ * @param[in] u16str utf-16 string without BOM.
+ * @param length number of code units in u16str.
+ * @param u16str_endian Encode endian of the utf-16 string.
+ * @return length if the string is valid. On UTF_ERROR_INVALID_SEQUENCE, the
+ * position of the first unpaired surrogate.
+ */
+result validate_utf16(const char16_t *u16str,
+                      size_t          length,
+                      UTF_ENDIAN      u16str_endian);
+
+/*!
+ * Check whether a string is well-formed utf-32, that is no character is a
+ * surrogate or above 0x10ffff. The converters only reject the latter.
+ *
+ * @param[in] u32str utf-32 string without BOM.
+ * @param length number of characters in u32str.
+ * @param u32str_endian Encode endian of the utf-32 string.
+ * @return length if the string is valid. On UTF_ERROR_INVALID_SEQUENCE, the
+ * position of the first invalid character.
+ */
+result validate_utf32(const char32_t *u32str,
+                      size_t          length,
+                      UTF_ENDIAN      u32str_endian);
+
+/*!
+ * Check whether a string is plain ascii, that is no byte is from 0x80 on. Such
+ * a string is valid utf-8 and converts one byte to one character.
+ *
+ * @param[in] str string to be checked.
+ * @param length number of bytes in str.
+ * @return true if every byte is below 0x80.
+ */
+bool is_ascii(const char *str, size_t length);
+
+/*!
+ * Reverse the bytes of every code unit in place, which turns a utf-16 or
+ * utf-32 string from one endian into the other. A string swapped once into
+ * UTF_ENDIAN_NATIVE can be read as plain numbers from then on.
+ *
+ * @param[in,out] str string to be swapped.
+ * @param length number of code units in str.
+ */
+void swap_endian_inplace(char16_t *str, size_t length);
+void swap_endian_inplace(char32_t *str, size_t length);
+
+/*!
+ * Reverse the bytes of every code unit of a string in place, like the buffer
+ * overloads.
+ *
+ * @param[in,out] str string to be swapped.
+ */
+void swap_endian_inplace(std::u16string &str);
+void swap_endian_inplace(std::u32string &str);
+
+/*!
+ * Convert utf-32 string to utf-8 string in a caller provided buffer. Nothing is
+ * allocated, so the buffer should be sized with utf8_length_from_utf32. When
+ * it's too small, as much as fits is converted and UTF_ERROR_OUTPUT_TOO_SMALL
+ * is returned, so the conversion can be continued from result::count.
+ *
+ * @param[in] in utf-32 string without BOM.
+ * @param n number of characters in the utf-32 string.
+ * @param[out] out buffer for the utf-8 string.
+ * @param cap number of bytes in the buffer.
+ * @param endian Encode endian of the utf-32 string.
+ * @param mode UTF_MODE_STRICT to also stop at ill-formed input, which is
+ * checked block by block just before the block is converted. UTF_MODE_REPLACE
+ * to write U+FFFD instead and go on: one for every maximal subpart of an
+ * ill-formed utf-8 sequence as the WHATWG Encoding Standard does, and one for
+ * every unpaired surrogate or invalid utf-32 character. A utf-8 input then
+ * converts to at most one utf-16 or utf-32 unit per byte, and a utf-16 input
+ * to at most three bytes per unit, which may be more than the utf*_length
+ * functions give.
+ * @param fold case folding of the written characters. It is done in place on
+ * each block of the output while the block is in cache, so it costs no second
+ * pass over the whole output. Lenient conversions are then done block by
+ * block too, which is only visible for ill-formed input.
+ * @return bytes written, or the position where the conversion stopped.
+ */
+result convert_utf32_to_utf8(const char32_t *in,
+                             size_t          n,
+                             char *          out,
+                             size_t          cap,
+                             UTF_ENDIAN      endian,
+                             UTF_MODE        mode = UTF_MODE_LENIENT,
+                             UTF_FOLD        fold = UTF_FOLD_NONE);
+
+/*!
+ * Convert utf-16 string to utf-8 string in a caller provided buffer, the same
+ * way as convert_utf32_to_utf8.
+ *
+ * @param[in] in utf-16 string without BOM.
+ * @param n number of code units in the utf-16 string.
+ * @param[out] out buffer for the utf-8 string.
+ * @param cap number of bytes in the buffer.
+ * @param endian Encode endian of the utf-16 string.
+ * @return bytes written, or the position where the conversion stopped.
+ */
+result convert_utf16_to_utf8(const char16_t *in,
+                             size_t          n,
+                             char *          out,
+                             size_t          cap,
+                             UTF_ENDIAN      endian,
+                             UTF_MODE        mode = UTF_MODE_LENIENT,
+                             UTF_FOLD        fold = UTF_FOLD_NONE);
+
+/*!
+ * Convert utf-8 string to utf-32 string in a caller provided buffer, the same
+ * way as convert_utf32_to_utf8. No BOM is written.
+ *
+ * @param[in] in utf-8 string.
+ * @param n number of bytes in the utf-8 string.
+ * @param[out] out buffer for the utf-32 string.
+ * @param cap number of characters in the buffer.
+ * @param endian endian for the converted utf-32 string.
+ * @return characters written, or the position where the conversion stopped.
+ */
+result convert_utf8_to_utf32(const char *in,
+                             size_t      n,
+                             char32_t *  out,
+                             size_t      cap,
+                             UTF_ENDIAN  endian,
+                             UTF_MODE    mode = UTF_MODE_LENIENT,
+                             UTF_FOLD    fold = UTF_FOLD_NONE);
+
+/*!
+ * Convert utf-8 string to utf-16 string in a caller provided buffer, the same
+ * way as convert_utf32_to_utf8. No BOM is written.
+ *
+ * @param[in] in utf-8 string.
+ * @param n number of bytes in the utf-8 string.
+ * @param[out] out buffer for the utf-16 string.
+ * @param cap number of code units in the buffer.
+ * @param endian endian for the converted utf-16 string.
+ * @return code units written, or the position where the conversion stopped.
+ */
+result convert_utf8_to_utf16(const char *in,
+                             size_t      n,
+                             char16_t *  out,
+                             size_t      cap,
+                             UTF_ENDIAN  endian,
+                             UTF_MODE    mode = UTF_MODE_LENIENT,
+                             UTF_FOLD    fold = UTF_FOLD_NONE);
+
+/*!
+ * Convert utf-16 string to utf-32 string in a caller provided buffer, the same
+ * way as convert_utf32_to_utf8. No BOM is written.
+ *
+ * @param[in] in utf-16 string without BOM.
+ * @param n number of code units in the utf-16 string.
+ * @param[out] out buffer for the utf-32 string.
+ * @param cap number of characters in the buffer.
+ * @param in_endian Encode endian of the utf-16 string.
+ * @param out_endian endian for the converted utf-32 string.
+ * @return characters written, or the position where the conversion stopped.
+ */
+result convert_utf16_to_utf32(const char16_t *in,
+                              size_t          n,
+                              char32_t *      out,
+                              size_t          cap,
+                              UTF_ENDIAN      in_endian,
+                              UTF_ENDIAN      out_endian,
+                              UTF_MODE        mode = UTF_MODE_LENIENT,
+                              UTF_FOLD        fold = UTF_FOLD_NONE);
+
+/*!
+ * Convert utf-32 string to utf-16 string in a caller provided buffer, the same
+ * way as convert_utf32_to_utf8. No BOM is written.
+ *
+ * @param[in] in utf-32 string without BOM.
+ * @param n number of characters in the utf-32 string.
+ * @param[out] out buffer for the utf-16 string.
+ * @param cap number of code units in the buffer.
+ * @param in_endian Encode endian of the utf-32 string.
+ * @param out_endian endian for the converted utf-16 string.
+ * @return code units written, or the position where the conversion stopped.
+ */
+result convert_utf32_to_utf16(const char32_t *in,
+                              size_t          n,
+                              char16_t *      out,
+                              size_t          cap,
+                              UTF_ENDIAN      in_endian,
+                              UTF_ENDIAN      out_endian,
+                              UTF_MODE        mode = UTF_MODE_LENIENT,
+                              UTF_FOLD        fold = UTF_FOLD_NONE);
+
+/*!
+ * Convert a Latin-1 or Windows-1252 string to utf-8 in a caller provided
+ * buffer, the same way as convert_utf32_to_utf8. Every byte is a character,
+ * so the conversion only fails when the buffer is too small. The bytes of
+ * Windows-1252 which have no character, 0x81, 0x8d, 0x8f, 0x90 and 0x9d, are
+ * taken as the C1 controls of Latin-1 like the WHATWG Encoding Standard does.
+ *
+ * @param[in] in Latin-1 or Windows-1252 string.
+ * @param n number of bytes in the string.
+ * @param[out] out buffer for the utf-8 string, sized with
+ * utf8_length_from_latin1.
+ * @param cap number of bytes in the buffer.
+ * @param charset character set of the string.
+ * @return bytes written, or the position where the conversion stopped.
+ */
+result convert_latin1_to_utf8(const char *in,
+                              size_t      n,
+                              char *      out,
+                              size_t      cap,
+                              UTF_CHARSET charset = UTF_CHARSET_LATIN1);
+
+/*!
+ * Convert a Latin-1 or Windows-1252 string to utf-16 in a caller provided
+ * buffer, one unit for every byte. No BOM is written.
+ *
+ * @param[in] in Latin-1 or Windows-1252 string.
+ * @param n number of bytes in the string.
+ * @param[out] out buffer for the utf-16 string.
+ * @param cap number of code units in the buffer.
+ * @param endian endian for the converted utf-16 string.
+ * @param charset character set of the string.
+ * @return code units written, or the position where the conversion stopped.
+ */
+result convert_latin1_to_utf16(const char *in,
+                               size_t      n,
+                               char16_t *  out,
+                               size_t      cap,
+                               UTF_ENDIAN  endian,
+                               UTF_CHARSET charset = UTF_CHARSET_LATIN1);
+
+/*!
+ * Convert a Latin-1 or Windows-1252 string to utf-32 in a caller provided
+ * buffer, one character for every byte. No BOM is written.
+ */
+result convert_latin1_to_utf32(const char *in,
+                               size_t      n,
+                               char32_t *  out,
+                               size_t      cap,
+                               UTF_ENDIAN  endian,
+                               UTF_CHARSET charset = UTF_CHARSET_LATIN1);
+
+/*!
+ * Convert utf-8 string to Latin-1 or Windows-1252 in a caller provided
+ * buffer, one byte for every character. The conversion fails with
+ * UTF_ERROR_INVALID_SEQUENCE at the first character the character set does
+ * not have, unless mode is UTF_MODE_REPLACE.
+ *
+ * @param[in] in utf-8 string.
+ * @param n number of bytes in the utf-8 string.
+ * @param[out] out buffer for the converted string, which never takes more
+ * bytes than the input.
+ * @param cap number of bytes in the buffer.
+ * @param mode UTF_MODE_STRICT to also stop at ill-formed input like
+ * convert_utf8_to_utf32. UTF_MODE_REPLACE to write '?' instead of every
+ * character the character set does not have and of every maximal subpart of
+ * an ill-formed sequence, and go on.
+ * @param charset character set to convert to.
+ * @return bytes written, or the position where the conversion stopped.
+ */
+result convert_utf8_to_latin1(const char *in,
+                              size_t      n,
+                              char *      out,
+                              size_t      cap,
+                              UTF_MODE    mode    = UTF_MODE_LENIENT,
+                              UTF_CHARSET charset = UTF_CHARSET_LATIN1);
+
+/*!
+ * Convert utf-16 string to Latin-1 or Windows-1252 in a caller provided
+ * buffer, the same way as convert_utf8_to_latin1. A surrogate pair is a
+ * single character, which is never in the character set.
+ *
+ * @param[in] in utf-16 string without BOM.
+ * @param n number of code units in the utf-16 string.
+ * @param[out] out buffer for the converted string.
+ * @param cap number of bytes in the buffer.
+ * @param endian Encode endian of the utf-16 string.
+ * @return bytes written, or the position where the conversion stopped.
+ */
+result convert_utf16_to_latin1(const char16_t *in,
+                               size_t          n,
+                               char *          out,
+                               size_t          cap,
+                               UTF_ENDIAN      endian,
+                               UTF_MODE        mode    = UTF_MODE_LENIENT,
+                               UTF_CHARSET     charset = UTF_CHARSET_LATIN1);
+
+/*!
+ * Convert utf-32 string to Latin-1 or Windows-1252 in a caller provided
+ * buffer, the same way as convert_utf8_to_latin1.
+ */
+result convert_utf32_to_latin1(const char32_t *in,
+                               size_t          n,
+                               char *          out,
+                               size_t          cap,
+                               UTF_ENDIAN      endian,
+                               UTF_MODE        mode    = UTF_MODE_LENIENT,
+                               UTF_CHARSET     charset = UTF_CHARSET_LATIN1);
+
+/*!
+ * Get the length of a Latin-1 or Windows-1252 string after converted to
+ * utf-8, which is always exact.
+ *
+ * @param[in] str Latin-1 or Windows-1252 string.
+ * @param length number of bytes in str.
+ * @param charset character set of the string.
+ * @return number of bytes in the utf-8 string.
+ */
+size_t utf8_length_from_latin1(const char *str,
+                               size_t      length,
+                               UTF_CHARSET charset = UTF_CHARSET_LATIN1);
+
+/*!
+ * Convert a Latin-1 or Windows-1252 string to utf-8 string.
+ *
+ * @param[in] str string to be converted.
+ * @param[out] target the converted utf-8 string.
+ * @param charset character set of the string.
+ * @return true if succeeded, which is always the case.
+ */
+bool latin1_to_utf8(const std::string &str,
+                    std::string &      target,
+                    UTF_CHARSET        charset = UTF_CHARSET_LATIN1);
+
+/*!
+ * Convert utf-8 string to a Latin-1 or Windows-1252 string.
+ *
+ * @param[in] u8str utf-8 string to be converted.
+ * @param[out] target the converted string.
+ * @param mode how characters out of the character set and ill-formed input
+ * are handled, like for convert_utf8_to_latin1.
+ * @param charset character set to convert to.
+ * @return true if succeeded. On failure, target holds the conversion of the
+ * input before the character it stopped at.
+ */
+bool utf8_to_latin1(const std::string &u8str,
+                    std::string &      target,
+                    UTF_MODE           mode    = UTF_MODE_LENIENT,
+                    UTF_CHARSET        charset = UTF_CHARSET_LATIN1);
+
+bool latin1_to_utf16(const std::string &str,
+                     std::u16string &   target,
+                     UTF_ENDIAN         target_endian,
+                     UTF_CHARSET        charset = UTF_CHARSET_LATIN1);
+
+bool utf16_to_latin1(const std::u16string &u16str,
+                     UTF_ENDIAN            u16str_endian,
+                     std::string &         target,
+                     UTF_MODE              mode    = UTF_MODE_LENIENT,
+                     UTF_CHARSET           charset = UTF_CHARSET_LATIN1);
+
+bool latin1_to_utf32(const std::string &str,
+                     std::u32string &   target,
+                     UTF_ENDIAN         target_endian,
+                     UTF_CHARSET        charset = UTF_CHARSET_LATIN1);
+
+bool utf32_to_latin1(const std::u32string &u32str,
+                     UTF_ENDIAN            u32str_endian,
+                     std::string &         target,
+                     UTF_MODE              mode    = UTF_MODE_LENIENT,
+                     UTF_CHARSET           charset = UTF_CHARSET_LATIN1);
+
+/*!
+ * Convert a whole file from one encoding to another. The input is mapped into
+ * memory and converted straight into the mapped output file, which is sized
+ * with the utf*_length functions beforehand, so nothing is copied through
+ * intermediate buffers. A BOM in the input is converted like any other
+ * character.
+ *
+ * @param[in] in_path path of the file to be converted.
+ * @param[in] out_path path of the converted file, which is replaced. It must
+ * not be the input file, which fails with UTF_ERROR_FILE_IO.
+ * @param from encoding of the input file.
+ * @param to encoding of the output file.
+ * @param mode how ill-formed input is handled, like for the convert_utf*
+ * functions. Between encodings of the same code unit size the units are
+ * copied as they are in UTF_MODE_LENIENT, and checked with validate_utf* or
+ * replaced with U+FFFD in the other modes. A trailing partial code unit is
+ * reported like an ill-formed one, and replaced in UTF_MODE_REPLACE too.
+ * @return code units written on success. On UTF_ERROR_INVALID_SEQUENCE, the
+ * position of the input code unit the conversion stopped at, and the output
+ * file holds the conversion of the input before it.
+ */
+result convert_file(const char * in_path,
+                    const char * out_path,
+                    UTF_ENCODING from,
+                    UTF_ENCODING to,
+                    UTF_MODE     mode = UTF_MODE_LENIENT);
+
+/*!
+ * Guess the encoding of a text from its BOM, or without one from where its
+ * zero bytes are and which encodings it is valid in. Valid utf-8 is taken as
+ * utf-8 unless zeros are at every fourth byte, as in utf-32, or at most of
+ * the even or odd bytes, as in utf-16, so that text with a few zero bytes such
+ * as a terminating one stays utf-8. Text which fits no encoding is taken as
+ * utf-8.
+ *
+ * @param[in] data the text.
+ * @param size number of bytes of the text.
+ * @param[out] bom_size if not NULL, set to the number of bytes of the BOM, or
+ * 0 if there is none.
+ * @return the encoding of the text.
+ */
+UTF_ENCODING detect_encoding(const void *data,
+                             size_t      size,
+                             size_t *    bom_size = NULL);
+
+/*!
+ * Convert a text in any of the encodings of UTF_ENCODING to utf-8, with the
+ * encoding told by detect_encoding. The BOM, if any, is dropped.
+ *
+ * @param[in] data the text, which needs no alignment.
+ * @param size number of bytes of the text.
+ * @param[out] target the converted string.
+ * @param mode how ill-formed input is handled, like for to_u8string. A utf-8
+ * text is copied as it is in UTF_MODE_LENIENT. A partial utf-16 or utf-32
+ * unit at the end fails the conversion in every mode but UTF_MODE_REPLACE,
+ * which writes U+FFFD for it, the same as convert_file.
+ * @param[out] encoding if not NULL, set to the detected encoding.
+ * @return true if succeeded.
+ */
+bool convert_any_to_utf8(const void *  data,
+                         size_t        size,
+                         std::string & target,
+                         UTF_MODE      mode     = UTF_MODE_LENIENT,
+                         UTF_ENCODING *encoding = NULL);
+
+/*!
+ * Get the name of the vectorized kernels the conversions run with: "avx2",
+ * "ssse3", "neon" or "scalar" for none. The best ones the CPU supports are
+ * chosen on the first conversion. The neon kernels are only built with the
+ * UTF_CONVERT_ENABLE_NEON option. The UTF_CONVERT_IMPLEMENTATION environment
+ * variable can name others to compare them, which are taken if the CPU
+ * supports them.
+ *
+ * @return the name of the kernels.
+ */
+const char *active_implementation();
+
+/*!
+ * Conversions the statistics are kept for. Every API converts through one of
+ * these, and a strict or replacing conversion runs it once per validated
+ * block, the digesting ones once per digested block.
+ */
+enum UTF_CONVERSION {
+    UTF_CONVERSION_UTF8_TO_UTF16,
+    UTF_CONVERSION_UTF8_TO_UTF32,
+    UTF_CONVERSION_UTF16_TO_UTF8,
+    UTF_CONVERSION_UTF16_TO_UTF32,
+    UTF_CONVERSION_UTF32_TO_UTF8,
+    UTF_CONVERSION_UTF32_TO_UTF16,
+    UTF_CONVERSION_LATIN1_TO_UTF8,
+    UTF_CONVERSION_LATIN1_TO_UTF16,
+    UTF_CONVERSION_LATIN1_TO_UTF32,
+    UTF_CONVERSION_UTF8_TO_LATIN1,
+    UTF_CONVERSION_UTF16_TO_LATIN1,
+    UTF_CONVERSION_UTF32_TO_LATIN1,
+    UTF_CONVERSION_COUNT,
+};
+
+/*!
+ * Counters of one conversion.
+ */
+struct conversion_stats {
+    uint64_t calls;              // Runs of the conversion.
+    uint64_t bytes_in;           // Input bytes converted.
+    uint64_t bytes_out;          // Output bytes written.
+    uint64_t kernel_bytes_in;    // Input bytes the vectorized kernels took.
+    uint64_t scalar_fallbacks;   // Times a kernel left input to scalar code.
+    uint64_t invalid_sequences;  // Ill-formed input stopped at or replaced.
+    uint64_t output_too_small;   // Runs stopped by UTF_ERROR_OUTPUT_TOO_SMALL.
+    uint64_t other_errors;       // Runs stopped by any other error.
+};
+
+/*!
+ * Counters of all conversions since the start or the last reset_stats.
+ */
+struct stats {
+    conversion_stats conversions[UTF_CONVERSION_COUNT];
+    const char *     implementation;  // What active_implementation gives.
+};
+
+/*!
+ * Tell whether the library was built with the statistics, which the CMake
+ * option UTF_CONVERT_ENABLE_STATS turns on. Without them the counting
+ * compiles to nothing and stats_snapshot gives zeros.
+ *
+ * @return true if the conversions are counted.
+ */
+bool stats_enabled();
+
+/*!
+ * Sum the counters of all threads, including the ones which have ended. Each
+ * thread counts in its own relaxed atomics, so conversions are not slowed by
+ * each other, and a snapshot has every conversion which finished before it.
+ *
+ * @return the counters.
+ */
+stats stats_snapshot();
+
+/*!
+ * Start the counters of all threads from zero again, as after exporting them.
+ */
+void reset_stats();
+
+/*!
+ * Incremental utf-8 decoder for input which arrives in chunks, such as reads
+ * from a socket. A sequence cut by the end of a chunk is kept in the decoder
+ * and completed with the next chunk, so the chunks may split the input
+ * anywhere.
+ */
+class stream_decoder {
+public:
+    /*!
+     * @param target_endian endian for the decoded utf-32 or utf-16 string.
+     */
+    explicit stream_decoder(UTF_ENDIAN target_endian = UTF_ENDIAN_LITTLE_ENDIAN);
+
+    /*!
+     * Decode the next chunk. target is cleared first and then holds the
+     * characters completed by this chunk, so the same string can be passed
+     * again for every chunk without further allocations.
+     *
+     * @param[in] chunk next part of the utf-8 string.
+     * @param length number of bytes in chunk.
+     * @param[out] target the decoded characters.
+     * @return true if succeeded. On failure, target holds the characters
+     * before the invalid sequence and the rest of the chunk is dropped.
+     */
+    bool decode(const char *chunk, size_t length, std::u32string &target);
+    bool decode(const char *chunk, size_t length, std::u16string &target);
+
+    /*!
+     * End the input and reset the decoder.
+     *
+     * @return false if the input ends in the middle of a sequence.
+     */
+    bool finish();
+
+    /*!
+     * Drop the partial sequence, if any, to start a new input.
+     */
+    void reset();
+
+private:
+    UTF_ENDIAN endian_;
+    char       partial_[4];
+    size_t     partial_size_;
+};
+
+/*!
+ * Incremental utf-8 encoder for utf-16 or utf-32 input which arrives in
+ * chunks. A high surrogate at the end of a chunk is kept until the low
+ * surrogate arrives with the next one.
+ */
+class stream_encoder {
+public:
+    /*!
+     * @param source_endian Encode endian of the utf-16 or utf-32 string.
+     */
+    explicit stream_encoder(UTF_ENDIAN source_endian = UTF_ENDIAN_LITTLE_ENDIAN);
+
+    /*!
+     * Encode the next chunk, the same way as stream_decoder::decode.
+     *
+     * @param[in] chunk next part of the string, without BOM.
+     * @param length number of code units in chunk.
+     * @param[out] target the encoded utf-8 bytes.
+     * @return true if succeeded.
+     */
+    bool encode(const char16_t *chunk, size_t length, std::string &target);
+    bool encode(const char32_t *chunk, size_t length, std::string &target);
+
+    /*!
+     * End the input and reset the encoder.
+     *
+     * @return false if the input ends with a high surrogate.
+     */
+    bool finish();
+
+    /*!
+     * Drop the pending high surrogate, if any, to start a new input.
+     */
+    void reset();
+
+private:
+    UTF_ENDIAN endian_;
+    char16_t   pending_high_;
+    bool       has_pending_;
+};
+
+/*!
+ * Find where a code point starts in a utf-8 string, without decoding it. The
+ * code points are counted like utf32_length_from_utf8 does, as the bytes which
+ * are not continuation bytes, so ill-formed input is counted the same way. The
+ * counting goes a block at a time through the vectorized kernels.
+ *
+ * @param[in] u8str utf-8 string.
+ * @param length number of bytes in u8str.
+ * @param codepoint index of the code point.
+ * @return byte offset of the code point, or length if the string has no more
+ * code points than codepoint.
+ */
+size_t codepoint_offset(const char *u8str, size_t length, size_t codepoint);
+
+/*!
+ * Get a part of a utf-8 string by code points, such as to truncate it to a
+ * number of characters.
+ *
+ * @param[in] u8str utf-8 string.
+ * @param pos index of the first code point.
+ * @param count number of code points, or fewer if the string ends before.
+ * @return the bytes of the code points.
+ */
+std::string substr_codepoints(const std::string &u8str,
+                              size_t             pos,
+                              size_t             count = std::string::npos);
+
+/*!
+ * Side index of a utf-8 string for lookups by code point index, such as for
+ * pagination. It holds the byte offset of every sample-th code point, which
+ * takes 8 / sample bytes per code point instead of the 4 of a utf-32 copy,
+ * and a lookup skips at most sample - 1 code points from the nearest one.
+ *
+ * The index is built by the first lookup, so an index shared by threads needs
+ * a lookup before it is shared. It refers to the string, which must outlive
+ * it and stay unchanged.
+ */
+class utf8_index {
+public:
+    /*!
+     * @param[in] u8str utf-8 string.
+     * @param length number of bytes in u8str.
+     * @param sample code points between two offsets of the index.
+     */
+    utf8_index(const char *u8str, size_t length, size_t sample = 64);
+
+    /*!
+     * @return number of code points in the string, counted like
+     * codepoint_offset counts them.
+     */
+    size_t size() const;
+
+    /*!
+     * @param codepoint index of the code point.
+     * @return byte offset of the code point, or the length of the string if it
+     * has no more code points than codepoint.
+     */
+    size_t offset(size_t codepoint) const;
+
+    /*!
+     * Get a part of the string by code points, like substr_codepoints.
+     * The offsets of the part in the string are offset(pos) and
+     * offset(pos + count).
+     */
+    std::string substr(size_t pos, size_t count = std::string::npos) const;
+
+private:
+    void build() const;
+
+    const char *                str_;
+    size_t                      length_;
+    size_t                      sample_;
+    mutable size_t              size_;
+    mutable std::vector<size_t> offsets_;  // Empty until built.
+};
+
+/*!
+ * Count the code points of a utf-8 string without decoding it, as the bytes
+ * which are not continuation bytes, the same as utf32_length_from_utf8.
+ *
+ * @param[in] u8str utf-8 string.
+ * @param length number of bytes in u8str.
+ * @return number of code points.
+ */
+size_t count_codepoints_utf8(const char *u8str, size_t length);
+
+/*!
+ * Count the code points of a utf-16 string without decoding it, as the code
+ * units which are not the low surrogate of a pair, the same as
+ * utf32_length_from_utf16.
+ *
+ * @param[in] u16str utf-16 string without BOM.
+ * @param length number of code units in u16str.
+ * @param u16str_endian Encode endian of the utf-16 string.
+ * @return number of code points.
+ */
+size_t count_codepoints_utf16(const char16_t *u16str,
+                              size_t          length,
+                              UTF_ENDIAN      u16str_endian);
+
+/*!
+ * Get the number of terminal columns a character takes, like wcwidth: 0 for
+ * controls, combining marks, format characters and the Hangul vowels and
+ * final consonants which join the syllable before, 2 for the Wide and
+ * Fullwidth characters of the East Asian Width property, and 1 for the rest.
+ * Ambiguous characters are narrow. The table is from Unicode 15.0.
+ *
+ * @param ch the character.
+ * @return 0, 1 or 2.
+ */
+int codepoint_width(char32_t ch);
+
+/*!
+ * Get the number of terminal columns a utf-8 string takes, the sum of
+ * codepoint_width of its characters, without converting it. Every maximal
+ * subpart of an ill-formed sequence takes 1 column, as U+FFFD would.
+ *
+ * @param[in] u8str utf-8 string.
+ * @param length number of bytes in u8str.
+ * @return number of columns.
+ */
+size_t display_width(const char *u8str, size_t length);
+
+/*!
+ * Get the number of terminal columns a utf-16 string takes, like for utf-8.
+ * Every unpaired surrogate takes 1 column.
+ *
+ * @param[in] u16str utf-16 string without BOM.
+ * @param length number of code units in u16str.
+ * @param u16str_endian Encode endian of the utf-16 string.
+ * @return number of columns.
+ */
+size_t display_width(const char16_t *u16str,
+                     size_t          length,
+                     UTF_ENDIAN      u16str_endian);
+
+/*!
+ * Streaming hash and code point count of utf-8 bytes, for the conversions
+ * below which feed it each block of their output right after writing it,
+ * while the block is still in cache. The hash is XXH64, so a string hashes
+ * the same whether it was converted or was utf-8 already and fed to update.
+ */
+class utf8_digest {
+public:
+    /*!
+     * @param seed seed of the hash.
+     */
+    explicit utf8_digest(uint64_t seed = 0);
+
+    /*!
+     * Add the next bytes. The bytes may be split anywhere, even in the middle
+     * of a sequence.
+     *
+     * @param[in] u8str next part of the utf-8 string.
+     * @param length number of bytes in u8str.
+     */
+    void update(const char *u8str, size_t length);
+
+    /*!
+     * @return XXH64 of all bytes added since the construction or last reset.
+     */
+    uint64_t hash() const;
+
+    /*!
+     * @return number of code points in these bytes, counted as
+     * utf32_length_from_utf8 does.
+     */
+    size_t codepoints() const { return codepoints_; }
+
+    /*!
+     * Start again with no bytes.
+     */
+    void reset(uint64_t seed = 0);
+
+private:
+    uint64_t      acc_[4];
+    uint64_t      seed_;
+    uint64_t      length_;
+    unsigned char buffer_[32];
+    size_t        buffered_;
+    size_t        codepoints_;
+};
+
+/*!
+ * Convert utf-32 string to utf-8 string in a caller provided buffer like
+ * convert_utf32_to_utf8, and add what is written to digest a block at a time
+ * as it is written. On failure, digest has the bytes written before the stop,
+ * so a conversion continued from result::count with the same digest gives the
+ * digest of the whole output.
+ *
+ * @param[in,out] digest digest the utf-8 bytes are added to.
+ */
+result convert_utf32_to_utf8(const char32_t *in,
+                             size_t          n,
+                             char *          out,
+                             size_t          cap,
+                             UTF_ENDIAN      endian,
+                             utf8_digest &   digest,
+                             UTF_MODE        mode = UTF_MODE_LENIENT);
+
+/*!
+ * Convert utf-16 string to utf-8 string in a caller provided buffer and add
+ * it to digest, the same way as the utf-32 overload. The blocks never cut a
+ * surrogate pair.
+ *
+ * @param[in,out] digest digest the utf-8 bytes are added to.
+ */
+result convert_utf16_to_utf8(const char16_t *in,
+                             size_t          n,
+                             char *          out,
+                             size_t          cap,
+                             UTF_ENDIAN      endian,
+                             utf8_digest &   digest,
+                             UTF_MODE        mode = UTF_MODE_LENIENT);
+
+/*!
+ * Destination of the bytes written by the write_*_as_utf8 functions.
+ *
+ * @param context the context passed with the function.
+ * @param[in] data next bytes of the output.
+ * @param size number of bytes in data.
+ * @return false to stop the conversion, such as on a write error.
+ */
+typedef bool (*sink_function)(void *context, const char *data, size_t size);
+
+/*!
+ * Bytes given to a sink at a time at most, which is the size of the block
+ * the output is converted into on the stack. It is small enough to stay in
+ * the cache between the conversion and the sink.
+ */
+const size_t sink_block_size = 16 * 1024;
+
+/*!
+ * Convert utf-32 string to utf-8 and give the output to write a block at a
+ * time as it is converted, so the whole output is never held in memory, with
+ * the modes of convert_utf32_to_utf8.
+ *
+ * @param[in] in utf-32 string.
+ * @param n number of characters in in.
+ * @param endian endian of in.
+ * @param write function the output is given to.
+ * @param context passed to write.
+ * @return result::count is the number of bytes written on success, or else
+ * the position in in before which all the output was written. The error is
+ * UTF_ERROR_FILE_IO if write returned false.
+ */
+result write_utf32_as_utf8(const char32_t *in,
+                           size_t          n,
+                           UTF_ENDIAN      endian,
+                           sink_function   write,
+                           void *          context,
+                           UTF_MODE        mode = UTF_MODE_LENIENT);
+
+/*!
+ * Convert utf-16 string to utf-8 and give the output to write a block at a
+ * time, the same way as write_utf32_as_utf8.
+ *
+ * @param n number of code units in in.
+ */
+result write_utf16_as_utf8(const char16_t *in,
+                           size_t          n,
+                           UTF_ENDIAN      endian,
+                           sink_function   write,
+                           void *          context,
+                           UTF_MODE        mode = UTF_MODE_LENIENT);
+
+/*!
+ * Sink writing to a stdio file.
+ */
+class file_sink {
+public:
+    explicit file_sink(std::FILE *file) : file_(file) {}
+
+    bool operator()(const char *data, size_t size);
+
+private:
+    std::FILE *file_;
+};
+
+/*!
+ * Sink writing to an output stream.
+ */
+class ostream_sink {
+public:
+    explicit ostream_sink(std::ostream &stream) : stream_(&stream) {}
+
+    bool operator()(const char *data, size_t size);
+
+private:
+    std::ostream *stream_;
+};
+
+namespace sink_detail {
+template <typename Sink>
+bool write(void *context, const char *data, size_t size) {
+    return (*static_cast<Sink *>(context))(data, size);
+}
+}  // namespace sink_detail
+
+/*!
+ * Convert to utf-8 and give the output to sink, any object which can be
+ * called like sink_function without the context: file_sink, ostream_sink or
+ * a lambda.
+ */
+template <typename Sink>
+result write_utf32_as_utf8(const char32_t *in,
+                           size_t          n,
+                           UTF_ENDIAN      endian,
+                           Sink &          sink,
+                           UTF_MODE        mode = UTF_MODE_LENIENT) {
+    return write_utf32_as_utf8(
+        in, n, endian, sink_detail::write<Sink>, &sink, mode);
+}
+
+template <typename Sink>
+result write_utf16_as_utf8(const char16_t *in,
+                           size_t          n,
+                           UTF_ENDIAN      endian,
+                           Sink &          sink,
+                           UTF_MODE        mode = UTF_MODE_LENIENT) {
+    return write_utf16_as_utf8(
+        in, n, endian, sink_detail::write<Sink>, &sink, mode);
+}
+
+/*!
+ * Convert in[0, length) into target after its first bom units, for the
+ * to_*string overloads below. On failure, target keeps the conversion of the
+ * input before the code unit the conversion stopped at.
+ *
+ * @param measure measure(in, length) gives the converted length, which is
+ * never less than what convert writes and exact for the part of the input
+ * before an invalid code unit.
+ * @param convert convert(in, length, out, cap) converts with the buffer API.
+ */
+template <typename In, typename String, typename Measure, typename Convert>
+bool convert_to_string(const In *     in,
+                       size_t         length,
+                       size_t         bom,
+                       String &       target,
+                       const Measure &measure,
+                       const Convert &convert) {
+    target.resize(bom + measure(in, length));
+    const result res =
+        convert(in, length, &target[0] + bom, target.size() - bom);
+    if (res.error != UTF_ERROR_NONE) {
+        target.resize(bom + measure(in, res.count));
+        return false;
+    }
+    target.resize(bom + res.count);
+    return true;
+}
+
+/*!
+ * U+FEFF in endian, which the add_bom conversions write in the unit
+ * convert_to_string leaves before the text. 0 for an unsupported endian, like
+ * the standard string overloads.
+ */
+inline char16_t u16_bom(UTF_ENDIAN endian) {
+    if (endian == UTF_ENDIAN_NATIVE)
+        return 0xfeff;
+    return endian == UTF_ENDIAN_LITTLE_ENDIAN || endian == UTF_ENDIAN_BIG_ENDIAN
+               ? 0xfffe
+               : 0;
+}
+
+inline char32_t u32_bom(UTF_ENDIAN endian) {
+    if (endian == UTF_ENDIAN_NATIVE)
+        return 0xfeff;
+    return endian == UTF_ENDIAN_LITTLE_ENDIAN || endian == UTF_ENDIAN_BIG_ENDIAN
+               ? 0xfffe0000
+               : 0;
+}
+
+/*
+ * The to_*string conversions for strings with any allocator, such as the
+ * arena_allocator of utf_convert_arena.hpp. They behave like the overloads
+ * for the standard strings above, which are still picked for those.
+ */
+template <typename Char, typename Alloc>
+using any_string = std::basic_string<Char, std::char_traits<Char>, Alloc>;
+
+template <typename InAlloc, typename Alloc>
+bool to_u8string(const any_string<char32_t, InAlloc> &u32str,
+                 UTF_ENDIAN                           u32str_endian,
+                 any_string<char, Alloc> &            target,
+                 UTF_MODE                             mode = UTF_MODE_LENIENT,
+                 UTF_FOLD                             fold = UTF_FOLD_NONE) {
+    return convert_to_string(
+        u32str.data(), u32str.size(), 0, target,
+        [=](const char32_t *in, size_t n) {
+            return utf8_length_from_utf32(in, n, u32str_endian);
+        },
+        [=](const char32_t *in, size_t n, char *out, size_t cap) {
+            return convert_utf32_to_utf8(
+                in, n, out, cap, u32str_endian, mode, fold);
+        });
+}
+
+template <typename InAlloc, typename Alloc>
+bool to_u8string(const any_string<char16_t, InAlloc> &u16str,
+                 UTF_ENDIAN                           u16str_endian,
+                 any_string<char, Alloc> &            target,
+                 UTF_MODE                             mode = UTF_MODE_LENIENT,
+                 UTF_FOLD                             fold = UTF_FOLD_NONE) {
+    return convert_to_string(
+        u16str.data(), u16str.size(), 0, target,
+        [=](const char16_t *in, size_t n) {
+            return mode == UTF_MODE_REPLACE
+                       ? 3 * n
+                       : utf8_length_from_utf16(in, n, u16str_endian);
+        },
+        [=](const char16_t *in, size_t n, char *out, size_t cap) {
+            return convert_utf16_to_utf8(
+                in, n, out, cap, u16str_endian, mode, fold);
+        });
+}
+
+template <typename InAlloc, typename Alloc>
+bool to_u32string(const any_string<char, InAlloc> &u8str,
+                  any_string<char32_t, Alloc> &    target,
+                  UTF_ENDIAN                       target_endian,
+                  bool                             add_bom = false,
+                  UTF_MODE                         mode    = UTF_MODE_LENIENT,
+                  UTF_FOLD                         fold    = UTF_FOLD_NONE) {
+    const bool res = convert_to_string(
+        u8str.data(), u8str.size(), add_bom ? 1 : 0, target,
+        [=](const char *in, size_t n) {
+            return mode == UTF_MODE_REPLACE ? n : utf32_length_from_utf8(in, n);
+        },
+        [=](const char *in, size_t n, char32_t *out, size_t cap) {
+            return convert_utf8_to_utf32(in, n, out, cap, target_endian, mode, fold);
+        });
+    if (add_bom)
+        target[0] = u32_bom(target_endian);
+    return res;
+}
+
+template <typename InAlloc, typename Alloc>
+bool to_u32string(const any_string<char16_t, InAlloc> &u16str,
+                  UTF_ENDIAN                           u16str_endian,
+                  any_string<char32_t, Alloc> &        target,
+                  UTF_ENDIAN                           target_endian,
+                  bool                                 add_bom = false,
+                  UTF_MODE                             mode    = UTF_MODE_LENIENT,
+                  UTF_FOLD                             fold    = UTF_FOLD_NONE) {
+    const bool res = convert_to_string(
+        u16str.data(), u16str.size(), add_bom ? 1 : 0, target,
+        [=](const char16_t *in, size_t n) {
+            return utf32_length_from_utf16(in, n, u16str_endian);
+        },
+        [=](const char16_t *in, size_t n, char32_t *out, size_t cap) {
+            return convert_utf16_to_utf32(
+                in, n, out, cap, u16str_endian, target_endian, mode, fold);
+        });
+    if (add_bom)
+        target[0] = u32_bom(target_endian);
+    return res;
+}
+
+template <typename InAlloc, typename Alloc>
+bool to_u16string(const any_string<char, InAlloc> &u8str,
+                  any_string<char16_t, Alloc> &    target,
+                  UTF_ENDIAN                       target_endian,
+                  bool                             add_bom = false,
+                  UTF_MODE                         mode    = UTF_MODE_LENIENT,
+                  UTF_FOLD                         fold    = UTF_FOLD_NONE) {
+    const bool res = convert_to_string(
+        u8str.data(), u8str.size(), add_bom ? 1 : 0, target,
+        [=](const char *in, size_t n) {
+            return mode == UTF_MODE_REPLACE ? n : utf16_length_from_utf8(in, n);
+        },
+        [=](const char *in, size_t n, char16_t *out, size_t cap) {
+            return convert_utf8_to_utf16(in, n, out, cap, target_endian, mode, fold);
+        });
+    if (add_bom)
+        target[0] = u16_bom(target_endian);
+    return res;
+}
+
+template <typename InAlloc, typename Alloc>
+bool to_u16string(const any_string<char32_t, InAlloc> &u32str,
+                  UTF_ENDIAN                           u32str_endian,
+                  any_string<char16_t, Alloc> &        target,
+                  UTF_ENDIAN                           target_endian,
+                  bool                                 add_bom = false,
+                  UTF_MODE                             mode    = UTF_MODE_LENIENT,
+                  UTF_FOLD                             fold    = UTF_FOLD_NONE) {
+    const bool res = convert_to_string(
+        u32str.data(), u32str.size(), add_bom ? 1 : 0, target,
+        [=](const char32_t *in, size_t n) {
+            return utf16_length_from_utf32(in, n, u32str_endian);
+        },
+        [=](const char32_t *in, size_t n, char16_t *out, size_t cap) {
+            return convert_utf32_to_utf16(
+                in, n, out, cap, u32str_endian, target_endian, mode, fold);
+        });
+    if (add_bom)
+        target[0] = u16_bom(target_endian);
+    return res;
+}
+
+#ifdef UTF_CONVERT_HAS_STRING_VIEW
+inline result validate_utf8(std::string_view u8str) {
+    return validate_utf8(u8str.data(), u8str.size());
+}
+
+inline result validate_utf16(std::u16string_view u16str,
+                             UTF_ENDIAN          u16str_endian) {
+    return validate_utf16(u16str.data(), u16str.size(), u16str_endian);
+}
+
+inline result validate_utf32(std::u32string_view u32str,
+                             UTF_ENDIAN          u32str_endian) {
+    return validate_utf32(u32str.data(), u32str.size(), u32str_endian);
+}
+
+inline bool is_ascii(std::string_view str) {
+    return is_ascii(str.data(), str.size());
+}
+
+inline size_t count_codepoints_utf8(std::string_view u8str) {
+    return count_codepoints_utf8(u8str.data(), u8str.size());
+}
+
+inline size_t count_codepoints_utf16(std::u16string_view u16str,
+                                     UTF_ENDIAN          u16str_endian) {
+    return count_codepoints_utf16(u16str.data(), u16str.size(), u16str_endian);
+}
+
+inline size_t display_width(std::string_view u8str) {
+    return display_width(u8str.data(), u8str.size());
+}
+
+inline size_t display_width(std::u16string_view u16str,
+                            UTF_ENDIAN          u16str_endian) {
+    return display_width(u16str.data(), u16str.size(), u16str_endian);
+}
+
+inline result convert_utf32_to_utf8(std::u32string_view in,
+                                    char *              out,
+                                    size_t              cap,
+                                    UTF_ENDIAN          endian,
+                                    UTF_MODE            mode = UTF_MODE_LENIENT,
+                                    UTF_FOLD            fold = UTF_FOLD_NONE) {
+    return convert_utf32_to_utf8(
+        in.data(), in.size(), out, cap, endian, mode, fold);
+}
+
+inline result convert_utf16_to_utf8(std::u16string_view in,
+                                    char *              out,
+                                    size_t              cap,
+                                    UTF_ENDIAN          endian,
+                                    UTF_MODE            mode = UTF_MODE_LENIENT,
+                                    UTF_FOLD            fold = UTF_FOLD_NONE) {
+    return convert_utf16_to_utf8(
+        in.data(), in.size(), out, cap, endian, mode, fold);
+}
+
+inline result convert_utf8_to_utf32(std::string_view in,
+                                    char32_t *       out,
+                                    size_t           cap,
+                                    UTF_ENDIAN       endian,
+                                    UTF_MODE         mode = UTF_MODE_LENIENT,
+                                    UTF_FOLD         fold = UTF_FOLD_NONE) {
+    return convert_utf8_to_utf32(
+        in.data(), in.size(), out, cap, endian, mode, fold);
+}
+
+inline result convert_utf8_to_utf16(std::string_view in,
+                                    char16_t *       out,
+                                    size_t           cap,
+                                    UTF_ENDIAN       endian,
+                                    UTF_MODE         mode = UTF_MODE_LENIENT,
+                                    UTF_FOLD         fold = UTF_FOLD_NONE) {
+    return convert_utf8_to_utf16(
+        in.data(), in.size(), out, cap, endian, mode, fold);
+}
+
+inline result convert_utf16_to_utf32(std::u16string_view in,
+                                     char32_t *          out,
+                                     size_t              cap,
+                                     UTF_ENDIAN          in_endian,
+                                     UTF_ENDIAN          out_endian,
+                                     UTF_MODE            mode = UTF_MODE_LENIENT,
+                                     UTF_FOLD            fold = UTF_FOLD_NONE) {
+    return convert_utf16_to_utf32(
+        in.data(), in.size(), out, cap, in_endian, out_endian, mode, fold);
+}
+
+inline result convert_utf32_to_utf16(std::u32string_view in,
+                                     char16_t *          out,
+                                     size_t              cap,
+                                     UTF_ENDIAN          in_endian,
+                                     UTF_ENDIAN          out_endian,
+                                     UTF_MODE            mode = UTF_MODE_LENIENT,
+                                     UTF_FOLD            fold = UTF_FOLD_NONE) {
+    return convert_utf32_to_utf16(
+        in.data(), in.size(), out, cap, in_endian, out_endian, mode, fold);
+}
+
+/*!
+ * Split string views into the pointers and lengths the batch functions take.
+ */
+template <typename Char>
+void split_views(const std::basic_string_view<Char> *strs,
+                 size_t                              count,
+                 std::vector<const Char *> &         data,
+                 std::vector<size_t> &               lengths) {
+    data.resize(count);
+    lengths.resize(count);
+    for (size_t i = 0; i < count; i++) {
+        data[i]    = strs[i].data();
+        lengths[i] = strs[i].size();
+    }
+}
+
+inline bool batch_to_u16string(const std::string_view *u8strs,
+                               size_t                  count,
+                               std::u16string &        target,
+                               std::vector<size_t> &   offsets,
+                               UTF_ENDIAN              target_endian,
+                               UTF_MODE                mode = UTF_MODE_LENIENT) {
+    std::vector<const char *> data;
+    std::vector<size_t>       lengths;
+    split_views(u8strs, count, data, lengths);
+    return batch_to_u16string(data.data(), lengths.data(), count, target,
+                              offsets, target_endian, mode);
+}
+
+inline bool batch_to_u32string(const std::string_view *u8strs,
+                               size_t                  count,
+                               std::u32string &        target,
+                               std::vector<size_t> &   offsets,
+                               UTF_ENDIAN              target_endian,
+                               UTF_MODE                mode = UTF_MODE_LENIENT) {
+    std::vector<const char *> data;
+    std::vector<size_t>       lengths;
+    split_views(u8strs, count, data, lengths);
+    return batch_to_u32string(data.data(), lengths.data(), count, target,
+                              offsets, target_endian, mode);
+}
+
+inline bool batch_to_u8string(const std::u16string_view *u16strs,
+                              size_t                     count,
+                              UTF_ENDIAN                 u16strs_endian,
+                              std::string &              target,
+                              std::vector<size_t> &      offsets,
+                              UTF_MODE                   mode = UTF_MODE_LENIENT) {
+    std::vector<const char16_t *> data;
+    std::vector<size_t>           lengths;
+    split_views(u16strs, count, data, lengths);
+    return batch_to_u8string(data.data(), lengths.data(), count,
+                             u16strs_endian, target, offsets, mode);
+}
+
+inline bool batch_to_u8string(const std::u32string_view *u32strs,
+                              size_t                     count,
+                              UTF_ENDIAN                 u32strs_endian,
+                              std::string &              target,
+                              std::vector<size_t> &      offsets,
+                              UTF_MODE                   mode = UTF_MODE_LENIENT) {
+    std::vector<const char32_t *> data;
+    std::vector<size_t>           lengths;
+    split_views(u32strs, count, data, lengths);
+    return batch_to_u8string(data.data(), lengths.data(), count,
+                             u32strs_endian, target, offsets, mode);
+}
+#endif
 }  // namespace utf_convert
 
 #endif  // UTF_CONVERT_HPP
@@ -0,0 +1,120 @@
+#ifndef UTF_CONVERT_ARENA_HPP
+#define UTF_CONVERT_ARENA_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <string>
+
+#include "utf_convert.hpp"
+
+namespace utf_convert {
+/*!
+ * Bump allocator for the strings of one request or task, which are all freed
+ * together by reset or the destructor. Memory is taken from the system in
+ * blocks, so converting many strings does not go through the global allocator
+ * for each one. An arena is not thread-safe, use one per thread.
+ */
+class arena {
+public:
+    /*!
+     * @param block_size bytes of the blocks taken from the system. Larger
+     * allocations get a block of their own.
+     */
+    explicit arena(size_t block_size = 64 * 1024);
+    ~arena();
+
+    arena(const arena &) = delete;
+    arena &operator=(const arena &) = delete;
+
+    /*!
+     * Allocate size bytes aligned to alignment, which must be a power of two
+     * no larger than alignof(std::max_align_t).
+     *
+     * @throw std::bad_alloc if no block can be allocated.
+     */
+    void *allocate(size_t size, size_t alignment) {
+        const size_t room = end_ - pos_;
+        const size_t pad =
+            (0 - reinterpret_cast<uintptr_t>(pos_)) & (alignment - 1);
+        if (pos_ != NULL && pad <= room && size <= room - pad) {
+            char *res = pos_ + pad;
+            pos_      = res + size;
+            return res;
+        }
+        return allocate_block(size);
+    }
+
+    /*!
+     * Free everything allocated so far. One block is kept for the allocations
+     * after.
+     */
+    void reset();
+
+    /*!
+     * Get the number of bytes taken from the system.
+     */
+    size_t capacity() const { return capacity_; }
+
+private:
+    struct block;
+
+    void *allocate_block(size_t size);
+
+    static const size_t header_size;
+
+    size_t block_size_;
+    size_t capacity_;
+    block *blocks_;  // The newest block, whose next is the one before.
+    char * pos_;
+    char * end_;
+};
+
+/*!
+ * Standard allocator drawing from an arena, for std::basic_string and the
+ * containers. Deallocation does nothing, the memory is freed with the arena.
+ */
+template <typename T>
+class arena_allocator {
+public:
+    typedef T value_type;
+
+    explicit arena_allocator(arena &owner) : arena_(&owner) {}
+
+    template <typename U>
+    arena_allocator(const arena_allocator<U> &other) : arena_(other.owner()) {}
+
+    T *allocate(size_t n) {
+        if (n > size_t(-1) / sizeof(T))
+            throw std::bad_alloc();
+        return static_cast<T *>(arena_->allocate(n * sizeof(T), alignof(T)));
+    }
+
+    void deallocate(T *, size_t) {}
+
+    arena *owner() const { return arena_; }
+
+private:
+    arena *arena_;
+};
+
+template <typename T, typename U>
+bool operator==(const arena_allocator<T> &a, const arena_allocator<U> &b) {
+    return a.owner() == b.owner();
+}
+
+template <typename T, typename U>
+bool operator!=(const arena_allocator<T> &a, const arena_allocator<U> &b) {
+    return a.owner() != b.owner();
+}
+
+/*
+ * Strings in an arena, for the to_*string conversions. They are constructed
+ * with the allocator, e.g. arena_u16string str(arena_allocator<char16_t>(a)).
+ */
+typedef any_string<char, arena_allocator<char> >         arena_string;
+typedef any_string<char16_t, arena_allocator<char16_t> > arena_u16string;
+typedef any_string<char32_t, arena_allocator<char32_t> > arena_u32string;
+}  // namespace utf_convert
+
+#endif  // UTF_CONVERT_ARENA_HPP
@@ -0,0 +1,344 @@
+#ifndef UTF_CONVERT_ASYNC_HPP
+#define UTF_CONVERT_ASYNC_HPP
+
+/*
+ * Decoding of utf-8 read from an asynchronous byte source with C++20
+ * coroutines, such as a socket or file read through io_uring. The source is
+ * any type with a read member function taking a buffer and its capacity,
+ * which returns an awaitable giving the number of bytes read, 0 at the end of
+ * the input:
+ *
+ *     utf_convert::async_transcoder<socket_reader> transcoder(reader);
+ *     while (co_await transcoder.next())
+ *         consume(transcoder.chunk());
+ *     if (transcoder.error() != utf_convert::UTF_ERROR_NONE)
+ *         ...
+ *
+ * The transcoder reads into two buffers in turn. Once a chunk has been read,
+ * the read of the next one starts before the chunk is decoded, so the read
+ * runs while the chunk is decoded and consumed. Each call of next decodes one
+ * chunk at most, so the time a coroutine runs between two reads is bounded by
+ * the chunk size however long the input is, unlike a single conversion of the
+ * whole input.
+ *
+ * There is no scheduler here: the transcoder suspends and resumes only where
+ * the source and the caller do, on whatever thread they resume it.
+ */
+
+#if __cplusplus < 202002L || !defined(__cpp_impl_coroutine)
+#error "utf_convert_async.hpp requires C++20 coroutines"
+#endif
+
+#include <atomic>
+#include <coroutine>
+#include <cstddef>
+#include <exception>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "utf_convert.hpp"
+
+namespace utf_convert {
+
+/*!
+ * Lazy coroutine giving a T, which starts when it is awaited and resumes the
+ * awaiting coroutine when it ends. Exceptions are rethrown to the awaiting
+ * coroutine.
+ */
+template <typename T>
+class async_task {
+public:
+    struct promise_type {
+        T                       value{};
+        std::exception_ptr      exception;
+        std::coroutine_handle<> continuation;
+
+        async_task get_return_object() {
+            return async_task(
+                std::coroutine_handle<promise_type>::from_promise(*this));
+        }
+
+        std::suspend_always initial_suspend() noexcept { return {}; }
+
+        struct final_awaiter {
+            bool await_ready() noexcept { return false; }
+
+            std::coroutine_handle<>
+            await_suspend(std::coroutine_handle<promise_type> handle) noexcept {
+                std::coroutine_handle<> next = handle.promise().continuation;
+                return next ? next : std::noop_coroutine();
+            }
+
+            void await_resume() noexcept {}
+        };
+
+        final_awaiter final_suspend() noexcept { return {}; }
+
+        void return_value(T result) { value = std::move(result); }
+
+        void unhandled_exception() { exception = std::current_exception(); }
+    };
+
+    async_task(async_task &&other) noexcept
+        : handle_(std::exchange(other.handle_, nullptr)) {}
+
+    async_task &operator=(async_task &&other) noexcept {
+        if (this != &other) {
+            if (handle_)
+                handle_.destroy();
+            handle_ = std::exchange(other.handle_, nullptr);
+        }
+        return *this;
+    }
+
+    ~async_task() {
+        if (handle_)
+            handle_.destroy();
+    }
+
+    struct awaiter {
+        std::coroutine_handle<promise_type> handle;
+
+        bool await_ready() noexcept { return false; }
+
+        std::coroutine_handle<>
+        await_suspend(std::coroutine_handle<> awaiting) noexcept {
+            handle.promise().continuation = awaiting;
+            return handle;
+        }
+
+        T await_resume() {
+            if (handle.promise().exception)
+                std::rethrow_exception(handle.promise().exception);
+            return std::move(handle.promise().value);
+        }
+    };
+
+    /*!
+     * Start the task and wait for it. A task is awaited once.
+     */
+    awaiter operator co_await() && noexcept { return awaiter{handle_}; }
+
+private:
+    explicit async_task(std::coroutine_handle<promise_type> handle)
+        : handle_(handle) {}
+
+    std::coroutine_handle<promise_type> handle_;
+};
+
+namespace async_detail {
+
+/*!
+ * Read started at once, which is awaited later. The read and its awaiter
+ * race to finish first through the flag, so the read may complete on another
+ * thread: the one which comes second resumes the awaiting coroutine, or goes
+ * on without suspending.
+ */
+class read_operation {
+public:
+    struct promise_type {
+        size_t                  size = 0;
+        std::exception_ptr      exception;
+        std::coroutine_handle<> continuation;
+        std::atomic<bool>       arrived{false};
+
+        read_operation get_return_object() {
+            return read_operation(
+                std::coroutine_handle<promise_type>::from_promise(*this));
+        }
+
+        std::suspend_never initial_suspend() noexcept { return {}; }
+
+        struct final_awaiter {
+            bool await_ready() noexcept { return false; }
+
+            std::coroutine_handle<>
+            await_suspend(std::coroutine_handle<promise_type> handle) noexcept {
+                promise_type &promise = handle.promise();
+                if (promise.arrived.exchange(true, std::memory_order_acq_rel))
+                    return promise.continuation;
+                return std::noop_coroutine();
+            }
+
+            void await_resume() noexcept {}
+        };
+
+        final_awaiter final_suspend() noexcept { return {}; }
+
+        void return_value(size_t result) { size = result; }
+
+        void unhandled_exception() { exception = std::current_exception(); }
+    };
+
+    read_operation() : handle_(nullptr) {}
+
+    read_operation(read_operation &&other) noexcept
+        : handle_(std::exchange(other.handle_, nullptr)) {}
+
+    read_operation &operator=(read_operation &&other) noexcept {
+        if (this != &other) {
+            if (handle_)
+                handle_.destroy();
+            handle_ = std::exchange(other.handle_, nullptr);
+        }
+        return *this;
+    }
+
+    ~read_operation() {
+        if (handle_)
+            handle_.destroy();
+    }
+
+    /*!
+     * @return true if a read was started and not awaited yet.
+     */
+    bool pending() const { return bool(handle_); }
+
+    struct awaiter {
+        std::coroutine_handle<promise_type> handle;
+
+        bool await_ready() noexcept { return false; }
+
+        bool await_suspend(std::coroutine_handle<> awaiting) noexcept {
+            promise_type &promise = handle.promise();
+            promise.continuation  = awaiting;
+            return !promise.arrived.exchange(true, std::memory_order_acq_rel);
+        }
+
+        size_t await_resume() {
+            if (handle.promise().exception)
+                std::rethrow_exception(handle.promise().exception);
+            return handle.promise().size;
+        }
+    };
+
+    awaiter operator co_await() & noexcept { return awaiter{handle_}; }
+
+private:
+    explicit read_operation(std::coroutine_handle<promise_type> handle)
+        : handle_(handle) {}
+
+    std::coroutine_handle<promise_type> handle_;
+};
+
+template <typename Source>
+read_operation start_read(Source &source, char *buffer, size_t capacity) {
+    co_return static_cast<size_t>(co_await source.read(buffer, capacity));
+}
+}  // namespace async_detail
+
+/*!
+ * Decoder of the utf-8 bytes of an asynchronous source into chunks of utf-16
+ * or utf-32, on top of stream_decoder.
+ *
+ * After next gives true, the read of the next chunk is running. To stop
+ * before the end of the input, await close before the transcoder is
+ * destroyed. Source and transcoder must outlive the reads.
+ */
+template <typename Source, typename String = std::u16string>
+class async_transcoder {
+public:
+    /*!
+     * @param source source of the utf-8 bytes.
+     * @param target_endian endian of the decoded chunks.
+     * @param chunk_size capacity of each of the two read buffers.
+     */
+    explicit async_transcoder(Source &   source,
+                              UTF_ENDIAN target_endian = UTF_ENDIAN_LITTLE_ENDIAN,
+                              size_t     chunk_size    = 64 * 1024)
+        : source_(source),
+          decoder_(target_endian),
+          current_(0),
+          ended_(false),
+          error_(UTF_ERROR_NONE) {
+        buffers_[0].resize(chunk_size == 0 ? 1 : chunk_size);
+        buffers_[1].resize(buffers_[0].size());
+    }
+
+    async_transcoder(const async_transcoder &) = delete;
+    async_transcoder &operator=(const async_transcoder &) = delete;
+
+    /*!
+     * Wait for the next chunk and decode it. Exceptions of the source are
+     * rethrown here.
+     *
+     * @return true if chunk holds the characters completed by the next chunk,
+     * which may be none. false at the end of the input, or on an error which
+     * error tells. After an invalid sequence, chunk holds the characters
+     * before it.
+     */
+    async_task<bool> next() {
+        if (ended_ || error_ != UTF_ERROR_NONE)
+            co_return false;
+        if (!read_.pending())
+            read_ = start_read(current_);
+
+        const size_t size = co_await read_;
+        read_             = async_detail::read_operation();
+        if (size == 0) {
+            ended_ = true;
+            chunk_.clear();
+            if (!decoder_.finish())
+                error_ = UTF_ERROR_INVALID_SEQUENCE;
+            co_return false;
+        }
+
+        // Read the next chunk into the other buffer while this one is decoded.
+        const char *data = buffers_[current_].data();
+        current_ ^= 1;
+        read_ = start_read(current_);
+
+        if (!decoder_.decode(data, size, chunk_)) {
+            error_ = UTF_ERROR_INVALID_SEQUENCE;
+            co_await read_;
+            read_ = async_detail::read_operation();
+            co_return false;
+        }
+        co_return true;
+    }
+
+    /*!
+     * @return the characters decoded by the last call of next.
+     */
+    const String &chunk() const { return chunk_; }
+
+    /*!
+     * @return UTF_ERROR_INVALID_SEQUENCE if the input is not valid utf-8 or
+     * ends in the middle of a sequence, or else UTF_ERROR_NONE.
+     */
+    UTF_ERROR error() const { return error_; }
+
+    /*!
+     * Wait for the running read, if any, and drop the rest of the input.
+     *
+     * @return true if there was no error.
+     */
+    async_task<bool> close() {
+        if (read_.pending()) {
+            co_await read_;
+            read_ = async_detail::read_operation();
+        }
+        ended_ = true;
+        decoder_.reset();
+        co_return error_ == UTF_ERROR_NONE;
+    }
+
+private:
+    async_detail::read_operation start_read(size_t buffer) {
+        return async_detail::start_read(source_, buffers_[buffer].data(),
+                                        buffers_[buffer].size());
+    }
+
+    Source &                     source_;
+    stream_decoder               decoder_;
+    std::vector<char>            buffers_[2];
+    size_t                       current_;  // The buffer being read into.
+    async_detail::read_operation read_;
+    String                       chunk_;
+    bool                         ended_;
+    UTF_ERROR                    error_;
+};
+}  // namespace utf_convert
+
+#endif  // UTF_CONVERT_ASYNC_HPP
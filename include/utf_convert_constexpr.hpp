@@ -0,0 +1,228 @@
+#ifndef UTF_CONVERT_CONSTEXPR_HPP
+#define UTF_CONVERT_CONSTEXPR_HPP
+
+/*
+ * Conversion of utf-8 string literals at compile time. This header stands on
+ * its own: it needs neither utf_convert.hpp nor the library, and the results
+ * are constants with no code or static initializer left at run time.
+ *
+ * With C++17:
+ *
+ *     constexpr auto w = UTF_CONVERT_U16_LITERAL("\xe4\xbd\xa0\xe5\xa5\xbd");
+ *
+ * With C++20 the literal can be a template argument:
+ *
+ *     constexpr auto w = utf_convert::to_u16<"\xe4\xbd\xa0\xe5\xa5\xbd">();
+ *
+ * Both give a std::array of code unit values, that is utf-16 or utf-32 in the
+ * byte order of the host, followed by a null unit like the literal itself.
+ * Unlike the converters of the library, the literal must be well-formed
+ * utf-8; an ill-formed one fails to compile, at a call to
+ * invalid_utf8_literal.
+ */
+
+#if __cplusplus < 201703L
+#error "utf_convert_constexpr.hpp requires C++17"
+#endif
+
+#include <array>
+#include <cstddef>
+
+namespace utf_convert {
+namespace literal {
+
+/*!
+ * Not constexpr on purpose: reaching it in a constant expression stops the
+ * compilation, with its name in the error message.
+ */
+inline void invalid_utf8_literal() {}
+
+/*!
+ * Decode the well-formed utf-8 sequence at u8str[i] and move i past it.
+ *
+ * @param[in] u8str utf-8 string, of char or char8_t.
+ * @param length number of bytes in u8str.
+ * @param[in,out] i position of the sequence.
+ * @return the character.
+ */
+template <typename Char>
+constexpr char32_t decode(const Char *u8str, std::size_t length,
+                          std::size_t &i) {
+    const unsigned char lead = static_cast<unsigned char>(u8str[i]);
+    if (lead < 0x80) {
+        i += 1;
+        return lead;
+    }
+
+    std::size_t size      = 0;
+    char32_t    min_value = 0;
+    if ((lead & 0xe0) == 0xc0) {
+        size      = 2;
+        min_value = 0x80;
+    } else if ((lead & 0xf0) == 0xe0) {
+        size      = 3;
+        min_value = 0x800;
+    } else if ((lead & 0xf8) == 0xf0) {
+        size      = 4;
+        min_value = 0x10000;
+    } else {
+        invalid_utf8_literal();
+    }
+
+    if (length - i < size)
+        invalid_utf8_literal();
+
+    char32_t value = lead & (0x7f >> size);
+    for (std::size_t k = 1; k < size; k++) {
+        const unsigned char c = static_cast<unsigned char>(u8str[i + k]);
+        if ((c & 0xc0) != 0x80)
+            invalid_utf8_literal();
+        value = (value << 6) | (c & 0x3f);
+    }
+
+    if (value < min_value || value > 0x10ffff ||
+        (value >= 0xd800 && value < 0xe000))
+        invalid_utf8_literal();
+
+    i += size;
+    return value;
+}
+
+/*!
+ * Get the number of utf-16 code units of a utf-8 string, without the null
+ * unit.
+ */
+template <typename Char>
+constexpr std::size_t utf16_length(const Char *u8str, std::size_t length) {
+    std::size_t count = 0;
+    for (std::size_t i = 0; i < length;) {
+        count += decode(u8str, length, i) < 0x10000 ? 1 : 2;
+    }
+    return count;
+}
+
+/*!
+ * Get the number of characters of a utf-8 string, without the null unit.
+ */
+template <typename Char>
+constexpr std::size_t utf32_length(const Char *u8str, std::size_t length) {
+    std::size_t count = 0;
+    for (std::size_t i = 0; i < length; count++) {
+        decode(u8str, length, i);
+    }
+    return count;
+}
+
+/*!
+ * Convert a utf-8 string to utf-16 code units.
+ *
+ * @tparam N number of code units, which must be utf16_length(u8str, length).
+ * @param[in] u8str utf-8 string, of char or char8_t.
+ * @param length number of bytes in u8str.
+ * @return the code units followed by a null unit.
+ */
+template <std::size_t N, typename Char>
+constexpr std::array<char16_t, N + 1> to_u16_array(const Char *u8str,
+                                                   std::size_t length) {
+    std::array<char16_t, N + 1> res{};
+    std::size_t                 pos = 0;
+    for (std::size_t i = 0; i < length;) {
+        char32_t value = decode(u8str, length, i);
+        if (value < 0x10000) {
+            res[pos++] = static_cast<char16_t>(value);
+        } else {
+            value -= 0x10000;
+            res[pos++] = static_cast<char16_t>(0xd800 | (value >> 10));
+            res[pos++] = static_cast<char16_t>(0xdc00 | (value & 0x3ff));
+        }
+    }
+    return res;
+}
+
+/*!
+ * Convert a utf-8 string to utf-32 characters, the same way as to_u16_array.
+ *
+ * @tparam N number of characters, which must be utf32_length(u8str, length).
+ */
+template <std::size_t N, typename Char>
+constexpr std::array<char32_t, N + 1> to_u32_array(const Char *u8str,
+                                                   std::size_t length) {
+    std::array<char32_t, N + 1> res{};
+    std::size_t                 pos = 0;
+    for (std::size_t i = 0; i < length;) {
+        res[pos++] = decode(u8str, length, i);
+    }
+    return res;
+}
+
+}  // namespace literal
+
+#if __cplusplus >= 202002L
+/*!
+ * A string literal as a template argument, for to_u16 and to_u32.
+ */
+template <typename Char, std::size_t N>
+struct fixed_string {
+    Char value[N];
+
+    constexpr fixed_string(const Char (&str)[N]) : value() {
+        for (std::size_t i = 0; i < N; i++) {
+            value[i] = str[i];
+        }
+    }
+
+    static constexpr std::size_t length = N - 1;
+};
+
+/*!
+ * Convert a utf-8 string literal to utf-16 at compile time.
+ *
+ * @tparam str utf-8 string literal, of char or char8_t.
+ * @return the code units followed by a null unit.
+ */
+template <fixed_string str>
+constexpr auto to_u16() {
+    constexpr std::size_t size = literal::utf16_length(str.value, str.length);
+    return literal::to_u16_array<size>(str.value, str.length);
+}
+
+/*!
+ * Convert a utf-8 string literal to utf-32 at compile time.
+ *
+ * @tparam str utf-8 string literal, of char or char8_t.
+ * @return the characters followed by a null unit.
+ */
+template <fixed_string str>
+constexpr auto to_u32() {
+    constexpr std::size_t size = literal::utf32_length(str.value, str.length);
+    return literal::to_u32_array<size>(str.value, str.length);
+}
+#endif
+
+}  // namespace utf_convert
+
+/*!
+ * Convert a utf-8 string literal to utf-16 at compile time, for C++17 where
+ * the literal can not be a template argument.
+ */
+#define UTF_CONVERT_U16_LITERAL(str)                                           \
+    ([] {                                                                      \
+        constexpr std::size_t size =                                           \
+            ::utf_convert::literal::utf16_length(str, sizeof(str) - 1);        \
+        return ::utf_convert::literal::to_u16_array<size>(str,                 \
+                                                          sizeof(str) - 1);    \
+    }())
+
+/*!
+ * Convert a utf-8 string literal to utf-32 at compile time, the same way as
+ * UTF_CONVERT_U16_LITERAL.
+ */
+#define UTF_CONVERT_U32_LITERAL(str)                                           \
+    ([] {                                                                      \
+        constexpr std::size_t size =                                           \
+            ::utf_convert::literal::utf32_length(str, sizeof(str) - 1);        \
+        return ::utf_convert::literal::to_u32_array<size>(str,                 \
+                                                          sizeof(str) - 1);    \
+    }())
+
+#endif  // UTF_CONVERT_CONSTEXPR_HPP
@@ -1,11 +1,17 @@
 #include "utf_convert.hpp"
 
+#include "utf_convert_simd.hpp"
+#include "utf_convert_stats.hpp"
+
 #include <cassert>
 #include <cstdint>
 #include <cstring>
+#include <ostream>
 #include <string>
 
 namespace {
+using utf_convert::stats_detail::run_stats;
+
 union utf32_character {
     char32_t ch;
     uint8_t  v[4];
@@ -16,36 +22,163 @@ union utf16_character {
     uint8_t  v[2];
 };
 
+// Short names for the template arguments below.
+const utf_convert::UTF_ENDIAN little = utf_convert::UTF_ENDIAN_LITTLE_ENDIAN;
+const utf_convert::UTF_ENDIAN big    = utf_convert::UTF_ENDIAN_BIG_ENDIAN;
+
+/*
+ * Code units are read and written with the endian as a template argument, so
+ * the converters below are compiled once per endian without a test of it in
+ * their loops. The shifts compile to a plain load or store, with a byte swap
+ * for the order other than the host's.
+ */
+template <utf_convert::UTF_ENDIAN endian>
+inline uint16_t load_u16(const uint8_t *src) {
+    if (endian == utf_convert::UTF_ENDIAN_BIG_ENDIAN)
+        return (static_cast<uint16_t>(src[0]) << 8) | src[1];
+    return (static_cast<uint16_t>(src[1]) << 8) | src[0];
+}
+
+template <utf_convert::UTF_ENDIAN endian>
+inline uint32_t load_u32(const uint8_t *src) {
+    if (endian == utf_convert::UTF_ENDIAN_BIG_ENDIAN) {
+        return ((static_cast<uint32_t>(src[0]) << 24) |
+                (static_cast<uint32_t>(src[1]) << 16) |
+                (static_cast<uint32_t>(src[2]) << 8) | src[3]);
+    }
+    return ((static_cast<uint32_t>(src[3]) << 24) |
+            (static_cast<uint32_t>(src[2]) << 16) |
+            (static_cast<uint32_t>(src[1]) << 8) | src[0]);
+}
+
+template <utf_convert::UTF_ENDIAN endian>
+inline char16_t make_u16(uint16_t value) {
+    utf16_character res;
+    if (endian == utf_convert::UTF_ENDIAN_BIG_ENDIAN) {
+        res.v[0] = value >> 8;
+        res.v[1] = value & 0xff;
+    } else {
+        res.v[0] = value & 0xff;
+        res.v[1] = value >> 8;
+    }
+    return res.ch;
+}
+
+template <utf_convert::UTF_ENDIAN endian>
+inline char32_t make_u32(uint32_t value) {
+    utf32_character res;
+    if (endian == utf_convert::UTF_ENDIAN_BIG_ENDIAN) {
+        res.v[0] = value >> 24;
+        res.v[1] = (value >> 16) & 0xff;
+        res.v[2] = (value >> 8) & 0xff;
+        res.v[3] = value & 0xff;
+    } else {
+        res.v[0] = value & 0xff;
+        res.v[1] = (value >> 8) & 0xff;
+        res.v[2] = (value >> 16) & 0xff;
+        res.v[3] = value >> 24;
+    }
+    return res.ch;
+}
+
+/*
+ * The same with the endian known at run time only, for code outside of the
+ * converter loops.
+ */
 inline uint16_t get_u16_endian_value(const uint8_t *         src,
                                      utf_convert::UTF_ENDIAN endian) {
-    switch (endian) {
-    case utf_convert::UTF_ENDIAN_BIG_ENDIAN:
-        return (static_cast<uint16_t>(src[0]) << 8) | src[1];
+    return endian == big ? load_u16<big>(src) : load_u16<little>(src);
+}
+
+inline uint32_t get_u32_endian_value(const uint8_t *         src,
+                                     utf_convert::UTF_ENDIAN endian) {
+    return endian == big ? load_u32<big>(src) : load_u32<little>(src);
+}
+
+inline char16_t make_u16_endian_value(uint16_t                value,
+                                      utf_convert::UTF_ENDIAN endian) {
+    return endian == big ? make_u16<big>(value) : make_u16<little>(value);
+}
+
+inline char32_t make_u32_endian_value(uint32_t                value,
+                                      utf_convert::UTF_ENDIAN endian) {
+    return endian == big ? make_u32<big>(value) : make_u32<little>(value);
+}
+
+inline bool is_supported_endian(utf_convert::UTF_ENDIAN endian) {
+    return endian == utf_convert::UTF_ENDIAN_LITTLE_ENDIAN ||
+           endian == utf_convert::UTF_ENDIAN_BIG_ENDIAN;
+}
 
-    case utf_convert::UTF_ENDIAN_LITTLE_ENDIAN:
-        return (static_cast<uint16_t>(src[1]) << 8) | src[0];
+/*
+ * The scalar converters take runs of ascii a word of ascii_word_size bytes at
+ * a time. A word is ascii if it has none of the bits of its mask set, which is
+ * laid out in memory the same way as the code units, so the masks below work
+ * on any host.
+ */
+const size_t ascii_word_size = 8;
+
+const uint8_t u8_ascii_mask[ascii_word_size] = {
+    0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80};
+const uint8_t u16_ascii_mask[2][ascii_word_size] = {
+    {0x80, 0xff, 0x80, 0xff, 0x80, 0xff, 0x80, 0xff},
+    {0xff, 0x80, 0xff, 0x80, 0xff, 0x80, 0xff, 0x80}};
+const uint8_t u32_ascii_mask[2][ascii_word_size] = {
+    {0x80, 0xff, 0xff, 0xff, 0x80, 0xff, 0xff, 0xff},
+    {0xff, 0xff, 0xff, 0x80, 0xff, 0xff, 0xff, 0x80}};
+
+inline bool is_ascii_word(const void *src, const uint8_t *mask) {
+    uint64_t word;
+    uint64_t bits;
+    std::memcpy(&word, src, sizeof(word));
+    std::memcpy(&bits, mask, sizeof(bits));
+    return (word & bits) == 0;
+}
+
+/*!
+ * Index of the byte holding the value of an ascii code unit of size bytes.
+ */
+template <utf_convert::UTF_ENDIAN endian>
+inline size_t ascii_byte_index(size_t size) {
+    return endian == utf_convert::UTF_ENDIAN_BIG_ENDIAN ? size - 1 : 0;
+}
+
+/*!
+ * Copy the low bytes of count ascii code units of size bytes each.
+ */
+template <utf_convert::UTF_ENDIAN endian>
+inline void
+narrow_ascii(const uint8_t *src, size_t size, size_t count, char *dst) {
+    src += ascii_byte_index<endian>(size);
+    for (size_t k = 0; k < count; k++) {
+        dst[k] = src[k * size];
     }
 }
 
-bool convert_u32str_to_u8str_without_bom(const uint8_t *         u32str,
-                                         size_t                  u32size,
-                                         utf_convert::UTF_ENDIAN endian,
-                                         std::string &           target) {
-    for (size_t i = 0; i < u32size; i++) {
+/*!
+ * Zero-extend count ascii bytes into code units of type Unit.
+ */
+template <utf_convert::UTF_ENDIAN endian, typename Unit>
+inline void widen_ascii(const char *src, size_t count, Unit *dst) {
+    uint8_t *out = reinterpret_cast<uint8_t *>(dst);
+    std::memset(out, 0, count * sizeof(Unit));
+
+    out += ascii_byte_index<endian>(sizeof(Unit));
+    for (size_t k = 0; k < count; k++) {
+        out[k * sizeof(Unit)] = src[k];
+    }
+}
+
+template <utf_convert::UTF_ENDIAN endian>
+utf_convert::UTF_ERROR
+convert_u32str_to_u8str_without_bom(const uint8_t *u32str,
+                                    size_t         u32size,
+                                    size_t &       i,
+                                    char *&        dst,
+                                    char *         dst_end) {
+    for (; i < u32size; i++) {
         const uint8_t *cur = u32str + i * (sizeof(char32_t) / sizeof(uint8_t));
-        uint32_t       value = 0;
-
-        if (endian == utf_convert::UTF_ENDIAN_BIG_ENDIAN) {
-            value = ((static_cast<uint32_t>(cur[0]) << 24) |
-                     (static_cast<uint32_t>(cur[1]) << 16) |
-                     (static_cast<uint32_t>(cur[2]) << 8) | cur[3]);
-        } else if (endian == utf_convert::UTF_ENDIAN_LITTLE_ENDIAN) {
-            value = ((static_cast<uint32_t>(cur[3]) << 24) |
-                     (static_cast<uint32_t>(cur[2]) << 16) |
-                     (static_cast<uint32_t>(cur[1]) << 8) | cur[0]);
-        } else {
-            return false;  // Unsupported endian
-        }
+        const uint32_t value = load_u32<endian>(cur);
 
         if (value < 0x80) {
             /*
@@ -55,7 +188,21 @@ bool convert_u32str_to_u8str_without_bom(const uint8_t *         u32str,
              * +-----------------------------------------+
              * The single byte is 0ABC DEFG
              */
-            target.push_back(value);
+            // A run of ascii goes on two words at a time, the loop steps
+            // past the last character.
+            if (u32size - i >= 4 && dst_end - dst >= 4 &&
+                is_ascii_word(cur, u32_ascii_mask[endian]) &&
+                is_ascii_word(cur + ascii_word_size, u32_ascii_mask[endian])) {
+                narrow_ascii<endian>(cur, sizeof(char32_t), 4, dst);
+                dst += 4;
+                i += 3;
+                continue;
+            }
+
+            if (dst_end - dst < 1)
+                return utf_convert::UTF_ERROR_OUTPUT_TOO_SMALL;
+
+            *dst++ = value;
         } else if (value < 0x0800) {
             /*
              * +-----------------------------------------+
@@ -65,8 +212,11 @@ bool convert_u32str_to_u8str_without_bom(const uint8_t *         u32str,
              * The higher byte is 110A BCDE
              * The lower byte is 10FG HIJK
              */
-            target.push_back((value >> 6) & 0x1f | 0xc0);
-            target.push_back(value & 0x3f | 0x80);
+            if (dst_end - dst < 2)
+                return utf_convert::UTF_ERROR_OUTPUT_TOO_SMALL;
+
+            *dst++ = ((value >> 6) & 0x1f) | 0xc0;
+            *dst++ = (value & 0x3f) | 0x80;
         } else if (value < 0x010000) {
             /*
              * +-----------------------------------------+
@@ -77,65 +227,205 @@ bool convert_u32str_to_u8str_without_bom(const uint8_t *         u32str,
              * The second byte is  10EF GHIJ
              * The third byte is 10KL MNOP
              */
-            target.push_back((value >> 12) & 0x0f | 0xe0);
-            target.push_back((value >> 6) & 0x3f | 0x80);
-            target.push_back(value & 0x3f | 0x80);
+            if (dst_end - dst < 3)
+                return utf_convert::UTF_ERROR_OUTPUT_TOO_SMALL;
+
+            *dst++ = ((value >> 12) & 0x0f) | 0xe0;
+            *dst++ = ((value >> 6) & 0x3f) | 0x80;
+            *dst++ = (value & 0x3f) | 0x80;
         } else if (value < 0x110000) {
-            target.push_back((value >> 18) & 0x07 | 0xf0);
-            target.push_back((value >> 12) & 0x3f | 0x80);
-            target.push_back((value >> 6) & 0x3f | 0x80);
-            target.push_back(value & 0x3f | 0x80);
+            if (dst_end - dst < 4)
+                return utf_convert::UTF_ERROR_OUTPUT_TOO_SMALL;
+
+            *dst++ = ((value >> 18) & 0x07) | 0xf0;
+            *dst++ = ((value >> 12) & 0x3f) | 0x80;
+            *dst++ = ((value >> 6) & 0x3f) | 0x80;
+            *dst++ = (value & 0x3f) | 0x80;
         } else {
-            return false;
+            return utf_convert::UTF_ERROR_INVALID_SEQUENCE;
         }
     }
-    return true;
+    return utf_convert::UTF_ERROR_NONE;
 }
 
-bool convert_u16str_to_u8str_without_bom(const uint8_t *         u16str,
-                                         size_t                  u16length,
+/*!
+ * Convert a utf-32 string without BOM into a buffer, running the vectorized
+ * encoder first and the scalar one over whatever it leaves. Both src and dst
+ * are advanced to where the conversion stops.
+ */
+utf_convert::UTF_ERROR convert_u32_to_u8(const char32_t *&       src,
+                                         const char32_t *        end,
                                          utf_convert::UTF_ENDIAN endian,
-                                         std::string &           target) {
-    for (size_t i = 0; i < u16length; i++) {
+                                         char *&                 dst,
+                                         char *                  dst_end) {
+    run_stats<char32_t, char> stats(
+        utf_convert::UTF_CONVERSION_UTF32_TO_UTF8, src, dst);
+    if (!is_supported_endian(endian))
+        return stats.finish(
+            utf_convert::UTF_ERROR_UNSUPPORTED_ENDIAN, src, dst);
+
+    const char32_t *kernel_begin = src;
+    utf_convert::simd::u32_to_u8(src, end, dst, dst_end, endian);
+    stats.kernel(kernel_begin, src, end);
+
+    // The bytes written could alias dst itself, so the encoder works on a copy
+    // that stays in a register.
+    const uint8_t *        u32str = reinterpret_cast<const uint8_t *>(src);
+    char *                 out    = dst;
+    size_t                 pos    = 0;
+    utf_convert::UTF_ERROR res;
+    if (endian == little) {
+        res = convert_u32str_to_u8str_without_bom<little>(
+            u32str, end - src, pos, out, dst_end);
+    } else {
+        res = convert_u32str_to_u8str_without_bom<big>(
+            u32str, end - src, pos, out, dst_end);
+    }
+    src += pos;
+    dst = out;
+    return stats.finish(res, src, dst);
+}
+
+bool convert_u32str_to_u8str(const char32_t *        u32str,
+                             size_t                  u32size,
+                             utf_convert::UTF_ENDIAN endian,
+                             std::string &           target) {
+    target.resize(utf_convert::utf8_length_from_utf32(u32str, u32size, endian));
+
+    const char32_t *src = u32str;
+    char *          dst = &target[0];
+    const utf_convert::UTF_ERROR res = convert_u32_to_u8(
+        src, u32str + u32size, endian, dst, dst + target.size());
+
+    target.resize(dst - &target[0]);
+    return res == utf_convert::UTF_ERROR_NONE;
+}
+
+template <utf_convert::UTF_ENDIAN endian>
+utf_convert::UTF_ERROR
+convert_u16str_to_u8str_without_bom(const uint8_t *u16str,
+                                    size_t         u16length,
+                                    size_t &       i,
+                                    char *&        dst,
+                                    char *         dst_end) {
+    for (; i < u16length; i++) {
         const uint8_t *cur = u16str + i * (sizeof(char16_t) / sizeof(uint8_t));
-        uint16_t       value = get_u16_endian_value(cur, endian);
+        const uint16_t value = load_u16<endian>(cur);
 
         if (value < 0x80) {
-            target.push_back(value);
+            // A run of ascii goes on a word at a time, the loop steps past
+            // the last unit.
+            if (u16length - i >= 4 && dst_end - dst >= 4 &&
+                is_ascii_word(cur, u16_ascii_mask[endian])) {
+                narrow_ascii<endian>(cur, sizeof(char16_t), 4, dst);
+                dst += 4;
+                i += 3;
+                continue;
+            }
+
+            if (dst_end - dst < 1)
+                return utf_convert::UTF_ERROR_OUTPUT_TOO_SMALL;
+
+            *dst++ = value;
         } else if (value < 0x0800) {
-            target.push_back((value >> 6) & 0x1f | 0xc0);
-            target.push_back(value & 0x3f | 0x80);
+            if (dst_end - dst < 2)
+                return utf_convert::UTF_ERROR_OUTPUT_TOO_SMALL;
+
+            *dst++ = ((value >> 6) & 0x1f) | 0xc0;
+            *dst++ = (value & 0x3f) | 0x80;
         } else if (value >= 0xd800 && value < 0xdc00) {
             // 0x00010000 ~ 0x001fffff: 1111 0xxx 10xx xxxx 10xx xxxx 10xx xxxx
             if (i + 1 >= u16length) {
-                return false;  // surrogate pair requires two utf-16 characters.
+                // surrogate pair requires two utf-16 characters.
+                return utf_convert::UTF_ERROR_INVALID_SEQUENCE;
             }
 
             uint32_t high = value;
-            i++;
-            cur          = u16str + i * (sizeof(char16_t) / sizeof(uint8_t));
-            uint32_t low = get_u16_endian_value(cur, endian);
+            cur = u16str + (i + 1) * (sizeof(char16_t) / sizeof(uint8_t));
+            uint32_t low = load_u16<endian>(cur);
 
             if (low < 0xdc00) {
-                return false;  // Invalid surrogate pair
+                // Invalid surrogate pair
+                return utf_convert::UTF_ERROR_INVALID_SEQUENCE;
             }
 
+            if (dst_end - dst < 4)
+                return utf_convert::UTF_ERROR_OUTPUT_TOO_SMALL;
+
+            i++;
+
             uint32_t code_point = high - 0xd800;
             code_point <<= 10;
             code_point |= (low - 0xdc00);
             code_point += 0x10000;
 
-            target.push_back((code_point >> 18) | 0xf0);
-            target.push_back(((code_point >> 12) & 0x3f) | 0x80);
-            target.push_back(((code_point >> 6) & 0x3f) | 0x80);
-            target.push_back((code_point & 0x3f) | 0x80);
+            *dst++ = (code_point >> 18) | 0xf0;
+            *dst++ = ((code_point >> 12) & 0x3f) | 0x80;
+            *dst++ = ((code_point >> 6) & 0x3f) | 0x80;
+            *dst++ = (code_point & 0x3f) | 0x80;
         } else {
-            target.push_back((value >> 12) & 0x0f | 0xe0);
-            target.push_back((value >> 6) & 0x3f | 0x80);
-            target.push_back(value & 0x3f | 0x80);
+            if (dst_end - dst < 3)
+                return utf_convert::UTF_ERROR_OUTPUT_TOO_SMALL;
+
+            *dst++ = ((value >> 12) & 0x0f) | 0xe0;
+            *dst++ = ((value >> 6) & 0x3f) | 0x80;
+            *dst++ = (value & 0x3f) | 0x80;
         }
     }
-    return true;
+    return utf_convert::UTF_ERROR_NONE;
+}
+
+/*!
+ * Convert a utf-16 string without BOM into a buffer, the same way as
+ * convert_u32_to_u8.
+ */
+utf_convert::UTF_ERROR convert_u16_to_u8(const char16_t *&       src,
+                                         const char16_t *        end,
+                                         utf_convert::UTF_ENDIAN endian,
+                                         char *&                 dst,
+                                         char *                  dst_end) {
+    run_stats<char16_t, char> stats(
+        utf_convert::UTF_CONVERSION_UTF16_TO_UTF8, src, dst);
+    if (!is_supported_endian(endian))
+        return stats.finish(
+            utf_convert::UTF_ERROR_UNSUPPORTED_ENDIAN, src, dst);
+
+    const char16_t *kernel_begin = src;
+    utf_convert::simd::u16_to_u8(src, end, dst, dst_end, endian);
+    stats.kernel(kernel_begin, src, end);
+
+    // The bytes written could alias dst itself, so the encoder works on a copy
+    // that stays in a register.
+    const uint8_t *        u16str = reinterpret_cast<const uint8_t *>(src);
+    char *                 out    = dst;
+    size_t                 pos    = 0;
+    utf_convert::UTF_ERROR res;
+    if (endian == little) {
+        res = convert_u16str_to_u8str_without_bom<little>(
+            u16str, end - src, pos, out, dst_end);
+    } else {
+        res = convert_u16str_to_u8str_without_bom<big>(
+            u16str, end - src, pos, out, dst_end);
+    }
+    src += pos;
+    dst = out;
+    return stats.finish(res, src, dst);
+}
+
+bool convert_u16str_to_u8str(const char16_t *        u16str,
+                             size_t                  u16length,
+                             utf_convert::UTF_ENDIAN endian,
+                             std::string &           target) {
+    target.resize(
+        utf_convert::utf8_length_from_utf16(u16str, u16length, endian));
+
+    const char16_t *src = u16str;
+    char *          dst = &target[0];
+    const utf_convert::UTF_ERROR res = convert_u16_to_u8(
+        src, u16str + u16length, endian, dst, dst + target.size());
+
+    target.resize(dst - &target[0]);
+    return res == utf_convert::UTF_ERROR_NONE;
 }
 
 inline char32_t get_u32_str_bom(utf_convert::UTF_ENDIAN endian) {
@@ -181,191 +471,753 @@ inline bool match_u16_bom(char16_t bom, utf_convert::UTF_ENDIAN endian) {
         return false;
 }
 
-bool convert_u8str_to_u32str_little_endian(const std::string &u8str,
-                                           std::u32string &   target) {
-    utf32_character u32;
+/*!
+ * Read the sequence starting at u8str[i] by its lead byte. Continuation bytes
+ * are not checked, and lead bytes from 0xf8 on are read as 0xf0 ~ 0xf7.
+ *
+ *   0ABC DEFG                                -> 0ABC DEFG
+ *   110A BCDE 10FG HIJK                      -> 0ABC DEFG HIJK
+ *   1110 ABCD 10EF GHIJ 10KL MNOP            -> ABCD EFGH IJKL MNOP
+ *   1111 0ABC 10DE FGHI 10JK LMNO 10PQ RSTU  -> A BCDE FGHI JKLM NOPQ RSTU
+ *
+ * @param[out] value the character read.
+ * @return length of the sequence, or 0 if the lead byte is a continuation
+ * byte or the sequence is cut by the end of the string.
+ */
+inline size_t read_u8_sequence(const char *u8str,
+                               size_t      u8size,
+                               size_t      i,
+                               uint32_t &  value) {
+    const uint8_t lead = u8str[i];
 
-    for (size_t i = 0; i < u8str.size();) {
-        u32.ch = 0;
+    if ((lead & 0xf0) == 0xf0) {
+        if (i + 3 >= u8size)
+            return 0;
 
-        if ((u8str[i] & 0xf0) == 0xf0) {
-            /*
-             * +-----------------------------------------------+
-             * |                     UTF-8                     |
-             * +-----------+-----------+-----------+-----------+
-             * | 1111 0ABC | 10DE FGHI | 10JK LMNO | 10PQ RSTU |
-             * +-----------+-----------+-----------+-----------+
-             *
-             * The utf-32 character is
-             * 0000 0000 000A BCDE FGHI JKLM NOPQ RSTU
-             */
+        value = ((lead & 0x07) << 18) | ((u8str[i + 1] & 0x3f) << 12) |
+                ((u8str[i + 2] & 0x3f) << 6) | (u8str[i + 3] & 0x3f);
+        return 4;
+    } else if ((lead & 0xe0) == 0xe0) {
+        if (i + 2 >= u8size)
+            return 0;
+
+        value = ((lead & 0x0f) << 12) | ((u8str[i + 1] & 0x3f) << 6) |
+                (u8str[i + 2] & 0x3f);
+        return 3;
+    } else if ((lead & 0xc0) == 0xc0) {
+        if (i + 1 >= u8size)
+            return 0;
 
-            if (i + 3 >= u8str.size())
-                return false;
+        value = ((lead & 0x1f) << 6) | (u8str[i + 1] & 0x3f);
+        return 2;
+    } else if (lead < 0x80) {
+        value = lead;
+        return 1;
+    }
+    return 0;
+}
 
-            u32.v[3] = 0;
-            u32.v[2] = ((u8str[i] & 0x07) << 2) | ((u8str[i + 1] & 0x30) >> 4);
-            u32.v[1] =
-                ((u8str[i + 1] & 0x0f) << 4) | ((u8str[i + 2] & 0x3c) >> 2);
-            u32.v[0] = ((u8str[i + 2] & 0x03) << 6) | ((u8str[i + 3] & 0x3f));
+/*!
+ * Check whether the ascii fast path can take the word at u8str[i], with room
+ * code units left in the output.
+ */
+inline bool
+is_ascii_run(const char *u8str, size_t u8size, size_t i, size_t room) {
+    return static_cast<uint8_t>(u8str[i]) < 0x80 &&
+           u8size - i >= ascii_word_size && room >= ascii_word_size &&
+           is_ascii_word(u8str + i, u8_ascii_mask);
+}
 
-            target.push_back(u32.ch);
-            i += 4;
-        } else if ((u8str[i] & 0xe0) == 0xe0) {
-            /*
-             * +-----------------------------------+
-             * |               UTF-8               |
-             * +-----------+-----------+-----------+
-             * | 1110 ABCD | 10EF GHIJ | 10KL MNOP |
-             * +-----------+-----------+-----------+
-             *
-             * The utf-32 character is
-             * 0000 0000 0000 0000 ABCD EFGH IJKL MNOP
-             */
+template <utf_convert::UTF_ENDIAN endian>
+utf_convert::UTF_ERROR convert_u8str_to_u32str(const char *u8str,
+                                               size_t      u8size,
+                                               size_t &    i,
+                                               char32_t *& dst,
+                                               char32_t *  dst_end) {
+    while (i < u8size) {
+        if (dst == dst_end)
+            return utf_convert::UTF_ERROR_OUTPUT_TOO_SMALL;
 
-            if (i + 2 >= u8str.size())
-                return false;
+        // Runs of ascii go a word at a time.
+        if (is_ascii_run(u8str, u8size, i, dst_end - dst)) {
+            widen_ascii<endian>(u8str + i, ascii_word_size, dst);
+            dst += ascii_word_size;
+            i += ascii_word_size;
+            continue;
+        }
 
-            u32.v[3] = 0;
-            u32.v[2] = 0;
-            u32.v[1] = ((u8str[i] & 0x0f) << 4) | ((u8str[i + 1] & 0x3c) >> 2);
-            u32.v[0] = ((u8str[i + 1] & 0x03) << 6) | ((u8str[i + 2] & 0x3f));
+        uint32_t     value;
+        const size_t length = read_u8_sequence(u8str, u8size, i, value);
+        if (length == 0)
+            return utf_convert::UTF_ERROR_INVALID_SEQUENCE;
 
-            target.push_back(u32.ch);
-            i += 3;
-        } else if ((u8str[i] & 0xc0) == 0xc0) {
-            /*
-             * +-----------------------+
-             * |         UTF-8         |
-             * +-----------------------+
-             * | 110A BCDE | 10FG HIJK |
-             * +-----------------------+
-             *
-             * The utf-32 character is
-             * 0000 0000 0000 0000 0000 0ABC DEFG HIJK
-             */
+        *dst++ = make_u32<endian>(value);
+        i += length;
+    }
+    return utf_convert::UTF_ERROR_NONE;
+}
 
-            if (i + 1 >= u8str.size())
-                return false;
+/*!
+ * Convert a utf-8 string into a utf-32 buffer without BOM, the same way as
+ * convert_u32_to_u8.
+ */
+utf_convert::UTF_ERROR convert_u8_to_u32(const char *&           src,
+                                         const char *            end,
+                                         utf_convert::UTF_ENDIAN endian,
+                                         char32_t *&             dst,
+                                         char32_t *              dst_end) {
+    run_stats<char, char32_t> stats(
+        utf_convert::UTF_CONVERSION_UTF8_TO_UTF32, src, dst);
+    if (!is_supported_endian(endian))
+        return stats.finish(
+            utf_convert::UTF_ERROR_UNSUPPORTED_ENDIAN, src, dst);
 
-            u32.v[3] = 0;
-            u32.v[2] = 0;
-            u32.v[1] = ((u8str[i] & 0x1c) >> 2);
-            u32.v[0] = ((u8str[i] & 0x03) << 6) | (u8str[i + 1] & 0x3f);
+    const char *   kernel_begin = src;
+    const uint8_t *cur          = reinterpret_cast<const uint8_t *>(src);
+    utf_convert::simd::u8_to_u32(cur,
+                                 reinterpret_cast<const uint8_t *>(end),
+                                 dst,
+                                 dst_end,
+                                 endian);
+    src = reinterpret_cast<const char *>(cur);
+    stats.kernel(kernel_begin, src, end);
 
-            target.push_back(u32.ch);
-            i += 2;
-        } else if ((u8str[i] & 0x7f) == u8str[i]) {
-            u32.v[3] = u32.v[2] = u32.v[1] = 0;
-            u32.v[0]                       = u8str[i];
+    size_t                 pos = 0;
+    utf_convert::UTF_ERROR res;
+    if (endian == little) {
+        res = convert_u8str_to_u32str<little>(
+            src, end - src, pos, dst, dst_end);
+    } else {
+        res = convert_u8str_to_u32str<big>(src, end - src, pos, dst, dst_end);
+    }
+    src += pos;
+    return stats.finish(res, src, dst);
+}
 
-            target.push_back(u32.ch);
-            i += 1;
-        } else {
-            return false;
+inline char16_t get_u16_str_bom(utf_convert::UTF_ENDIAN endian) {
+    return is_supported_endian(endian) ? make_u16_endian_value(0xfeff, endian)
+                                       : 0;
+}
+
+/*!
+ * Write a character as one utf-16 unit, or as a surrogate pair from 0x10000
+ * on. The character must be below 0x110000.
+ */
+template <utf_convert::UTF_ENDIAN endian>
+utf_convert::UTF_ERROR
+put_u16_code_point(uint32_t value, char16_t *&dst, char16_t *dst_end) {
+    if (value < 0x10000) {
+        if (dst == dst_end)
+            return utf_convert::UTF_ERROR_OUTPUT_TOO_SMALL;
+
+        *dst++ = make_u16<endian>(value);
+    } else {
+        /*
+         * +-----------------------------------------+
+         * |          UTF-32 minus 0x10000           |
+         * | 0000 0000 0000 ABCD EFGH IJKL MNOP QRST |
+         * +-----------------------------------------+
+         * The high surrogate is 1101 10AB CDEF GHIJ
+         * The low surrogate is 1101 11KL MNOP QRST
+         */
+        if (dst_end - dst < 2)
+            return utf_convert::UTF_ERROR_OUTPUT_TOO_SMALL;
+
+        value -= 0x10000;
+        *dst++ = make_u16<endian>(0xd800 | (value >> 10));
+        *dst++ = make_u16<endian>(0xdc00 | (value & 0x3ff));
+    }
+    return utf_convert::UTF_ERROR_NONE;
+}
+
+template <utf_convert::UTF_ENDIAN endian>
+utf_convert::UTF_ERROR convert_u8str_to_u16str(const char *u8str,
+                                               size_t      u8size,
+                                               size_t &    i,
+                                               char16_t *& dst,
+                                               char16_t *  dst_end) {
+    while (i < u8size) {
+        // Runs of ascii go a word at a time.
+        if (is_ascii_run(u8str, u8size, i, dst_end - dst)) {
+            widen_ascii<endian>(u8str + i, ascii_word_size, dst);
+            dst += ascii_word_size;
+            i += ascii_word_size;
+            continue;
         }
+
+        uint32_t     value;
+        const size_t length = read_u8_sequence(u8str, u8size, i, value);
+        if (length == 0 || value >= 0x110000)
+            return utf_convert::UTF_ERROR_INVALID_SEQUENCE;
+
+        const utf_convert::UTF_ERROR res =
+            put_u16_code_point<endian>(value, dst, dst_end);
+        if (res != utf_convert::UTF_ERROR_NONE)
+            return res;
+
+        i += length;
     }
-    return true;
+    return utf_convert::UTF_ERROR_NONE;
 }
 
-bool convert_u8str_to_u32str_big_endian(const std::string &u8str,
-                                        std::u32string &   target) {
-    utf32_character u32;
+template <utf_convert::UTF_ENDIAN src_endian,
+          utf_convert::UTF_ENDIAN dst_endian>
+utf_convert::UTF_ERROR convert_u16str_to_u32str(const uint8_t *u16str,
+                                                size_t         u16length,
+                                                size_t &       i,
+                                                char32_t *&    dst,
+                                                char32_t *     dst_end) {
+    for (; i < u16length; i++) {
+        if (dst == dst_end)
+            return utf_convert::UTF_ERROR_OUTPUT_TOO_SMALL;
 
-    for (size_t i = 0; i < u8str.size();) {
-        u32.ch = 0;
+        const uint8_t *cur = u16str + i * (sizeof(char16_t) / sizeof(uint8_t));
+        uint32_t       value = load_u16<src_endian>(cur);
 
-        if ((u8str[i] & 0xf0) == 0xf0) {
-            /*
-             * +-----------------------------------------------+
-             * |                     UTF-8                     |
-             * +-----------+-----------+-----------+-----------+
-             * | 1111 0ABC | 10DE FGHI | 10JK LMNO | 10PQ RSTU |
-             * +-----------+-----------+-----------+-----------+
-             *
-             * The utf-32 character is
-             * 0000 0000 000A BCDE FGHI JKLM NOPQ RSTU
-             */
+        // Surrogate pairs are accepted like convert_u16str_to_u8str_without_bom.
+        if (value >= 0xd800 && value < 0xdc00) {
+            if (i + 1 >= u16length)
+                return utf_convert::UTF_ERROR_INVALID_SEQUENCE;
 
-            if (i + 3 >= u8str.size())
-                return false;
+            const uint32_t low =
+                load_u16<src_endian>(cur + sizeof(char16_t) / sizeof(uint8_t));
+            if (low < 0xdc00)
+                return utf_convert::UTF_ERROR_INVALID_SEQUENCE;
 
-            u32.v[0] = 0;
-            u32.v[1] = ((u8str[i] & 0x07) << 2) | ((u8str[i + 1] & 0x30) >> 4);
-            u32.v[2] =
-                ((u8str[i + 1] & 0x0f) << 4) | ((u8str[i + 2] & 0x3c) >> 2);
-            u32.v[3] = ((u8str[i + 2] & 0x03) << 6) | ((u8str[i + 3] & 0x3f));
+            value -= 0xd800;
+            value <<= 10;
+            value |= (low - 0xdc00);
+            value += 0x10000;
+            i++;
+        }
 
-            target.push_back(u32.ch);
-            i += 4;
-        } else if ((u8str[i] & 0xe0) == 0xe0) {
-            /*
-             * +-----------------------------------+
-             * |               UTF-8               |
-             * +-----------+-----------+-----------+
-             * | 1110 ABCD | 10EF GHIJ | 10KL MNOP |
-             * +-----------+-----------+-----------+
-             *
-             * The utf-32 character is
-             * 0000 0000 0000 0000 ABCD EFGH IJKL MNOP
-             */
+        *dst++ = make_u32<dst_endian>(value);
+    }
+    return utf_convert::UTF_ERROR_NONE;
+}
 
-            if (i + 2 >= u8str.size())
-                return false;
+template <utf_convert::UTF_ENDIAN src_endian,
+          utf_convert::UTF_ENDIAN dst_endian>
+utf_convert::UTF_ERROR convert_u32str_to_u16str(const uint8_t *u32str,
+                                                size_t         u32size,
+                                                size_t &       i,
+                                                char16_t *&    dst,
+                                                char16_t *     dst_end) {
+    for (; i < u32size; i++) {
+        const uint32_t value = load_u32<src_endian>(
+            u32str + i * (sizeof(char32_t) / sizeof(uint8_t)));
 
-            u32.v[0] = 0;
-            u32.v[1] = 0;
-            u32.v[2] = ((u8str[i] & 0x0f) << 4) | ((u8str[i + 1] & 0x3c) >> 2);
-            u32.v[3] = ((u8str[i + 1] & 0x03) << 6) | ((u8str[i + 2] & 0x3f));
+        if (value >= 0x110000)
+            return utf_convert::UTF_ERROR_INVALID_SEQUENCE;
 
-            target.push_back(u32.ch);
-            i += 3;
-        } else if ((u8str[i] & 0xc0) == 0xc0) {
-            /*
-             * +-----------------------+
-             * |         UTF-8         |
-             * +-----------------------+
-             * | 110A BCDE | 10FG HIJK |
-             * +-----------------------+
-             *
-             * The utf-32 character is
-             * 0000 0000 0000 0000 0000 0ABC DEFG HIJK
-             */
+        const utf_convert::UTF_ERROR res =
+            put_u16_code_point<dst_endian>(value, dst, dst_end);
+        if (res != utf_convert::UTF_ERROR_NONE)
+            return res;
+    }
+    return utf_convert::UTF_ERROR_NONE;
+}
 
-            if (i + 1 >= u8str.size())
-                return false;
+/*!
+ * Convert a utf-8 string into a utf-16 buffer without BOM, the same way as
+ * convert_u32_to_u8.
+ */
+utf_convert::UTF_ERROR convert_u8_to_u16(const char *&           src,
+                                         const char *            end,
+                                         utf_convert::UTF_ENDIAN endian,
+                                         char16_t *&             dst,
+                                         char16_t *              dst_end) {
+    run_stats<char, char16_t> stats(
+        utf_convert::UTF_CONVERSION_UTF8_TO_UTF16, src, dst);
+    if (!is_supported_endian(endian))
+        return stats.finish(
+            utf_convert::UTF_ERROR_UNSUPPORTED_ENDIAN, src, dst);
 
-            u32.v[0] = 0;
-            u32.v[1] = 0;
-            u32.v[2] = ((u8str[i] & 0x1c) >> 2);
-            u32.v[3] = ((u8str[i] & 0x03) << 6) | (u8str[i + 1] & 0x3f);
+    const char *   kernel_begin = src;
+    const uint8_t *cur          = reinterpret_cast<const uint8_t *>(src);
+    utf_convert::simd::u8_to_u16(cur,
+                                 reinterpret_cast<const uint8_t *>(end),
+                                 dst,
+                                 dst_end,
+                                 endian);
+    src = reinterpret_cast<const char *>(cur);
+    stats.kernel(kernel_begin, src, end);
 
-            target.push_back(u32.ch);
-            i += 2;
-        } else if ((u8str[i] & 0x7f) == u8str[i]) {
-            u32.v[0] = u32.v[1] = u32.v[2] = 0;
-            u32.v[3]                       = u8str[i];
+    size_t                 pos = 0;
+    utf_convert::UTF_ERROR res;
+    if (endian == little) {
+        res = convert_u8str_to_u16str<little>(
+            src, end - src, pos, dst, dst_end);
+    } else {
+        res = convert_u8str_to_u16str<big>(src, end - src, pos, dst, dst_end);
+    }
+    src += pos;
+    return stats.finish(res, src, dst);
+}
 
-            target.push_back(u32.ch);
-            i += 1;
-        } else {
-            return false;
+/*!
+ * Convert a utf-16 string without BOM into a utf-32 buffer without BOM, the
+ * same way as convert_u32_to_u8.
+ */
+utf_convert::UTF_ERROR convert_u16_to_u32(const char16_t *&       src,
+                                          const char16_t *        end,
+                                          utf_convert::UTF_ENDIAN src_endian,
+                                          utf_convert::UTF_ENDIAN dst_endian,
+                                          char32_t *&             dst,
+                                          char32_t *              dst_end) {
+    run_stats<char16_t, char32_t> stats(
+        utf_convert::UTF_CONVERSION_UTF16_TO_UTF32, src, dst);
+    if (!is_supported_endian(src_endian) || !is_supported_endian(dst_endian))
+        return stats.finish(
+            utf_convert::UTF_ERROR_UNSUPPORTED_ENDIAN, src, dst);
+
+    const char16_t *kernel_begin = src;
+    utf_convert::simd::u16_to_u32(
+        src, end, dst, dst_end, src_endian, dst_endian);
+    stats.kernel(kernel_begin, src, end);
+
+    const uint8_t *        u16str = reinterpret_cast<const uint8_t *>(src);
+    size_t                 pos    = 0;
+    utf_convert::UTF_ERROR res;
+    if (src_endian == little && dst_endian == little) {
+        res = convert_u16str_to_u32str<little, little>(
+            u16str, end - src, pos, dst, dst_end);
+    } else if (src_endian == little) {
+        res = convert_u16str_to_u32str<little, big>(
+            u16str, end - src, pos, dst, dst_end);
+    } else if (dst_endian == little) {
+        res = convert_u16str_to_u32str<big, little>(
+            u16str, end - src, pos, dst, dst_end);
+    } else {
+        res = convert_u16str_to_u32str<big, big>(
+            u16str, end - src, pos, dst, dst_end);
+    }
+    src += pos;
+    return stats.finish(res, src, dst);
+}
+
+/*!
+ * Convert a utf-32 string without BOM into a utf-16 buffer without BOM, the
+ * same way as convert_u32_to_u8.
+ */
+utf_convert::UTF_ERROR convert_u32_to_u16(const char32_t *&       src,
+                                          const char32_t *        end,
+                                          utf_convert::UTF_ENDIAN src_endian,
+                                          utf_convert::UTF_ENDIAN dst_endian,
+                                          char16_t *&             dst,
+                                          char16_t *              dst_end) {
+    run_stats<char32_t, char16_t> stats(
+        utf_convert::UTF_CONVERSION_UTF32_TO_UTF16, src, dst);
+    if (!is_supported_endian(src_endian) || !is_supported_endian(dst_endian))
+        return stats.finish(
+            utf_convert::UTF_ERROR_UNSUPPORTED_ENDIAN, src, dst);
+
+    const char32_t *kernel_begin = src;
+    utf_convert::simd::u32_to_u16(
+        src, end, dst, dst_end, src_endian, dst_endian);
+    stats.kernel(kernel_begin, src, end);
+
+    const uint8_t *        u32str = reinterpret_cast<const uint8_t *>(src);
+    size_t                 pos    = 0;
+    utf_convert::UTF_ERROR res;
+    if (src_endian == little && dst_endian == little) {
+        res = convert_u32str_to_u16str<little, little>(
+            u32str, end - src, pos, dst, dst_end);
+    } else if (src_endian == little) {
+        res = convert_u32str_to_u16str<little, big>(
+            u32str, end - src, pos, dst, dst_end);
+    } else if (dst_endian == little) {
+        res = convert_u32str_to_u16str<big, little>(
+            u32str, end - src, pos, dst, dst_end);
+    } else {
+        res = convert_u32str_to_u16str<big, big>(
+            u32str, end - src, pos, dst, dst_end);
+    }
+    src += pos;
+    return stats.finish(res, src, dst);
+}
+
+/*!
+ * Build the result of a buffer conversion from where it stopped.
+ */
+inline utf_convert::result make_result(utf_convert::UTF_ERROR error,
+                                       size_t                 read,
+                                       size_t                 written) {
+    utf_convert::result res;
+    res.error = error;
+    res.count = error == utf_convert::UTF_ERROR_NONE ? written : read;
+    return res;
+}
+
+/*!
+ * Code units validated at a time by the strict converters, few enough to be
+ * still in cache when they are converted.
+ */
+const size_t strict_block_size = 4096;
+
+/*!
+ * Get the length of the maximal subpart of the ill-formed utf-8 sequence at
+ * s, which is replaced by a single U+FFFD: the lead byte and the continuation
+ * bytes after it which could still be part of a well-formed sequence, or just
+ * the byte itself if it can not start one.
+ */
+size_t u8_maximal_subpart(const char *s, size_t length) {
+    const uint8_t lead = s[0];
+    size_t        size;
+    uint8_t       low  = 0x80;  // Range of the second byte.
+    uint8_t       high = 0xbf;
+    if (lead >= 0xc2 && lead <= 0xdf) {
+        size = 2;
+    } else if (lead >= 0xe0 && lead <= 0xef) {
+        size = 3;
+        low  = lead == 0xe0 ? 0xa0 : 0x80;
+        high = lead == 0xed ? 0x9f : 0xbf;
+    } else if (lead >= 0xf0 && lead <= 0xf4) {
+        size = 4;
+        low  = lead == 0xf0 ? 0x90 : 0x80;
+        high = lead == 0xf4 ? 0x8f : 0xbf;
+    } else {
+        return 1;
+    }
+
+    size_t i = 1;
+    for (; i < size && i < length; i++) {
+        const uint8_t c = s[i];
+        if (c < low || c > high)
+            break;
+        low  = 0x80;
+        high = 0xbf;
+    }
+    return i;
+}
+
+/*
+ * Validation of the strict and replacing converters. is_boundary tells
+ * whether a block may end before s, which is when no well-formed sequence goes
+ * across s. invalid_length gives the number of code units replaced by one
+ * U+FFFD at an ill-formed sequence.
+ */
+struct u8_checker {
+    utf_convert::result validate(const char *s, size_t length) const {
+        return utf_convert::validate_utf8(s, length);
+    }
+
+    bool is_boundary(const char *s) const { return (*s & 0xc0) != 0x80; }
+
+    size_t invalid_length(const char *s, size_t length) const {
+        return u8_maximal_subpart(s, length);
+    }
+};
+
+struct u16_checker {
+    explicit u16_checker(utf_convert::UTF_ENDIAN endian) : endian(endian) {}
+
+    utf_convert::result validate(const char16_t *s, size_t length) const {
+        return utf_convert::validate_utf16(s, length, endian);
+    }
+
+    bool is_boundary(const char16_t *s) const {
+        const uint16_t prev = get_u16_endian_value(
+            reinterpret_cast<const uint8_t *>(s - 1), endian);
+        return (prev & 0xfc00) != 0xd800;
+    }
+
+    size_t invalid_length(const char16_t *, size_t) const { return 1; }
+
+    utf_convert::UTF_ENDIAN endian;
+};
+
+struct u32_checker {
+    explicit u32_checker(utf_convert::UTF_ENDIAN endian) : endian(endian) {}
+
+    utf_convert::result validate(const char32_t *s, size_t length) const {
+        return utf_convert::validate_utf32(s, length, endian);
+    }
+
+    bool is_boundary(const char32_t *) const { return true; }
+
+    size_t invalid_length(const char32_t *, size_t) const { return 1; }
+
+    utf_convert::UTF_ENDIAN endian;
+};
+
+/*
+ * U+FFFD in each output encoding, for the replacing converters.
+ */
+struct replacement {
+    explicit replacement(utf_convert::UTF_ENDIAN endian)
+        : u16(make_u16_endian_value(0xfffd, endian)),
+          u32(make_u32_endian_value(0xfffd, endian)) {}
+
+    const char *units(const char *) const { return "\xef\xbf\xbd"; }
+    const char16_t *units(const char16_t *) const { return &u16; }
+    const char32_t *units(const char32_t *) const { return &u32; }
+
+    static size_t size(const char *) { return 3; }
+    static size_t size(const char16_t *) { return 1; }
+    static size_t size(const char32_t *) { return 1; }
+
+    char16_t u16;
+    char32_t u32;
+};
+
+/*!
+ * Convert like convert(src, end, dst, dst_end) does, but stop at the first
+ * ill-formed sequence, or with UTF_MODE_REPLACE write the units of fffd for
+ * it and go on.
+ * The input is validated a block at a time right before the block is
+ * converted, and the blocks never cut a well-formed sequence, so the errors
+ * are the same as for the whole input and the well-formed parts still go
+ * through the vectorized kernels.
+ */
+template <typename In,
+          typename Out,
+          typename Replacement,
+          typename Checker,
+          typename Convert>
+utf_convert::UTF_ERROR
+convert_strict(utf_convert::UTF_CONVERSION conversion,
+               const In *&                 src,
+               const In *                  end,
+               Out *&                      dst,
+               Out *                       dst_end,
+               utf_convert::UTF_MODE       mode,
+               const Replacement &         fffd,
+               const Checker &             checker,
+               const Convert &             convert) {
+    while (src < end) {
+        const In *block_end = size_t(end - src) > strict_block_size
+                                  ? src + strict_block_size
+                                  : end;
+        while (block_end < end && !checker.is_boundary(block_end)) {
+            block_end++;
         }
+
+        const utf_convert::result valid =
+            checker.validate(src, block_end - src);
+        const bool failed = valid.error != utf_convert::UTF_ERROR_NONE;
+        const utf_convert::UTF_ERROR res =
+            convert(src, failed ? src + valid.count : block_end, dst, dst_end);
+        if (res != utf_convert::UTF_ERROR_NONE)
+            return res;
+        if (!failed)
+            continue;
+        if (valid.error == utf_convert::UTF_ERROR_INVALID_SEQUENCE)
+            utf_convert::stats_detail::record_invalid(conversion);
+        if (mode != utf_convert::UTF_MODE_REPLACE ||
+            valid.error != utf_convert::UTF_ERROR_INVALID_SEQUENCE)
+            return valid.error;
+
+        const size_t size = fffd.size(dst);
+        if (size_t(dst_end - dst) < size)
+            return utf_convert::UTF_ERROR_OUTPUT_TOO_SMALL;
+        std::memcpy(dst, fffd.units(dst), size * sizeof(Out));
+        dst += size;
+        src += checker.invalid_length(src, end - src);
+    }
+    return utf_convert::UTF_ERROR_NONE;
+}
+
+/*!
+ * Whether the character is changed by the fold, and by how much: the Latin-1
+ * capitals are 0x20 below their small letters like the ASCII ones.
+ */
+inline bool is_folded(uint32_t value, utf_convert::UTF_FOLD fold) {
+    if (value - 'A' < 26)
+        return true;
+    return fold == utf_convert::UTF_FOLD_LATIN1 && value - 0xc0 < 0x1f &&
+           value != 0xd7;
+}
+
+/*!
+ * Fold the case of the characters in [begin, end) in place, which must start
+ * at a character. The vectorized kernel folds most of them.
+ */
+void fold_case(char *                  begin,
+               char *                  end,
+               utf_convert::UTF_ENDIAN,
+               utf_convert::UTF_FOLD   fold) {
+    char *s = begin;
+    utf_convert::simd::fold_u8(s, end, fold);
+
+    for (; s < end; s++) {
+        const uint8_t c     = *s;
+        uint32_t      value = c;
+        // Only the second byte of 0xc3 0x80 ~ 0xc3 0x9e changes.
+        if (c >= 0x80)
+            value = s > begin && uint8_t(s[-1]) == 0xc3 ? c + 0x40 : 0;
+        if (is_folded(value, fold))
+            *s = static_cast<char>(c + 0x20);
     }
-    return true;
+}
+
+void fold_case(char16_t *              begin,
+               char16_t *              end,
+               utf_convert::UTF_ENDIAN endian,
+               utf_convert::UTF_FOLD   fold) {
+    char16_t *s = begin;
+    utf_convert::simd::fold_u16(s, end, endian, fold);
+
+    for (; s < end; s++) {
+        const uint16_t value =
+            get_u16_endian_value(reinterpret_cast<const uint8_t *>(s), endian);
+        if (is_folded(value, fold))
+            *s = make_u16_endian_value(value + 0x20, endian);
+    }
+}
+
+void fold_case(char32_t *              begin,
+               char32_t *              end,
+               utf_convert::UTF_ENDIAN endian,
+               utf_convert::UTF_FOLD   fold) {
+    char32_t *s = begin;
+    utf_convert::simd::fold_u32(s, end, endian, fold);
+
+    for (; s < end; s++) {
+        const uint32_t value =
+            get_u32_endian_value(reinterpret_cast<const uint8_t *>(s), endian);
+        if (is_folded(value, fold))
+            *s = make_u32_endian_value(value + 0x20, endian);
+    }
+}
+
+/*!
+ * A converter which folds the case of what convert wrote right after it, so
+ * the output is folded while it is still in cache.
+ */
+template <typename Convert>
+struct folding {
+    folding(const Convert &         convert,
+            utf_convert::UTF_ENDIAN endian,
+            utf_convert::UTF_FOLD   fold)
+        : convert(convert), endian(endian), fold(fold) {}
+
+    template <typename In, typename Out>
+    utf_convert::UTF_ERROR
+    operator()(const In *&src, const In *end, Out *&dst, Out *dst_end) const {
+        Out *const                   begin = dst;
+        const utf_convert::UTF_ERROR res   = convert(src, end, dst, dst_end);
+        fold_case(begin, dst, endian, fold);
+        return res;
+    }
+
+    const Convert &         convert;
+    utf_convert::UTF_ENDIAN endian;
+    utf_convert::UTF_FOLD   fold;
+};
+
+/*!
+ * Convert like convert(src, end, dst, dst_end) does, a block at a time, cut
+ * where checker.is_boundary allows like for convert_strict.
+ */
+template <typename In, typename Out, typename Checker, typename Convert>
+utf_convert::UTF_ERROR convert_in_blocks(const In *&    src,
+                                         const In *     end,
+                                         Out *&         dst,
+                                         Out *          dst_end,
+                                         const Checker &checker,
+                                         const Convert &convert) {
+    while (src < end) {
+        const In *block_end = size_t(end - src) > strict_block_size
+                                  ? src + strict_block_size
+                                  : end;
+        while (block_end < end && !checker.is_boundary(block_end)) {
+            block_end++;
+        }
+
+        const utf_convert::UTF_ERROR res =
+            convert(src, block_end, dst, dst_end);
+        if (res != utf_convert::UTF_ERROR_NONE)
+            return res;
+    }
+    return utf_convert::UTF_ERROR_NONE;
+}
+
+/*!
+ * Convert with the handling of ill-formed input given by mode and the case
+ * folding given by fold, as the buffer API does for anything but a lenient
+ * conversion without folding. out_endian is the endian of the output, for
+ * U+FFFD and the folding.
+ */
+template <typename In, typename Out, typename Checker, typename Convert>
+utf_convert::UTF_ERROR convert_in_mode(utf_convert::UTF_CONVERSION conversion,
+                                       const In *&                 src,
+                                       const In *                  end,
+                                       Out *&                      dst,
+                                       Out *                       dst_end,
+                                       utf_convert::UTF_MODE       mode,
+                                       utf_convert::UTF_FOLD       fold,
+                                       utf_convert::UTF_ENDIAN     out_endian,
+                                       const Checker &             checker,
+                                       const Convert &             convert) {
+    const replacement fffd(out_endian);
+    if (fold == utf_convert::UTF_FOLD_NONE)
+        return convert_strict(
+            conversion, src, end, dst, dst_end, mode, fffd, checker, convert);
+
+    const folding<Convert> folded(convert, out_endian, fold);
+    if (mode == utf_convert::UTF_MODE_LENIENT)
+        return convert_in_blocks(src, end, dst, dst_end, checker, folded);
+    return convert_strict(
+        conversion, src, end, dst, dst_end, mode, fffd, checker, folded);
+}
+
+/*!
+ * Convert with the handling of ill-formed input given by mode, as the buffer
+ * API does.
+ */
+utf_convert::UTF_ERROR convert_u32_to_u8_in_mode(const char32_t *&       src,
+                                                 const char32_t *        end,
+                                                 utf_convert::UTF_ENDIAN endian,
+                                                 utf_convert::UTF_MODE   mode,
+                                                 char *&                 dst,
+                                                 char *                  dst_end) {
+    if (mode == utf_convert::UTF_MODE_LENIENT)
+        return convert_u32_to_u8(src, end, endian, dst, dst_end);
+
+    return convert_strict(
+        utf_convert::UTF_CONVERSION_UTF32_TO_UTF8,
+        src, end, dst, dst_end, mode, replacement(endian), u32_checker(endian),
+        [=](const char32_t *&s, const char32_t *e, char *&d, char *d_end) {
+            return convert_u32_to_u8(s, e, endian, d, d_end);
+        });
+}
+
+utf_convert::UTF_ERROR convert_u16_to_u8_in_mode(const char16_t *&       src,
+                                                 const char16_t *        end,
+                                                 utf_convert::UTF_ENDIAN endian,
+                                                 utf_convert::UTF_MODE   mode,
+                                                 char *&                 dst,
+                                                 char *                  dst_end) {
+    if (mode == utf_convert::UTF_MODE_LENIENT)
+        return convert_u16_to_u8(src, end, endian, dst, dst_end);
+
+    return convert_strict(
+        utf_convert::UTF_CONVERSION_UTF16_TO_UTF8,
+        src, end, dst, dst_end, mode, replacement(endian), u16_checker(endian),
+        [=](const char16_t *&s, const char16_t *e, char *&d, char *d_end) {
+            return convert_u16_to_u8(s, e, endian, d, d_end);
+        });
 }
 }  // namespace
 
+/*
+ * The strict, replacing and folding conversions go through the buffer API,
+ * by way of the templates for any allocator, named with their arguments so
+ * the overloads here are not picked again.
+ */
 bool utf_convert::to_u8string(const std::u32string &u32str_without_bom,
                               UTF_ENDIAN            u32str_endian,
-                              std::string &         target) {
-    target.clear();
-
-    return convert_u32str_to_u8str_without_bom(
-        reinterpret_cast<const uint8_t *>(u32str_without_bom.data()),
-        u32str_without_bom.size(),
-        u32str_endian,
-        target);
+                              std::string &         target,
+                              UTF_MODE              mode,
+                              UTF_FOLD              fold) {
+    if (mode != UTF_MODE_LENIENT || fold != UTF_FOLD_NONE)
+        return to_u8string<std::allocator<char32_t>, std::allocator<char> >(
+            u32str_without_bom, u32str_endian, target, mode, fold);
+    return convert_u32str_to_u8str(u32str_without_bom.data(),
+                                   u32str_without_bom.size(),
+                                   u32str_endian,
+                                   target);
 }
 
 bool utf_convert::to_u8string(const std::u32string &u32str_with_bom,
@@ -375,25 +1227,20 @@ bool utf_convert::to_u8string(const std::u32string &u32str_with_bom,
 
     target.clear();
 
-    const uint8_t *u32str_ptr =
-        reinterpret_cast<const uint8_t *>(u32str_with_bom.data());
-
     if (match_u32_bom(u32str_with_bom[0], utf_convert::UTF_ENDIAN_BIG_ENDIAN)) {
         // Big endian
-        return convert_u32str_to_u8str_without_bom(
-            u32str_ptr + 4,
-            u32str_with_bom.size() - 1,
-            utf_convert::UTF_ENDIAN_BIG_ENDIAN,
-            target);
+        return convert_u32str_to_u8str(u32str_with_bom.data() + 1,
+                                       u32str_with_bom.size() - 1,
+                                       utf_convert::UTF_ENDIAN_BIG_ENDIAN,
+                                       target);
 
     } else if (match_u32_bom(u32str_with_bom[0],
                              utf_convert::UTF_ENDIAN_LITTLE_ENDIAN)) {
         // Little endian
-        return convert_u32str_to_u8str_without_bom(
-            u32str_ptr + 4,
-            u32str_with_bom.size() - 1,
-            utf_convert::UTF_ENDIAN_LITTLE_ENDIAN,
-            target);
+        return convert_u32str_to_u8str(u32str_with_bom.data() + 1,
+                                       u32str_with_bom.size() - 1,
+                                       utf_convert::UTF_ENDIAN_LITTLE_ENDIAN,
+                                       target);
     } else {
         return false;  // Unknown bom
     }
@@ -401,13 +1248,14 @@ bool utf_convert::to_u8string(const std::u32string &u32str_with_bom,
 
 bool utf_convert::to_u8string(const std::u16string &u16str,
                               UTF_ENDIAN            u16str_endian,
-                              std::string &         target) {
-    target.clear();
-    return convert_u16str_to_u8str_without_bom(
-        reinterpret_cast<const uint8_t *>(u16str.data()),
-        u16str.size(),
-        u16str_endian,
-        target);
+                              std::string &         target,
+                              UTF_MODE              mode,
+                              UTF_FOLD              fold) {
+    if (mode != UTF_MODE_LENIENT || fold != UTF_FOLD_NONE)
+        return to_u8string<std::allocator<char16_t>, std::allocator<char> >(
+            u16str, u16str_endian, target, mode, fold);
+    return convert_u16str_to_u8str(
+        u16str.data(), u16str.size(), u16str_endian, target);
 }
 
 bool utf_convert::to_u8string(const std::u16string &u16str_with_bom,
@@ -416,22 +1264,18 @@ bool utf_convert::to_u8string(const std::u16string &u16str_with_bom,
         return false;
 
     target.clear();
-    const uint8_t *u16str_ptr =
-        reinterpret_cast<const uint8_t *>(u16str_with_bom.data()) + 2;
-
-    if (match_u16_bom(u16str_with_bom[1], utf_convert::UTF_ENDIAN_BIG_ENDIAN)) {
-        return convert_u16str_to_u8str_without_bom(
-            u16str_ptr,
-            u16str_with_bom.size() - 1,
-            utf_convert::UTF_ENDIAN_BIG_ENDIAN,
-            target);
-    } else if (match_u16_bom(u16str_with_bom[1],
+
+    if (match_u16_bom(u16str_with_bom[0], utf_convert::UTF_ENDIAN_BIG_ENDIAN)) {
+        return convert_u16str_to_u8str(u16str_with_bom.data() + 1,
+                                       u16str_with_bom.size() - 1,
+                                       utf_convert::UTF_ENDIAN_BIG_ENDIAN,
+                                       target);
+    } else if (match_u16_bom(u16str_with_bom[0],
                              utf_convert::UTF_ENDIAN_LITTLE_ENDIAN)) {
-        return convert_u16str_to_u8str_without_bom(
-            u16str_ptr,
-            u16str_with_bom.size() - 1,
-            utf_convert::UTF_ENDIAN_LITTLE_ENDIAN,
-            target);
+        return convert_u16str_to_u8str(u16str_with_bom.data() + 1,
+                                       u16str_with_bom.size() - 1,
+                                       utf_convert::UTF_ENDIAN_LITTLE_ENDIAN,
+                                       target);
     } else {
         return false;
     }
@@ -440,15 +1284,1503 @@ bool utf_convert::to_u8string(const std::u16string &u16str_with_bom,
 bool utf_convert::to_u32string(const std::string &u8str,
                                std::u32string &   target,
                                UTF_ENDIAN         target_endian,
-                               bool               add_bom) {
-    target.clear();
+                               bool               add_bom,
+                               UTF_MODE           mode,
+                               UTF_FOLD           fold) {
+    if (mode != UTF_MODE_LENIENT || fold != UTF_FOLD_NONE)
+        return to_u32string<std::allocator<char>, std::allocator<char32_t> >(
+            u8str, target, target_endian, add_bom, mode, fold);
+
+    target.resize((add_bom ? 1 : 0) +
+                  utf32_length_from_utf8(u8str.data(), u8str.size()));
+
+    char32_t *dst = &target[0];
     if (add_bom) {
-        target.push_back(get_u32_str_bom(target_endian));
+        *dst++ = get_u32_str_bom(target_endian);
     }
 
-    if (target_endian == UTF_ENDIAN_LITTLE_ENDIAN) {
-        return convert_u8str_to_u32str_little_endian(u8str, target);
-    } else {
-        return convert_u8str_to_u32str_big_endian(u8str, target);
+    const char *    src = u8str.data();
+    const UTF_ERROR res = convert_u8_to_u32(src,
+                                            src + u8str.size(),
+                                            target_endian,
+                                            dst,
+                                            &target[0] + target.size());
+
+    target.resize(dst - &target[0]);
+    return res == UTF_ERROR_NONE;
+}
+
+bool utf_convert::to_u16string(const std::string &u8str,
+                               std::u16string &   target,
+                               UTF_ENDIAN         target_endian,
+                               bool               add_bom,
+                               UTF_MODE           mode,
+                               UTF_FOLD           fold) {
+    if (mode != UTF_MODE_LENIENT || fold != UTF_FOLD_NONE)
+        return to_u16string<std::allocator<char>, std::allocator<char16_t> >(
+            u8str, target, target_endian, add_bom, mode, fold);
+
+    target.resize((add_bom ? 1 : 0) +
+                  utf16_length_from_utf8(u8str.data(), u8str.size()));
+
+    char16_t *dst = &target[0];
+    if (add_bom) {
+        *dst++ = get_u16_str_bom(target_endian);
+    }
+
+    const char *    src = u8str.data();
+    const UTF_ERROR res = convert_u8_to_u16(src,
+                                            src + u8str.size(),
+                                            target_endian,
+                                            dst,
+                                            &target[0] + target.size());
+
+    target.resize(dst - &target[0]);
+    return res == UTF_ERROR_NONE;
+}
+
+bool utf_convert::to_u16string(const std::u32string &u32str,
+                               UTF_ENDIAN            u32str_endian,
+                               std::u16string &      target,
+                               UTF_ENDIAN            target_endian,
+                               bool                  add_bom,
+                               UTF_MODE              mode,
+                               UTF_FOLD              fold) {
+    if (mode != UTF_MODE_LENIENT || fold != UTF_FOLD_NONE)
+        return to_u16string<std::allocator<char32_t>,
+                            std::allocator<char16_t> >(
+            u32str, u32str_endian, target, target_endian, add_bom, mode,
+            fold);
+
+    target.resize(
+        (add_bom ? 1 : 0) +
+        utf16_length_from_utf32(u32str.data(), u32str.size(), u32str_endian));
+
+    char16_t *dst = &target[0];
+    if (add_bom) {
+        *dst++ = get_u16_str_bom(target_endian);
+    }
+
+    const char32_t *src = u32str.data();
+    const UTF_ERROR res = convert_u32_to_u16(src,
+                                             src + u32str.size(),
+                                             u32str_endian,
+                                             target_endian,
+                                             dst,
+                                             &target[0] + target.size());
+
+    target.resize(dst - &target[0]);
+    return res == UTF_ERROR_NONE;
+}
+
+bool utf_convert::to_u32string(const std::u16string &u16str,
+                               UTF_ENDIAN            u16str_endian,
+                               std::u32string &      target,
+                               UTF_ENDIAN            target_endian,
+                               bool                  add_bom,
+                               UTF_MODE              mode,
+                               UTF_FOLD              fold) {
+    if (mode != UTF_MODE_LENIENT || fold != UTF_FOLD_NONE)
+        return to_u32string<std::allocator<char16_t>,
+                            std::allocator<char32_t> >(
+            u16str, u16str_endian, target, target_endian, add_bom, mode,
+            fold);
+
+    target.resize(
+        (add_bom ? 1 : 0) +
+        utf32_length_from_utf16(u16str.data(), u16str.size(), u16str_endian));
+
+    char32_t *dst = &target[0];
+    if (add_bom) {
+        *dst++ = get_u32_str_bom(target_endian);
     }
+
+    const char16_t *src = u16str.data();
+    const UTF_ERROR res = convert_u16_to_u32(src,
+                                             src + u16str.size(),
+                                             u16str_endian,
+                                             target_endian,
+                                             dst,
+                                             &target[0] + target.size());
+
+    target.resize(dst - &target[0]);
+    return res == UTF_ERROR_NONE;
+}
+
+utf_convert::result utf_convert::convert_utf32_to_utf8(const char32_t *in,
+                                                       size_t          n,
+                                                       char *          out,
+                                                       size_t          cap,
+                                                       UTF_ENDIAN      endian,
+                                                       UTF_MODE        mode,
+                                                       UTF_FOLD        fold) {
+    const char32_t *src = in;
+    char *          dst = out;
+    UTF_ERROR       res;
+    if (mode != UTF_MODE_LENIENT || fold != UTF_FOLD_NONE) {
+        res = convert_in_mode(
+            UTF_CONVERSION_UTF32_TO_UTF8,
+            src, in + n, dst, out + cap, mode, fold, endian,
+            u32_checker(endian),
+            [=](const char32_t *&s, const char32_t *e, char *&d, char *d_end) {
+                return convert_u32_to_u8(s, e, endian, d, d_end);
+            });
+    } else {
+        res = convert_u32_to_u8(src, in + n, endian, dst, out + cap);
+    }
+    return make_result(res, src - in, dst - out);
+}
+
+utf_convert::result utf_convert::convert_utf16_to_utf8(const char16_t *in,
+                                                       size_t          n,
+                                                       char *          out,
+                                                       size_t          cap,
+                                                       UTF_ENDIAN      endian,
+                                                       UTF_MODE        mode,
+                                                       UTF_FOLD        fold) {
+    const char16_t *src = in;
+    char *          dst = out;
+    UTF_ERROR       res;
+    if (mode != UTF_MODE_LENIENT || fold != UTF_FOLD_NONE) {
+        res = convert_in_mode(
+            UTF_CONVERSION_UTF16_TO_UTF8,
+            src, in + n, dst, out + cap, mode, fold, endian,
+            u16_checker(endian),
+            [=](const char16_t *&s, const char16_t *e, char *&d, char *d_end) {
+                return convert_u16_to_u8(s, e, endian, d, d_end);
+            });
+    } else {
+        res = convert_u16_to_u8(src, in + n, endian, dst, out + cap);
+    }
+    return make_result(res, src - in, dst - out);
+}
+
+utf_convert::result utf_convert::convert_utf8_to_utf32(const char *in,
+                                                       size_t      n,
+                                                       char32_t *  out,
+                                                       size_t      cap,
+                                                       UTF_ENDIAN  endian,
+                                                       UTF_MODE    mode,
+                                                       UTF_FOLD    fold) {
+    const char *src = in;
+    char32_t *  dst = out;
+    UTF_ERROR   res;
+    if (mode != UTF_MODE_LENIENT || fold != UTF_FOLD_NONE) {
+        res = convert_in_mode(
+            UTF_CONVERSION_UTF8_TO_UTF32,
+            src, in + n, dst, out + cap, mode, fold, endian, u8_checker(),
+            [=](const char *&s, const char *e, char32_t *&d, char32_t *d_end) {
+                return convert_u8_to_u32(s, e, endian, d, d_end);
+            });
+    } else {
+        res = convert_u8_to_u32(src, in + n, endian, dst, out + cap);
+    }
+    return make_result(res, src - in, dst - out);
+}
+
+utf_convert::result utf_convert::convert_utf8_to_utf16(const char *in,
+                                                       size_t      n,
+                                                       char16_t *  out,
+                                                       size_t      cap,
+                                                       UTF_ENDIAN  endian,
+                                                       UTF_MODE    mode,
+                                                       UTF_FOLD    fold) {
+    const char *src = in;
+    char16_t *  dst = out;
+    UTF_ERROR   res;
+    if (mode != UTF_MODE_LENIENT || fold != UTF_FOLD_NONE) {
+        res = convert_in_mode(
+            UTF_CONVERSION_UTF8_TO_UTF16,
+            src, in + n, dst, out + cap, mode, fold, endian, u8_checker(),
+            [=](const char *&s, const char *e, char16_t *&d, char16_t *d_end) {
+                return convert_u8_to_u16(s, e, endian, d, d_end);
+            });
+    } else {
+        res = convert_u8_to_u16(src, in + n, endian, dst, out + cap);
+    }
+    return make_result(res, src - in, dst - out);
+}
+
+utf_convert::result utf_convert::convert_utf16_to_utf32(const char16_t *in,
+                                                        size_t          n,
+                                                        char32_t *      out,
+                                                        size_t          cap,
+                                                        UTF_ENDIAN in_endian,
+                                                        UTF_ENDIAN out_endian,
+                                                        UTF_MODE   mode,
+                                                        UTF_FOLD   fold) {
+    const char16_t *src = in;
+    char32_t *      dst = out;
+    UTF_ERROR       res;
+    if (mode != UTF_MODE_LENIENT || fold != UTF_FOLD_NONE) {
+        res = convert_in_mode(UTF_CONVERSION_UTF16_TO_UTF32,
+                              src, in + n, dst, out + cap, mode, fold,
+                              out_endian, u16_checker(in_endian),
+                              [=](const char16_t *&s, const char16_t *e,
+                                  char32_t *&d, char32_t *d_end) {
+                                  return convert_u16_to_u32(
+                                      s, e, in_endian, out_endian, d, d_end);
+                              });
+    } else {
+        res = convert_u16_to_u32(
+            src, in + n, in_endian, out_endian, dst, out + cap);
+    }
+    return make_result(res, src - in, dst - out);
+}
+
+utf_convert::result utf_convert::convert_utf32_to_utf16(const char32_t *in,
+                                                        size_t          n,
+                                                        char16_t *      out,
+                                                        size_t          cap,
+                                                        UTF_ENDIAN in_endian,
+                                                        UTF_ENDIAN out_endian,
+                                                        UTF_MODE   mode,
+                                                        UTF_FOLD   fold) {
+    const char32_t *src = in;
+    char16_t *      dst = out;
+    UTF_ERROR       res;
+    if (mode != UTF_MODE_LENIENT || fold != UTF_FOLD_NONE) {
+        res = convert_in_mode(UTF_CONVERSION_UTF32_TO_UTF16,
+                              src, in + n, dst, out + cap, mode, fold,
+                              out_endian, u32_checker(in_endian),
+                              [=](const char32_t *&s, const char32_t *e,
+                                  char16_t *&d, char16_t *d_end) {
+                                  return convert_u32_to_u16(
+                                      s, e, in_endian, out_endian, d, d_end);
+                              });
+    } else {
+        res = convert_u32_to_u16(
+            src, in + n, in_endian, out_endian, dst, out + cap);
+    }
+    return make_result(res, src - in, dst - out);
+}
+
+size_t utf_convert::utf8_length_from_utf32(const char32_t *u32str,
+                                           size_t          length,
+                                           UTF_ENDIAN      u32str_endian) {
+    const char32_t *src   = u32str;
+    const char32_t *end   = u32str + length;
+    size_t          count = 0;
+    if (is_supported_endian(u32str_endian))
+        count = simd::utf8_length_from_utf32(src, end, u32str_endian);
+
+    for (; src < end; src++) {
+        const uint32_t value = get_u32_endian_value(
+            reinterpret_cast<const uint8_t *>(src), u32str_endian);
+
+        if (value < 0x80)
+            count += 1;
+        else if (value < 0x0800)
+            count += 2;
+        else if (value < 0x010000)
+            count += 3;
+        else
+            count += 4;
+    }
+    return count;
+}
+
+size_t utf_convert::utf8_length_from_utf16(const char16_t *u16str,
+                                           size_t          length,
+                                           UTF_ENDIAN      u16str_endian) {
+    const char16_t *src   = u16str;
+    const char16_t *end   = u16str + length;
+    size_t          count = 0;
+    if (is_supported_endian(u16str_endian))
+        count = simd::utf8_length_from_utf16(src, end, u16str_endian);
+
+    // A low surrogate after a high one ends a four-byte pair.
+    bool after_high = false;
+    if (src > u16str) {
+        const uint16_t prev = get_u16_endian_value(
+            reinterpret_cast<const uint8_t *>(src - 1), u16str_endian);
+        after_high = prev >= 0xd800 && prev < 0xdc00;
+    }
+
+    for (; src < end; src++) {
+        const uint16_t value = get_u16_endian_value(
+            reinterpret_cast<const uint8_t *>(src), u16str_endian);
+
+        if (value < 0x80)
+            count += 1;
+        else if (value < 0x0800)
+            count += 2;
+        else if (value >= 0xd800 && value < 0xdc00)
+            count += 2;
+        else if (value >= 0xdc00 && value < 0xe000 && after_high)
+            count += 2;
+        else
+            count += 3;
+
+        after_high = value >= 0xd800 && value < 0xdc00;
+    }
+    return count;
+}
+
+size_t utf_convert::utf32_length_from_utf8(const char *u8str, size_t length) {
+    const uint8_t *src   = reinterpret_cast<const uint8_t *>(u8str);
+    const uint8_t *end   = src + length;
+    size_t         count = simd::utf32_length_from_utf8(src, end);
+
+    for (; src < end; src++) {
+        if ((*src & 0xc0) != 0x80)
+            count++;
+    }
+    return count;
+}
+
+size_t utf_convert::utf16_length_from_utf8(const char *u8str, size_t length) {
+    const uint8_t *src   = reinterpret_cast<const uint8_t *>(u8str);
+    const uint8_t *end   = src + length;
+    size_t         count = simd::utf16_length_from_utf8(src, end);
+
+    for (; src < end; src++) {
+        if ((*src & 0xc0) != 0x80)
+            count++;
+        if (*src >= 0xf0)
+            count++;
+    }
+    return count;
+}
+
+size_t utf_convert::utf32_length_from_utf16(const char16_t *u16str,
+                                            size_t          length,
+                                            UTF_ENDIAN      u16str_endian) {
+    const char16_t *src   = u16str;
+    const char16_t *end   = u16str + length;
+    size_t          count = 0;
+    if (is_supported_endian(u16str_endian))
+        count = simd::utf32_length_from_utf16(src, end, u16str_endian);
+
+    bool after_high = false;
+    if (src > u16str) {
+        const uint16_t prev = get_u16_endian_value(
+            reinterpret_cast<const uint8_t *>(src - 1), u16str_endian);
+        after_high = prev >= 0xd800 && prev < 0xdc00;
+    }
+
+    for (; src < end; src++) {
+        const uint16_t value = get_u16_endian_value(
+            reinterpret_cast<const uint8_t *>(src), u16str_endian);
+
+        if (!(value >= 0xdc00 && value < 0xe000 && after_high))
+            count++;
+
+        after_high = value >= 0xd800 && value < 0xdc00;
+    }
+    return count;
+}
+
+size_t utf_convert::utf16_length_from_utf32(const char32_t *u32str,
+                                            size_t          length,
+                                            UTF_ENDIAN      u32str_endian) {
+    const char32_t *src   = u32str;
+    const char32_t *end   = u32str + length;
+    size_t          count = 0;
+    if (is_supported_endian(u32str_endian))
+        count = simd::utf16_length_from_utf32(src, end, u32str_endian);
+
+    for (; src < end; src++) {
+        const uint32_t value = get_u32_endian_value(
+            reinterpret_cast<const uint8_t *>(src), u32str_endian);
+
+        count += value < 0x10000 ? 1 : 2;
+    }
+    return count;
+}
+
+utf_convert::result utf_convert::validate_utf8(const char *u8str,
+                                               size_t      length) {
+    const uint8_t *begin = reinterpret_cast<const uint8_t *>(u8str);
+    const uint8_t *src   = begin;
+    const uint8_t *end   = begin + length;
+    simd::validate_utf8(src, end);
+
+    while (src < end) {
+        const uint8_t lead = *src;
+        if (lead < 0x80) {
+            src++;
+            continue;
+        }
+
+        size_t   size;
+        uint32_t min_value;
+        if ((lead & 0xe0) == 0xc0) {
+            size      = 2;
+            min_value = 0x80;
+        } else if ((lead & 0xf0) == 0xe0) {
+            size      = 3;
+            min_value = 0x800;
+        } else if ((lead & 0xf8) == 0xf0) {
+            size      = 4;
+            min_value = 0x10000;
+        } else {
+            return make_result(UTF_ERROR_INVALID_SEQUENCE, src - begin, 0);
+        }
+
+        if (size_t(end - src) < size)
+            return make_result(UTF_ERROR_INVALID_SEQUENCE, src - begin, 0);
+
+        uint32_t value = lead & (0x7f >> size);
+        for (size_t i = 1; i < size; i++) {
+            if ((src[i] & 0xc0) != 0x80)
+                return make_result(UTF_ERROR_INVALID_SEQUENCE, src - begin, 0);
+            value = (value << 6) | (src[i] & 0x3f);
+        }
+
+        if (value < min_value || value > 0x10ffff ||
+            (value >= 0xd800 && value < 0xe000))
+            return make_result(UTF_ERROR_INVALID_SEQUENCE, src - begin, 0);
+        src += size;
+    }
+    return make_result(UTF_ERROR_NONE, length, length);
+}
+
+utf_convert::result utf_convert::validate_utf16(const char16_t *u16str,
+                                                size_t          length,
+                                                UTF_ENDIAN      u16str_endian) {
+    if (!is_supported_endian(u16str_endian))
+        return make_result(UTF_ERROR_UNSUPPORTED_ENDIAN, 0, 0);
+
+    const char16_t *src = u16str;
+    const char16_t *end = u16str + length;
+    simd::validate_utf16(src, end, u16str_endian);
+
+    while (src < end) {
+        const uint16_t value = get_u16_endian_value(
+            reinterpret_cast<const uint8_t *>(src), u16str_endian);
+        if ((value & 0xf800) != 0xd800) {
+            src++;
+            continue;
+        }
+
+        // A high surrogate followed by a low one.
+        if (value >= 0xdc00 || end - src < 2 ||
+            (get_u16_endian_value(reinterpret_cast<const uint8_t *>(src + 1),
+                                  u16str_endian) &
+             0xfc00) != 0xdc00)
+            return make_result(UTF_ERROR_INVALID_SEQUENCE, src - u16str, 0);
+        src += 2;
+    }
+    return make_result(UTF_ERROR_NONE, length, length);
+}
+
+utf_convert::result utf_convert::validate_utf32(const char32_t *u32str,
+                                                size_t          length,
+                                                UTF_ENDIAN      u32str_endian) {
+    if (!is_supported_endian(u32str_endian))
+        return make_result(UTF_ERROR_UNSUPPORTED_ENDIAN, 0, 0);
+
+    const char32_t *src = u32str;
+    const char32_t *end = u32str + length;
+    simd::validate_utf32(src, end, u32str_endian);
+
+    for (; src < end; src++) {
+        const uint32_t value = get_u32_endian_value(
+            reinterpret_cast<const uint8_t *>(src), u32str_endian);
+        if (value > 0x10ffff || (value >= 0xd800 && value < 0xe000))
+            return make_result(UTF_ERROR_INVALID_SEQUENCE, src - u32str, 0);
+    }
+    return make_result(UTF_ERROR_NONE, length, length);
+}
+
+bool utf_convert::is_ascii(const char *str, size_t length) {
+    const uint8_t *src = reinterpret_cast<const uint8_t *>(str);
+    const uint8_t *end = src + length;
+    simd::ascii_prefix(src, end);
+
+    for (; size_t(end - src) >= ascii_word_size; src += ascii_word_size) {
+        if (!is_ascii_word(src, u8_ascii_mask))
+            return false;
+    }
+    for (; src < end; src++) {
+        if (*src >= 0x80)
+            return false;
+    }
+    return true;
+}
+
+void utf_convert::swap_endian_inplace(char16_t *str, size_t length) {
+    char16_t *const end = str + length;
+    simd::swap_u16(str, end);
+
+    for (; str < end; str++) {
+        const uint16_t unit = *str;
+        *str = static_cast<char16_t>((unit >> 8) | (unit << 8));
+    }
+}
+
+void utf_convert::swap_endian_inplace(char32_t *str, size_t length) {
+    char32_t *const end = str + length;
+    simd::swap_u32(str, end);
+
+    for (; str < end; str++) {
+        const uint32_t unit = *str;
+        *str = static_cast<char32_t>((unit >> 24) | ((unit >> 8) & 0xff00) |
+                                     ((unit << 8) & 0xff0000) | (unit << 24));
+    }
+}
+
+void utf_convert::swap_endian_inplace(std::u16string &str) {
+    if (!str.empty())
+        swap_endian_inplace(&str[0], str.size());
+}
+
+void utf_convert::swap_endian_inplace(std::u32string &str) {
+    if (!str.empty())
+        swap_endian_inplace(&str[0], str.size());
+}
+
+namespace {
+/*
+ * Characters of the Windows-1252 bytes 0x80 ~ 0x9f. The five bytes which have
+ * none keep their C1 control like in Latin-1, as the WHATWG Encoding Standard
+ * does, so every byte decodes and encodes back to itself.
+ */
+const uint16_t cp1252_c1[32] = {
+    0x20ac, 0x0081, 0x201a, 0x0192, 0x201e, 0x2026, 0x2020, 0x2021,
+    0x02c6, 0x2030, 0x0160, 0x2039, 0x0152, 0x008d, 0x017d, 0x008f,
+    0x0090, 0x2018, 0x2019, 0x201c, 0x201d, 0x2022, 0x2013, 0x2014,
+    0x02dc, 0x2122, 0x0161, 0x203a, 0x0153, 0x009d, 0x017e, 0x0178};
+
+inline uint32_t decode_latin1(uint8_t byte, utf_convert::UTF_CHARSET charset) {
+    if (charset == utf_convert::UTF_CHARSET_WINDOWS_1252 && byte >= 0x80 &&
+        byte < 0xa0)
+        return cp1252_c1[byte - 0x80];
+    return byte;
+}
+
+/*!
+ * Encode a character to the byte of the character set which decodes to it.
+ *
+ * @return false, writing nothing, if the character set does not have it.
+ */
+inline bool
+encode_latin1(uint32_t value, utf_convert::UTF_CHARSET charset, char &byte) {
+    const bool cp1252 = charset == utf_convert::UTF_CHARSET_WINDOWS_1252;
+
+    if (value < 0x80 || (value >= 0xa0 && value < 0x100) ||
+        (value < 0x100 && !cp1252)) {
+        byte = static_cast<char>(value);
+        return true;
+    }
+    for (size_t k = 0; cp1252 && k < 32; k++) {
+        if (cp1252_c1[k] == value) {
+            byte = static_cast<char>(0x80 + k);
+            return true;
+        }
+    }
+    return false;
+}
+
+/*
+ * '?' for the characters the character set does not have, and for the
+ * ill-formed sequences in UTF_MODE_REPLACE.
+ */
+struct latin1_replacement {
+    const char *units(const char *) const { return "?"; }
+
+    static size_t size(const char *) { return 1; }
+};
+
+/*!
+ * Code units the scalar code converts after a Latin-1 kernel stops, before
+ * the kernel gets the rest. The kernels stop at whole registers the scalar
+ * code has to convert, such as the Windows-1252 punctuation, and are worth
+ * trying again after them.
+ */
+const size_t latin1_scalar_run = 64;
+
+/*!
+ * Convert like convert_u8_to_u32 with kernel(src, end, dst, dst_end), and
+ * with scalar(src, size, stop, i, dst, dst_end) from src[i] on. The scalar
+ * code stops at src[stop] unless a character goes across it. The run is
+ * counted as conversion in the statistics.
+ */
+template <typename In, typename Out, typename Kernel, typename Scalar>
+utf_convert::UTF_ERROR
+convert_latin1_runs(utf_convert::UTF_CONVERSION conversion,
+                    const In *&                 src,
+                    const In *                  end,
+                    Out *&                      dst,
+                    Out *                       dst_end,
+                    const Kernel &              kernel,
+                    const Scalar &              scalar) {
+    run_stats<In, Out>     stats(conversion, src, dst);
+    utf_convert::UTF_ERROR res = utf_convert::UTF_ERROR_NONE;
+
+    while (src < end && res == utf_convert::UTF_ERROR_NONE) {
+        const In *kernel_begin = src;
+        kernel(src, end, dst, dst_end);
+        stats.kernel(kernel_begin, src, end);
+
+        const size_t size = end - src;
+        size_t       pos  = 0;
+        res = scalar(src,
+                     size,
+                     size < latin1_scalar_run ? size : latin1_scalar_run,
+                     pos,
+                     dst,
+                     dst_end);
+        src += pos;
+    }
+    return stats.finish(res, src, dst);
+}
+
+utf_convert::UTF_ERROR
+convert_latin1str_to_u8str(const uint8_t *          str,
+                           size_t                   stop,
+                           size_t &                 i,
+                           char *&                  dst,
+                           char *                   dst_end,
+                           utf_convert::UTF_CHARSET charset) {
+    for (; i < stop; i++) {
+        const uint32_t value  = decode_latin1(str[i], charset);
+        const size_t   length = value < 0x80 ? 1 : value < 0x800 ? 2 : 3;
+        if (size_t(dst_end - dst) < length)
+            return utf_convert::UTF_ERROR_OUTPUT_TOO_SMALL;
+
+        if (length == 1) {
+            *dst++ = value;
+        } else if (length == 2) {
+            *dst++ = (value >> 6) | 0xc0;
+            *dst++ = (value & 0x3f) | 0x80;
+        } else {
+            *dst++ = (value >> 12) | 0xe0;
+            *dst++ = ((value >> 6) & 0x3f) | 0x80;
+            *dst++ = (value & 0x3f) | 0x80;
+        }
+    }
+    return utf_convert::UTF_ERROR_NONE;
+}
+
+template <utf_convert::UTF_ENDIAN endian>
+utf_convert::UTF_ERROR
+convert_latin1str_to_u16str(const uint8_t *          str,
+                            size_t                   stop,
+                            size_t &                 i,
+                            char16_t *&              dst,
+                            char16_t *               dst_end,
+                            utf_convert::UTF_CHARSET charset) {
+    for (; i < stop; i++) {
+        if (dst == dst_end)
+            return utf_convert::UTF_ERROR_OUTPUT_TOO_SMALL;
+        *dst++ = make_u16<endian>(decode_latin1(str[i], charset));
+    }
+    return utf_convert::UTF_ERROR_NONE;
+}
+
+template <utf_convert::UTF_ENDIAN endian>
+utf_convert::UTF_ERROR
+convert_latin1str_to_u32str(const uint8_t *          str,
+                            size_t                   stop,
+                            size_t &                 i,
+                            char32_t *&              dst,
+                            char32_t *               dst_end,
+                            utf_convert::UTF_CHARSET charset) {
+    for (; i < stop; i++) {
+        if (dst == dst_end)
+            return utf_convert::UTF_ERROR_OUTPUT_TOO_SMALL;
+        *dst++ = make_u32<endian>(decode_latin1(str[i], charset));
+    }
+    return utf_convert::UTF_ERROR_NONE;
+}
+
+/*
+ * The encoders below write '?' for the characters the character set does not
+ * have if replace is set, and fail at them otherwise.
+ */
+utf_convert::UTF_ERROR
+convert_u8str_to_latin1str(const char *             u8str,
+                           size_t                   u8size,
+                           size_t                   stop,
+                           size_t &                 i,
+                           char *&                  dst,
+                           char *                   dst_end,
+                           utf_convert::UTF_CHARSET charset,
+                           bool                     replace) {
+    while (i < stop) {
+        if (dst == dst_end)
+            return utf_convert::UTF_ERROR_OUTPUT_TOO_SMALL;
+
+        uint32_t     value;
+        const size_t length = read_u8_sequence(u8str, u8size, i, value);
+        if (length == 0)
+            return utf_convert::UTF_ERROR_INVALID_SEQUENCE;
+
+        if (!encode_latin1(value, charset, *dst)) {
+            if (!replace)
+                return utf_convert::UTF_ERROR_INVALID_SEQUENCE;
+            *dst = '?';
+        }
+        dst++;
+        i += length;
+    }
+    return utf_convert::UTF_ERROR_NONE;
+}
+
+template <utf_convert::UTF_ENDIAN endian>
+utf_convert::UTF_ERROR
+convert_u16str_to_latin1str(const uint8_t *          u16str,
+                            size_t                   u16length,
+                            size_t                   stop,
+                            size_t &                 i,
+                            char *&                  dst,
+                            char *                   dst_end,
+                            utf_convert::UTF_CHARSET charset,
+                            bool                     replace) {
+    while (i < stop) {
+        if (dst == dst_end)
+            return utf_convert::UTF_ERROR_OUTPUT_TOO_SMALL;
+
+        const uint8_t *cur   = u16str + i * (sizeof(char16_t) / sizeof(uint8_t));
+        const uint16_t value = load_u16<endian>(cur);
+        size_t         length = 1;
+
+        if (!encode_latin1(value, charset, *dst)) {
+            if (!replace)
+                return utf_convert::UTF_ERROR_INVALID_SEQUENCE;
+
+            // A surrogate pair is a single character, replaced once.
+            if (value >= 0xd800 && value < 0xdc00 && i + 1 < u16length &&
+                (load_u16<endian>(cur + sizeof(char16_t)) & 0xfc00) == 0xdc00)
+                length = 2;
+            *dst = '?';
+        }
+        dst++;
+        i += length;
+    }
+    return utf_convert::UTF_ERROR_NONE;
+}
+
+template <utf_convert::UTF_ENDIAN endian>
+utf_convert::UTF_ERROR
+convert_u32str_to_latin1str(const uint8_t *          u32str,
+                            size_t                   stop,
+                            size_t &                 i,
+                            char *&                  dst,
+                            char *                   dst_end,
+                            utf_convert::UTF_CHARSET charset,
+                            bool                     replace) {
+    for (; i < stop; i++) {
+        if (dst == dst_end)
+            return utf_convert::UTF_ERROR_OUTPUT_TOO_SMALL;
+
+        const uint32_t value = load_u32<endian>(
+            u32str + i * (sizeof(char32_t) / sizeof(uint8_t)));
+        if (!encode_latin1(value, charset, *dst)) {
+            if (!replace)
+                return utf_convert::UTF_ERROR_INVALID_SEQUENCE;
+            *dst = '?';
+        }
+        dst++;
+    }
+    return utf_convert::UTF_ERROR_NONE;
+}
+
+utf_convert::UTF_ERROR convert_latin1_to_u8(const uint8_t *&         src,
+                                            const uint8_t *          end,
+                                            utf_convert::UTF_CHARSET charset,
+                                            char *&                  dst,
+                                            char *                   dst_end) {
+    return convert_latin1_runs(
+        utf_convert::UTF_CONVERSION_LATIN1_TO_UTF8, src, end, dst, dst_end,
+        [=](const uint8_t *&s, const uint8_t *e, char *&d, char *d_end) {
+            utf_convert::simd::latin1_to_u8(s, e, d, d_end, charset);
+        },
+        [=](const uint8_t *s, size_t, size_t stop, size_t &i, char *&d,
+            char *d_end) {
+            return convert_latin1str_to_u8str(s, stop, i, d, d_end, charset);
+        });
+}
+
+utf_convert::UTF_ERROR convert_latin1_to_u16(const uint8_t *&         src,
+                                             const uint8_t *          end,
+                                             utf_convert::UTF_ENDIAN  endian,
+                                             utf_convert::UTF_CHARSET charset,
+                                             char16_t *&              dst,
+                                             char16_t *               dst_end) {
+    if (!is_supported_endian(endian))
+        return utf_convert::UTF_ERROR_UNSUPPORTED_ENDIAN;
+
+    return convert_latin1_runs(
+        utf_convert::UTF_CONVERSION_LATIN1_TO_UTF16, src, end, dst, dst_end,
+        [=](const uint8_t *&s, const uint8_t *e, char16_t *&d,
+            char16_t *d_end) {
+            utf_convert::simd::latin1_to_u16(s, e, d, d_end, endian, charset);
+        },
+        [=](const uint8_t *s, size_t, size_t stop, size_t &i, char16_t *&d,
+            char16_t *d_end) {
+            return endian == little ? convert_latin1str_to_u16str<little>(
+                                          s, stop, i, d, d_end, charset)
+                                    : convert_latin1str_to_u16str<big>(
+                                          s, stop, i, d, d_end, charset);
+        });
+}
+
+utf_convert::UTF_ERROR convert_latin1_to_u32(const uint8_t *&         src,
+                                             const uint8_t *          end,
+                                             utf_convert::UTF_ENDIAN  endian,
+                                             utf_convert::UTF_CHARSET charset,
+                                             char32_t *&              dst,
+                                             char32_t *               dst_end) {
+    if (!is_supported_endian(endian))
+        return utf_convert::UTF_ERROR_UNSUPPORTED_ENDIAN;
+
+    return convert_latin1_runs(
+        utf_convert::UTF_CONVERSION_LATIN1_TO_UTF32, src, end, dst, dst_end,
+        [=](const uint8_t *&s, const uint8_t *e, char32_t *&d,
+            char32_t *d_end) {
+            utf_convert::simd::latin1_to_u32(s, e, d, d_end, endian, charset);
+        },
+        [=](const uint8_t *s, size_t, size_t stop, size_t &i, char32_t *&d,
+            char32_t *d_end) {
+            return endian == little ? convert_latin1str_to_u32str<little>(
+                                          s, stop, i, d, d_end, charset)
+                                    : convert_latin1str_to_u32str<big>(
+                                          s, stop, i, d, d_end, charset);
+        });
+}
+
+utf_convert::UTF_ERROR convert_u8_to_latin1(const char *&            src,
+                                            const char *             end,
+                                            utf_convert::UTF_CHARSET charset,
+                                            bool                     replace,
+                                            char *&                  dst,
+                                            char *                   dst_end) {
+    return convert_latin1_runs(
+        utf_convert::UTF_CONVERSION_UTF8_TO_LATIN1, src, end, dst, dst_end,
+        [=](const char *&s, const char *e, char *&d, char *d_end) {
+            const uint8_t *cur = reinterpret_cast<const uint8_t *>(s);
+            utf_convert::simd::u8_to_latin1(
+                cur, reinterpret_cast<const uint8_t *>(e), d, d_end, charset);
+            s = reinterpret_cast<const char *>(cur);
+        },
+        [=](const char *s, size_t size, size_t stop, size_t &i, char *&d,
+            char *d_end) {
+            return convert_u8str_to_latin1str(
+                s, size, stop, i, d, d_end, charset, replace);
+        });
+}
+
+utf_convert::UTF_ERROR convert_u16_to_latin1(const char16_t *&        src,
+                                             const char16_t *         end,
+                                             utf_convert::UTF_ENDIAN  endian,
+                                             utf_convert::UTF_CHARSET charset,
+                                             bool                     replace,
+                                             char *&                  dst,
+                                             char *                   dst_end) {
+    if (!is_supported_endian(endian))
+        return utf_convert::UTF_ERROR_UNSUPPORTED_ENDIAN;
+
+    return convert_latin1_runs(
+        utf_convert::UTF_CONVERSION_UTF16_TO_LATIN1, src, end, dst, dst_end,
+        [=](const char16_t *&s, const char16_t *e, char *&d, char *d_end) {
+            utf_convert::simd::u16_to_latin1(s, e, d, d_end, endian, charset);
+        },
+        [=](const char16_t *s, size_t size, size_t stop, size_t &i, char *&d,
+            char *d_end) {
+            const uint8_t *u16str = reinterpret_cast<const uint8_t *>(s);
+            return endian == little
+                       ? convert_u16str_to_latin1str<little>(
+                             u16str, size, stop, i, d, d_end, charset, replace)
+                       : convert_u16str_to_latin1str<big>(
+                             u16str, size, stop, i, d, d_end, charset, replace);
+        });
+}
+
+utf_convert::UTF_ERROR convert_u32_to_latin1(const char32_t *&        src,
+                                             const char32_t *         end,
+                                             utf_convert::UTF_ENDIAN  endian,
+                                             utf_convert::UTF_CHARSET charset,
+                                             bool                     replace,
+                                             char *&                  dst,
+                                             char *                   dst_end) {
+    if (!is_supported_endian(endian))
+        return utf_convert::UTF_ERROR_UNSUPPORTED_ENDIAN;
+
+    return convert_latin1_runs(
+        utf_convert::UTF_CONVERSION_UTF32_TO_LATIN1, src, end, dst, dst_end,
+        [=](const char32_t *&s, const char32_t *e, char *&d, char *d_end) {
+            utf_convert::simd::u32_to_latin1(s, e, d, d_end, endian, charset);
+        },
+        [=](const char32_t *s, size_t, size_t stop, size_t &i, char *&d,
+            char *d_end) {
+            const uint8_t *u32str = reinterpret_cast<const uint8_t *>(s);
+            return endian == little
+                       ? convert_u32str_to_latin1str<little>(
+                             u32str, stop, i, d, d_end, charset, replace)
+                       : convert_u32str_to_latin1str<big>(
+                             u32str, stop, i, d, d_end, charset, replace);
+        });
+}
+}  // namespace
+
+utf_convert::result utf_convert::convert_latin1_to_utf8(const char *in,
+                                                        size_t      n,
+                                                        char *      out,
+                                                        size_t      cap,
+                                                        UTF_CHARSET charset) {
+    const uint8_t *begin = reinterpret_cast<const uint8_t *>(in);
+    const uint8_t *src   = begin;
+    char *         dst   = out;
+    const UTF_ERROR res =
+        convert_latin1_to_u8(src, begin + n, charset, dst, out + cap);
+    return make_result(res, src - begin, dst - out);
+}
+
+utf_convert::result utf_convert::convert_latin1_to_utf16(const char *in,
+                                                         size_t      n,
+                                                         char16_t *  out,
+                                                         size_t      cap,
+                                                         UTF_ENDIAN  endian,
+                                                         UTF_CHARSET charset) {
+    const uint8_t *begin = reinterpret_cast<const uint8_t *>(in);
+    const uint8_t *src   = begin;
+    char16_t *     dst   = out;
+    const UTF_ERROR res  = convert_latin1_to_u16(
+        src, begin + n, endian, charset, dst, out + cap);
+    return make_result(res, src - begin, dst - out);
+}
+
+utf_convert::result utf_convert::convert_latin1_to_utf32(const char *in,
+                                                         size_t      n,
+                                                         char32_t *  out,
+                                                         size_t      cap,
+                                                         UTF_ENDIAN  endian,
+                                                         UTF_CHARSET charset) {
+    const uint8_t *begin = reinterpret_cast<const uint8_t *>(in);
+    const uint8_t *src   = begin;
+    char32_t *     dst   = out;
+    const UTF_ERROR res  = convert_latin1_to_u32(
+        src, begin + n, endian, charset, dst, out + cap);
+    return make_result(res, src - begin, dst - out);
+}
+
+utf_convert::result utf_convert::convert_utf8_to_latin1(const char *in,
+                                                        size_t      n,
+                                                        char *      out,
+                                                        size_t      cap,
+                                                        UTF_MODE    mode,
+                                                        UTF_CHARSET charset) {
+    const bool  replace = mode == UTF_MODE_REPLACE;
+    const char *src     = in;
+    char *      dst     = out;
+    UTF_ERROR   res;
+    if (mode != UTF_MODE_LENIENT) {
+        res = convert_strict(
+            UTF_CONVERSION_UTF8_TO_LATIN1,
+            src, in + n, dst, out + cap, mode, latin1_replacement(),
+            u8_checker(),
+            [=](const char *&s, const char *e, char *&d, char *d_end) {
+                return convert_u8_to_latin1(s, e, charset, replace, d, d_end);
+            });
+    } else {
+        res = convert_u8_to_latin1(src, in + n, charset, false, dst, out + cap);
+    }
+    return make_result(res, src - in, dst - out);
+}
+
+utf_convert::result utf_convert::convert_utf16_to_latin1(const char16_t *in,
+                                                         size_t          n,
+                                                         char *          out,
+                                                         size_t          cap,
+                                                         UTF_ENDIAN  endian,
+                                                         UTF_MODE    mode,
+                                                         UTF_CHARSET charset) {
+    const bool      replace = mode == UTF_MODE_REPLACE;
+    const char16_t *src     = in;
+    char *          dst     = out;
+    UTF_ERROR       res;
+    if (mode != UTF_MODE_LENIENT) {
+        res = convert_strict(UTF_CONVERSION_UTF16_TO_LATIN1,
+                             src, in + n, dst, out + cap, mode,
+                             latin1_replacement(), u16_checker(endian),
+                             [=](const char16_t *&s, const char16_t *e,
+                                 char *&d, char *d_end) {
+                                 return convert_u16_to_latin1(
+                                     s, e, endian, charset, replace, d, d_end);
+                             });
+    } else {
+        res = convert_u16_to_latin1(
+            src, in + n, endian, charset, false, dst, out + cap);
+    }
+    return make_result(res, src - in, dst - out);
+}
+
+utf_convert::result utf_convert::convert_utf32_to_latin1(const char32_t *in,
+                                                         size_t          n,
+                                                         char *          out,
+                                                         size_t          cap,
+                                                         UTF_ENDIAN  endian,
+                                                         UTF_MODE    mode,
+                                                         UTF_CHARSET charset) {
+    const bool      replace = mode == UTF_MODE_REPLACE;
+    const char32_t *src     = in;
+    char *          dst     = out;
+    UTF_ERROR       res;
+    if (mode != UTF_MODE_LENIENT) {
+        res = convert_strict(UTF_CONVERSION_UTF32_TO_LATIN1,
+                             src, in + n, dst, out + cap, mode,
+                             latin1_replacement(), u32_checker(endian),
+                             [=](const char32_t *&s, const char32_t *e,
+                                 char *&d, char *d_end) {
+                                 return convert_u32_to_latin1(
+                                     s, e, endian, charset, replace, d, d_end);
+                             });
+    } else {
+        res = convert_u32_to_latin1(
+            src, in + n, endian, charset, false, dst, out + cap);
+    }
+    return make_result(res, src - in, dst - out);
+}
+
+size_t utf_convert::utf8_length_from_latin1(const char *str,
+                                            size_t      length,
+                                            UTF_CHARSET charset) {
+    const uint8_t *src   = reinterpret_cast<const uint8_t *>(str);
+    size_t         count = length;
+
+    // Latin-1 takes a second byte from 0x80 on, which the compiler vectorizes.
+    if (charset != UTF_CHARSET_WINDOWS_1252) {
+        for (size_t i = 0; i < length; i++)
+            count += src[i] >> 7;
+        return count;
+    }
+    for (size_t i = 0; i < length; i++) {
+        const uint32_t value = decode_latin1(src[i], charset);
+        count += (value >= 0x80) + (value >= 0x800);
+    }
+    return count;
+}
+
+bool utf_convert::latin1_to_utf8(const std::string &str,
+                                 std::string &      target,
+                                 UTF_CHARSET        charset) {
+    return convert_to_string(
+        str.data(), str.size(), 0, target,
+        [=](const char *in, size_t n) {
+            return utf8_length_from_latin1(in, n, charset);
+        },
+        [=](const char *in, size_t n, char *out, size_t cap) {
+            return convert_latin1_to_utf8(in, n, out, cap, charset);
+        });
+}
+
+bool utf_convert::utf8_to_latin1(const std::string &u8str,
+                                 std::string &      target,
+                                 UTF_MODE           mode,
+                                 UTF_CHARSET        charset) {
+    return convert_to_string(
+        u8str.data(), u8str.size(), 0, target,
+        [=](const char *in, size_t n) {
+            return mode == UTF_MODE_REPLACE ? n : utf32_length_from_utf8(in, n);
+        },
+        [=](const char *in, size_t n, char *out, size_t cap) {
+            return convert_utf8_to_latin1(in, n, out, cap, mode, charset);
+        });
+}
+
+bool utf_convert::latin1_to_utf16(const std::string &str,
+                                  std::u16string &   target,
+                                  UTF_ENDIAN         target_endian,
+                                  UTF_CHARSET        charset) {
+    return convert_to_string(
+        str.data(), str.size(), 0, target,
+        [](const char *, size_t n) { return n; },
+        [=](const char *in, size_t n, char16_t *out, size_t cap) {
+            return convert_latin1_to_utf16(
+                in, n, out, cap, target_endian, charset);
+        });
+}
+
+bool utf_convert::utf16_to_latin1(const std::u16string &u16str,
+                                  UTF_ENDIAN            u16str_endian,
+                                  std::string &         target,
+                                  UTF_MODE              mode,
+                                  UTF_CHARSET           charset) {
+    return convert_to_string(
+        u16str.data(), u16str.size(), 0, target,
+        [=](const char16_t *in, size_t n) {
+            return utf32_length_from_utf16(in, n, u16str_endian);
+        },
+        [=](const char16_t *in, size_t n, char *out, size_t cap) {
+            return convert_utf16_to_latin1(
+                in, n, out, cap, u16str_endian, mode, charset);
+        });
+}
+
+bool utf_convert::latin1_to_utf32(const std::string &str,
+                                  std::u32string &   target,
+                                  UTF_ENDIAN         target_endian,
+                                  UTF_CHARSET        charset) {
+    return convert_to_string(
+        str.data(), str.size(), 0, target,
+        [](const char *, size_t n) { return n; },
+        [=](const char *in, size_t n, char32_t *out, size_t cap) {
+            return convert_latin1_to_utf32(
+                in, n, out, cap, target_endian, charset);
+        });
+}
+
+bool utf_convert::utf32_to_latin1(const std::u32string &u32str,
+                                  UTF_ENDIAN            u32str_endian,
+                                  std::string &         target,
+                                  UTF_MODE              mode,
+                                  UTF_CHARSET           charset) {
+    return convert_to_string(
+        u32str.data(), u32str.size(), 0, target,
+        [](const char32_t *, size_t n) { return n; },
+        [=](const char32_t *in, size_t n, char *out, size_t cap) {
+            return convert_utf32_to_latin1(
+                in, n, out, cap, u32str_endian, mode, charset);
+        });
+}
+
+namespace {
+/*!
+ * Length of the utf-8 sequence starting with lead, classified like the scalar
+ * decoders do. A continuation byte yields 0.
+ */
+inline size_t u8_sequence_length(char lead) {
+    if ((lead & 0xf0) == 0xf0)
+        return 4;
+    else if ((lead & 0xe0) == 0xe0)
+        return 3;
+    else if ((lead & 0xc0) == 0xc0)
+        return 2;
+    else if ((lead & 0x7f) == lead)
+        return 1;
+    else
+        return 0;
+}
+
+inline size_t decoded_length(const char *u8str,
+                             size_t      length,
+                             const std::u32string &) {
+    return utf_convert::utf32_length_from_utf8(u8str, length);
+}
+
+inline size_t decoded_length(const char *u8str,
+                             size_t      length,
+                             const std::u16string &) {
+    return utf_convert::utf16_length_from_utf8(u8str, length);
+}
+
+inline utf_convert::UTF_ERROR decode_u8(const char *&          src,
+                                        const char *           end,
+                                        utf_convert::UTF_ENDIAN endian,
+                                        char32_t *&            dst,
+                                        char32_t *             dst_end) {
+    return convert_u8_to_u32(src, end, endian, dst, dst_end);
+}
+
+inline utf_convert::UTF_ERROR decode_u8(const char *&          src,
+                                        const char *           end,
+                                        utf_convert::UTF_ENDIAN endian,
+                                        char16_t *&            dst,
+                                        char16_t *             dst_end) {
+    return convert_u8_to_u16(src, end, endian, dst, dst_end);
+}
+
+/*!
+ * Decode a chunk of utf-8 string for stream_decoder. The sequence left in
+ * partial by the previous chunk is completed first, and a sequence cut by the
+ * end of this chunk is moved to partial.
+ */
+template <typename String>
+bool decode_u8_chunk(const char *            chunk,
+                     size_t                  length,
+                     utf_convert::UTF_ENDIAN endian,
+                     char *                  partial,
+                     size_t &                partial_size,
+                     String &                target) {
+    typedef typename String::value_type char_type;
+
+    const char *src = chunk;
+    const char *end = chunk + length;
+
+    target.clear();
+    if (partial_size > 0) {
+        const size_t required = u8_sequence_length(partial[0]);
+        while (partial_size < required && src < end)
+            partial[partial_size++] = *src++;
+
+        if (partial_size < required)
+            return true;  // Still not complete.
+    }
+
+    target.resize(decoded_length(partial, partial_size, target) +
+                  decoded_length(src, end - src, target));
+
+    char_type *      dst     = &target[0];
+    char_type *const dst_end = &target[0] + target.size();
+
+    utf_convert::UTF_ERROR res = utf_convert::UTF_ERROR_NONE;
+    if (partial_size > 0) {
+        const char *cur = partial;
+        res = decode_u8(cur, partial + partial_size, endian, dst, dst_end);
+        partial_size = 0;
+    }
+
+    if (res == utf_convert::UTF_ERROR_NONE) {
+        res = decode_u8(src, end, endian, dst, dst_end);
+
+        if (res == utf_convert::UTF_ERROR_INVALID_SEQUENCE &&
+            u8_sequence_length(*src) > static_cast<size_t>(end - src)) {
+            // Cut by the end of the chunk, wait for the rest of it.
+            partial_size = end - src;
+            memcpy(partial, src, partial_size);
+            res = utf_convert::UTF_ERROR_NONE;
+        }
+    }
+
+    target.resize(dst - &target[0]);
+    return res == utf_convert::UTF_ERROR_NONE;
+}
+}  // namespace
+
+utf_convert::stream_decoder::stream_decoder(UTF_ENDIAN target_endian)
+    : endian_(target_endian), partial_size_(0) {}
+
+bool utf_convert::stream_decoder::decode(const char *    chunk,
+                                         size_t          length,
+                                         std::u32string &target) {
+    return decode_u8_chunk(
+        chunk, length, endian_, partial_, partial_size_, target);
+}
+
+bool utf_convert::stream_decoder::decode(const char *    chunk,
+                                         size_t          length,
+                                         std::u16string &target) {
+    return decode_u8_chunk(
+        chunk, length, endian_, partial_, partial_size_, target);
+}
+
+bool utf_convert::stream_decoder::finish() {
+    const bool res = partial_size_ == 0;
+    partial_size_  = 0;
+    return res;
+}
+
+void utf_convert::stream_decoder::reset() {
+    partial_size_ = 0;
+}
+
+utf_convert::stream_encoder::stream_encoder(UTF_ENDIAN source_endian)
+    : endian_(source_endian), pending_high_(0), has_pending_(false) {}
+
+bool utf_convert::stream_encoder::encode(const char16_t *chunk,
+                                         size_t          length,
+                                         std::string &   target) {
+    const char16_t *src = chunk;
+    const char16_t *end = chunk + length;
+
+    target.clear();
+    if (length == 0)
+        return true;
+
+    // The pending high surrogate and the low one after it take four bytes.
+    target.resize((has_pending_ ? 4 : 0) +
+                  utf8_length_from_utf16(chunk, length, endian_));
+
+    char *      dst     = &target[0];
+    char *const dst_end = &target[0] + target.size();
+    UTF_ERROR   res     = UTF_ERROR_NONE;
+    if (has_pending_) {
+        const char16_t  pair[2] = {pending_high_, *src++};
+        const char16_t *cur     = pair;
+
+        res = convert_u16_to_u8(cur, pair + 2, endian_, dst, dst_end);
+        has_pending_ = false;
+    }
+
+    if (res == UTF_ERROR_NONE) {
+        res = convert_u16_to_u8(src, end, endian_, dst, dst_end);
+
+        // Only a high surrogate at the end of the chunk fails on the last unit.
+        if (res == UTF_ERROR_INVALID_SEQUENCE && end - src == 1) {
+            pending_high_ = *src;
+            has_pending_  = true;
+            res           = UTF_ERROR_NONE;
+        }
+    }
+
+    target.resize(dst - &target[0]);
+    return res == UTF_ERROR_NONE;
+}
+
+bool utf_convert::stream_encoder::encode(const char32_t *chunk,
+                                         size_t          length,
+                                         std::string &   target) {
+    const char32_t *src = chunk;
+
+    target.resize(utf8_length_from_utf32(chunk, length, endian_));
+
+    char *          dst = &target[0];
+    const UTF_ERROR res = convert_u32_to_u8(
+        src, chunk + length, endian_, dst, &target[0] + target.size());
+
+    target.resize(dst - &target[0]);
+    return res == UTF_ERROR_NONE;
+}
+
+bool utf_convert::stream_encoder::finish() {
+    const bool res = !has_pending_;
+    has_pending_   = false;
+    return res;
+}
+
+void utf_convert::stream_encoder::reset() {
+    has_pending_ = false;
+}
+
+namespace {
+/*!
+ * Code units converted at a time by the digesting conversions, few enough for
+ * their output, at most 8 KiB, to be still in cache when it is hashed.
+ */
+const size_t digest_block_size = 2048;
+
+/*!
+ * Convert like convert(src, end, dst, dst_end) does, a block at a time, and
+ * add the bytes written for each block to digest right after. The blocks end
+ * where checker.is_boundary allows.
+ */
+template <typename In, typename Checker, typename Convert>
+utf_convert::UTF_ERROR convert_digest(const In *&               src,
+                                      const In *                end,
+                                      char *&                   dst,
+                                      char *                    dst_end,
+                                      utf_convert::utf8_digest &digest,
+                                      const Checker &           checker,
+                                      const Convert &           convert) {
+    utf_convert::UTF_ERROR res = utf_convert::UTF_ERROR_NONE;
+
+    while (src < end && res == utf_convert::UTF_ERROR_NONE) {
+        const In *block_end = size_t(end - src) > digest_block_size
+                                  ? src + digest_block_size
+                                  : end;
+        while (block_end < end && !checker.is_boundary(block_end)) {
+            block_end++;
+        }
+
+        char *const block = dst;
+        res = convert(src, block_end, dst, dst_end);
+        digest.update(block, dst - block);
+    }
+    return res;
+}
+}  // namespace
+
+utf_convert::result utf_convert::convert_utf32_to_utf8(const char32_t *in,
+                                                       size_t          n,
+                                                       char *          out,
+                                                       size_t          cap,
+                                                       UTF_ENDIAN      endian,
+                                                       utf8_digest &   digest,
+                                                       UTF_MODE        mode) {
+    const char32_t *src = in;
+    char *          dst = out;
+    const UTF_ERROR res = convert_digest(
+        src, in + n, dst, out + cap, digest, u32_checker(endian),
+        [=](const char32_t *&s, const char32_t *e, char *&d, char *d_end) {
+            return convert_u32_to_u8_in_mode(s, e, endian, mode, d, d_end);
+        });
+    return make_result(res, src - in, dst - out);
+}
+
+utf_convert::result utf_convert::convert_utf16_to_utf8(const char16_t *in,
+                                                       size_t          n,
+                                                       char *          out,
+                                                       size_t          cap,
+                                                       UTF_ENDIAN      endian,
+                                                       utf8_digest &   digest,
+                                                       UTF_MODE        mode) {
+    const char16_t *src = in;
+    char *          dst = out;
+    const UTF_ERROR res = convert_digest(
+        src, in + n, dst, out + cap, digest, u16_checker(endian),
+        [=](const char16_t *&s, const char16_t *e, char *&d, char *d_end) {
+            return convert_u16_to_u8_in_mode(s, e, endian, mode, d, d_end);
+        });
+    return make_result(res, src - in, dst - out);
+}
+
+namespace {
+/*!
+ * Convert like convert(src, end, dst, dst_end) does into a block on the
+ * stack, and give the block to write each time it is full.
+ *
+ * @param[out] written number of bytes given to write.
+ */
+template <typename In, typename Convert>
+utf_convert::UTF_ERROR convert_to_sink(const In *&                src,
+                                       const In *                 end,
+                                       utf_convert::sink_function write,
+                                       void *                     context,
+                                       size_t &                   written,
+                                       const Convert &            convert) {
+    char block[utf_convert::sink_block_size];
+
+    written = 0;
+    while (src < end) {
+        const In *const block_src = src;
+        char *          dst       = block;
+        const utf_convert::UTF_ERROR res =
+            convert(src, end, dst, block + sizeof(block));
+
+        if (dst != block && !write(context, block, dst - block)) {
+            src = block_src;
+            return utf_convert::UTF_ERROR_FILE_IO;
+        }
+        written += dst - block;
+        // A full block is only an error when nothing fits in an empty one.
+        if (res != utf_convert::UTF_ERROR_NONE &&
+            (res != utf_convert::UTF_ERROR_OUTPUT_TOO_SMALL || dst == block))
+            return res;
+    }
+    return utf_convert::UTF_ERROR_NONE;
+}
+}  // namespace
+
+utf_convert::result utf_convert::write_utf32_as_utf8(const char32_t *in,
+                                                     size_t          n,
+                                                     UTF_ENDIAN      endian,
+                                                     sink_function   write,
+                                                     void *          context,
+                                                     UTF_MODE        mode) {
+    const char32_t *src     = in;
+    size_t          written = 0;
+    const UTF_ERROR res     = convert_to_sink(
+        src, in + n, write, context, written,
+        [=](const char32_t *&s, const char32_t *e, char *&d, char *d_end) {
+            return convert_u32_to_u8_in_mode(s, e, endian, mode, d, d_end);
+        });
+    return make_result(res, src - in, written);
+}
+
+utf_convert::result utf_convert::write_utf16_as_utf8(const char16_t *in,
+                                                     size_t          n,
+                                                     UTF_ENDIAN      endian,
+                                                     sink_function   write,
+                                                     void *          context,
+                                                     UTF_MODE        mode) {
+    const char16_t *src     = in;
+    size_t          written = 0;
+    const UTF_ERROR res     = convert_to_sink(
+        src, in + n, write, context, written,
+        [=](const char16_t *&s, const char16_t *e, char *&d, char *d_end) {
+            return convert_u16_to_u8_in_mode(s, e, endian, mode, d, d_end);
+        });
+    return make_result(res, src - in, written);
+}
+
+bool utf_convert::file_sink::operator()(const char *data, size_t size) {
+    return std::fwrite(data, 1, size, file_) == size;
+}
+
+bool utf_convert::ostream_sink::operator()(const char *data, size_t size) {
+    stream_->write(data, size);
+    return bool(*stream_);
 }
@@ -0,0 +1,82 @@
+#include "utf_convert_arena.hpp"
+
+#include <cstdlib>
+
+struct utf_convert::arena::block {
+    block *next;
+    size_t size;  // Bytes after the header.
+};
+
+/*!
+ * Size of the block header, rounded up so that the bytes after it are aligned
+ * like those from malloc.
+ */
+const size_t utf_convert::arena::header_size =
+    (sizeof(block) + alignof(std::max_align_t) - 1) &
+    ~(alignof(std::max_align_t) - 1);
+
+utf_convert::arena::arena(size_t block_size)
+    : block_size_(block_size == 0 ? 1 : block_size),
+      capacity_(0),
+      blocks_(NULL),
+      pos_(NULL),
+      end_(NULL) {}
+
+utf_convert::arena::~arena() {
+    while (blocks_ != NULL) {
+        block *next = blocks_->next;
+        std::free(blocks_);
+        blocks_ = next;
+    }
+}
+
+void *utf_convert::arena::allocate_block(size_t size) {
+    const size_t block_size = size > block_size_ ? size : block_size_;
+    if (block_size > size_t(-1) - header_size)
+        throw std::bad_alloc();
+
+    block *b = static_cast<block *>(std::malloc(header_size + block_size));
+    if (b == NULL)
+        throw std::bad_alloc();
+    b->size = block_size;
+    capacity_ += block_size;
+
+    char *data = reinterpret_cast<char *>(b) + header_size;
+    if (size > block_size_ && blocks_ != NULL) {
+        // A large allocation gets its block to itself, behind the current
+        // block, which is still used for the small ones.
+        b->next       = blocks_->next;
+        blocks_->next = b;
+        return data;
+    }
+
+    b->next = blocks_;
+    blocks_ = b;
+    pos_    = data + size;
+    end_    = data + block_size;
+    return data;
+}
+
+void utf_convert::arena::reset() {
+    block *kept = NULL;
+    while (blocks_ != NULL) {
+        block *next = blocks_->next;
+        if (kept == NULL && blocks_->size == block_size_) {
+            kept = blocks_;
+        } else {
+            capacity_ -= blocks_->size;
+            std::free(blocks_);
+        }
+        blocks_ = next;
+    }
+
+    blocks_ = kept;
+    if (kept == NULL) {
+        pos_ = NULL;
+        end_ = NULL;
+    } else {
+        kept->next = NULL;
+        pos_       = reinterpret_cast<char *>(kept) + header_size;
+        end_       = pos_ + kept->size;
+    }
+}
@@ -0,0 +1,129 @@
+#include "utf_convert.hpp"
+
+#include <vector>
+
+namespace {
+using utf_convert::result;
+using utf_convert::UTF_ERROR_NONE;
+
+/*!
+ * Convert count strings one after another into target, which is sized once
+ * for all of them, and record where each one ends.
+ *
+ * @param[in] strs input strings.
+ * @param[in] lengths number of code units in each input string.
+ * @param count number of input strings.
+ * @param[out] target the converted strings.
+ * @param[out] offsets count + 1 offsets of the converted strings in target.
+ * @param measure measure(in, length) gives the converted length of a string,
+ * which is never less than what convert writes.
+ * @param convert convert(in, length, out, cap) converts a string with the
+ * buffer API.
+ * @return true if succeeded. On failure, target and offsets end with the
+ * string before the one which failed.
+ */
+template <typename In, typename String, typename Measure, typename Convert>
+bool convert_batch(const In *const *    strs,
+                   const size_t *       lengths,
+                   size_t               count,
+                   String &             target,
+                   std::vector<size_t> &offsets,
+                   const Measure &      measure,
+                   const Convert &      convert) {
+    size_t size = 0;
+    for (size_t i = 0; i < count; i++) {
+        size += measure(strs[i], lengths[i]);
+    }
+
+    offsets.clear();
+    offsets.reserve(count + 1);
+    offsets.push_back(0);
+
+    target.resize(size);
+    typename String::value_type *out = &target[0];
+
+    size_t pos = 0;
+    for (size_t i = 0; i < count; i++) {
+        const result res = convert(strs[i], lengths[i], out + pos, size - pos);
+        if (res.error != UTF_ERROR_NONE) {
+            target.resize(pos);
+            return false;
+        }
+        pos += res.count;
+        offsets.push_back(pos);
+    }
+    target.resize(pos);
+    return true;
+}
+
+/*!
+ * A utf-8 string never converts to more utf-16 or utf-32 units than it has
+ * bytes. For short strings this bound wastes little and saves measuring every
+ * string before converting it.
+ */
+inline size_t u8_bound(const char *, size_t length) { return length; }
+}  // namespace
+
+bool utf_convert::batch_to_u16string(const char *const *  u8strs,
+                                     const size_t *       lengths,
+                                     size_t               count,
+                                     std::u16string &     target,
+                                     std::vector<size_t> &offsets,
+                                     UTF_ENDIAN           target_endian,
+                                     UTF_MODE             mode) {
+    return convert_batch(
+        u8strs, lengths, count, target, offsets, u8_bound,
+        [=](const char *in, size_t n, char16_t *out, size_t cap) {
+            return convert_utf8_to_utf16(in, n, out, cap, target_endian, mode);
+        });
+}
+
+bool utf_convert::batch_to_u32string(const char *const *  u8strs,
+                                     const size_t *       lengths,
+                                     size_t               count,
+                                     std::u32string &     target,
+                                     std::vector<size_t> &offsets,
+                                     UTF_ENDIAN           target_endian,
+                                     UTF_MODE             mode) {
+    return convert_batch(
+        u8strs, lengths, count, target, offsets, u8_bound,
+        [=](const char *in, size_t n, char32_t *out, size_t cap) {
+            return convert_utf8_to_utf32(in, n, out, cap, target_endian, mode);
+        });
+}
+
+bool utf_convert::batch_to_u8string(const char16_t *const *u16strs,
+                                    const size_t *         lengths,
+                                    size_t                 count,
+                                    UTF_ENDIAN             u16strs_endian,
+                                    std::string &          target,
+                                    std::vector<size_t> &  offsets,
+                                    UTF_MODE               mode) {
+    return convert_batch(
+        u16strs, lengths, count, target, offsets,
+        [=](const char16_t *in, size_t n) {
+            return mode == UTF_MODE_REPLACE
+                       ? 3 * n
+                       : utf8_length_from_utf16(in, n, u16strs_endian);
+        },
+        [=](const char16_t *in, size_t n, char *out, size_t cap) {
+            return convert_utf16_to_utf8(in, n, out, cap, u16strs_endian, mode);
+        });
+}
+
+bool utf_convert::batch_to_u8string(const char32_t *const *u32strs,
+                                    const size_t *         lengths,
+                                    size_t                 count,
+                                    UTF_ENDIAN             u32strs_endian,
+                                    std::string &          target,
+                                    std::vector<size_t> &  offsets,
+                                    UTF_MODE               mode) {
+    return convert_batch(
+        u32strs, lengths, count, target, offsets,
+        [=](const char32_t *in, size_t n) {
+            return utf8_length_from_utf32(in, n, u32strs_endian);
+        },
+        [=](const char32_t *in, size_t n, char *out, size_t cap) {
+            return convert_utf32_to_utf8(in, n, out, cap, u32strs_endian, mode);
+        });
+}
@@ -0,0 +1,335 @@
+#include "utf_convert.hpp"
+
+#include <cstdint>
+#include <cstring>
+
+namespace {
+using utf_convert::UTF_ENCODING;
+using utf_convert::UTF_ENDIAN;
+using utf_convert::UTF_ERROR_NONE;
+
+/*!
+ * Units copied at a time to validate misaligned utf-16 or utf-32 text.
+ */
+const size_t copy_units = 4096;
+
+/*!
+ * Tell the encoding from the BOM at the start of data. The utf-32 BOMs are
+ * checked first, as FF FE 00 00 also starts with the utf-16 one.
+ *
+ * @return the size of the BOM, or 0 if there is none.
+ */
+size_t match_bom(const uint8_t *s, size_t size, UTF_ENCODING &encoding) {
+    if (size >= 3 && s[0] == 0xef && s[1] == 0xbb && s[2] == 0xbf) {
+        encoding = utf_convert::UTF_ENCODING_UTF8;
+        return 3;
+    }
+    if (size >= 4 && s[0] == 0xff && s[1] == 0xfe && s[2] == 0 && s[3] == 0) {
+        encoding = utf_convert::UTF_ENCODING_UTF32_LITTLE_ENDIAN;
+        return 4;
+    }
+    if (size >= 4 && s[0] == 0 && s[1] == 0 && s[2] == 0xfe && s[3] == 0xff) {
+        encoding = utf_convert::UTF_ENCODING_UTF32_BIG_ENDIAN;
+        return 4;
+    }
+    if (size >= 2 && s[0] == 0xff && s[1] == 0xfe) {
+        encoding = utf_convert::UTF_ENCODING_UTF16_LITTLE_ENDIAN;
+        return 2;
+    }
+    if (size >= 2 && s[0] == 0xfe && s[1] == 0xff) {
+        encoding = utf_convert::UTF_ENCODING_UTF16_BIG_ENDIAN;
+        return 2;
+    }
+    return 0;
+}
+
+/*!
+ * Count the zero bytes of s by their offset modulo 4. The loop has no
+ * branches, so that the compiler vectorizes it.
+ */
+void count_zeros(const uint8_t *s, size_t size, size_t zeros[4]) {
+    size_t z0 = 0, z1 = 0, z2 = 0, z3 = 0;
+    size_t i = 0;
+    for (; i + 4 <= size; i += 4) {
+        z0 += s[i] == 0;
+        z1 += s[i + 1] == 0;
+        z2 += s[i + 2] == 0;
+        z3 += s[i + 3] == 0;
+    }
+    zeros[0] = z0;
+    zeros[1] = z1;
+    zeros[2] = z2;
+    zeros[3] = z3;
+    for (; i < size; i++) {
+        zeros[i & 3] += s[i] == 0;
+    }
+}
+
+/*!
+ * Whether the unit ending a chunk of utf-16 text is a high surrogate, which
+ * must be validated together with the unit after it.
+ */
+bool ends_with_high(const char16_t *s, size_t n, UTF_ENDIAN endian) {
+    const uint8_t *last = reinterpret_cast<const uint8_t *>(s + n - 1);
+    const uint8_t  high =
+        endian == utf_convert::UTF_ENDIAN_BIG_ENDIAN ? last[0] : last[1];
+    return (high & 0xfc) == 0xd8;
+}
+
+/*!
+ * Validate length units of Char text at s, which needs no alignment. Text
+ * which is not aligned is copied in chunks to validate.
+ */
+bool valid_text(const uint8_t *s, size_t length, char16_t, UTF_ENDIAN endian) {
+    if (reinterpret_cast<uintptr_t>(s) % alignof(char16_t) == 0) {
+        return utf_convert::validate_utf16(
+                   reinterpret_cast<const char16_t *>(s), length, endian)
+                   .error == UTF_ERROR_NONE;
+    }
+
+    char16_t units[copy_units];
+    while (length > 0) {
+        size_t n = length < copy_units ? length : copy_units;
+        std::memcpy(units, s, n * sizeof(char16_t));
+        // Leave a high surrogate to the next chunk, unless it is the last unit.
+        if (n > 1 && n < length && ends_with_high(units, n, endian))
+            n--;
+        if (utf_convert::validate_utf16(units, n, endian).error !=
+            UTF_ERROR_NONE)
+            return false;
+        s += n * sizeof(char16_t);
+        length -= n;
+    }
+    return true;
+}
+
+bool valid_text(const uint8_t *s, size_t length, char32_t, UTF_ENDIAN endian) {
+    if (reinterpret_cast<uintptr_t>(s) % alignof(char32_t) == 0) {
+        return utf_convert::validate_utf32(
+                   reinterpret_cast<const char32_t *>(s), length, endian)
+                   .error == UTF_ERROR_NONE;
+    }
+
+    char32_t units[copy_units];
+    while (length > 0) {
+        const size_t n = length < copy_units ? length : copy_units;
+        std::memcpy(units, s, n * sizeof(char32_t));
+        if (utf_convert::validate_utf32(units, n, endian).error !=
+            UTF_ERROR_NONE)
+            return false;
+        s += n * sizeof(char32_t);
+        length -= n;
+    }
+    return true;
+}
+
+/*!
+ * Validate size bytes at s as utf-16, first in the endian which has the zero
+ * bytes at the high bytes of its units.
+ *
+ * @return whether either endian is valid, which is set in encoding.
+ */
+bool match_utf16(const uint8_t *s,
+                 size_t         size,
+                 size_t         even,
+                 size_t         odd,
+                 UTF_ENCODING & encoding) {
+    const UTF_ENDIAN first =
+        odd >= even ? utf_convert::UTF_ENDIAN_LITTLE_ENDIAN
+                    : utf_convert::UTF_ENDIAN_BIG_ENDIAN;
+    const UTF_ENDIAN second = first == utf_convert::UTF_ENDIAN_LITTLE_ENDIAN
+                                  ? utf_convert::UTF_ENDIAN_BIG_ENDIAN
+                                  : utf_convert::UTF_ENDIAN_LITTLE_ENDIAN;
+    const UTF_ENDIAN endians[] = {first, second};
+    for (size_t i = 0; i < 2; i++) {
+        if (valid_text(s, size / 2, char16_t(), endians[i])) {
+            encoding = endians[i] == utf_convert::UTF_ENDIAN_LITTLE_ENDIAN
+                           ? utf_convert::UTF_ENCODING_UTF16_LITTLE_ENDIAN
+                           : utf_convert::UTF_ENCODING_UTF16_BIG_ENDIAN;
+            return true;
+        }
+    }
+    return false;
+}
+
+/*!
+ * Convert length units of aligned utf-16 or utf-32 text to utf-8, like the
+ * to_u8string overloads do.
+ */
+bool convert_units(const char16_t *      in,
+                   size_t                length,
+                   UTF_ENDIAN            endian,
+                   std::string &         target,
+                   utf_convert::UTF_MODE mode) {
+    return utf_convert::convert_to_string(
+        in, length, 0, target,
+        [=](const char16_t *s, size_t n) {
+            return mode == utf_convert::UTF_MODE_REPLACE
+                       ? 3 * n
+                       : utf_convert::utf8_length_from_utf16(s, n, endian);
+        },
+        [=](const char16_t *s, size_t n, char *out, size_t cap) {
+            return utf_convert::convert_utf16_to_utf8(
+                s, n, out, cap, endian, mode);
+        });
+}
+
+bool convert_units(const char32_t *      in,
+                   size_t                length,
+                   UTF_ENDIAN            endian,
+                   std::string &         target,
+                   utf_convert::UTF_MODE mode) {
+    return utf_convert::convert_to_string(
+        in, length, 0, target,
+        [=](const char32_t *s, size_t n) {
+            return utf_convert::utf8_length_from_utf32(s, n, endian);
+        },
+        [=](const char32_t *s, size_t n, char *out, size_t cap) {
+            return utf_convert::convert_utf32_to_utf8(
+                s, n, out, cap, endian, mode);
+        });
+}
+
+/*!
+ * Convert length units of Char text at s, which needs no alignment, to
+ * utf-8. Text which is not aligned is copied into a string first.
+ */
+template <typename Char>
+bool convert_text(const uint8_t *       s,
+                  size_t                length,
+                  UTF_ENDIAN            endian,
+                  std::string &         target,
+                  utf_convert::UTF_MODE mode) {
+    if (reinterpret_cast<uintptr_t>(s) % alignof(Char) == 0) {
+        return convert_units(
+            reinterpret_cast<const Char *>(s), length, endian, target, mode);
+    }
+    std::basic_string<Char> units(length, Char());
+    if (length > 0)
+        std::memcpy(&units[0], s, length * sizeof(Char));
+    return convert_units(units.data(), length, endian, target, mode);
+}
+
+/*!
+ * Copy utf-8 text into target, checking or replacing its ill-formed
+ * sequences as mode says.
+ */
+bool convert_u8_text(const char *          u8str,
+                     size_t                length,
+                     std::string &         target,
+                     utf_convert::UTF_MODE mode) {
+    if (mode == utf_convert::UTF_MODE_LENIENT ||
+        utf_convert::validate_utf8(u8str, length).error == UTF_ERROR_NONE) {
+        target.assign(u8str, length);
+        return true;
+    }
+    if (mode == utf_convert::UTF_MODE_STRICT) {
+        target.clear();
+        return false;
+    }
+
+    // Replace through utf-32, which holds the replacement characters.
+    std::u32string            u32str(length, char32_t());
+    const utf_convert::result res = utf_convert::convert_utf8_to_utf32(
+        u8str, length, &u32str[0], length,
+        utf_convert::UTF_ENDIAN_LITTLE_ENDIAN, mode);
+    u32str.resize(res.count);
+    return utf_convert::to_u8string(
+        u32str, utf_convert::UTF_ENDIAN_LITTLE_ENDIAN, target);
+}
+}  // namespace
+
+utf_convert::UTF_ENCODING utf_convert::detect_encoding(const void *data,
+                                                       size_t      size,
+                                                       size_t *    bom_size) {
+    const uint8_t *s        = static_cast<const uint8_t *>(data);
+    UTF_ENCODING   encoding = UTF_ENCODING_UTF8;
+
+    const size_t bom = match_bom(s, size, encoding);
+    if (bom_size != NULL)
+        *bom_size = bom;
+    if (bom > 0)
+        return encoding;
+
+    size_t zeros[4];
+    count_zeros(s, size, zeros);
+    const size_t even = zeros[0] + zeros[2];
+    const size_t odd  = zeros[1] + zeros[3];
+
+    // Every utf-32 unit has its highest byte zero, which is checked before
+    // validating.
+    if (size % 4 == 0 && size > 0) {
+        const size_t units = size / 4;
+        if (zeros[3] == units &&
+            valid_text(s, units, char32_t(), UTF_ENDIAN_LITTLE_ENDIAN))
+            return UTF_ENCODING_UTF32_LITTLE_ENDIAN;
+        if (zeros[0] == units &&
+            valid_text(s, units, char32_t(), UTF_ENDIAN_BIG_ENDIAN))
+            return UTF_ENCODING_UTF32_BIG_ENDIAN;
+    }
+
+    // Text in the scripts encoded in one byte has zeros at the high bytes of
+    // most of its utf-16 units, which are the odd ones in little endian. A few
+    // zeros, such as a terminating one, are still utf-8 text.
+    if (size % 2 == 0 && 2 * (odd > even ? odd : even) > size / 2 &&
+        match_utf16(s, size, even, odd, encoding))
+        return encoding;
+
+    if (validate_utf8(static_cast<const char *>(data), size).error ==
+        UTF_ERROR_NONE)
+        return UTF_ENCODING_UTF8;
+    // Utf-16 text with few zero bytes, such as CJK text, is taken when it is
+    // no utf-8. Without zeros it reads the same either way round, little
+    // endian is taken first then.
+    if (size % 2 == 0 && match_utf16(s, size, even, odd, encoding))
+        return encoding;
+    return UTF_ENCODING_UTF8;
+}
+
+bool utf_convert::convert_any_to_utf8(const void *  data,
+                                      size_t        size,
+                                      std::string & target,
+                                      UTF_MODE      mode,
+                                      UTF_ENCODING *encoding) {
+    size_t             bom      = 0;
+    const UTF_ENCODING detected = detect_encoding(data, size, &bom);
+    if (encoding != NULL)
+        *encoding = detected;
+
+    const uint8_t *s = static_cast<const uint8_t *>(data) + bom;
+    size -= bom;
+
+    const UTF_ENDIAN endian = detected == UTF_ENCODING_UTF16_BIG_ENDIAN ||
+                                      detected == UTF_ENCODING_UTF32_BIG_ENDIAN
+                                  ? UTF_ENDIAN_BIG_ENDIAN
+                                  : UTF_ENDIAN_LITTLE_ENDIAN;
+    switch (detected) {
+    case UTF_ENCODING_UTF16_LITTLE_ENDIAN:
+    case UTF_ENCODING_UTF16_BIG_ENDIAN:
+        if (!convert_text<char16_t>(s, size / 2, endian, target, mode))
+            return false;
+        break;
+    case UTF_ENCODING_UTF32_LITTLE_ENDIAN:
+    case UTF_ENCODING_UTF32_BIG_ENDIAN:
+        if (!convert_text<char32_t>(s, size / 4, endian, target, mode))
+            return false;
+        break;
+    default:
+        return convert_u8_text(reinterpret_cast<const char *>(s), size,
+                               target, mode);
+    }
+
+    // Bytes after the last whole unit, which only a text with a BOM can have,
+    // are a cut unit. It can not be converted at all, so even UTF_MODE_LENIENT
+    // rejects it like convert_file does.
+    const size_t unit = detected == UTF_ENCODING_UTF16_LITTLE_ENDIAN ||
+                                detected == UTF_ENCODING_UTF16_BIG_ENDIAN
+                            ? 2
+                            : 4;
+    if (size % unit == 0)
+        return true;
+    if (mode != UTF_MODE_REPLACE)
+        return false;
+    target += "\xef\xbf\xbd";
+    return true;
+}
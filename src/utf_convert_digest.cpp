@@ -0,0 +1,123 @@
+#include "utf_convert.hpp"
+
+#include <cstring>
+
+namespace {
+/*
+ * XXH64, as specified in the xxHash repository: four lanes over stripes of
+ * 32 bytes, then the rest of the input and an avalanche. Input words are read
+ * as little endian.
+ */
+const uint64_t prime1 = 0x9e3779b185ebca87ULL;
+const uint64_t prime2 = 0xc2b2ae3d27d4eb4fULL;
+const uint64_t prime3 = 0x165667b19e3779f9ULL;
+const uint64_t prime4 = 0x85ebca77c2b2ae63ULL;
+const uint64_t prime5 = 0x27d4eb2f165667c5ULL;
+
+inline uint64_t rotl(uint64_t value, unsigned bits) {
+    return (value << bits) | (value >> (64 - bits));
+}
+
+inline uint64_t load_u64(const unsigned char *src) {
+    uint64_t value = 0;
+    for (size_t i = 8; i-- > 0;) {
+        value = (value << 8) | src[i];
+    }
+    return value;
+}
+
+inline uint32_t load_u32(const unsigned char *src) {
+    return uint32_t(src[0]) | (uint32_t(src[1]) << 8) |
+           (uint32_t(src[2]) << 16) | (uint32_t(src[3]) << 24);
+}
+
+inline uint64_t round(uint64_t acc, uint64_t input) {
+    return rotl(acc + input * prime2, 31) * prime1;
+}
+
+inline uint64_t merge_round(uint64_t hash, uint64_t acc) {
+    return (hash ^ round(0, acc)) * prime1 + prime4;
+}
+
+inline void consume_stripe(uint64_t *acc, const unsigned char *stripe) {
+    for (size_t lane = 0; lane < 4; lane++) {
+        acc[lane] = round(acc[lane], load_u64(stripe + 8 * lane));
+    }
+}
+}  // namespace
+
+utf_convert::utf8_digest::utf8_digest(uint64_t seed) { reset(seed); }
+
+void utf_convert::utf8_digest::reset(uint64_t seed) {
+    acc_[0]     = seed + prime1 + prime2;
+    acc_[1]     = seed + prime2;
+    acc_[2]     = seed;
+    acc_[3]     = seed - prime1;
+    seed_       = seed;
+    length_     = 0;
+    buffered_   = 0;
+    codepoints_ = 0;
+}
+
+void utf_convert::utf8_digest::update(const char *u8str, size_t length) {
+    const unsigned char *src = reinterpret_cast<const unsigned char *>(u8str);
+    const unsigned char *end = src + length;
+
+    codepoints_ += utf32_length_from_utf8(u8str, length);
+    length_ += length;
+
+    if (buffered_ + length < sizeof(buffer_)) {
+        std::memcpy(buffer_ + buffered_, src, length);
+        buffered_ += length;
+        return;
+    }
+
+    if (buffered_ > 0) {
+        const size_t fill = sizeof(buffer_) - buffered_;
+        std::memcpy(buffer_ + buffered_, src, fill);
+        consume_stripe(acc_, buffer_);
+        src += fill;
+        buffered_ = 0;
+    }
+    for (; end - src >= 32; src += 32) {
+        consume_stripe(acc_, src);
+    }
+
+    std::memcpy(buffer_, src, end - src);
+    buffered_ = end - src;
+}
+
+uint64_t utf_convert::utf8_digest::hash() const {
+    uint64_t hash;
+    if (length_ >= 32) {
+        hash = rotl(acc_[0], 1) + rotl(acc_[1], 7) + rotl(acc_[2], 12) +
+               rotl(acc_[3], 18);
+        for (size_t lane = 0; lane < 4; lane++) {
+            hash = merge_round(hash, acc_[lane]);
+        }
+    } else {
+        hash = seed_ + prime5;
+    }
+    hash += length_;
+
+    const unsigned char *src = buffer_;
+    const unsigned char *end = buffer_ + buffered_;
+    for (; end - src >= 8; src += 8) {
+        hash = rotl(hash ^ round(0, load_u64(src)), 27) * prime1 + prime4;
+    }
+    if (end - src >= 4) {
+        hash = rotl(hash ^ (uint64_t(load_u32(src)) * prime1), 23) * prime2 +
+               prime3;
+        src += 4;
+    }
+    for (; src < end; src++) {
+        hash = rotl(hash ^ (*src * prime5), 11) * prime1;
+    }
+
+    hash ^= hash >> 33;
+    hash *= prime2;
+    hash ^= hash >> 29;
+    hash *= prime3;
+    hash ^= hash >> 32;
+    return hash;
+}
@@ -0,0 +1,563 @@
+#include "utf_convert.hpp"
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+#if defined(_WIN32)
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace {
+/*!
+ * Read only mapping of a whole file. An empty file is not mapped at all and
+ * gives a NULL data pointer.
+ */
+class input_mapping {
+public:
+    input_mapping() : data_(NULL), size_(0) {
+#if defined(_WIN32)
+        file_    = INVALID_HANDLE_VALUE;
+        mapping_ = NULL;
+#else
+        fd_ = -1;
+#endif
+    }
+
+    ~input_mapping() {
+#if defined(_WIN32)
+        if (data_ != NULL)
+            UnmapViewOfFile(data_);
+        if (mapping_ != NULL)
+            CloseHandle(mapping_);
+        if (file_ != INVALID_HANDLE_VALUE)
+            CloseHandle(file_);
+#else
+        if (data_ != NULL)
+            munmap(data_, size_);
+        if (fd_ >= 0)
+            close(fd_);
+#endif
+    }
+
+    input_mapping(const input_mapping &) = delete;
+    input_mapping &operator=(const input_mapping &) = delete;
+
+    bool open(const char *path) {
+#if defined(_WIN32)
+        file_ = CreateFileA(path,
+                            GENERIC_READ,
+                            FILE_SHARE_READ,
+                            NULL,
+                            OPEN_EXISTING,
+                            FILE_FLAG_SEQUENTIAL_SCAN,
+                            NULL);
+        if (file_ == INVALID_HANDLE_VALUE)
+            return false;
+
+        LARGE_INTEGER size;
+        if (!GetFileSizeEx(file_, &size))
+            return false;
+        size_ = static_cast<size_t>(size.QuadPart);
+        if (size_ == 0)
+            return true;
+
+        mapping_ = CreateFileMappingA(file_, NULL, PAGE_READONLY, 0, 0, NULL);
+        if (mapping_ == NULL)
+            return false;
+
+        data_ = MapViewOfFile(mapping_, FILE_MAP_READ, 0, 0, 0);
+        return data_ != NULL;
+#else
+        fd_ = ::open(path, O_RDONLY);
+        if (fd_ < 0)
+            return false;
+
+        struct stat st;
+        if (fstat(fd_, &st) != 0)
+            return false;
+        size_ = static_cast<size_t>(st.st_size);
+        if (size_ == 0)
+            return true;
+
+        void *data = mmap(NULL, size_, PROT_READ, MAP_PRIVATE, fd_, 0);
+        if (data == MAP_FAILED)
+            return false;
+
+        data_ = data;
+        madvise(data_, size_, MADV_SEQUENTIAL);
+        return true;
+#endif
+    }
+
+    const void *data() const {
+        return data_;
+    }
+
+    size_t size() const {
+        return size_;
+    }
+
+    /*!
+     * Whether path names the mapped file, through another name or a link too,
+     * which must not be truncated while it is read.
+     */
+    bool is_file(const char *path) const {
+#if defined(_WIN32)
+        HANDLE other = CreateFileA(path,
+                                   0,
+                                   FILE_SHARE_READ | FILE_SHARE_WRITE |
+                                       FILE_SHARE_DELETE,
+                                   NULL,
+                                   OPEN_EXISTING,
+                                   FILE_ATTRIBUTE_NORMAL,
+                                   NULL);
+        if (other == INVALID_HANDLE_VALUE)
+            return false;
+
+        BY_HANDLE_FILE_INFORMATION info, other_info;
+        const bool same = GetFileInformationByHandle(file_, &info) &&
+                          GetFileInformationByHandle(other, &other_info) &&
+                          info.dwVolumeSerialNumber ==
+                              other_info.dwVolumeSerialNumber &&
+                          info.nFileIndexHigh == other_info.nFileIndexHigh &&
+                          info.nFileIndexLow == other_info.nFileIndexLow;
+        CloseHandle(other);
+        return same;
+#else
+        struct stat st, other;
+        return fstat(fd_, &st) == 0 && stat(path, &other) == 0 &&
+               st.st_dev == other.st_dev && st.st_ino == other.st_ino;
+#endif
+    }
+
+private:
+    void * data_;
+    size_t size_;
+#if defined(_WIN32)
+    HANDLE file_;
+    HANDLE mapping_;
+#else
+    int fd_;
+#endif
+};
+
+/*!
+ * Writable mapping of a new file created with its final size. close() cuts
+ * the file to the number of bytes actually written.
+ */
+class output_mapping {
+public:
+    output_mapping() : data_(NULL), size_(0) {
+#if defined(_WIN32)
+        file_    = INVALID_HANDLE_VALUE;
+        mapping_ = NULL;
+#else
+        fd_ = -1;
+#endif
+    }
+
+    ~output_mapping() {
+        unmap();
+#if defined(_WIN32)
+        if (file_ != INVALID_HANDLE_VALUE)
+            CloseHandle(file_);
+#else
+        if (fd_ >= 0)
+            ::close(fd_);
+#endif
+    }
+
+    output_mapping(const output_mapping &) = delete;
+    output_mapping &operator=(const output_mapping &) = delete;
+
+    bool open(const char *path, size_t size) {
+        size_ = size;
+#if defined(_WIN32)
+        file_ = CreateFileA(path,
+                            GENERIC_READ | GENERIC_WRITE,
+                            0,
+                            NULL,
+                            CREATE_ALWAYS,
+                            FILE_ATTRIBUTE_NORMAL,
+                            NULL);
+        if (file_ == INVALID_HANDLE_VALUE)
+            return false;
+        if (size_ == 0)
+            return true;
+
+        const uint64_t size64 = size_;
+        mapping_              = CreateFileMappingA(file_,
+                                      NULL,
+                                      PAGE_READWRITE,
+                                      static_cast<DWORD>(size64 >> 32),
+                                      static_cast<DWORD>(size64),
+                                      NULL);
+        if (mapping_ == NULL)
+            return false;
+
+        data_ = MapViewOfFile(mapping_, FILE_MAP_WRITE, 0, 0, 0);
+        return data_ != NULL;
+#else
+        fd_ = ::open(path, O_RDWR | O_CREAT | O_TRUNC, 0666);
+        if (fd_ < 0)
+            return false;
+        if (size_ == 0)
+            return true;
+
+        if (ftruncate(fd_, static_cast<off_t>(size_)) != 0)
+            return false;
+
+        void *data =
+            mmap(NULL, size_, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+        if (data == MAP_FAILED)
+            return false;
+
+        data_ = data;
+        return true;
+#endif
+    }
+
+    void *data() const {
+        return data_;
+    }
+
+    /*!
+     * Unmap the file and cut it to size bytes.
+     */
+    bool close(size_t size) {
+        unmap();
+#if defined(_WIN32)
+        LARGE_INTEGER end;
+        end.QuadPart = static_cast<LONGLONG>(size);
+
+        const bool res = SetFilePointerEx(file_, end, NULL, FILE_BEGIN) &&
+                         SetEndOfFile(file_);
+        CloseHandle(file_);
+        file_ = INVALID_HANDLE_VALUE;
+        return res;
+#else
+        bool res =
+            size == size_ || ftruncate(fd_, static_cast<off_t>(size)) == 0;
+        res = ::close(fd_) == 0 && res;
+        fd_      = -1;
+        return res;
+#endif
+    }
+
+private:
+    void unmap() {
+#if defined(_WIN32)
+        if (data_ != NULL)
+            UnmapViewOfFile(data_);
+        if (mapping_ != NULL)
+            CloseHandle(mapping_);
+        mapping_ = NULL;
+#else
+        if (data_ != NULL)
+            munmap(data_, size_);
+#endif
+        data_ = NULL;
+    }
+
+    void * data_;
+    size_t size_;
+#if defined(_WIN32)
+    HANDLE file_;
+    HANDLE mapping_;
+#else
+    int fd_;
+#endif
+};
+
+inline size_t unit_size(utf_convert::UTF_ENCODING encoding) {
+    switch (encoding) {
+    case utf_convert::UTF_ENCODING_UTF16_LITTLE_ENDIAN:
+    case utf_convert::UTF_ENCODING_UTF16_BIG_ENDIAN:
+        return sizeof(char16_t);
+
+    case utf_convert::UTF_ENCODING_UTF32_LITTLE_ENDIAN:
+    case utf_convert::UTF_ENCODING_UTF32_BIG_ENDIAN:
+        return sizeof(char32_t);
+
+    default:
+        return sizeof(char);
+    }
+}
+
+inline utf_convert::UTF_ENDIAN
+encoding_endian(utf_convert::UTF_ENCODING encoding) {
+    return encoding == utf_convert::UTF_ENCODING_UTF16_BIG_ENDIAN ||
+                   encoding == utf_convert::UTF_ENCODING_UTF32_BIG_ENDIAN
+               ? utf_convert::UTF_ENDIAN_BIG_ENDIAN
+               : utf_convert::UTF_ENDIAN_LITTLE_ENDIAN;
+}
+
+/*!
+ * Number of code units of the input after converted, the same as the
+ * utf*_length functions give.
+ */
+size_t converted_length(const void *              in,
+                        size_t                    n,
+                        utf_convert::UTF_ENCODING from,
+                        utf_convert::UTF_ENCODING to) {
+    const size_t                  from_size = unit_size(from);
+    const size_t                  to_size   = unit_size(to);
+    const utf_convert::UTF_ENDIAN endian    = encoding_endian(from);
+
+    if (from_size == to_size)
+        return n;
+
+    if (from_size == sizeof(char)) {
+        const char *u8str = static_cast<const char *>(in);
+        return to_size == sizeof(char16_t)
+                   ? utf_convert::utf16_length_from_utf8(u8str, n)
+                   : utf_convert::utf32_length_from_utf8(u8str, n);
+    } else if (from_size == sizeof(char16_t)) {
+        const char16_t *u16str = static_cast<const char16_t *>(in);
+        return to_size == sizeof(char)
+                   ? utf_convert::utf8_length_from_utf16(u16str, n, endian)
+                   : utf_convert::utf32_length_from_utf16(u16str, n, endian);
+    } else {
+        const char32_t *u32str = static_cast<const char32_t *>(in);
+        return to_size == sizeof(char)
+                   ? utf_convert::utf8_length_from_utf32(u32str, n, endian)
+                   : utf_convert::utf16_length_from_utf32(u32str, n, endian);
+    }
+}
+
+/*!
+ * Most code units the input can take after converted in UTF_MODE_REPLACE,
+ * where a single byte or unit can become a U+FFFD.
+ */
+size_t replaced_length(size_t n, size_t from_size, size_t to_size) {
+    if (to_size == sizeof(char))
+        return n * (from_size == sizeof(char32_t) ? 4 : 3);
+    if (to_size == sizeof(char16_t) && from_size == sizeof(char32_t))
+        return n * 2;
+    return n;
+}
+
+/*!
+ * Write U+FFFD in the encoding to at out, returning the code units written.
+ */
+size_t write_replacement(uint8_t *out, utf_convert::UTF_ENCODING to) {
+    const size_t size = unit_size(to);
+    if (size == sizeof(char)) {
+        memcpy(out, "\xef\xbf\xbd", 3);
+        return 3;
+    }
+
+    const bool big_endian =
+        encoding_endian(to) == utf_convert::UTF_ENDIAN_BIG_ENDIAN;
+    for (size_t j = 0; j < size; j++) {
+        const size_t shift = 8 * (big_endian ? size - 1 - j : j);
+        out[j]             = (0xfffd >> shift) & 0xff;
+    }
+    return 1;
+}
+
+/*!
+ * Check the utf-16 or utf-32 units from pos on like validate_utf16 and
+ * validate_utf32 do.
+ */
+utf_convert::result validate_units(const void *            in,
+                                   size_t                  n,
+                                   size_t                  pos,
+                                   size_t                  size,
+                                   utf_convert::UTF_ENDIAN endian) {
+    if (size == sizeof(char16_t))
+        return utf_convert::validate_utf16(
+            static_cast<const char16_t *>(in) + pos, n - pos, endian);
+    return utf_convert::validate_utf32(
+        static_cast<const char32_t *>(in) + pos, n - pos, endian);
+}
+
+/*!
+ * Copy units of the same size, swapping their bytes if the endians differ.
+ * Ill-formed units are copied as they are in UTF_MODE_LENIENT only, like the
+ * other conversions check or replace them.
+ */
+utf_convert::result copy_units(const void *              in,
+                               size_t                    n,
+                               void *                    out,
+                               size_t                    cap,
+                               utf_convert::UTF_ENCODING from,
+                               utf_convert::UTF_ENCODING to,
+                               utf_convert::UTF_MODE     mode) {
+    const size_t size = unit_size(from);
+
+    if (size == sizeof(char) && mode != utf_convert::UTF_MODE_LENIENT) {
+        const char *              u8str = static_cast<const char *>(in);
+        const utf_convert::result valid = utf_convert::validate_utf8(u8str, n);
+        if (valid.error != utf_convert::UTF_ERROR_NONE) {
+            if (mode == utf_convert::UTF_MODE_STRICT) {
+                memcpy(out, in, valid.count);
+                return valid;
+            }
+
+            // Replace through utf-32, which holds the replacement characters.
+            std::u32string u32str(n, char32_t());
+            const size_t   length =
+                utf_convert::convert_utf8_to_utf32(
+                    u8str, n, &u32str[0], n,
+                    utf_convert::UTF_ENDIAN_LITTLE_ENDIAN, mode)
+                    .count;
+            return utf_convert::convert_utf32_to_utf8(
+                u32str.data(), length, static_cast<char *>(out), cap,
+                utf_convert::UTF_ENDIAN_LITTLE_ENDIAN);
+        }
+    }
+
+    if (from == to || size == sizeof(char)) {
+        memcpy(out, in, n * size);
+    } else {
+        const uint8_t *src = static_cast<const uint8_t *>(in);
+        uint8_t *      dst = static_cast<uint8_t *>(out);
+        for (size_t i = 0; i < n * size; i += size) {
+            for (size_t j = 0; j < size; j++)
+                dst[i + j] = src[i + size - 1 - j];
+        }
+    }
+
+    utf_convert::result res;
+    res.error = utf_convert::UTF_ERROR_NONE;
+    res.count = n;
+    if (size == sizeof(char) || mode == utf_convert::UTF_MODE_LENIENT)
+        return res;
+
+    // Every unpaired surrogate or invalid utf-32 character is one unit, which
+    // takes one U+FFFD.
+    for (size_t pos = 0; pos < n; pos++) {
+        const utf_convert::result valid =
+            validate_units(in, n, pos, size, encoding_endian(from));
+        if (valid.error == utf_convert::UTF_ERROR_NONE)
+            break;
+
+        pos += valid.count;
+        if (mode == utf_convert::UTF_MODE_STRICT) {
+            res.error = valid.error;
+            res.count = pos;
+            break;
+        }
+        write_replacement(static_cast<uint8_t *>(out) + pos * size, to);
+    }
+    return res;
+}
+
+utf_convert::result convert_units(const void *              in,
+                                  size_t                    n,
+                                  void *                    out,
+                                  size_t                    cap,
+                                  utf_convert::UTF_ENCODING from,
+                                  utf_convert::UTF_ENCODING to,
+                                  utf_convert::UTF_MODE     mode) {
+    const size_t                  from_size  = unit_size(from);
+    const size_t                  to_size    = unit_size(to);
+    const utf_convert::UTF_ENDIAN in_endian  = encoding_endian(from);
+    const utf_convert::UTF_ENDIAN out_endian = encoding_endian(to);
+
+    if (from_size == to_size)
+        return copy_units(in, n, out, cap, from, to, mode);
+
+    if (from_size == sizeof(char)) {
+        const char *u8str = static_cast<const char *>(in);
+        if (to_size == sizeof(char16_t))
+            return utf_convert::convert_utf8_to_utf16(
+                u8str, n, static_cast<char16_t *>(out), cap, out_endian, mode);
+        return utf_convert::convert_utf8_to_utf32(
+            u8str, n, static_cast<char32_t *>(out), cap, out_endian, mode);
+    } else if (from_size == sizeof(char16_t)) {
+        const char16_t *u16str = static_cast<const char16_t *>(in);
+        if (to_size == sizeof(char))
+            return utf_convert::convert_utf16_to_utf8(
+                u16str, n, static_cast<char *>(out), cap, in_endian, mode);
+        return utf_convert::convert_utf16_to_utf32(u16str, n,
+                                                   static_cast<char32_t *>(out),
+                                                   cap, in_endian, out_endian,
+                                                   mode);
+    } else {
+        const char32_t *u32str = static_cast<const char32_t *>(in);
+        if (to_size == sizeof(char))
+            return utf_convert::convert_utf32_to_utf8(
+                u32str, n, static_cast<char *>(out), cap, in_endian, mode);
+        return utf_convert::convert_utf32_to_utf16(u32str, n,
+                                                   static_cast<char16_t *>(out),
+                                                   cap, in_endian, out_endian,
+                                                   mode);
+    }
+}
+
+inline utf_convert::result make_error(utf_convert::UTF_ERROR error,
+                                      size_t                 count) {
+    utf_convert::result res;
+    res.error = error;
+    res.count = count;
+    return res;
+}
+}  // namespace
+
+utf_convert::result utf_convert::convert_file(const char * in_path,
+                                              const char * out_path,
+                                              UTF_ENCODING from,
+                                              UTF_ENCODING to,
+                                              UTF_MODE     mode) {
+    input_mapping input;
+    if (!input.open(in_path))
+        return make_error(UTF_ERROR_FILE_IO, 0);
+
+    // A trailing partial code unit is left out and reported after the rest,
+    // or replaced after it.
+    const size_t from_size = unit_size(from);
+    const size_t n         = input.size() / from_size;
+    const bool   complete  = n * from_size == input.size();
+
+    const size_t to_size = unit_size(to);
+    size_t       cap = n > 0 ? converted_length(input.data(), n, from, to) : 0;
+    if (mode == UTF_MODE_REPLACE)
+        cap = replaced_length(complete ? n : n + 1, from_size, to_size);
+
+    // Opening the output truncates it, which would lose the input.
+    if (input.is_file(out_path))
+        return make_error(UTF_ERROR_FILE_IO, 0);
+
+    output_mapping output;
+    if (!output.open(out_path, cap * to_size))
+        return make_error(UTF_ERROR_FILE_IO, 0);
+
+    result res     = make_error(UTF_ERROR_NONE, 0);
+    size_t written = 0;
+    if (n > 0) {
+        res = convert_units(
+            input.data(), n, output.data(), cap, from, to, mode);
+        if (res.error == UTF_ERROR_NONE) {
+            written = res.count;
+        } else {
+            // Converting the valid prefix again tells how much was written.
+            written = convert_units(input.data(), res.count, output.data(),
+                                    cap, from, to, mode)
+                          .count;
+        }
+    }
+
+    if (res.error == UTF_ERROR_NONE && !complete && mode == UTF_MODE_REPLACE) {
+        written += write_replacement(
+            static_cast<uint8_t *>(output.data()) + written * to_size, to);
+        res.count = written;
+    }
+
+    if (!output.close(written * to_size))
+        return make_error(UTF_ERROR_FILE_IO, 0);
+
+    if (res.error == UTF_ERROR_NONE && !complete && mode != UTF_MODE_REPLACE)
+        return make_error(UTF_ERROR_INVALID_SEQUENCE, n);
+    return res;
+}
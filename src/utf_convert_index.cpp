@@ -0,0 +1,105 @@
+#include "utf_convert.hpp"
+
+namespace {
+/*!
+ * Fewest bytes counted at a time with utf32_length_from_utf8, which is about
+ * where the vectorized kernels start to pay off.
+ */
+const size_t min_count_size = 64;
+
+/*!
+ * Skip n code points from s, which is usually at the start of one.
+ *
+ * @return the start of the code point after the n skipped, or end.
+ */
+const char *skip_codepoints(const char *s, const char *end, size_t n) {
+    // A block of at most n bytes has at most n code points, so it can be
+    // skipped after counting them. Only the last block is scanned.
+    for (;;) {
+        const size_t size = n > min_count_size ? n : min_count_size;
+        if (size_t(end - s) < size)
+            break;
+
+        const size_t count = utf_convert::utf32_length_from_utf8(s, size);
+        if (count > n)
+            break;
+        n -= count;
+        s += size;
+    }
+
+    for (; s < end; s++) {
+        if ((*s & 0xc0) != 0x80) {
+            if (n == 0)
+                return s;
+            n--;
+        }
+    }
+    return end;
+}
+}  // namespace
+
+size_t utf_convert::codepoint_offset(const char *u8str,
+                                     size_t      length,
+                                     size_t      codepoint) {
+    return skip_codepoints(u8str, u8str + length, codepoint) - u8str;
+}
+
+std::string utf_convert::substr_codepoints(const std::string &u8str,
+                                           size_t             pos,
+                                           size_t             count) {
+    const char *begin = skip_codepoints(
+        u8str.data(), u8str.data() + u8str.size(), pos);
+    const char *end = skip_codepoints(begin, u8str.data() + u8str.size(),
+                                      count);
+    return std::string(begin, end);
+}
+
+utf_convert::utf8_index::utf8_index(const char *u8str,
+                                    size_t      length,
+                                    size_t      sample)
+    : str_(u8str),
+      length_(length),
+      sample_(sample == 0 ? 1 : sample),
+      size_(0) {}
+
+void utf_convert::utf8_index::build() const {
+    const char *const end = str_ + length_;
+
+    offsets_.reserve(length_ / sample_ + 1);
+    const char *s = skip_codepoints(str_, end, 0);
+    for (;;) {
+        offsets_.push_back(s - str_);
+        const char *next = skip_codepoints(s, end, sample_);
+        if (next == end)
+            break;
+        s = next;
+    }
+    size_ = (offsets_.size() - 1) * sample_ +
+            utf32_length_from_utf8(s, end - s);
+}
+
+size_t utf_convert::utf8_index::size() const {
+    if (offsets_.empty())
+        build();
+    return size_;
+}
+
+size_t utf_convert::utf8_index::offset(size_t codepoint) const {
+    if (offsets_.empty())
+        build();
+
+    const size_t sample = codepoint / sample_;
+    if (sample >= offsets_.size())
+        return length_;
+    return skip_codepoints(str_ + offsets_[sample], str_ + length_,
+                           codepoint % sample_) -
+           str_;
+}
+
+std::string utf_convert::utf8_index::substr(size_t pos, size_t count) const {
+    const size_t begin = offset(pos);
+    const size_t end =
+        count > size_ - (pos < size_ ? pos : size_) ? length_
+                                                    : offset(pos + count);
+    return std::string(str_ + begin, str_ + end);
+}
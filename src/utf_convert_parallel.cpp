@@ -0,0 +1,279 @@
+#include "utf_convert.hpp"
+
+#include <algorithm>
+#include <functional>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+namespace {
+using utf_convert::result;
+using utf_convert::UTF_ENDIAN;
+using utf_convert::UTF_ERROR_NONE;
+
+/*!
+ * Smallest input in bytes worth a thread of its own. Below this, starting the
+ * thread costs more than the conversion it takes over.
+ */
+const size_t min_chunk_size = 1 << 20;
+
+inline bool is_supported_endian(UTF_ENDIAN endian) {
+    return endian == utf_convert::UTF_ENDIAN_LITTLE_ENDIAN ||
+           endian == utf_convert::UTF_ENDIAN_BIG_ENDIAN;
+}
+
+/*!
+ * Number of chunks to split an input of size bytes into.
+ *
+ * @param size size of the input in bytes.
+ * @param thread_count requested number of threads, 0 for one per hardware
+ * thread.
+ */
+size_t chunk_count(size_t size, size_t thread_count) {
+    // Asking for the hardware threads reads system files on some platforms,
+    // which is not worth it for small inputs.
+    size_t chunks = size / min_chunk_size;
+    if (chunks <= 1)
+        return 1;
+
+    if (thread_count == 0)
+        thread_count = std::thread::hardware_concurrency();
+    return std::max<size_t>(1, std::min(thread_count, chunks));
+}
+
+/*!
+ * Check whether the scalar decoder starts a sequence at u8str[i], provided it
+ * started one at some earlier position. None of the three bytes before may be
+ * a lead byte whose sequence reaches i, as continuation bytes are not checked.
+ */
+bool is_u8_boundary(const char *u8str, size_t length, size_t i) {
+    if (i == length)
+        return true;
+    if ((u8str[i] & 0xc0) == 0x80)
+        return false;
+
+    for (size_t back = 1; back <= 3 && back <= i; back++) {
+        unsigned char lead = u8str[i - back];
+        if (lead < 0xc0)
+            continue;
+
+        size_t sequence_length = lead >= 0xf0 ? 4 : lead >= 0xe0 ? 3 : 2;
+        if (sequence_length > back)
+            return false;
+    }
+    return true;
+}
+
+/*!
+ * Check whether a utf-16 string may be split before u16str[i], that is the
+ * unit before is not a high surrogate. Only the high byte of the unit is
+ * needed, which is picked by the endian.
+ */
+bool is_u16_boundary(const char16_t *u16str,
+                     size_t          length,
+                     size_t          i,
+                     UTF_ENDIAN      endian) {
+    if (i == 0 || i == length)
+        return true;
+
+    const unsigned char *unit =
+        reinterpret_cast<const unsigned char *>(u16str + i - 1);
+    unsigned char high =
+        endian == utf_convert::UTF_ENDIAN_LITTLE_ENDIAN ? unit[1] : unit[0];
+    return (high & 0xfc) != 0xd8;
+}
+
+/*!
+ * Run task(0) to task(count - 1) at the same time, task(0) on the calling
+ * thread. A task whose thread can not be started runs on the calling thread.
+ */
+template <typename Task>
+void run_tasks(size_t count, const Task &task) {
+    std::vector<std::thread> workers;
+    workers.reserve(count);
+    for (size_t i = 1; i < count; i++) {
+        try {
+            workers.push_back(std::thread(std::cref(task), i));
+        } catch (const std::system_error &) {
+            task(i);
+        }
+    }
+    task(0);
+    for (size_t i = 0; i < workers.size(); i++) {
+        workers[i].join();
+    }
+}
+
+/*!
+ * Convert in[0, length) into target split into chunks, which are measured and
+ * converted on their own threads.
+ *
+ * The chunks are measured first, and the prefix sum of their lengths places
+ * every chunk in target, which is sized once. Inputs the scalar converters
+ * accept may still convert to less than measured, in which case the chunks
+ * are moved together afterwards. On failure, target keeps the conversion of
+ * the input before the first invalid code unit, like the serial converters.
+ *
+ * @param[in] in input string.
+ * @param length number of code units in the input.
+ * @param chunks number of chunks to split the input into.
+ * @param[out] target the converted string.
+ * @param is_boundary is_boundary(in, length, i) tells whether the input may
+ * be split before in[i].
+ * @param measure measure(in, length) gives the converted length of a chunk,
+ * which is never less than what convert writes.
+ * @param convert convert(in, length, out, cap) converts a chunk with the
+ * buffer API.
+ * @return true if succeeded.
+ */
+template <typename In,
+          typename String,
+          typename Boundary,
+          typename Measure,
+          typename Convert>
+bool convert_chunks(const In *      in,
+                    size_t          length,
+                    size_t          chunks,
+                    String &        target,
+                    const Boundary &is_boundary,
+                    const Measure & measure,
+                    const Convert & convert) {
+    std::vector<size_t> bounds(chunks + 1, length);
+    bounds[0] = 0;
+    for (size_t i = 1; i < chunks; i++) {
+        size_t pos = std::max(length / chunks * i, bounds[i - 1]);
+        while (!is_boundary(in, length, pos)) {
+            pos++;
+        }
+        bounds[i] = pos;
+    }
+
+    std::vector<size_t> offsets(chunks + 1, 0);
+    run_tasks(chunks, [&](size_t i) {
+        offsets[i + 1] = measure(in + bounds[i], bounds[i + 1] - bounds[i]);
+    });
+    for (size_t i = 0; i < chunks; i++) {
+        offsets[i + 1] += offsets[i];
+    }
+
+    target.resize(offsets[chunks]);
+    typename String::value_type *out = &target[0];
+
+    std::vector<result> results(chunks);
+    run_tasks(chunks, [&](size_t i) {
+        results[i] = convert(in + bounds[i],
+                             bounds[i + 1] - bounds[i],
+                             out + offsets[i],
+                             offsets[i + 1] - offsets[i]);
+    });
+
+    size_t size = 0;
+    for (size_t i = 0; i < chunks; i++) {
+        result res    = results[i];
+        bool   failed = res.error != UTF_ERROR_NONE;
+        if (failed) {
+            // Converting the valid prefix again tells how much was written.
+            res = convert(in + bounds[i],
+                          res.count,
+                          out + offsets[i],
+                          offsets[i + 1] - offsets[i]);
+        }
+
+        if (size != offsets[i]) {
+            std::copy(out + offsets[i], out + offsets[i] + res.count,
+                      out + size);
+        }
+        size += res.count;
+
+        if (failed) {
+            target.resize(size);
+            return false;
+        }
+    }
+    target.resize(size);
+    return true;
+}
+}  // namespace
+
+bool utf_convert::parallel_to_u8string(const std::u32string &u32str,
+                                       UTF_ENDIAN            u32str_endian,
+                                       std::string &         target,
+                                       size_t                thread_count) {
+    size_t chunks =
+        chunk_count(u32str.size() * sizeof(char32_t), thread_count);
+    if (chunks == 1 || !is_supported_endian(u32str_endian))
+        return to_u8string(u32str, u32str_endian, target);
+
+    return convert_chunks(
+        u32str.data(), u32str.size(), chunks, target,
+        [](const char32_t *, size_t, size_t) { return true; },
+        [=](const char32_t *in, size_t n) {
+            return utf8_length_from_utf32(in, n, u32str_endian);
+        },
+        [=](const char32_t *in, size_t n, char *out, size_t cap) {
+            return convert_utf32_to_utf8(in, n, out, cap, u32str_endian);
+        });
+}
+
+bool utf_convert::parallel_to_u8string(const std::u16string &u16str,
+                                       UTF_ENDIAN            u16str_endian,
+                                       std::string &         target,
+                                       size_t                thread_count) {
+    size_t chunks =
+        chunk_count(u16str.size() * sizeof(char16_t), thread_count);
+    if (chunks == 1 || !is_supported_endian(u16str_endian))
+        return to_u8string(u16str, u16str_endian, target);
+
+    return convert_chunks(
+        u16str.data(), u16str.size(), chunks, target,
+        [=](const char16_t *in, size_t n, size_t i) {
+            return is_u16_boundary(in, n, i, u16str_endian);
+        },
+        [=](const char16_t *in, size_t n) {
+            return utf8_length_from_utf16(in, n, u16str_endian);
+        },
+        [=](const char16_t *in, size_t n, char *out, size_t cap) {
+            return convert_utf16_to_utf8(in, n, out, cap, u16str_endian);
+        });
+}
+
+bool utf_convert::parallel_to_u32string(const std::string &u8str,
+                                        std::u32string &   target,
+                                        UTF_ENDIAN         target_endian,
+                                        size_t             thread_count) {
+    size_t chunks = chunk_count(u8str.size(), thread_count);
+    if (chunks == 1 || !is_supported_endian(target_endian))
+        return to_u32string(u8str, target, target_endian);
+
+    return convert_chunks(
+        u8str.data(), u8str.size(), chunks, target, is_u8_boundary,
+        [](const char *in, size_t n) { return utf32_length_from_utf8(in, n); },
+        [=](const char *in, size_t n, char32_t *out, size_t cap) {
+            return convert_utf8_to_utf32(in, n, out, cap, target_endian);
+        });
+}
+
+bool utf_convert::parallel_to_u32string(const std::u16string &u16str,
+                                        UTF_ENDIAN            u16str_endian,
+                                        std::u32string &      target,
+                                        UTF_ENDIAN            target_endian,
+                                        size_t                thread_count) {
+    size_t chunks =
+        chunk_count(u16str.size() * sizeof(char16_t), thread_count);
+    if (chunks == 1 || !is_supported_endian(u16str_endian) ||
+        !is_supported_endian(target_endian))
+        return to_u32string(u16str, u16str_endian, target, target_endian);
+
+    return convert_chunks(
+        u16str.data(), u16str.size(), chunks, target,
+        [=](const char16_t *in, size_t n, size_t i) {
+            return is_u16_boundary(in, n, i, u16str_endian);
+        },
+        [=](const char16_t *in, size_t n) {
+            return utf32_length_from_utf16(in, n, u16str_endian);
+        },
+        [=](const char16_t *in, size_t n, char32_t *out, size_t cap) {
+            return convert_utf16_to_utf32(
+                in, n, out, cap, u16str_endian, target_endian);
+        });
+}
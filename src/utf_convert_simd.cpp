@@ -0,0 +1,390 @@
+#include "utf_convert_simd_kernels.hpp"
+
+#include <cstdlib>
+
+namespace {
+using utf_convert::simd::kernel_table;
+
+#if defined(UTF_CONVERT_SIMD_X86)
+
+bool cpu_supports_ssse3() {
+#if defined(__GNUC__) || defined(__clang__)
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("ssse3");
+#elif defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 1);
+    return (info[2] & (1 << 9)) != 0;
+#else
+    return false;
+#endif
+}
+
+bool cpu_supports_avx2() {
+#if defined(__GNUC__) || defined(__clang__)
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2");
+#elif defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 0);
+    if (info[0] < 7)
+        return false;
+
+    __cpuid(info, 1);
+    const bool osxsave = (info[2] & (1 << 27)) != 0;
+    const bool avx     = (info[2] & (1 << 28)) != 0;
+    if (!osxsave || !avx || (_xgetbv(0) & 0x06) != 0x06)
+        return false;  // The OS does not save ymm registers.
+
+    __cpuidex(info, 7, 0);
+    return (info[1] & (1 << 5)) != 0;
+#else
+    return false;
+#endif
+}
+
+bool cpu_supports_popcnt() {
+#if defined(__GNUC__) || defined(__clang__)
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("popcnt");
+#elif defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 1);
+    return (info[2] & (1 << 23)) != 0;
+#else
+    return false;
+#endif
+}
+
+bool cpu_supports_avx2_popcnt() {
+    return cpu_supports_avx2() && cpu_supports_popcnt();
+}
+
+#endif
+
+bool cpu_supports_always() { return true; }
+
+/*!
+ * No kernels at all, the scalar code converts the whole input.
+ */
+const kernel_table scalar_kernels = {};
+
+/*!
+ * A set of kernels which can be chosen at run time, with the check whether
+ * the running CPU supports them.
+ */
+struct implementation {
+    const char *        name;
+    bool (*supported)();
+    const kernel_table *kernels;
+};
+
+/*
+ * The implementations from the best to the worst. The scalar one comes last
+ * and is always supported.
+ */
+const implementation implementations[] = {
+#if defined(UTF_CONVERT_SIMD_X86)
+    {"avx2", cpu_supports_avx2_popcnt, &utf_convert::simd::avx2_kernels},
+    {"ssse3", cpu_supports_ssse3, &utf_convert::simd::ssse3_kernels},
+#elif defined(UTF_CONVERT_SIMD_NEON)
+    {"neon", cpu_supports_always, &utf_convert::simd::neon_kernels},
+#endif
+    {"scalar", cpu_supports_always, &scalar_kernels},
+};
+
+const size_t implementation_count =
+    sizeof(implementations) / sizeof(implementations[0]);
+
+/*!
+ * Choose the implementation named by the UTF_CONVERT_IMPLEMENTATION
+ * environment variable if the CPU supports it, or else the best one it
+ * supports.
+ */
+const implementation &select_implementation() {
+    const char *name = std::getenv("UTF_CONVERT_IMPLEMENTATION");
+    if (name != NULL) {
+        for (size_t i = 0; i < implementation_count; i++) {
+            if (std::strcmp(name, implementations[i].name) == 0 &&
+                implementations[i].supported())
+                return implementations[i];
+        }
+    }
+
+    for (size_t i = 0; i < implementation_count; i++) {
+        if (implementations[i].supported())
+            return implementations[i];
+    }
+    return implementations[implementation_count - 1];
+}
+
+/*!
+ * Get the implementation of the process, which is chosen on the first call.
+ */
+const implementation &active() {
+    static const implementation &impl = select_implementation();
+    return impl;
+}
+
+inline const kernel_table &kernels() { return *active().kernels; }
+}  // namespace
+
+const char *utf_convert::active_implementation() { return active().name; }
+
+void utf_convert::simd::u8_to_u32(const uint8_t *&src,
+                                  const uint8_t * end,
+                                  char32_t *&     dst,
+                                  char32_t *      dst_end,
+                                  UTF_ENDIAN      endian) {
+    const u8_to_u32_kernel kernel = kernels().u8_to_u32;
+
+    if (kernel != NULL)
+        kernel(src, end, dst, dst_end, endian);
+}
+
+void utf_convert::simd::u32_to_u8(const char32_t *&src,
+                                  const char32_t * end,
+                                  char *&          dst,
+                                  char *           dst_end,
+                                  UTF_ENDIAN       endian) {
+    const u32_to_u8_kernel kernel = kernels().u32_to_u8;
+
+    if (kernel != NULL)
+        kernel(src, end, dst, dst_end, endian);
+}
+
+void utf_convert::simd::u16_to_u8(const char16_t *&src,
+                                  const char16_t * end,
+                                  char *&          dst,
+                                  char *           dst_end,
+                                  UTF_ENDIAN       endian) {
+    const u16_to_u8_kernel kernel = kernels().u16_to_u8;
+
+    if (kernel != NULL)
+        kernel(src, end, dst, dst_end, endian);
+}
+
+void utf_convert::simd::u8_to_u16(const uint8_t *&src,
+                                  const uint8_t * end,
+                                  char16_t *&     dst,
+                                  char16_t *      dst_end,
+                                  UTF_ENDIAN      endian) {
+    const u8_to_u16_kernel kernel = kernels().u8_to_u16;
+
+    if (kernel != NULL)
+        kernel(src, end, dst, dst_end, endian);
+}
+
+void utf_convert::simd::u16_to_u32(const char16_t *&src,
+                                   const char16_t * end,
+                                   char32_t *&      dst,
+                                   char32_t *       dst_end,
+                                   UTF_ENDIAN       src_endian,
+                                   UTF_ENDIAN       dst_endian) {
+    const u16_to_u32_kernel kernel = kernels().u16_to_u32;
+
+    if (kernel != NULL)
+        kernel(src, end, dst, dst_end, src_endian, dst_endian);
+}
+
+void utf_convert::simd::u32_to_u16(const char32_t *&src,
+                                   const char32_t * end,
+                                   char16_t *&      dst,
+                                   char16_t *       dst_end,
+                                   UTF_ENDIAN       src_endian,
+                                   UTF_ENDIAN       dst_endian) {
+    const u32_to_u16_kernel kernel = kernels().u32_to_u16;
+
+    if (kernel != NULL)
+        kernel(src, end, dst, dst_end, src_endian, dst_endian);
+}
+
+size_t utf_convert::simd::utf32_length_from_utf8(const uint8_t *&src,
+                                                 const uint8_t * end) {
+    const utf32_length_from_utf8_kernel kernel = kernels().utf32_length_from_utf8;
+
+    return kernel != NULL ? kernel(src, end) : 0;
+}
+
+size_t utf_convert::simd::utf8_length_from_utf32(const char32_t *&src,
+                                                 const char32_t * end,
+                                                 UTF_ENDIAN       endian) {
+    const utf8_length_from_utf32_kernel kernel = kernels().utf8_length_from_utf32;
+
+    return kernel != NULL ? kernel(src, end, endian) : 0;
+}
+
+size_t utf_convert::simd::utf8_length_from_utf16(const char16_t *&src,
+                                                 const char16_t * end,
+                                                 UTF_ENDIAN       endian) {
+    const utf8_length_from_utf16_kernel kernel = kernels().utf8_length_from_utf16;
+
+    return kernel != NULL ? kernel(src, end, endian) : 0;
+}
+
+size_t utf_convert::simd::utf16_length_from_utf8(const uint8_t *&src,
+                                                 const uint8_t * end) {
+    const utf16_length_from_utf8_kernel kernel = kernels().utf16_length_from_utf8;
+
+    return kernel != NULL ? kernel(src, end) : 0;
+}
+
+size_t utf_convert::simd::utf32_length_from_utf16(const char16_t *&src,
+                                                  const char16_t * end,
+                                                  UTF_ENDIAN       endian) {
+    const utf32_length_from_utf16_kernel kernel = kernels().utf32_length_from_utf16;
+
+    return kernel != NULL ? kernel(src, end, endian) : 0;
+}
+
+size_t utf_convert::simd::utf16_length_from_utf32(const char32_t *&src,
+                                                  const char32_t * end,
+                                                  UTF_ENDIAN       endian) {
+    const utf16_length_from_utf32_kernel kernel = kernels().utf16_length_from_utf32;
+
+    return kernel != NULL ? kernel(src, end, endian) : 0;
+}
+
+void utf_convert::simd::validate_utf8(const uint8_t *&src,
+                                      const uint8_t * end) {
+    const validate_utf8_kernel kernel = kernels().validate_utf8;
+
+    if (kernel != NULL)
+        kernel(src, end);
+}
+
+void utf_convert::simd::validate_utf16(const char16_t *&src,
+                                       const char16_t * end,
+                                       UTF_ENDIAN       endian) {
+    const validate_utf16_kernel kernel = kernels().validate_utf16;
+
+    if (kernel != NULL)
+        kernel(src, end, endian);
+}
+
+void utf_convert::simd::validate_utf32(const char32_t *&src,
+                                       const char32_t * end,
+                                       UTF_ENDIAN       endian) {
+    const validate_utf32_kernel kernel = kernels().validate_utf32;
+
+    if (kernel != NULL)
+        kernel(src, end, endian);
+}
+
+void utf_convert::simd::ascii_prefix(const uint8_t *&src, const uint8_t *end) {
+    const ascii_prefix_kernel kernel = kernels().ascii_prefix;
+
+    if (kernel != NULL)
+        kernel(src, end);
+}
+
+void utf_convert::simd::latin1_to_u8(const uint8_t *&src,
+                                     const uint8_t * end,
+                                     char *&         dst,
+                                     char *          dst_end,
+                                     UTF_CHARSET     charset) {
+    const latin1_to_u8_kernel kernel = kernels().latin1_to_u8;
+
+    if (kernel != NULL)
+        kernel(src, end, dst, dst_end, charset);
+}
+
+void utf_convert::simd::latin1_to_u16(const uint8_t *&src,
+                                      const uint8_t * end,
+                                      char16_t *&     dst,
+                                      char16_t *      dst_end,
+                                      UTF_ENDIAN      endian,
+                                      UTF_CHARSET     charset) {
+    const latin1_to_u16_kernel kernel = kernels().latin1_to_u16;
+
+    if (kernel != NULL)
+        kernel(src, end, dst, dst_end, endian, charset);
+}
+
+void utf_convert::simd::latin1_to_u32(const uint8_t *&src,
+                                      const uint8_t * end,
+                                      char32_t *&     dst,
+                                      char32_t *      dst_end,
+                                      UTF_ENDIAN      endian,
+                                      UTF_CHARSET     charset) {
+    const latin1_to_u32_kernel kernel = kernels().latin1_to_u32;
+
+    if (kernel != NULL)
+        kernel(src, end, dst, dst_end, endian, charset);
+}
+
+void utf_convert::simd::u8_to_latin1(const uint8_t *&src,
+                                     const uint8_t * end,
+                                     char *&         dst,
+                                     char *          dst_end,
+                                     UTF_CHARSET     charset) {
+    const u8_to_latin1_kernel kernel = kernels().u8_to_latin1;
+
+    if (kernel != NULL)
+        kernel(src, end, dst, dst_end, charset);
+}
+
+void utf_convert::simd::u16_to_latin1(const char16_t *&src,
+                                      const char16_t * end,
+                                      char *&          dst,
+                                      char *           dst_end,
+                                      UTF_ENDIAN       endian,
+                                      UTF_CHARSET      charset) {
+    const u16_to_latin1_kernel kernel = kernels().u16_to_latin1;
+
+    if (kernel != NULL)
+        kernel(src, end, dst, dst_end, endian, charset);
+}
+
+void utf_convert::simd::u32_to_latin1(const char32_t *&src,
+                                      const char32_t * end,
+                                      char *&          dst,
+                                      char *           dst_end,
+                                      UTF_ENDIAN       endian,
+                                      UTF_CHARSET      charset) {
+    const u32_to_latin1_kernel kernel = kernels().u32_to_latin1;
+
+    if (kernel != NULL)
+        kernel(src, end, dst, dst_end, endian, charset);
+}
+
+void utf_convert::simd::swap_u16(char16_t *&str, char16_t *end) {
+    const swap_u16_kernel kernel = kernels().swap_u16;
+
+    if (kernel != NULL)
+        kernel(str, end);
+}
+
+void utf_convert::simd::swap_u32(char32_t *&str, char32_t *end) {
+    const swap_u32_kernel kernel = kernels().swap_u32;
+
+    if (kernel != NULL)
+        kernel(str, end);
+}
+
+void utf_convert::simd::fold_u8(char *&str, char *end, UTF_FOLD fold) {
+    const fold_u8_kernel kernel = kernels().fold_u8;
+
+    if (kernel != NULL)
+        kernel(str, end, fold);
+}
+
+void utf_convert::simd::fold_u16(char16_t *&str,
+                                 char16_t * end,
+                                 UTF_ENDIAN endian,
+                                 UTF_FOLD   fold) {
+    const fold_u16_kernel kernel = kernels().fold_u16;
+
+    if (kernel != NULL)
+        kernel(str, end, endian, fold);
+}
+
+void utf_convert::simd::fold_u32(char32_t *&str,
+                                 char32_t * end,
+                                 UTF_ENDIAN endian,
+                                 UTF_FOLD   fold) {
+    const fold_u32_kernel kernel = kernels().fold_u32;
+
+    if (kernel != NULL)
+        kernel(str, end, endian, fold);
+}
@@ -0,0 +1,408 @@
+#ifndef UTF_CONVERT_SIMD_HPP
+#define UTF_CONVERT_SIMD_HPP
+
+#include <cstddef>
+#include <cstdint>
+
+#include "utf_convert.hpp"
+
+namespace utf_convert {
+namespace simd {
+
+/*!
+ * Decode the leading part of a utf-8 string with the best vectorized kernel
+ * supported by the running CPU. The kernel is selected on the first call.
+ *
+ * The kernel stops as soon as it meets a block it cannot decode on its own
+ * (an invalid lead byte or fewer bytes than a full register), so the caller
+ * must finish the remaining input with the scalar decoder.
+ *
+ * @param[in,out] src start of the utf-8 string, advanced past decoded bytes.
+ * @param[in] end end of the utf-8 string.
+ * @param[in,out] dst output buffer, advanced past written characters.
+ * @param[in] dst_end end of the output buffer. The kernel only stores whole
+ * registers, and stops when they may not fit any more.
+ * @param endian endian for the decoded utf-32 characters.
+ */
+void u8_to_u32(const uint8_t *&src,
+               const uint8_t * end,
+               char32_t *&     dst,
+               char32_t *      dst_end,
+               UTF_ENDIAN      endian);
+
+/*!
+ * Encode the leading part of a utf-32 string with the best vectorized kernel
+ * supported by the running CPU. Like u8_to_u32, the kernel stops at the first
+ * block it can not encode on its own, which must be finished with the scalar
+ * encoder.
+ *
+ * @param[in,out] src start of the utf-32 string, advanced past encoded
+ * characters.
+ * @param[in] end end of the utf-32 string.
+ * @param[in,out] dst output buffer, advanced past written bytes.
+ * @param[in] dst_end end of the output buffer.
+ * @param endian endian of the utf-32 string.
+ */
+void u32_to_u8(const char32_t *&src,
+               const char32_t * end,
+               char *&          dst,
+               char *           dst_end,
+               UTF_ENDIAN       endian);
+
+/*!
+ * Encode the leading part of a utf-16 string with the best vectorized kernel
+ * supported by the running CPU. Blocks with unpaired surrogates go through a
+ * scalar step inside the kernel, with the same result as the scalar encoder.
+ * The kernel returns at the first unit the scalar encoder would fail on, or
+ * when the input gets shorter than a block.
+ *
+ * @param[in,out] src start of the utf-16 string, advanced past encoded units.
+ * @param[in] end end of the utf-16 string.
+ * @param[in,out] dst output buffer, advanced past written bytes.
+ * @param[in] dst_end end of the output buffer.
+ * @param endian endian of the utf-16 string.
+ */
+void u16_to_u8(const char16_t *&src,
+               const char16_t * end,
+               char *&          dst,
+               char *           dst_end,
+               UTF_ENDIAN       endian);
+
+/*!
+ * Decode the leading part of a utf-8 string to utf-16, the same way as
+ * u8_to_u32. Characters from 0x10000 on are written as surrogate pairs.
+ *
+ * @param[in,out] src start of the utf-8 string, advanced past decoded bytes.
+ * @param[in] end end of the utf-8 string.
+ * @param[in,out] dst output buffer, advanced past written units.
+ * @param[in] dst_end end of the output buffer.
+ * @param endian endian for the decoded utf-16 units.
+ */
+void u8_to_u16(const uint8_t *&src,
+               const uint8_t * end,
+               char16_t *&     dst,
+               char16_t *      dst_end,
+               UTF_ENDIAN      endian);
+
+/*!
+ * Decode the leading part of a utf-16 string to utf-32. Like u16_to_u8,
+ * blocks with surrogates go through a scalar step inside the kernel, and it
+ * returns at the first unit the scalar decoder would fail on.
+ *
+ * @param[in,out] src start of the utf-16 string, advanced past decoded units.
+ * @param[in] end end of the utf-16 string.
+ * @param[in,out] dst output buffer, advanced past written characters.
+ * @param[in] dst_end end of the output buffer.
+ * @param src_endian endian of the utf-16 string.
+ * @param dst_endian endian for the decoded utf-32 characters.
+ */
+void u16_to_u32(const char16_t *&src,
+                const char16_t * end,
+                char32_t *&      dst,
+                char32_t *       dst_end,
+                UTF_ENDIAN       src_endian,
+                UTF_ENDIAN       dst_endian);
+
+/*!
+ * Encode the leading part of a utf-32 string to utf-16, the same way as
+ * u16_to_u32. It returns at the first character from 0x110000 on.
+ *
+ * @param[in,out] src start of the utf-32 string, advanced past encoded
+ * characters.
+ * @param[in] end end of the utf-32 string.
+ * @param[in,out] dst output buffer, advanced past written units.
+ * @param[in] dst_end end of the output buffer.
+ * @param src_endian endian of the utf-32 string.
+ * @param dst_endian endian for the encoded utf-16 units.
+ */
+void u32_to_u16(const char32_t *&src,
+                const char32_t * end,
+                char16_t *&      dst,
+                char16_t *       dst_end,
+                UTF_ENDIAN       src_endian,
+                UTF_ENDIAN       dst_endian);
+
+/*!
+ * Count the utf-32 characters of the leading part of a utf-8 string, that is
+ * its bytes other than continuation bytes.
+ *
+ * @param[in,out] src start of the utf-8 string, advanced past counted bytes.
+ * The rest must be counted by the caller.
+ * @param[in] end end of the utf-8 string.
+ * @return number of characters in the counted part.
+ */
+size_t utf32_length_from_utf8(const uint8_t *&src, const uint8_t *end);
+
+/*!
+ * Count the utf-8 bytes of the leading part of a utf-32 string.
+ *
+ * @param[in,out] src start of the utf-32 string, advanced past counted
+ * characters.
+ * @param[in] end end of the utf-32 string.
+ * @param endian endian of the utf-32 string.
+ * @return number of bytes in the counted part.
+ */
+size_t utf8_length_from_utf32(const char32_t *&src,
+                              const char32_t * end,
+                              UTF_ENDIAN       endian);
+
+/*!
+ * Count the utf-8 bytes of the leading part of a utf-16 string. A surrogate
+ * takes two bytes, except for a low surrogate which does not follow a high
+ * one, which takes three like the scalar encoder writes it. The caller must
+ * count the rest the same way, taking the unit before src into account.
+ *
+ * @param[in,out] src start of the utf-16 string, advanced past counted units.
+ * @param[in] end end of the utf-16 string.
+ * @param endian endian of the utf-16 string.
+ * @return number of bytes in the counted part.
+ */
+size_t utf8_length_from_utf16(const char16_t *&src,
+                              const char16_t * end,
+                              UTF_ENDIAN       endian);
+
+/*!
+ * Count the utf-16 units of the leading part of a utf-8 string: one for every
+ * byte other than continuation bytes, and another one for four-byte leads.
+ *
+ * @param[in,out] src start of the utf-8 string, advanced past counted bytes.
+ * @param[in] end end of the utf-8 string.
+ * @return number of units in the counted part.
+ */
+size_t utf16_length_from_utf8(const uint8_t *&src, const uint8_t *end);
+
+/*!
+ * Count the utf-32 characters of the leading part of a utf-16 string, that is
+ * its units other than low surrogates following a high one. The caller must
+ * count the rest the same way, taking the unit before src into account.
+ *
+ * @param[in,out] src start of the utf-16 string, advanced past counted units.
+ * @param[in] end end of the utf-16 string.
+ * @param endian endian of the utf-16 string.
+ * @return number of characters in the counted part.
+ */
+size_t utf32_length_from_utf16(const char16_t *&src,
+                               const char16_t * end,
+                               UTF_ENDIAN       endian);
+
+/*!
+ * Count the utf-16 units of the leading part of a utf-32 string.
+ *
+ * @param[in,out] src start of the utf-32 string, advanced past counted
+ * characters.
+ * @param[in] end end of the utf-32 string.
+ * @param endian endian of the utf-32 string.
+ * @return number of units in the counted part.
+ */
+size_t utf16_length_from_utf32(const char32_t *&src,
+                               const char32_t * end,
+                               UTF_ENDIAN       endian);
+
+/*!
+ * Validate the leading part of a utf-8 string, a register at a time with the
+ * lookup tables of Keiser and Lemire. The kernel stops before the first
+ * register with an error in it, or when the input gets shorter than a
+ * register.
+ *
+ * @param[in,out] src start of the utf-8 string, advanced past valid bytes. It
+ * is moved back to the start of a sequence the kernel has not finished, so
+ * the caller must validate the rest from src with the scalar validator, which
+ * then finds the exact error position.
+ * @param[in] end end of the utf-8 string.
+ */
+void validate_utf8(const uint8_t *&src, const uint8_t *end);
+
+/*!
+ * Validate the leading part of a utf-16 string, that is check that high and
+ * low surrogates come in pairs. Like validate_utf8, the kernel stops before
+ * the first register with an error in it, and moves src back to a high
+ * surrogate cut by the end of the last register.
+ *
+ * @param[in,out] src start of the utf-16 string, advanced past valid units.
+ * @param[in] end end of the utf-16 string.
+ * @param endian endian of the utf-16 string.
+ */
+void validate_utf16(const char16_t *&src,
+                    const char16_t * end,
+                    UTF_ENDIAN       endian);
+
+/*!
+ * Validate the leading part of a utf-32 string, that is check that no
+ * character is a surrogate or above 0x10ffff. The kernel stops before the
+ * first register with an error in it.
+ *
+ * @param[in,out] src start of the utf-32 string, advanced past valid
+ * characters.
+ * @param[in] end end of the utf-32 string.
+ * @param endian endian of the utf-32 string.
+ */
+void validate_utf32(const char32_t *&src,
+                    const char32_t * end,
+                    UTF_ENDIAN       endian);
+
+/*!
+ * Skip the leading ascii part of a string, a register at a time. The kernel
+ * stops before the first register with a byte from 0x80 on, or when the input
+ * gets shorter than a register, so the caller must check the rest.
+ *
+ * @param[in,out] src start of the string, advanced past ascii bytes.
+ * @param[in] end end of the string.
+ */
+void ascii_prefix(const uint8_t *&src, const uint8_t *end);
+
+/*!
+ * Convert the leading part of a Latin-1 or Windows-1252 string to utf-8.
+ * With Windows-1252, the kernel stops before the first register with a byte
+ * in 0x80 ~ 0x9f, which the caller must convert with the scalar code.
+ *
+ * @param[in,out] src start of the string, advanced past converted bytes.
+ * @param[in] end end of the string.
+ * @param[in,out] dst output buffer, advanced past written bytes.
+ * @param[in] dst_end end of the output buffer.
+ * @param charset character set of the string.
+ */
+void latin1_to_u8(const uint8_t *&src,
+                  const uint8_t * end,
+                  char *&         dst,
+                  char *          dst_end,
+                  UTF_CHARSET     charset);
+
+/*!
+ * Widen the leading part of a Latin-1 or Windows-1252 string to utf-16, with
+ * the same stops as latin1_to_u8.
+ *
+ * @param[in,out] src start of the string, advanced past converted bytes.
+ * @param[in] end end of the string.
+ * @param[in,out] dst output buffer, advanced past written units.
+ * @param[in] dst_end end of the output buffer.
+ * @param endian endian for the utf-16 units.
+ * @param charset character set of the string.
+ */
+void latin1_to_u16(const uint8_t *&src,
+                   const uint8_t * end,
+                   char16_t *&     dst,
+                   char16_t *      dst_end,
+                   UTF_ENDIAN      endian,
+                   UTF_CHARSET     charset);
+
+/*!
+ * Widen the leading part of a Latin-1 or Windows-1252 string to utf-32, the
+ * same way as latin1_to_u16.
+ */
+void latin1_to_u32(const uint8_t *&src,
+                   const uint8_t * end,
+                   char32_t *&     dst,
+                   char32_t *      dst_end,
+                   UTF_ENDIAN      endian,
+                   UTF_CHARSET     charset);
+
+/*!
+ * Narrow the leading part of a utf-8 string to Latin-1 or Windows-1252. The
+ * kernel stops before the first register with other bytes than ascii and
+ * well-formed two-byte sequences with the lead bytes 0xc2 and 0xc3, or with
+ * Windows-1252 before the characters from 0x80 on below 0xa0, which the
+ * caller must convert with the scalar code.
+ *
+ * @param[in,out] src start of the utf-8 string, advanced past converted
+ * bytes.
+ * @param[in] end end of the utf-8 string.
+ * @param[in,out] dst output buffer, advanced past written bytes.
+ * @param[in] dst_end end of the output buffer.
+ * @param charset character set to convert to.
+ */
+void u8_to_latin1(const uint8_t *&src,
+                  const uint8_t * end,
+                  char *&         dst,
+                  char *          dst_end,
+                  UTF_CHARSET     charset);
+
+/*!
+ * Narrow the leading part of a utf-16 string to Latin-1 or Windows-1252. The
+ * kernel stops before the first register with a unit from 0x100 on, or with
+ * Windows-1252 from 0x80 on below 0xa0, which the caller must convert with
+ * the scalar code.
+ *
+ * @param[in,out] src start of the utf-16 string, advanced past converted
+ * units.
+ * @param[in] end end of the utf-16 string.
+ * @param[in,out] dst output buffer, advanced past written bytes.
+ * @param[in] dst_end end of the output buffer.
+ * @param endian endian of the utf-16 string.
+ * @param charset character set to convert to.
+ */
+void u16_to_latin1(const char16_t *&src,
+                   const char16_t * end,
+                   char *&          dst,
+                   char *           dst_end,
+                   UTF_ENDIAN       endian,
+                   UTF_CHARSET      charset);
+
+/*!
+ * Narrow the leading part of a utf-32 string to Latin-1 or Windows-1252, the
+ * same way as u16_to_latin1.
+ */
+void u32_to_latin1(const char32_t *&src,
+                   const char32_t * end,
+                   char *&          dst,
+                   char *           dst_end,
+                   UTF_ENDIAN       endian,
+                   UTF_CHARSET      charset);
+
+/*!
+ * Reverse the bytes of the code units at the start of a utf-16 string in
+ * place. The kernel stops before the last units which do not fill a
+ * register, which the caller must swap with the scalar code.
+ *
+ * @param[in,out] str start of the string, advanced past swapped units.
+ * @param[in] end end of the string.
+ */
+void swap_u16(char16_t *&str, char16_t *end);
+
+/*!
+ * Reverse the bytes of the code units at the start of a utf-32 string in
+ * place, the same way as swap_u16.
+ *
+ * @param[in,out] str start of the string, advanced past swapped units.
+ * @param[in] end end of the string.
+ */
+void swap_u32(char32_t *&str, char32_t *end);
+
+/*!
+ * Fold the case of the characters at the start of a utf-8 string in place,
+ * the same way as swap_u16. The string must start at a character, and the
+ * caller folds the rest with the scalar code, which must look at the byte
+ * before the first one left for a Latin-1 character.
+ *
+ * @param[in,out] str start of the string, advanced past folded bytes.
+ * @param[in] end end of the string.
+ * @param fold which characters are folded, not UTF_FOLD_NONE.
+ */
+void fold_u8(char *&str, char *end, UTF_FOLD fold);
+
+/*!
+ * Fold the case of the code units at the start of a utf-16 string in place,
+ * the same way as swap_u16. Surrogates are never folded, so the string may
+ * start anywhere.
+ *
+ * @param[in,out] str start of the string, advanced past folded units.
+ * @param[in] end end of the string.
+ * @param endian Encode endian of the string.
+ * @param fold which characters are folded, not UTF_FOLD_NONE.
+ */
+void fold_u16(char16_t *&str, char16_t *end, UTF_ENDIAN endian, UTF_FOLD fold);
+
+/*!
+ * Fold the case of the characters at the start of a utf-32 string in place,
+ * the same way as swap_u16.
+ *
+ * @param[in,out] str start of the string, advanced past folded characters.
+ * @param[in] end end of the string.
+ * @param endian Encode endian of the string.
+ * @param fold which characters are folded, not UTF_FOLD_NONE.
+ */
+void fold_u32(char32_t *&str, char32_t *end, UTF_ENDIAN endian, UTF_FOLD fold);
+
+}  // namespace simd
+}  // namespace utf_convert
+
+#endif  // UTF_CONVERT_SIMD_HPP
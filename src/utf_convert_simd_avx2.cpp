@@ -0,0 +1,1297 @@
+#include "utf_convert_simd_kernels.hpp"
+
+#if defined(UTF_CONVERT_SIMD_X86)
+
+namespace {
+using utf_convert::simd::ssse3_kernels;
+
+// Load two unaligned xmm registers into the lower and upper lanes.
+UTF_CONVERT_TARGET("avx2")
+inline __m256i load_u8x32_avx2(const uint8_t *lo, const uint8_t *hi) {
+    return _mm256_inserti128_si256(
+        _mm256_castsi128_si256(
+            _mm_loadu_si128(reinterpret_cast<const __m128i *>(lo))),
+        _mm_loadu_si128(reinterpret_cast<const __m128i *>(hi)),
+        1);
+}
+
+// Same as load_u8_block_ssse3, for a block of 64 bytes.
+UTF_CONVERT_TARGET("avx2")
+inline void load_u8_block_avx2(const uint8_t *src, u8_block_masks &m) {
+    uint64_t sign = 0, two = 0, three = 0, four = 0;
+    for (unsigned i = 0; i < 2; i++) {
+        const __m256i in =
+            _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src + i * 32));
+        const uint64_t bits = static_cast<uint32_t>(_mm256_movemask_epi8(in));
+        if (bits == 0)
+            continue;
+
+        sign |= bits << (i * 32);
+        two |= (static_cast<uint32_t>(_mm256_movemask_epi8(
+                    _mm256_cmpgt_epi8(in, _mm256_set1_epi8(-65)))) &
+                bits)
+               << (i * 32);
+        three |= (static_cast<uint32_t>(_mm256_movemask_epi8(
+                      _mm256_cmpgt_epi8(in, _mm256_set1_epi8(-33)))) &
+                  bits)
+                 << (i * 32);
+        four |= (static_cast<uint32_t>(_mm256_movemask_epi8(
+                     _mm256_cmpgt_epi8(in, _mm256_set1_epi8(-17)))) &
+                 bits)
+                << (i * 32);
+    }
+    set_u8_block_masks(m, sign, two, three, four);
+}
+
+UTF_CONVERT_TARGET("avx2")
+void u8_to_u32_avx2(const uint8_t *&src,
+                    const uint8_t * end,
+                    char32_t *&     dst,
+                    char32_t *      dst_end,
+                    UTF_ENDIAN      endian) {
+    const u8_decode_table &table = u8_decode_table::get();
+    const bool big_endian = endian == utf_convert::UTF_ENDIAN_BIG_ENDIAN;
+
+    const uint8_t * s = src;
+    char32_t *      d = dst;
+    u8_block_masks  m;
+
+    while (end - s >= 64 && dst_end - d >= 64) {
+        load_u8_block_avx2(s, m);
+
+        if (m.sign == 0) {
+            for (int i = 0; i < 8; i++) {
+                __m256i out = _mm256_cvtepu8_epi32(_mm_loadl_epi64(
+                    reinterpret_cast<const __m128i *>(s + i * 8)));
+                if (big_endian)
+                    out = _mm256_slli_epi32(out, 24);
+                _mm256_storeu_si256(reinterpret_cast<__m256i *>(d + i * 8),
+                                    out);
+            }
+            s += 64;
+            d += 64;
+            continue;
+        }
+
+        // The sequences take at most twelve bytes, decoded in xmm registers.
+        const unsigned done =
+            u8_to_u32_block_ssse3(table, m, s, 48, d, big_endian);
+        s += done;
+        if (done < 48)
+            break;
+    }
+
+    src = s;
+    dst = d;
+
+    // The tail shorter than a block may still fill a xmm register.
+    ssse3_kernels.u8_to_u32(src, end, dst, dst_end, endian);
+}
+
+/*!
+ * Pack eight lanes spread as described in u8_encode_table to dst, given the
+ * lane masks of (c >= 0x80), (c >= 0x800) and (c >= 0x10000). Returns the
+ * length.
+ */
+UTF_CONVERT_TARGET("avx2")
+inline size_t store_u8x8_avx2(const u8_encode_table &table,
+                              __m256i                bytes,
+                              unsigned               two,
+                              unsigned               three,
+                              unsigned               four,
+                              char *                 dst) {
+    const u8_encode_entry &first =
+        table.entry[u8_encode_spread[two & 0x0f] +
+                    u8_encode_spread[three & 0x0f] +
+                    u8_encode_spread[four & 0x0f]];
+    const u8_encode_entry &second =
+        table.entry[u8_encode_spread[two >> 4] + u8_encode_spread[three >> 4] +
+                    u8_encode_spread[four >> 4]];
+
+    const __m256i packed = _mm256_shuffle_epi8(
+        bytes, load_u8x32_avx2(first.shuffle, second.shuffle));
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(dst),
+                     _mm256_castsi256_si128(packed));
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + first.length),
+                     _mm256_extracti128_si256(packed, 1));
+    return first.length + second.length;
+}
+
+UTF_CONVERT_TARGET("avx2")
+void u32_to_u8_avx2(const char32_t *&src,
+                    const char32_t * end,
+                    char *&          dst,
+                    char *           dst_end,
+                    UTF_ENDIAN       endian) {
+    const u8_encode_table &table = u8_encode_table::get();
+    const bool    big_endian = endian == utf_convert::UTF_ENDIAN_BIG_ENDIAN;
+    const __m256i swap       = _mm256_setr_epi8(3, 2, 1, 0, 7, 6, 5, 4, 11, 10,
+                                          9, 8, 15, 14, 13, 12, 3, 2, 1, 0, 7,
+                                          6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12);
+
+    const char32_t *s = src;
+    char *          d = dst;
+
+    while (end - s >= 8 && dst_end - d >= 32) {
+        if (end - s >= 16) {
+            __m256i lo =
+                _mm256_loadu_si256(reinterpret_cast<const __m256i *>(s));
+            __m256i hi =
+                _mm256_loadu_si256(reinterpret_cast<const __m256i *>(s + 8));
+            if (big_endian) {
+                lo = _mm256_shuffle_epi8(lo, swap);
+                hi = _mm256_shuffle_epi8(hi, swap);
+            }
+
+            const __m256i any = _mm256_or_si256(lo, hi);
+            if (_mm256_testz_si256(any, _mm256_set1_epi32(~0x7f))) {
+                // Pack within lanes, then put the qwords back in order.
+                const __m256i words = _mm256_permute4x64_epi64(
+                    _mm256_packs_epi32(lo, hi), 0xd8);
+                const __m256i bytes = _mm256_permute4x64_epi64(
+                    _mm256_packus_epi16(words, words), 0x08);
+                _mm_storeu_si128(reinterpret_cast<__m128i *>(d),
+                                 _mm256_castsi256_si128(bytes));
+                s += 16;
+                d += 16;
+                continue;
+            }
+        }
+
+        __m256i in = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(s));
+        if (big_endian)
+            in = _mm256_shuffle_epi8(in, swap);
+        if (_mm256_movemask_epi8(_mm256_cmpgt_epi32(
+                _mm256_srli_epi32(in, 16), _mm256_set1_epi32(0x10))) != 0)
+            break;
+
+        const __m256i two   = _mm256_cmpgt_epi32(in, _mm256_set1_epi32(0x7f));
+        const __m256i three = _mm256_cmpgt_epi32(in, _mm256_set1_epi32(0x7ff));
+        const __m256i four  = _mm256_cmpgt_epi32(in, _mm256_set1_epi32(0xffff));
+
+        __m256i bytes = _mm256_and_si256(in, _mm256_set1_epi32(0x0000003f));
+        bytes         = _mm256_or_si256(bytes,
+                                _mm256_and_si256(_mm256_slli_epi32(in, 2),
+                                                 _mm256_set1_epi32(0x00003f00)));
+        bytes         = _mm256_or_si256(bytes,
+                                _mm256_and_si256(_mm256_slli_epi32(in, 4),
+                                                 _mm256_set1_epi32(0x003f0000)));
+        bytes         = _mm256_or_si256(bytes,
+                                _mm256_and_si256(_mm256_slli_epi32(in, 6),
+                                                 _mm256_set1_epi32(0x3f000000)));
+
+        __m256i prefix = _mm256_and_si256(two, _mm256_set1_epi32(0x0000c080));
+        prefix         = _mm256_xor_si256(
+            prefix, _mm256_and_si256(three, _mm256_set1_epi32(0x00e04000)));
+        prefix = _mm256_xor_si256(
+            prefix, _mm256_and_si256(four, _mm256_set1_epi32(0xf0600000)));
+
+        bytes = _mm256_or_si256(
+            _mm256_and_si256(two, _mm256_or_si256(bytes, prefix)),
+            _mm256_andnot_si256(two, in));
+
+        d += store_u8x8_avx2(table,
+                             bytes,
+                             _mm256_movemask_ps(_mm256_castsi256_ps(two)),
+                             _mm256_movemask_ps(_mm256_castsi256_ps(three)),
+                             _mm256_movemask_ps(_mm256_castsi256_ps(four)),
+                             d);
+        s += 8;
+    }
+
+    src = s;
+    dst = d;
+
+    ssse3_kernels.u32_to_u8(src, end, dst, dst_end, endian);
+}
+
+UTF_CONVERT_TARGET("avx2")
+inline __m256i encode_u16x8_avx2(__m256i   in,
+                                 __m256i   prev,
+                                 unsigned &mask_two,
+                                 unsigned &mask_three) {
+    const __m256i two = _mm256_cmpgt_epi32(in, _mm256_set1_epi32(0x7f));
+    const __m256i surrogate =
+        _mm256_cmpeq_epi32(_mm256_and_si256(in, _mm256_set1_epi32(0xf800)),
+                           _mm256_set1_epi32(0xd800));
+    const __m256i high =
+        _mm256_cmpeq_epi32(_mm256_and_si256(in, _mm256_set1_epi32(0xfc00)),
+                           _mm256_set1_epi32(0xd800));
+    const __m256i three = _mm256_andnot_si256(
+        surrogate, _mm256_cmpgt_epi32(in, _mm256_set1_epi32(0x7ff)));
+
+    __m256i bytes = _mm256_and_si256(in, _mm256_set1_epi32(0x0000003f));
+    bytes         = _mm256_or_si256(bytes,
+                            _mm256_and_si256(_mm256_slli_epi32(in, 2),
+                                             _mm256_set1_epi32(0x00003f00)));
+    bytes         = _mm256_or_si256(bytes,
+                            _mm256_and_si256(_mm256_slli_epi32(in, 4),
+                                             _mm256_set1_epi32(0x003f0000)));
+
+    __m256i prefix = _mm256_and_si256(two, _mm256_set1_epi32(0x0000c080));
+    prefix         = _mm256_xor_si256(
+        prefix, _mm256_and_si256(three, _mm256_set1_epi32(0x00e04000)));
+
+    bytes = _mm256_or_si256(
+        _mm256_and_si256(two, _mm256_or_si256(bytes, prefix)),
+        _mm256_andnot_si256(two, in));
+
+    const __m256i h =
+        _mm256_add_epi32(_mm256_and_si256(in, _mm256_set1_epi32(0x3ff)),
+                         _mm256_set1_epi32(0x40));
+    const __m256i high_bytes = _mm256_or_si256(
+        _mm256_or_si256(
+            _mm256_and_si256(h, _mm256_set1_epi32(0x700)),
+            _mm256_and_si256(_mm256_srli_epi32(h, 2), _mm256_set1_epi32(0x3f))),
+        _mm256_set1_epi32(0xf080));
+    const __m256i low_bytes = _mm256_or_si256(
+        _mm256_or_si256(
+            _mm256_slli_epi32(_mm256_and_si256(prev, _mm256_set1_epi32(0x03)),
+                              12),
+            _mm256_and_si256(_mm256_slli_epi32(in, 2),
+                             _mm256_set1_epi32(0xf00))),
+        _mm256_or_si256(_mm256_and_si256(in, _mm256_set1_epi32(0x3f)),
+                        _mm256_set1_epi32(0x8080)));
+    const __m256i pair_bytes =
+        _mm256_or_si256(_mm256_and_si256(high, high_bytes),
+                        _mm256_andnot_si256(high, low_bytes));
+
+    mask_two   = _mm256_movemask_ps(_mm256_castsi256_ps(two));
+    mask_three = _mm256_movemask_ps(_mm256_castsi256_ps(three));
+
+    return _mm256_or_si256(_mm256_and_si256(surrogate, pair_bytes),
+                           _mm256_andnot_si256(surrogate, bytes));
+}
+
+UTF_CONVERT_TARGET("avx2")
+inline __m256i load_u16x16_avx2(const char16_t *src, bool big_endian) {
+    const __m256i in =
+        _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src));
+    if (!big_endian)
+        return in;
+    return _mm256_or_si256(_mm256_slli_epi16(in, 8), _mm256_srli_epi16(in, 8));
+}
+
+UTF_CONVERT_TARGET("avx2")
+void u16_to_u8_avx2(const char16_t *&src,
+                    const char16_t * end,
+                    char *&          dst,
+                    char *           dst_end,
+                    UTF_ENDIAN       endian) {
+    const u8_encode_table &table = u8_encode_table::get();
+    const bool big_endian = endian == utf_convert::UTF_ENDIAN_BIG_ENDIAN;
+
+    const char16_t *s = src;
+    char *          d = dst;
+
+    bool     pending      = false;
+    uint16_t pending_high = 0;
+
+    while (end - s >= 32 && dst_end - d >= 64) {
+        const __m256i in = load_u16x16_avx2(s, big_endian);
+
+        if (!pending) {
+            const __m256i next = load_u16x16_avx2(s + 16, big_endian);
+            if (_mm256_testz_si256(_mm256_or_si256(in, next),
+                                   _mm256_set1_epi16(static_cast<short>(0xff80)))) {
+                _mm256_storeu_si256(
+                    reinterpret_cast<__m256i *>(d),
+                    _mm256_permute4x64_epi64(_mm256_packus_epi16(in, next),
+                                             0xd8));
+                s += 32;
+                d += 32;
+                continue;
+            }
+        }
+
+        const uint32_t high = _mm256_movemask_epi8(_mm256_cmpeq_epi16(
+            _mm256_and_si256(in, _mm256_set1_epi16(static_cast<short>(0xfc00))),
+            _mm256_set1_epi16(static_cast<short>(0xd800))));
+        const uint32_t low = _mm256_movemask_epi8(_mm256_cmpeq_epi16(
+            _mm256_and_si256(in, _mm256_set1_epi16(static_cast<short>(0xfc00))),
+            _mm256_set1_epi16(static_cast<short>(0xdc00))));
+
+        bool paired = low == ((high << 2) | (pending ? 0x03 : 0));
+        if (paired && (high & 0x80000000))
+            paired = (load_u16(s + 16, big_endian) & 0xfc00) == 0xdc00;
+
+        if (paired) {
+            // Shift the units up by one across the lanes.
+            __m256i prev = _mm256_alignr_epi8(
+                in, _mm256_permute2x128_si256(in, in, 0x08), 14);
+            prev = _mm256_insert_epi16(prev, pending_high, 0);
+
+            unsigned two, three;
+            __m256i  bytes = encode_u16x8_avx2(
+                _mm256_cvtepu16_epi32(_mm256_castsi256_si128(in)),
+                _mm256_cvtepu16_epi32(_mm256_castsi256_si128(prev)),
+                two,
+                three);
+            d += store_u8x8_avx2(table, bytes, two, three, 0, d);
+            bytes = encode_u16x8_avx2(
+                _mm256_cvtepu16_epi32(_mm256_extracti128_si256(in, 1)),
+                _mm256_cvtepu16_epi32(_mm256_extracti128_si256(prev, 1)),
+                two,
+                three);
+            d += store_u8x8_avx2(table, bytes, two, three, 0, d);
+
+            pending      = (high & 0x80000000) != 0;
+            pending_high = _mm256_extract_epi16(in, 15);
+            s += 16;
+            continue;
+        }
+
+        if (pending) {
+            encode_u16_low_surrogate(pending_high, load_u16(s, big_endian), d);
+            pending = false;
+            s++;
+            continue;
+        }
+
+        const char16_t *stop = s + trailing_zeros(high | low) / 2 + 1;
+        while (s < stop) {
+            if (!encode_u16_code_point(s, end, d, big_endian))
+                break;
+        }
+        if (s < stop)
+            break;
+    }
+
+    if (pending) {
+        encode_u16_low_surrogate(pending_high, load_u16(s, big_endian), d);
+        s++;
+    }
+
+    src = s;
+    dst = d;
+
+    ssse3_kernels.u16_to_u8(src, end, dst, dst_end, endian);
+}
+
+UTF_CONVERT_TARGET("avx2")
+void u8_to_u16_avx2(const uint8_t *&src,
+                    const uint8_t * end,
+                    char16_t *&     dst,
+                    char16_t *      dst_end,
+                    UTF_ENDIAN      endian) {
+    const u8_decode_table &table = u8_decode_table::get();
+    const bool big_endian = endian == utf_convert::UTF_ENDIAN_BIG_ENDIAN;
+
+    const uint8_t * s = src;
+    char16_t *      d = dst;
+    u8_block_masks  m;
+
+    while (end - s >= 64 && dst_end - d >= 64) {
+        load_u8_block_avx2(s, m);
+
+        if (m.sign == 0) {
+            for (int i = 0; i < 4; i++) {
+                __m256i out = _mm256_cvtepu8_epi16(_mm_loadu_si128(
+                    reinterpret_cast<const __m128i *>(s + i * 16)));
+                if (big_endian)
+                    out = _mm256_slli_epi16(out, 8);
+                _mm256_storeu_si256(reinterpret_cast<__m256i *>(d + i * 16),
+                                    out);
+            }
+            s += 64;
+            d += 64;
+            continue;
+        }
+
+        // Mixed blocks are converted like in u8_to_u32_avx2.
+        const unsigned done =
+            u8_to_u16_block_ssse3(table, m, s, 48, d, big_endian);
+        s += done;
+        if (done < 48)
+            break;
+    }
+
+    src = s;
+    dst = d;
+
+    ssse3_kernels.u8_to_u16(src, end, dst, dst_end, endian);
+}
+
+UTF_CONVERT_TARGET("avx2")
+void u16_to_u32_avx2(const char16_t *&src,
+                     const char16_t * end,
+                     char32_t *&      dst,
+                     char32_t *       dst_end,
+                     UTF_ENDIAN       src_endian,
+                     UTF_ENDIAN       dst_endian) {
+    const bool src_big_endian = src_endian == utf_convert::UTF_ENDIAN_BIG_ENDIAN;
+    const bool dst_big_endian = dst_endian == utf_convert::UTF_ENDIAN_BIG_ENDIAN;
+    const __m256i swap = _mm256_setr_epi8(3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8,
+                                          15, 14, 13, 12, 3, 2, 1, 0, 7, 6, 5,
+                                          4, 11, 10, 9, 8, 15, 14, 13, 12);
+
+    const char16_t *s = src;
+    char32_t *      d = dst;
+
+    while (end - s >= 16 && dst_end - d >= 16) {
+        const __m256i in = load_u16x16_avx2(s, src_big_endian);
+        const __m256i surrogate = _mm256_cmpeq_epi16(
+            _mm256_and_si256(in, _mm256_set1_epi16(static_cast<short>(0xf800))),
+            _mm256_set1_epi16(static_cast<short>(0xd800)));
+
+        if (_mm256_movemask_epi8(surrogate) == 0) {
+            __m256i lo = _mm256_cvtepu16_epi32(_mm256_castsi256_si128(in));
+            __m256i hi = _mm256_cvtepu16_epi32(_mm256_extracti128_si256(in, 1));
+            if (dst_big_endian) {
+                lo = _mm256_shuffle_epi8(lo, swap);
+                hi = _mm256_shuffle_epi8(hi, swap);
+            }
+            _mm256_storeu_si256(reinterpret_cast<__m256i *>(d), lo);
+            _mm256_storeu_si256(reinterpret_cast<__m256i *>(d + 8), hi);
+            s += 16;
+            d += 16;
+            continue;
+        }
+
+        const char16_t *stop = s + 16;
+        while (s < stop) {
+            if (!decode_u16_code_point(
+                    s, end, d, src_big_endian, dst_big_endian))
+                break;
+        }
+        if (s < stop)
+            break;
+    }
+
+    src = s;
+    dst = d;
+
+    ssse3_kernels.u16_to_u32(src, end, dst, dst_end, src_endian, dst_endian);
+}
+
+UTF_CONVERT_TARGET("avx2")
+void u32_to_u16_avx2(const char32_t *&src,
+                     const char32_t * end,
+                     char16_t *&      dst,
+                     char16_t *       dst_end,
+                     UTF_ENDIAN       src_endian,
+                     UTF_ENDIAN       dst_endian) {
+    const bool src_big_endian = src_endian == utf_convert::UTF_ENDIAN_BIG_ENDIAN;
+    const bool dst_big_endian = dst_endian == utf_convert::UTF_ENDIAN_BIG_ENDIAN;
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i swap = _mm256_setr_epi8(3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8,
+                                          15, 14, 13, 12, 3, 2, 1, 0, 7, 6, 5,
+                                          4, 11, 10, 9, 8, 15, 14, 13, 12);
+
+    const char32_t *s = src;
+    char16_t *      d = dst;
+
+    while (end - s >= 16 && dst_end - d >= 32) {
+        __m256i lo = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(s));
+        __m256i hi =
+            _mm256_loadu_si256(reinterpret_cast<const __m256i *>(s + 8));
+        if (src_big_endian) {
+            lo = _mm256_shuffle_epi8(lo, swap);
+            hi = _mm256_shuffle_epi8(hi, swap);
+        }
+
+        if (_mm256_movemask_epi8(_mm256_cmpeq_epi32(
+                _mm256_srli_epi32(_mm256_or_si256(lo, hi), 16), zero)) ==
+            static_cast<int>(0xffffffff)) {
+            // The values fit, so the saturation of packus never applies.
+            __m256i out = _mm256_permute4x64_epi64(_mm256_packus_epi32(lo, hi),
+                                                   0xd8);
+            if (dst_big_endian)
+                out = _mm256_or_si256(_mm256_slli_epi16(out, 8),
+                                      _mm256_srli_epi16(out, 8));
+            _mm256_storeu_si256(reinterpret_cast<__m256i *>(d), out);
+            s += 16;
+            d += 16;
+            continue;
+        }
+
+        const char32_t *stop = s + 16;
+        for (; s < stop; s++) {
+            if (!encode_u16_unit(load_u32(s, src_big_endian), d, dst_big_endian))
+                break;
+        }
+        if (s < stop)
+            break;
+    }
+
+    src = s;
+    dst = d;
+
+    ssse3_kernels.u32_to_u16(src, end, dst, dst_end, src_endian, dst_endian);
+}
+
+UTF_CONVERT_TARGET("avx2,popcnt")
+size_t utf32_length_from_utf8_avx2(const uint8_t *&src, const uint8_t *end) {
+    const uint8_t *s     = src;
+    size_t         count = 0;
+
+    while (end - s >= 32) {
+        const __m256i in =
+            _mm256_loadu_si256(reinterpret_cast<const __m256i *>(s));
+        count += count_ones(_mm256_movemask_epi8(
+            _mm256_cmpgt_epi8(in, _mm256_set1_epi8(-65))));
+        s += 32;
+    }
+
+    src = s;
+    return count;
+}
+
+UTF_CONVERT_TARGET("avx2,popcnt")
+size_t utf8_length_from_utf32_avx2(const char32_t *&src,
+                                   const char32_t * end,
+                                   UTF_ENDIAN       endian) {
+    const bool    big_endian = endian == utf_convert::UTF_ENDIAN_BIG_ENDIAN;
+    const __m256i swap       = _mm256_setr_epi8(3, 2, 1, 0, 7, 6, 5, 4, 11, 10,
+                                          9, 8, 15, 14, 13, 12, 3, 2, 1, 0, 7,
+                                          6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12);
+    const __m256i bias       = _mm256_set1_epi32(0x80000000);
+
+    const char32_t *s     = src;
+    size_t          count = 0;
+
+    while (end - s >= 8) {
+        __m256i in = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(s));
+        if (big_endian)
+            in = _mm256_shuffle_epi8(in, swap);
+        in = _mm256_xor_si256(in, bias);
+
+        count +=
+            8 +
+            count_ones(_mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpgt_epi32(
+                in, _mm256_xor_si256(_mm256_set1_epi32(0x7f), bias))))) +
+            count_ones(_mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpgt_epi32(
+                in, _mm256_xor_si256(_mm256_set1_epi32(0x7ff), bias))))) +
+            count_ones(_mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpgt_epi32(
+                in, _mm256_xor_si256(_mm256_set1_epi32(0xffff), bias)))));
+        s += 8;
+    }
+
+    src = s;
+    return count;
+}
+
+UTF_CONVERT_TARGET("avx2,popcnt")
+size_t utf8_length_from_utf16_avx2(const char16_t *&src,
+                                   const char16_t * end,
+                                   UTF_ENDIAN       endian) {
+    const bool    big_endian = endian == utf_convert::UTF_ENDIAN_BIG_ENDIAN;
+    const __m256i zero       = _mm256_setzero_si256();
+
+    const char16_t *s         = src;
+    size_t          count     = 0;
+    uint32_t        prev_high = 0;
+
+    while (end - s >= 16) {
+        const __m256i in = load_u16x16_avx2(s, big_endian);
+
+        const uint32_t two = ~_mm256_movemask_epi8(_mm256_cmpeq_epi16(
+            _mm256_and_si256(in, _mm256_set1_epi16(static_cast<short>(0xff80))),
+            zero));
+        const uint32_t three = ~_mm256_movemask_epi8(_mm256_cmpeq_epi16(
+            _mm256_and_si256(in, _mm256_set1_epi16(static_cast<short>(0xf800))),
+            zero));
+        const uint32_t surrogate = _mm256_movemask_epi8(_mm256_cmpeq_epi16(
+            _mm256_and_si256(in, _mm256_set1_epi16(static_cast<short>(0xf800))),
+            _mm256_set1_epi16(static_cast<short>(0xd800))));
+        const uint32_t high = _mm256_movemask_epi8(_mm256_cmpeq_epi16(
+            _mm256_and_si256(in, _mm256_set1_epi16(static_cast<short>(0xfc00))),
+            _mm256_set1_epi16(static_cast<short>(0xd800))));
+        const uint32_t lone_low =
+            surrogate & ~high & ~((high << 2) | prev_high);
+
+        count += 16 + (count_ones(two) + count_ones(three & ~surrogate) +
+                       count_ones(lone_low)) /
+                          2;
+        prev_high = (high & 0x80000000) ? 0x03 : 0;
+        s += 16;
+    }
+
+    src = s;
+    return count;
+}
+
+UTF_CONVERT_TARGET("avx2,popcnt")
+size_t utf16_length_from_utf8_avx2(const uint8_t *&src, const uint8_t *end) {
+    const uint8_t *s     = src;
+    size_t         count = 0;
+
+    while (end - s >= 32) {
+        const __m256i in =
+            _mm256_loadu_si256(reinterpret_cast<const __m256i *>(s));
+        const __m256i four_bytes =
+            _mm256_cmpeq_epi8(_mm256_max_epu8(in, _mm256_set1_epi8(-16)), in);
+        count += count_ones(_mm256_movemask_epi8(
+            _mm256_cmpgt_epi8(in, _mm256_set1_epi8(-65))));
+        count += count_ones(_mm256_movemask_epi8(four_bytes));
+        s += 32;
+    }
+
+    src = s;
+    return count;
+}
+
+UTF_CONVERT_TARGET("avx2,popcnt")
+size_t utf32_length_from_utf16_avx2(const char16_t *&src,
+                                    const char16_t * end,
+                                    UTF_ENDIAN       endian) {
+    const bool big_endian = endian == utf_convert::UTF_ENDIAN_BIG_ENDIAN;
+
+    const char16_t *s         = src;
+    size_t          count     = 0;
+    uint32_t        prev_high = 0;
+
+    while (end - s >= 16) {
+        const __m256i  in   = load_u16x16_avx2(s, big_endian);
+        const uint32_t high = _mm256_movemask_epi8(_mm256_cmpeq_epi16(
+            _mm256_and_si256(in, _mm256_set1_epi16(static_cast<short>(0xfc00))),
+            _mm256_set1_epi16(static_cast<short>(0xd800))));
+        const uint32_t low = _mm256_movemask_epi8(_mm256_cmpeq_epi16(
+            _mm256_and_si256(in, _mm256_set1_epi16(static_cast<short>(0xfc00))),
+            _mm256_set1_epi16(static_cast<short>(0xdc00))));
+
+        count += 16 - count_ones(low & ((high << 2) | prev_high)) / 2;
+        prev_high = (high & 0x80000000) ? 0x03 : 0;
+        s += 16;
+    }
+
+    src = s;
+    return count;
+}
+
+UTF_CONVERT_TARGET("avx2,popcnt")
+size_t utf16_length_from_utf32_avx2(const char32_t *&src,
+                                    const char32_t * end,
+                                    UTF_ENDIAN       endian) {
+    const bool    big_endian = endian == utf_convert::UTF_ENDIAN_BIG_ENDIAN;
+    const __m256i swap       = _mm256_setr_epi8(3, 2, 1, 0, 7, 6, 5, 4, 11, 10,
+                                          9, 8, 15, 14, 13, 12, 3, 2, 1, 0, 7,
+                                          6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12);
+    const __m256i bias       = _mm256_set1_epi32(0x80000000);
+
+    const char32_t *s     = src;
+    size_t          count = 0;
+
+    while (end - s >= 8) {
+        __m256i in = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(s));
+        if (big_endian)
+            in = _mm256_shuffle_epi8(in, swap);
+
+        count += 8 + count_ones(_mm256_movemask_ps(
+                         _mm256_castsi256_ps(_mm256_cmpgt_epi32(
+                             _mm256_xor_si256(in, bias),
+                             _mm256_xor_si256(_mm256_set1_epi32(0xffff), bias)))));
+        s += 8;
+    }
+
+    src = s;
+    return count;
+}
+
+// Same as u8_errors_ssse3, for both lanes.
+UTF_CONVERT_TARGET("avx2")
+inline __m256i u8_errors_avx2(__m256i in,
+                              __m256i prev_in,
+                              __m256i byte_1_high,
+                              __m256i byte_1_low,
+                              __m256i byte_2_high) {
+    const __m256i nibble = _mm256_set1_epi8(0x0f);
+    // The last bytes of prev_in below the first lane of in, for alignr.
+    const __m256i shifted = _mm256_permute2x128_si256(prev_in, in, 0x21);
+    const __m256i prev1   = _mm256_alignr_epi8(in, shifted, 15);
+    const __m256i prev2   = _mm256_alignr_epi8(in, shifted, 14);
+    const __m256i prev3   = _mm256_alignr_epi8(in, shifted, 13);
+
+    const __m256i special = _mm256_and_si256(
+        _mm256_and_si256(
+            _mm256_shuffle_epi8(
+                byte_1_high,
+                _mm256_and_si256(_mm256_srli_epi16(prev1, 4), nibble)),
+            _mm256_shuffle_epi8(byte_1_low, _mm256_and_si256(prev1, nibble))),
+        _mm256_shuffle_epi8(byte_2_high,
+                            _mm256_and_si256(_mm256_srli_epi16(in, 4), nibble)));
+
+    const __m256i must_be_continuation = _mm256_and_si256(
+        _mm256_or_si256(_mm256_subs_epu8(prev2, _mm256_set1_epi8(0xe0 - 0x80)),
+                        _mm256_subs_epu8(prev3, _mm256_set1_epi8(0xf0 - 0x80))),
+        _mm256_set1_epi8(static_cast<char>(0x80)));
+    return _mm256_xor_si256(must_be_continuation, special);
+}
+
+UTF_CONVERT_TARGET("avx2")
+void validate_utf8_avx2(const uint8_t *&src, const uint8_t *end) {
+    const __m256i byte_1_high = _mm256_broadcastsi128_si256(
+        _mm_loadu_si128(reinterpret_cast<const __m128i *>(u8_byte_1_high)));
+    const __m256i byte_1_low = _mm256_broadcastsi128_si256(
+        _mm_loadu_si128(reinterpret_cast<const __m128i *>(u8_byte_1_low)));
+    const __m256i byte_2_high = _mm256_broadcastsi128_si256(
+        _mm_loadu_si128(reinterpret_cast<const __m128i *>(u8_byte_2_high)));
+    const __m256i zero      = _mm256_setzero_si256();
+    const __m256i max_value = _mm256_setr_epi8(
+        -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+        -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+        static_cast<char>(0xf0 - 1), static_cast<char>(0xe0 - 1),
+        static_cast<char>(0xc0 - 1));
+
+    const uint8_t *s               = src;
+    __m256i        prev_in         = zero;
+    __m256i        prev_incomplete = zero;
+
+    while (end - s >= 32) {
+        const __m256i in =
+            _mm256_loadu_si256(reinterpret_cast<const __m256i *>(s));
+
+        __m256i error = prev_incomplete;
+        if (_mm256_movemask_epi8(in) != 0) {
+            error = u8_errors_avx2(
+                in, prev_in, byte_1_high, byte_1_low, byte_2_high);
+        }
+        if (!_mm256_testz_si256(error, error))
+            break;
+
+        prev_in         = in;
+        prev_incomplete = _mm256_subs_epu8(in, max_value);
+        s += 32;
+    }
+
+    src = u8_sequence_start(src, s);
+}
+
+UTF_CONVERT_TARGET("avx2")
+void validate_utf16_avx2(const char16_t *&src,
+                         const char16_t * end,
+                         UTF_ENDIAN       endian) {
+    const bool    big_endian = endian == utf_convert::UTF_ENDIAN_BIG_ENDIAN;
+    const __m256i mask = _mm256_set1_epi16(static_cast<short>(0xfc00));
+
+    const char16_t *s         = src;
+    uint32_t        prev_high = 0;
+
+    while (end - s >= 16) {
+        const __m256i in =
+            _mm256_and_si256(load_u16x16_avx2(s, big_endian), mask);
+        const __m256i high = _mm256_cmpeq_epi16(
+            in, _mm256_set1_epi16(static_cast<short>(0xd800)));
+        const __m256i low = _mm256_cmpeq_epi16(
+            in, _mm256_set1_epi16(static_cast<short>(0xdc00)));
+
+        // The packs work per lane, so bring the high surrogates to bits 0 to
+        // 15 and the low ones to bits 16 to 31.
+        const uint32_t bits = _mm256_movemask_epi8(_mm256_permute4x64_epi64(
+            _mm256_packs_epi16(high, low), 0xd8));
+        if ((((bits << 1) | prev_high) & 0xffff) != bits >> 16)
+            break;
+
+        prev_high = (bits >> 15) & 1;
+        s += 16;
+    }
+
+    src = s - prev_high;
+}
+
+UTF_CONVERT_TARGET("avx2")
+void validate_utf32_avx2(const char32_t *&src,
+                         const char32_t * end,
+                         UTF_ENDIAN       endian) {
+    const bool    big_endian = endian == utf_convert::UTF_ENDIAN_BIG_ENDIAN;
+    const __m256i swap       = _mm256_setr_epi8(
+        3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12,
+        3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12);
+    const __m256i bias = _mm256_set1_epi32(0x80000000);
+
+    const char32_t *s = src;
+
+    while (end - s >= 8) {
+        __m256i in = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(s));
+        if (big_endian)
+            in = _mm256_shuffle_epi8(in, swap);
+
+        const __m256i too_large = _mm256_cmpgt_epi32(
+            _mm256_xor_si256(in, bias),
+            _mm256_xor_si256(_mm256_set1_epi32(0x10ffff), bias));
+        const __m256i surrogate = _mm256_cmpeq_epi32(
+            _mm256_and_si256(in, _mm256_set1_epi32(0xfffff800)),
+            _mm256_set1_epi32(0xd800));
+        if (!_mm256_testz_si256(_mm256_or_si256(too_large, surrogate),
+                                _mm256_set1_epi32(-1)))
+            break;
+        s += 8;
+    }
+
+    src = s;
+}
+
+UTF_CONVERT_TARGET("avx2")
+void ascii_prefix_avx2(const uint8_t *&src, const uint8_t *end) {
+    const uint8_t *s = src;
+
+    while (end - s >= 128) {
+        const __m256i *in  = reinterpret_cast<const __m256i *>(s);
+        const __m256i  any = _mm256_or_si256(
+            _mm256_or_si256(_mm256_loadu_si256(in), _mm256_loadu_si256(in + 1)),
+            _mm256_or_si256(_mm256_loadu_si256(in + 2),
+                            _mm256_loadu_si256(in + 3)));
+        if (_mm256_movemask_epi8(any) != 0)
+            break;
+        s += 128;
+    }
+    while (end - s >= 32) {
+        const __m256i in =
+            _mm256_loadu_si256(reinterpret_cast<const __m256i *>(s));
+        if (_mm256_movemask_epi8(in) != 0)
+            break;
+        s += 32;
+    }
+
+    src = s;
+}
+
+// Same as has_c1_ssse3.
+UTF_CONVERT_TARGET("avx2")
+inline bool has_c1_avx2(__m256i in) {
+    const __m256i c1 =
+        _mm256_xor_si256(in, _mm256_set1_epi8(static_cast<char>(0x80)));
+    return _mm256_movemask_epi8(_mm256_cmpeq_epi8(
+               _mm256_min_epu8(c1, _mm256_set1_epi8(0x1f)), c1)) != 0;
+}
+
+/*!
+ * Encode sixteen Latin-1 bytes the same way as store_latin1x8_ssse3, eight in
+ * every lane.
+ */
+UTF_CONVERT_TARGET("avx2")
+inline size_t store_latin1x16_avx2(const latin1_encode_table &table,
+                                   __m128i                    in,
+                                   unsigned                   non_ascii,
+                                   char *                     dst) {
+    const __m256i lanes = _mm256_cvtepu8_epi16(in);
+    const __m256i lead =
+        _mm256_or_si256(_mm256_srli_epi16(lanes, 6), _mm256_set1_epi16(0xc0));
+    const __m256i cont = _mm256_slli_epi16(
+        _mm256_or_si256(_mm256_and_si256(lanes, _mm256_set1_epi16(0x3f)),
+                        _mm256_set1_epi16(0x80)),
+        8);
+    const __m256i bytes =
+        _mm256_blendv_epi8(lanes, _mm256_or_si256(lead, cont),
+                           _mm256_cmpgt_epi16(lanes, _mm256_set1_epi16(0x7f)));
+
+    const latin1_encode_entry &first  = table.entry[non_ascii & 0xff];
+    const latin1_encode_entry &second = table.entry[non_ascii >> 8];
+    const __m256i              packed = _mm256_shuffle_epi8(
+        bytes, load_u8x32_avx2(first.shuffle, second.shuffle));
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(dst),
+                     _mm256_castsi256_si128(packed));
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + first.length),
+                     _mm256_extracti128_si256(packed, 1));
+    return first.length + second.length;
+}
+
+UTF_CONVERT_TARGET("avx2")
+void latin1_to_u8_avx2(const uint8_t *&src,
+                       const uint8_t * end,
+                       char *&         dst,
+                       char *          dst_end,
+                       UTF_CHARSET     charset) {
+    const latin1_encode_table &table = latin1_encode_table::get();
+    const bool cp1252 = charset == utf_convert::UTF_CHARSET_WINDOWS_1252;
+
+    const uint8_t *s = src;
+    char *         d = dst;
+
+    while (end - s >= 32 && dst_end - d >= 64) {
+        const __m256i in =
+            _mm256_loadu_si256(reinterpret_cast<const __m256i *>(s));
+        const uint32_t non_ascii = _mm256_movemask_epi8(in);
+
+        if (non_ascii == 0) {
+            _mm256_storeu_si256(reinterpret_cast<__m256i *>(d), in);
+            s += 32;
+            d += 32;
+            continue;
+        }
+        if (cp1252 && has_c1_avx2(in))
+            break;
+
+        d += store_latin1x16_avx2(
+            table, _mm256_castsi256_si128(in), non_ascii & 0xffff, d);
+        d += store_latin1x16_avx2(
+            table, _mm256_extracti128_si256(in, 1), non_ascii >> 16, d);
+        s += 32;
+    }
+
+    src = s;
+    dst = d;
+}
+
+/*
+ * The widening kernels below take half a register of bytes at a time, with
+ * vpmovzx, and shift the low bytes up for big endian.
+ */
+UTF_CONVERT_TARGET("avx2")
+void latin1_to_u16_avx2(const uint8_t *&src,
+                        const uint8_t * end,
+                        char16_t *&     dst,
+                        char16_t *      dst_end,
+                        UTF_ENDIAN      endian,
+                        UTF_CHARSET     charset) {
+    const bool big_endian = endian == utf_convert::UTF_ENDIAN_BIG_ENDIAN;
+    const bool cp1252     = charset == utf_convert::UTF_CHARSET_WINDOWS_1252;
+
+    const uint8_t *s = src;
+    char16_t *     d = dst;
+
+    while (end - s >= 32 && dst_end - d >= 32) {
+        const __m256i in =
+            _mm256_loadu_si256(reinterpret_cast<const __m256i *>(s));
+        if (cp1252 && has_c1_avx2(in))
+            break;
+
+        __m256i lo = _mm256_cvtepu8_epi16(_mm256_castsi256_si128(in));
+        __m256i hi = _mm256_cvtepu8_epi16(_mm256_extracti128_si256(in, 1));
+        if (big_endian) {
+            lo = _mm256_slli_epi16(lo, 8);
+            hi = _mm256_slli_epi16(hi, 8);
+        }
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(d), lo);
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(d + 16), hi);
+        s += 32;
+        d += 32;
+    }
+
+    src = s;
+    dst = d;
+}
+
+UTF_CONVERT_TARGET("avx2")
+void latin1_to_u32_avx2(const uint8_t *&src,
+                        const uint8_t * end,
+                        char32_t *&     dst,
+                        char32_t *      dst_end,
+                        UTF_ENDIAN      endian,
+                        UTF_CHARSET     charset) {
+    const bool big_endian = endian == utf_convert::UTF_ENDIAN_BIG_ENDIAN;
+    const bool cp1252     = charset == utf_convert::UTF_CHARSET_WINDOWS_1252;
+
+    const uint8_t *s = src;
+    char32_t *     d = dst;
+
+    while (end - s >= 32 && dst_end - d >= 32) {
+        const __m256i in =
+            _mm256_loadu_si256(reinterpret_cast<const __m256i *>(s));
+        if (cp1252 && has_c1_avx2(in))
+            break;
+
+        for (int i = 0; i < 4; i++) {
+            __m256i out = _mm256_cvtepu8_epi32(
+                _mm_loadl_epi64(reinterpret_cast<const __m128i *>(s + i * 8)));
+            if (big_endian)
+                out = _mm256_slli_epi32(out, 24);
+            _mm256_storeu_si256(reinterpret_cast<__m256i *>(d + i * 8), out);
+        }
+        s += 32;
+        d += 32;
+    }
+
+    src = s;
+    dst = d;
+}
+
+/*
+ * Ascii goes a whole register at a time, anything else half a register at a
+ * time like in the SSSE3 kernel.
+ */
+UTF_CONVERT_TARGET("avx2")
+void u8_to_latin1_avx2(const uint8_t *&src,
+                       const uint8_t * end,
+                       char *&         dst,
+                       char *          dst_end,
+                       UTF_CHARSET     charset) {
+    const u8_compress_table &table = u8_compress_table::get();
+    const bool cp1252 = charset == utf_convert::UTF_CHARSET_WINDOWS_1252;
+
+    const uint8_t *s = src;
+    char *         d = dst;
+
+    while (end - s >= 32 && dst_end - d >= 32) {
+        const __m256i in =
+            _mm256_loadu_si256(reinterpret_cast<const __m256i *>(s));
+
+        if (_mm256_movemask_epi8(in) == 0) {
+            _mm256_storeu_si256(reinterpret_cast<__m256i *>(d), in);
+            s += 32;
+            d += 32;
+            continue;
+        }
+        if (!u8_to_latin1x16_ssse3(
+                table, _mm256_castsi256_si128(in), s, d, cp1252))
+            break;
+    }
+
+    src = s;
+    dst = d;
+}
+
+UTF_CONVERT_TARGET("avx2")
+void u16_to_latin1_avx2(const char16_t *&src,
+                        const char16_t * end,
+                        char *&          dst,
+                        char *           dst_end,
+                        UTF_ENDIAN       endian,
+                        UTF_CHARSET      charset) {
+    const bool    big_endian = endian == utf_convert::UTF_ENDIAN_BIG_ENDIAN;
+    const bool    cp1252     = charset == utf_convert::UTF_CHARSET_WINDOWS_1252;
+    const __m256i high_byte  = _mm256_set1_epi16(static_cast<short>(0xff00));
+
+    const char16_t *s = src;
+    char *          d = dst;
+
+    while (end - s >= 32 && dst_end - d >= 32) {
+        const __m256i lo = load_u16x16_avx2(s, big_endian);
+        const __m256i hi = load_u16x16_avx2(s + 16, big_endian);
+        if (!_mm256_testz_si256(_mm256_or_si256(lo, hi), high_byte))
+            break;
+
+        // vpackuswb packs within the lanes, which are put back in order.
+        const __m256i out = _mm256_permute4x64_epi64(
+            _mm256_packus_epi16(lo, hi), _MM_SHUFFLE(3, 1, 2, 0));
+        if (cp1252 && has_c1_avx2(out))
+            break;
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(d), out);
+        s += 32;
+        d += 32;
+    }
+
+    src = s;
+    dst = d;
+}
+
+UTF_CONVERT_TARGET("avx2")
+void u32_to_latin1_avx2(const char32_t *&src,
+                        const char32_t * end,
+                        char *&          dst,
+                        char *           dst_end,
+                        UTF_ENDIAN       endian,
+                        UTF_CHARSET      charset) {
+    const bool    big_endian = endian == utf_convert::UTF_ENDIAN_BIG_ENDIAN;
+    const bool    cp1252     = charset == utf_convert::UTF_CHARSET_WINDOWS_1252;
+    const __m256i swap       = _mm256_setr_epi8(3, 2, 1, 0, 7, 6, 5, 4, 11, 10,
+                                          9, 8, 15, 14, 13, 12, 3, 2, 1, 0, 7,
+                                          6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12);
+    const __m256i high_bytes = _mm256_set1_epi32(0xffffff00);
+    const __m256i order      = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+
+    const char32_t *s = src;
+    char *          d = dst;
+
+    while (end - s >= 32 && dst_end - d >= 32) {
+        __m256i in[4];
+        for (int i = 0; i < 4; i++) {
+            in[i] = _mm256_loadu_si256(
+                reinterpret_cast<const __m256i *>(s + i * 8));
+            if (big_endian)
+                in[i] = _mm256_shuffle_epi8(in[i], swap);
+        }
+        const __m256i any = _mm256_or_si256(_mm256_or_si256(in[0], in[1]),
+                                            _mm256_or_si256(in[2], in[3]));
+        if (!_mm256_testz_si256(any, high_bytes))
+            break;
+
+        // The packs leave every four characters in their lane, in the order
+        // restored by the permutation.
+        const __m256i out = _mm256_permutevar8x32_epi32(
+            _mm256_packus_epi16(_mm256_packs_epi32(in[0], in[1]),
+                                _mm256_packs_epi32(in[2], in[3])),
+            order);
+        if (cp1252 && has_c1_avx2(out))
+            break;
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(d), out);
+        s += 32;
+        d += 32;
+    }
+
+    src = s;
+    dst = d;
+}
+
+UTF_CONVERT_TARGET("avx2")
+void swap_u16_avx2(char16_t *&str, char16_t *end) {
+    const __m256i swap = _mm256_setr_epi8(
+        1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14,
+        1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14);
+
+    char16_t *s = str;
+    for (; end - s >= 16; s += 16) {
+        __m256i *unit = reinterpret_cast<__m256i *>(s);
+        _mm256_storeu_si256(
+            unit, _mm256_shuffle_epi8(_mm256_loadu_si256(unit), swap));
+    }
+    str = s;
+}
+
+UTF_CONVERT_TARGET("avx2")
+void swap_u32_avx2(char32_t *&str, char32_t *end) {
+    const __m256i swap = _mm256_setr_epi8(
+        3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12,
+        3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12);
+
+    char32_t *s = str;
+    for (; end - s >= 8; s += 8) {
+        __m256i *unit = reinterpret_cast<__m256i *>(s);
+        _mm256_storeu_si256(
+            unit, _mm256_shuffle_epi8(_mm256_loadu_si256(unit), swap));
+    }
+    str = s;
+}
+
+// All ones in the bytes of in from first to first + count - 1.
+UTF_CONVERT_TARGET("avx2")
+inline __m256i in_range_u8_avx2(__m256i in, char first, char count) {
+    const __m256i off = _mm256_sub_epi8(in, _mm256_set1_epi8(first));
+    return _mm256_cmpeq_epi8(
+        _mm256_min_epu8(off, _mm256_set1_epi8(count - 1)), off);
+}
+
+UTF_CONVERT_TARGET("avx2")
+void fold_u8_avx2(char *&str, char *end, UTF_FOLD fold) {
+    const bool latin1 = fold == utf_convert::UTF_FOLD_LATIN1;
+    const __m256i case_bit = _mm256_set1_epi8(0x20);
+
+    char *  s    = str;
+    __m256i prev = _mm256_setzero_si256();
+    for (; end - s >= 32; s += 32) {
+        __m256i *     unit = reinterpret_cast<__m256i *>(s);
+        const __m256i in   = _mm256_loadu_si256(unit);
+        __m256i       mask = in_range_u8_avx2(in, 'A', 26);
+        if (latin1) {
+            // U+00C0 ~ U+00DE are 0xc3 0x80 ~ 0xc3 0x9e, and only the second
+            // byte changes. The byte before each one is shifted in from the
+            // previous register.
+            const __m256i before = _mm256_alignr_epi8(
+                in, _mm256_permute2x128_si256(prev, in, 0x21), 15);
+            const __m256i upper = _mm256_andnot_si256(
+                _mm256_cmpeq_epi8(in, _mm256_set1_epi8(char(0x97))),
+                in_range_u8_avx2(in, char(0x80), 0x1f));
+            mask = _mm256_or_si256(
+                mask,
+                _mm256_and_si256(
+                    upper,
+                    _mm256_cmpeq_epi8(before, _mm256_set1_epi8(char(0xc3)))));
+            prev = in;
+        }
+        _mm256_storeu_si256(
+            unit, _mm256_add_epi8(in, _mm256_and_si256(mask, case_bit)));
+    }
+    str = s;
+}
+
+UTF_CONVERT_TARGET("avx2")
+void fold_u16_avx2(char16_t *&str,
+                   char16_t * end,
+                   UTF_ENDIAN endian,
+                   UTF_FOLD   fold) {
+    const bool    big    = endian == utf_convert::UTF_ENDIAN_BIG_ENDIAN;
+    const bool    latin1 = fold == utf_convert::UTF_FOLD_LATIN1;
+    const __m256i swap   = _mm256_setr_epi8(
+        1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14,
+        1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14);
+
+    char16_t *s = str;
+    for (; end - s >= 16; s += 16) {
+        __m256i *unit = reinterpret_cast<__m256i *>(s);
+        __m256i  in   = _mm256_loadu_si256(unit);
+        if (big)
+            in = _mm256_shuffle_epi8(in, swap);
+
+        __m256i off  = _mm256_sub_epi16(in, _mm256_set1_epi16('A'));
+        __m256i mask = _mm256_cmpeq_epi16(
+            _mm256_min_epu16(off, _mm256_set1_epi16(25)), off);
+        if (latin1) {
+            off  = _mm256_sub_epi16(in, _mm256_set1_epi16(0xc0));
+            mask = _mm256_or_si256(
+                mask,
+                _mm256_andnot_si256(
+                    _mm256_cmpeq_epi16(in, _mm256_set1_epi16(0xd7)),
+                    _mm256_cmpeq_epi16(
+                        _mm256_min_epu16(off, _mm256_set1_epi16(0x1e)), off)));
+        }
+        in = _mm256_add_epi16(
+            in, _mm256_and_si256(mask, _mm256_set1_epi16(0x20)));
+
+        if (big)
+            in = _mm256_shuffle_epi8(in, swap);
+        _mm256_storeu_si256(unit, in);
+    }
+    str = s;
+}
+
+UTF_CONVERT_TARGET("avx2")
+void fold_u32_avx2(char32_t *&str,
+                   char32_t * end,
+                   UTF_ENDIAN endian,
+                   UTF_FOLD   fold) {
+    const bool    big    = endian == utf_convert::UTF_ENDIAN_BIG_ENDIAN;
+    const bool    latin1 = fold == utf_convert::UTF_FOLD_LATIN1;
+    const __m256i swap   = _mm256_setr_epi8(
+        3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12,
+        3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12);
+
+    char32_t *s = str;
+    for (; end - s >= 8; s += 8) {
+        __m256i *unit = reinterpret_cast<__m256i *>(s);
+        __m256i  in   = _mm256_loadu_si256(unit);
+        if (big)
+            in = _mm256_shuffle_epi8(in, swap);
+
+        __m256i off  = _mm256_sub_epi32(in, _mm256_set1_epi32('A'));
+        __m256i mask = _mm256_cmpeq_epi32(
+            _mm256_min_epu32(off, _mm256_set1_epi32(25)), off);
+        if (latin1) {
+            off  = _mm256_sub_epi32(in, _mm256_set1_epi32(0xc0));
+            mask = _mm256_or_si256(
+                mask,
+                _mm256_andnot_si256(
+                    _mm256_cmpeq_epi32(in, _mm256_set1_epi32(0xd7)),
+                    _mm256_cmpeq_epi32(
+                        _mm256_min_epu32(off, _mm256_set1_epi32(0x1e)), off)));
+        }
+        in = _mm256_add_epi32(
+            in, _mm256_and_si256(mask, _mm256_set1_epi32(0x20)));
+
+        if (big)
+            in = _mm256_shuffle_epi8(in, swap);
+        _mm256_storeu_si256(unit, in);
+    }
+    str = s;
+}
+}  // namespace
+
+const utf_convert::simd::kernel_table utf_convert::simd::avx2_kernels = {
+    u8_to_u32_avx2,
+    u32_to_u8_avx2,
+    u16_to_u8_avx2,
+    u8_to_u16_avx2,
+    u16_to_u32_avx2,
+    u32_to_u16_avx2,
+    utf32_length_from_utf8_avx2,
+    utf8_length_from_utf32_avx2,
+    utf8_length_from_utf16_avx2,
+    utf16_length_from_utf8_avx2,
+    utf32_length_from_utf16_avx2,
+    utf16_length_from_utf32_avx2,
+    validate_utf8_avx2,
+    validate_utf16_avx2,
+    validate_utf32_avx2,
+    ascii_prefix_avx2,
+    latin1_to_u8_avx2,
+    latin1_to_u16_avx2,
+    latin1_to_u32_avx2,
+    u8_to_latin1_avx2,
+    u16_to_latin1_avx2,
+    u32_to_latin1_avx2,
+    swap_u16_avx2,
+    swap_u32_avx2,
+    fold_u8_avx2,
+    fold_u16_avx2,
+    fold_u32_avx2};
+
+#endif
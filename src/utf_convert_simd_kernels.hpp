@@ -0,0 +1,1090 @@
+#ifndef UTF_CONVERT_SIMD_KERNELS_HPP
+#define UTF_CONVERT_SIMD_KERNELS_HPP
+
+#include <cstring>
+
+#include "utf_convert_simd.hpp"
+
+
+// UTF_CONVERT_NO_SIMD builds the library with the scalar code only, which the
+// benchmarks use as a baseline. The NEON kernels are only built with
+// UTF_CONVERT_NEON, see UTF_CONVERT_ENABLE_NEON in CMakeLists.txt.
+#if defined(UTF_CONVERT_NO_SIMD)
+#elif defined(__x86_64__) || defined(_M_X64)
+#define UTF_CONVERT_SIMD_X86 1
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#elif defined(UTF_CONVERT_NEON) && \
+    (defined(__aarch64__) || defined(_M_ARM64)) && !defined(__AARCH64EB__)
+#define UTF_CONVERT_SIMD_NEON 1
+#include <arm_neon.h>
+#endif
+
+#if defined(__GNUC__) || defined(__clang__)
+#define UTF_CONVERT_TARGET(isa) __attribute__((target(isa)))
+#else
+#define UTF_CONVERT_TARGET(isa)
+#endif
+
+namespace utf_convert {
+namespace simd {
+
+typedef void (*u8_to_u32_kernel)(const uint8_t *&src,
+                                 const uint8_t * end,
+                                 char32_t *&     dst,
+                                 char32_t *      dst_end,
+                                 UTF_ENDIAN      endian);
+
+typedef void (*u32_to_u8_kernel)(const char32_t *&src,
+                                 const char32_t * end,
+                                 char *&          dst,
+                                 char *           dst_end,
+                                 UTF_ENDIAN       endian);
+
+typedef void (*u16_to_u8_kernel)(const char16_t *&src,
+                                 const char16_t * end,
+                                 char *&          dst,
+                                 char *           dst_end,
+                                 UTF_ENDIAN       endian);
+
+typedef void (*u8_to_u16_kernel)(const uint8_t *&src,
+                                 const uint8_t * end,
+                                 char16_t *&     dst,
+                                 char16_t *      dst_end,
+                                 UTF_ENDIAN      endian);
+
+typedef void (*u16_to_u32_kernel)(const char16_t *&src,
+                                  const char16_t * end,
+                                  char32_t *&      dst,
+                                  char32_t *       dst_end,
+                                  UTF_ENDIAN       src_endian,
+                                  UTF_ENDIAN       dst_endian);
+
+typedef void (*u32_to_u16_kernel)(const char32_t *&src,
+                                  const char32_t * end,
+                                  char16_t *&      dst,
+                                  char16_t *       dst_end,
+                                  UTF_ENDIAN       src_endian,
+                                  UTF_ENDIAN       dst_endian);
+
+typedef size_t (*utf32_length_from_utf8_kernel)(const uint8_t *&src,
+                                                const uint8_t * end);
+
+typedef size_t (*utf8_length_from_utf32_kernel)(const char32_t *&src,
+                                                const char32_t * end,
+                                                UTF_ENDIAN       endian);
+
+typedef size_t (*utf8_length_from_utf16_kernel)(const char16_t *&src,
+                                                const char16_t * end,
+                                                UTF_ENDIAN       endian);
+
+typedef size_t (*utf16_length_from_utf8_kernel)(const uint8_t *&src,
+                                                const uint8_t * end);
+
+typedef size_t (*utf32_length_from_utf16_kernel)(const char16_t *&src,
+                                                 const char16_t * end,
+                                                 UTF_ENDIAN       endian);
+
+typedef size_t (*utf16_length_from_utf32_kernel)(const char32_t *&src,
+                                                 const char32_t * end,
+                                                 UTF_ENDIAN       endian);
+
+typedef void (*validate_utf8_kernel)(const uint8_t *&src, const uint8_t *end);
+
+typedef void (*validate_utf16_kernel)(const char16_t *&src,
+                                      const char16_t * end,
+                                      UTF_ENDIAN       endian);
+
+typedef void (*validate_utf32_kernel)(const char32_t *&src,
+                                      const char32_t * end,
+                                      UTF_ENDIAN       endian);
+
+typedef void (*ascii_prefix_kernel)(const uint8_t *&src, const uint8_t *end);
+
+typedef void (*latin1_to_u8_kernel)(const uint8_t *&src,
+                                    const uint8_t * end,
+                                    char *&         dst,
+                                    char *          dst_end,
+                                    UTF_CHARSET     charset);
+
+typedef void (*latin1_to_u16_kernel)(const uint8_t *&src,
+                                     const uint8_t * end,
+                                     char16_t *&     dst,
+                                     char16_t *      dst_end,
+                                     UTF_ENDIAN      endian,
+                                     UTF_CHARSET     charset);
+
+typedef void (*latin1_to_u32_kernel)(const uint8_t *&src,
+                                     const uint8_t * end,
+                                     char32_t *&     dst,
+                                     char32_t *      dst_end,
+                                     UTF_ENDIAN      endian,
+                                     UTF_CHARSET     charset);
+
+typedef void (*u8_to_latin1_kernel)(const uint8_t *&src,
+                                    const uint8_t * end,
+                                    char *&         dst,
+                                    char *          dst_end,
+                                    UTF_CHARSET     charset);
+
+typedef void (*u16_to_latin1_kernel)(const char16_t *&src,
+                                     const char16_t * end,
+                                     char *&          dst,
+                                     char *           dst_end,
+                                     UTF_ENDIAN       endian,
+                                     UTF_CHARSET      charset);
+
+typedef void (*u32_to_latin1_kernel)(const char32_t *&src,
+                                     const char32_t * end,
+                                     char *&          dst,
+                                     char *           dst_end,
+                                     UTF_ENDIAN       endian,
+                                     UTF_CHARSET      charset);
+
+typedef void (*swap_u16_kernel)(char16_t *&str, char16_t *end);
+
+typedef void (*swap_u32_kernel)(char32_t *&str, char32_t *end);
+
+typedef void (*fold_u8_kernel)(char *&str, char *end, UTF_FOLD fold);
+
+typedef void (*fold_u16_kernel)(char16_t *&str,
+                                char16_t * end,
+                                UTF_ENDIAN endian,
+                                UTF_FOLD   fold);
+
+typedef void (*fold_u32_kernel)(char32_t *&str,
+                                char32_t * end,
+                                UTF_ENDIAN endian,
+                                UTF_FOLD   fold);
+
+/*!
+ * The kernels of one instruction set. Each of them is compiled in its own
+ * translation unit, with the flags of the instruction set.
+ */
+struct kernel_table {
+    u8_to_u32_kernel               u8_to_u32;
+    u32_to_u8_kernel               u32_to_u8;
+    u16_to_u8_kernel               u16_to_u8;
+    u8_to_u16_kernel               u8_to_u16;
+    u16_to_u32_kernel              u16_to_u32;
+    u32_to_u16_kernel              u32_to_u16;
+    utf32_length_from_utf8_kernel  utf32_length_from_utf8;
+    utf8_length_from_utf32_kernel  utf8_length_from_utf32;
+    utf8_length_from_utf16_kernel  utf8_length_from_utf16;
+    utf16_length_from_utf8_kernel  utf16_length_from_utf8;
+    utf32_length_from_utf16_kernel utf32_length_from_utf16;
+    utf16_length_from_utf32_kernel utf16_length_from_utf32;
+    validate_utf8_kernel           validate_utf8;
+    validate_utf16_kernel          validate_utf16;
+    validate_utf32_kernel          validate_utf32;
+    ascii_prefix_kernel            ascii_prefix;
+    latin1_to_u8_kernel            latin1_to_u8;
+    latin1_to_u16_kernel           latin1_to_u16;
+    latin1_to_u32_kernel           latin1_to_u32;
+    u8_to_latin1_kernel            u8_to_latin1;
+    u16_to_latin1_kernel           u16_to_latin1;
+    u32_to_latin1_kernel           u32_to_latin1;
+    swap_u16_kernel                swap_u16;
+    swap_u32_kernel                swap_u32;
+    fold_u8_kernel                 fold_u8;
+    fold_u16_kernel                fold_u16;
+    fold_u32_kernel                fold_u32;
+};
+
+#if defined(UTF_CONVERT_SIMD_X86)
+extern const kernel_table ssse3_kernels;  // utf_convert_simd_ssse3.cpp
+extern const kernel_table avx2_kernels;   // utf_convert_simd_avx2.cpp
+#elif defined(UTF_CONVERT_SIMD_NEON)
+extern const kernel_table neon_kernels;  // utf_convert_simd_neon.cpp
+#endif
+
+}  // namespace simd
+}  // namespace utf_convert
+
+/*
+ * The helpers below are shared by the kernels. They have internal linkage, so
+ * that every translation unit compiles its own copy with the flags of its
+ * instruction set, and the linker can not pick a copy with instructions the
+ * CPU may not have for the others.
+ */
+namespace {
+using utf_convert::UTF_CHARSET;
+using utf_convert::UTF_ENDIAN;
+using utf_convert::UTF_FOLD;
+
+/*
+ * Table used to decode the utf-8 sequences in the first twelve bytes of a
+ * register at once, after Lemire and Keiser, "Transcoding Billions of Unicode
+ * Characters per Second with SIMD Instructions". It is indexed by the mask of
+ * the bytes which end a sequence, bit i set when byte i + 1 is no continuation
+ * byte, and takes the sequences at the start in one of three shapes:
+ *
+ *   u8_decode_two    six sequences of one or two bytes, into 16-bit lanes
+ *   u8_decode_three  four sequences of up to three bytes, into 32-bit lanes
+ *   u8_decode_four   three sequences of up to four bytes, into 32-bit lanes
+ *
+ * Each shape is the first one whose sequences are all short enough. The
+ * shuffle moves every sequence into its lane with the last byte lowest, and
+ * the mask strips the length prefix of each byte:
+ *
+ * +-----------+-----------+-----------+-----------+
+ * |  byte 3   |  byte 2   |  byte 1   |  byte 0   |
+ * +-----------+-----------+-----------+-----------+
+ * | 0000 0ABC | 00DE FGHI | 00JK LMNO | 00PQ RSTU |
+ * +-----------+-----------+-----------+-----------+
+ *
+ * so that the bits only have to be packed together with shifts afterwards,
+ * within 16-bit lanes for the first shape. A sequence longer than four bytes
+ * gives u8_decode_none. Sixteen bytes of four byte sequences, the most the
+ * register holds, have the entry four_by_four.
+ *
+ * The scalar decoder reads a sequence by its lead byte alone, so the split by
+ * continuation bytes is only used where it is the same, see
+ * find_u8_decode_entry.
+ */
+enum u8_decode_shape {
+    u8_decode_none,
+    u8_decode_two,
+    u8_decode_three,
+    u8_decode_four,
+};
+
+struct u8_decode_index {
+    uint8_t shape;
+    uint8_t consumed;
+    uint8_t chars;
+    uint8_t shuffle;
+};
+
+struct u8_decode_shuffle {
+    uint8_t shuffle[16];
+    uint8_t mask[16];
+};
+
+struct u8_decode_table {
+    u8_decode_index   index[4096];
+    u8_decode_index   four_by_four;
+    u8_decode_shuffle shuffle[64 + 81 + 64 + 1];
+
+    u8_decode_table() {
+        static const uint8_t lead_mask[4] = {0x7f, 0x1f, 0x0f, 0x07};
+
+        for (unsigned ends = 0; ends < 4096; ends++) {
+            // Lengths of the sequences which end in the twelve bytes.
+            uint8_t  lengths[12];
+            unsigned count = 0;
+            unsigned start = 0;
+            for (unsigned byte = 0; byte < 12; byte++) {
+                if (ends & (1 << byte)) {
+                    lengths[count++] = byte + 1 - start;
+                    start            = byte + 1;
+                }
+            }
+
+            u8_decode_index &e = index[ends];
+            e.shape            = u8_decode_none;
+            if (fits(lengths, count, 6, 2)) {
+                e.shape   = u8_decode_two;
+                e.chars   = 6;
+                e.shuffle = 0;
+            } else if (fits(lengths, count, 4, 3)) {
+                e.shape   = u8_decode_three;
+                e.chars   = 4;
+                e.shuffle = 64;
+            } else if (fits(lengths, count, 3, 4)) {
+                e.shape   = u8_decode_four;
+                e.chars   = 3;
+                e.shuffle = 64 + 81;
+            } else {
+                continue;
+            }
+
+            // The shuffles are numbered by the lengths, in base max_length.
+            const unsigned lane_size = e.shape == u8_decode_two ? 2 : 4;
+            const unsigned base      = e.shape + 1;
+            unsigned       number    = 0;
+            uint8_t        offset    = 0;
+            for (unsigned i = e.chars; i-- > 0;) {
+                number = number * base + lengths[i] - 1;
+            }
+            u8_decode_shuffle &sh = shuffle[e.shuffle + number];
+            memset(sh.shuffle, 0x80, sizeof(sh.shuffle));
+            memset(sh.mask, 0, sizeof(sh.mask));
+            for (unsigned lane = 0; lane < e.chars; lane++) {
+                const uint8_t length = lengths[lane];
+                for (uint8_t byte = 0; byte < length; byte++) {
+                    sh.shuffle[lane * lane_size + byte] =
+                        offset + length - 1 - byte;
+                    sh.mask[lane * lane_size + byte] =
+                        byte == length - 1 ? lead_mask[length - 1] : 0x3f;
+                }
+                offset += length;
+            }
+            e.consumed = offset;
+            e.shuffle += number;
+        }
+
+        four_by_four.shape    = u8_decode_four;
+        four_by_four.consumed = 16;
+        four_by_four.chars    = 4;
+        four_by_four.shuffle  = 64 + 81 + 64;
+        u8_decode_shuffle &sh = shuffle[four_by_four.shuffle];
+        for (uint8_t byte = 0; byte < 16; byte++) {
+            sh.shuffle[byte] = (byte & ~3) + 3 - (byte & 3);
+            sh.mask[byte]    = (byte & 3) == 3 ? lead_mask[3] : 0x3f;
+        }
+    }
+
+    static const u8_decode_table &get() {
+        static const u8_decode_table table;
+        return table;
+    }
+
+private:
+    static bool fits(const uint8_t *lengths,
+                     unsigned       count,
+                     unsigned       chars,
+                     unsigned       max_length) {
+        if (count < chars)
+            return false;
+        for (unsigned i = 0; i < chars; i++) {
+            if (lengths[i] > max_length)
+                return false;
+        }
+        return true;
+    }
+};
+
+/*
+ * Byte masks of a block of up to 64 bytes of utf-8, bit i for byte i: the
+ * bytes from 0x80 on, the continuation bytes, and the bytes where those differ
+ * from the bytes the scalar decoder takes into the sequence of a lead byte
+ * before them, one after a byte from 0xc0 on, two after one from 0xe0 on and
+ * three after one from 0xf0 on. They are taken once for the block, so that the
+ * sequences of the block are found by shifts alone. The bits past the block
+ * are clear.
+ */
+struct u8_block_masks {
+    uint64_t sign;
+    uint64_t cont;
+    uint64_t mismatch;
+};
+
+/*!
+ * Set the masks of a block from those of the bytes from 0x80, 0xc0, 0xe0 and
+ * 0xf0 on.
+ */
+inline void set_u8_block_masks(u8_block_masks &m,
+                               uint64_t        sign,
+                               uint64_t        two,
+                               uint64_t        three,
+                               uint64_t        four) {
+    m.sign     = sign;
+    m.cont     = sign & ~two;
+    m.mismatch = ((two << 1) | (three << 2) | (four << 3)) ^ m.cont;
+}
+
+/*!
+ * Look up the entry of u8_decode_table for the sequences from byte pos of a
+ * block on. Returns NULL if the scalar decoder has to read them.
+ *
+ * The scalar decoder splits the consumed bytes like their continuation bytes
+ * do when there is no mismatch up to the byte after them. The lead bytes
+ * before pos add none, as pos is where a sequence starts for both.
+ */
+inline const u8_decode_index *find_u8_decode_entry(
+    const u8_decode_table &table, const u8_block_masks &m, unsigned pos) {
+    const unsigned         cont = static_cast<unsigned>(m.cont >> pos);
+    const u8_decode_index &e    = (cont & 0xffff) == 0xeeee
+                                   ? table.four_by_four
+                                   : table.index[(~cont >> 1) & 0xfff];
+    if (e.shape == u8_decode_none)
+        return NULL;
+    if (m.mismatch != 0 && (static_cast<unsigned>(m.mismatch >> pos) &
+                            ((2u << e.consumed) - 1)) != 0)
+        return NULL;
+    return &e;
+}
+
+/*
+ * Shuffle table used to encode four characters at a time. Every character is
+ * first spread over its own 32-bit lane, with the lead byte at the position
+ * given by its length:
+ *
+ * +-----------+-----------+-----------+-----------+
+ * |  byte 3   |  byte 2   |  byte 1   |  byte 0   |
+ * +-----------+-----------+-----------+-----------+
+ * | 1111 0ABC | 10DE FGHI | 10JK LMNO | 10PQ RSTU |  4 bytes
+ * | 0000 0000 | 1110 DEFG | 10HI JKLM | 10NO PQRS |  3 bytes
+ * | 0000 0000 | 0000 0000 | 110A BCDE | 10FG HIJK |  2 bytes
+ * | 0000 0000 | 0000 0000 | 0000 0000 | 0ABC DEFG |  1 byte
+ * +-----------+-----------+-----------+-----------+
+ *
+ * The entry is indexed by the lengths of the four characters, two bits each:
+ *
+ *     (len0 - 1) | (len1 - 1) << 2 | (len2 - 1) << 4 | (len3 - 1) << 6
+ *
+ * It gathers the used bytes of every lane in reverse order and packs them
+ * together.
+ */
+struct u8_encode_entry {
+    uint8_t shuffle[16];
+    uint8_t length;
+};
+
+struct u8_encode_table {
+    u8_encode_entry entry[256];
+
+    u8_encode_table() {
+        for (unsigned index = 0; index < 256; index++) {
+            u8_encode_entry &e = entry[index];
+            uint8_t          offset = 0;
+
+            memset(e.shuffle, 0x80, sizeof(e.shuffle));
+            for (unsigned lane = 0; lane < 4; lane++) {
+                const uint8_t length = ((index >> (lane * 2)) & 0x03) + 1;
+
+                for (uint8_t byte = 0; byte < length; byte++)
+                    e.shuffle[offset++] = lane * 4 + length - 1 - byte;
+            }
+            e.length = offset;
+        }
+    }
+
+    static const u8_encode_table &get() {
+        static const u8_encode_table table;
+        return table;
+    }
+};
+
+/*
+ * Spread a 4-bit lane mask into the 2-bit fields of an encode table index, so
+ * that adding the spread masks of (c >= 0x80), (c >= 0x800) and (c >= 0x10000)
+ * gives the length minus one of every lane.
+ */
+const uint8_t u8_encode_spread[16] = {0x00, 0x01, 0x04, 0x05, 0x10, 0x11,
+                                      0x14, 0x15, 0x40, 0x41, 0x44, 0x45,
+                                      0x50, 0x51, 0x54, 0x55};
+
+inline unsigned trailing_zeros(uint32_t value) {
+#if defined(__GNUC__) || defined(__clang__)
+    return __builtin_ctz(value);
+#elif defined(_MSC_VER)
+    unsigned long index;
+    _BitScanForward(&index, value);
+    return index;
+#else
+    unsigned count = 0;
+    while (!(value & 1)) {
+        value >>= 1;
+        count++;
+    }
+    return count;
+#endif
+}
+
+inline uint16_t load_u16(const char16_t *src, bool big_endian) {
+    const uint16_t value = *src;
+    return big_endian ? static_cast<uint16_t>((value << 8) | (value >> 8))
+                      : value;
+}
+
+/*!
+ * Encode the single code point at src exactly like the scalar utf-16 encoder
+ * does. Used by the kernels for blocks with unpaired surrogates. Returns false,
+ * leaving src and dst unchanged, if the scalar encoder would fail on it.
+ */
+inline bool encode_u16_code_point(const char16_t *&src,
+                                  const char16_t * end,
+                                  char *&          dst,
+                                  bool             big_endian) {
+    const uint16_t value = load_u16(src, big_endian);
+
+    if (value < 0x80) {
+        *dst++ = value;
+    } else if (value < 0x0800) {
+        *dst++ = ((value >> 6) & 0x1f) | 0xc0;
+        *dst++ = (value & 0x3f) | 0x80;
+    } else if (value >= 0xd800 && value < 0xdc00) {
+        if (end - src < 2)
+            return false;
+
+        const uint32_t low = load_u16(src + 1, big_endian);
+        if (low < 0xdc00)
+            return false;
+
+        uint32_t code_point = value - 0xd800;
+        code_point <<= 10;
+        code_point |= (low - 0xdc00);
+        code_point += 0x10000;
+
+        *dst++ = (code_point >> 18) | 0xf0;
+        *dst++ = ((code_point >> 12) & 0x3f) | 0x80;
+        *dst++ = ((code_point >> 6) & 0x3f) | 0x80;
+        *dst++ = (code_point & 0x3f) | 0x80;
+        src++;
+    } else {
+        *dst++ = ((value >> 12) & 0x0f) | 0xe0;
+        *dst++ = ((value >> 6) & 0x3f) | 0x80;
+        *dst++ = (value & 0x3f) | 0x80;
+    }
+    src++;
+    return true;
+}
+
+/*!
+ * Write the last two bytes of a surrogate pair whose first two bytes were
+ * written by a vector step ending with the high surrogate.
+ */
+inline void encode_u16_low_surrogate(uint16_t high, uint16_t low, char *&dst) {
+    *dst++ = 0x80 | ((high & 0x03) << 4) | ((low >> 6) & 0x0f);
+    *dst++ = 0x80 | (low & 0x3f);
+}
+
+inline void store_u16(char16_t *dst, uint16_t value, bool big_endian) {
+    *dst = big_endian ? static_cast<uint16_t>((value << 8) | (value >> 8))
+                      : value;
+}
+
+inline uint32_t load_u32(const char32_t *src, bool big_endian) {
+    const uint32_t value = *src;
+    return big_endian ? ((value & 0x000000ff) << 24) |
+                            ((value & 0x0000ff00) << 8) |
+                            ((value & 0x00ff0000) >> 8) | (value >> 24)
+                      : value;
+}
+
+inline void store_u32(char32_t *dst, uint32_t value, bool big_endian) {
+    *dst = load_u32(reinterpret_cast<const char32_t *>(&value), big_endian);
+}
+
+/*!
+ * Write a character as one utf-16 unit, or as a surrogate pair from 0x10000
+ * on. Returns false, writing nothing, if it is 0x110000 or above.
+ */
+inline bool encode_u16_unit(uint32_t value, char16_t *&dst, bool big_endian) {
+    if (value < 0x10000) {
+        store_u16(dst++, value, big_endian);
+    } else if (value < 0x110000) {
+        value -= 0x10000;
+        store_u16(dst++, 0xd800 | (value >> 10), big_endian);
+        store_u16(dst++, 0xdc00 | (value & 0x3ff), big_endian);
+    } else {
+        return false;
+    }
+    return true;
+}
+
+/*!
+ * Decode the single character at src exactly like the scalar utf-16 decoder
+ * does. Returns false, leaving src and dst unchanged, if the scalar decoder
+ * would fail on it.
+ */
+inline bool decode_u16_code_point(const char16_t *&src,
+                                  const char16_t * end,
+                                  char32_t *&      dst,
+                                  bool             src_big_endian,
+                                  bool             dst_big_endian) {
+    const uint16_t value      = load_u16(src, src_big_endian);
+    uint32_t       code_point = value;
+
+    if (value >= 0xd800 && value < 0xdc00) {
+        if (end - src < 2)
+            return false;
+
+        const uint32_t low = load_u16(src + 1, src_big_endian);
+        if (low < 0xdc00)
+            return false;
+
+        code_point = value - 0xd800;
+        code_point <<= 10;
+        code_point |= (low - 0xdc00);
+        code_point += 0x10000;
+        src++;
+    }
+
+    store_u32(dst++, code_point, dst_big_endian);
+    src++;
+    return true;
+}
+
+/*
+ * Error classes of the utf-8 validation, after Keiser and Lemire, "Validating
+ * UTF-8 In Less Than One Instruction Per Byte". Every byte is looked up together
+ * with the byte before it: by the high and the low nibble of the byte before,
+ * and by its own high nibble. The three lookups AND to the errors of the pair.
+ *
+ *   too short     11______ 0_______    a lead byte not followed
+ *                 11______ 11______    by a continuation byte
+ *   too long      0_______ 10______    a continuation byte after ascii
+ *   overlong 3    11100000 100_____
+ *   too large     11110100 1001____    above 0x10ffff
+ *                 11110101 ________
+ *                 1111011_ ________
+ *                 11111___ ________
+ *   surrogate     11101101 101_____    0xd800 to 0xdfff
+ *   overlong 2    1100000_ 10______
+ *   overlong 4    11110000 1000____
+ *   two conts     10______ 10______    which is only fine for the third and
+ *                                      the fourth byte of a sequence
+ *
+ * Too large 1000 is the part of too large with 1000____ as the second byte,
+ * which shares its bit with overlong 4 as both come from a 1111____ lead.
+ */
+const uint8_t u8_too_short       = 1 << 0;
+const uint8_t u8_too_long        = 1 << 1;
+const uint8_t u8_overlong_3      = 1 << 2;
+const uint8_t u8_too_large       = 1 << 3;
+const uint8_t u8_surrogate       = 1 << 4;
+const uint8_t u8_overlong_2      = 1 << 5;
+const uint8_t u8_too_large_1000  = 1 << 6;
+const uint8_t u8_overlong_4      = 1 << 6;
+const uint8_t u8_two_conts       = 1 << 7;
+const uint8_t u8_carry           = u8_too_short | u8_too_long | u8_two_conts;
+
+// Looked up by the high nibble of the byte before.
+const uint8_t u8_byte_1_high[16] = {
+    u8_too_long, u8_too_long, u8_too_long, u8_too_long,
+    u8_too_long, u8_too_long, u8_too_long, u8_too_long,
+    u8_two_conts, u8_two_conts, u8_two_conts, u8_two_conts,
+    u8_too_short | u8_overlong_2,
+    u8_too_short,
+    u8_too_short | u8_overlong_3 | u8_surrogate,
+    u8_too_short | u8_too_large | u8_too_large_1000 | u8_overlong_4,
+};
+
+// Looked up by the low nibble of the byte before.
+const uint8_t u8_byte_1_low[16] = {
+    u8_carry | u8_overlong_3 | u8_overlong_2 | u8_overlong_4,
+    u8_carry | u8_overlong_2,
+    u8_carry,
+    u8_carry,
+    u8_carry | u8_too_large,
+    u8_carry | u8_too_large | u8_too_large_1000,
+    u8_carry | u8_too_large | u8_too_large_1000,
+    u8_carry | u8_too_large | u8_too_large_1000,
+    u8_carry | u8_too_large | u8_too_large_1000,
+    u8_carry | u8_too_large | u8_too_large_1000,
+    u8_carry | u8_too_large | u8_too_large_1000,
+    u8_carry | u8_too_large | u8_too_large_1000,
+    u8_carry | u8_too_large | u8_too_large_1000,
+    u8_carry | u8_too_large | u8_too_large_1000 | u8_surrogate,
+    u8_carry | u8_too_large | u8_too_large_1000,
+    u8_carry | u8_too_large | u8_too_large_1000,
+};
+
+// Looked up by the high nibble of the byte itself.
+const uint8_t u8_byte_2_high[16] = {
+    u8_too_short, u8_too_short, u8_too_short, u8_too_short,
+    u8_too_short, u8_too_short, u8_too_short, u8_too_short,
+    u8_too_long | u8_overlong_2 | u8_two_conts | u8_overlong_3 |
+        u8_too_large_1000 | u8_overlong_4,
+    u8_too_long | u8_overlong_2 | u8_two_conts | u8_overlong_3 | u8_too_large,
+    u8_too_long | u8_overlong_2 | u8_two_conts | u8_surrogate | u8_too_large,
+    u8_too_long | u8_overlong_2 | u8_two_conts | u8_surrogate | u8_too_large,
+    u8_too_short, u8_too_short, u8_too_short, u8_too_short,
+};
+
+/*!
+ * Move s back to the start of the sequence which is not finished before it,
+ * if any, but not before begin. The bytes before s must be valid utf-8 apart
+ * from such a sequence, which is at most three bytes long.
+ */
+inline const uint8_t *u8_sequence_start(const uint8_t *begin,
+                                        const uint8_t *s) {
+    for (size_t back = 1; back <= 3 && back <= size_t(s - begin); back++) {
+        if (s[-back] >= 0xc0)
+            return s - back;
+        if (s[-back] < 0x80)
+            return s - back + 1;
+    }
+    return s;
+}
+
+/*
+ * Shuffle table used to encode eight Latin-1 bytes at a time. Every byte is
+ * first widened to a 16-bit lane which holds its utf-8 sequence, the lead
+ * byte first:
+ *
+ * +-----------+-----------+
+ * |  byte 1   |  byte 0   |
+ * +-----------+-----------+
+ * | 10EF GHIJ | 1100 00CD |  from 0x80 on
+ * | 0000 0000 | CDEF GHIJ |  ascii
+ * +-----------+-----------+
+ *
+ * The entry, indexed by the bit mask of the lanes from 0x80 on, gathers the
+ * used bytes of every lane and packs them together.
+ */
+struct latin1_encode_entry {
+    uint8_t shuffle[16];
+    uint8_t length;
+};
+
+struct latin1_encode_table {
+    latin1_encode_entry entry[256];
+
+    latin1_encode_table() {
+        for (unsigned index = 0; index < 256; index++) {
+            latin1_encode_entry &e      = entry[index];
+            uint8_t              offset = 0;
+
+            memset(e.shuffle, 0x80, sizeof(e.shuffle));
+            for (unsigned lane = 0; lane < 8; lane++) {
+                e.shuffle[offset++] = lane * 2;
+                if (index & (1 << lane))
+                    e.shuffle[offset++] = lane * 2 + 1;
+            }
+            e.length = offset;
+        }
+    }
+
+    static const latin1_encode_table &get() {
+        static const latin1_encode_table table;
+        return table;
+    }
+};
+
+/*
+ * Shuffle table which drops the bytes of eight given by the bits of the index
+ * and packs the others together. Once the two-byte sequences of utf-8 are
+ * decoded into the position of their lead byte, it drops the continuation
+ * bytes.
+ */
+struct u8_compress_entry {
+    uint8_t shuffle[16];
+    uint8_t length;
+};
+
+struct u8_compress_table {
+    u8_compress_entry entry[256];
+
+    u8_compress_table() {
+        for (unsigned index = 0; index < 256; index++) {
+            u8_compress_entry &e      = entry[index];
+            uint8_t            offset = 0;
+
+            memset(e.shuffle, 0x80, sizeof(e.shuffle));
+            for (unsigned byte = 0; byte < 8; byte++) {
+                if (!(index & (1 << byte)))
+                    e.shuffle[offset++] = byte;
+            }
+            e.length = offset;
+        }
+    }
+
+    static const u8_compress_table &get() {
+        static const u8_compress_table table;
+        return table;
+    }
+};
+
+#if defined(UTF_CONVERT_SIMD_X86)
+
+/*!
+ * Take the masks of the registers sixteen bytes each at src.
+ */
+UTF_CONVERT_TARGET("ssse3")
+inline void load_u8_block_ssse3(const uint8_t * src,
+                                unsigned        registers,
+                                u8_block_masks &m) {
+    uint64_t sign = 0, two = 0, three = 0, four = 0;
+    for (unsigned i = 0; i < registers; i++) {
+        const __m128i in =
+            _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i * 16));
+        const uint64_t bits = _mm_movemask_epi8(in);
+        if (bits == 0)
+            continue;  // Ascii, with no bits in any of the masks.
+
+        sign |= bits << (i * 16);
+        two |= (_mm_movemask_epi8(_mm_cmpgt_epi8(in, _mm_set1_epi8(-65))) &
+                bits)
+               << (i * 16);
+        three |= (_mm_movemask_epi8(_mm_cmpgt_epi8(in, _mm_set1_epi8(-33))) &
+                  bits)
+                 << (i * 16);
+        four |= (_mm_movemask_epi8(_mm_cmpgt_epi8(in, _mm_set1_epi8(-17))) &
+                 bits)
+                << (i * 16);
+    }
+    set_u8_block_masks(m, sign, two, three, four);
+}
+
+/*!
+ * Decode the sequences at the start of the sixteen bytes of in, as told by
+ * the entry e of u8_decode_table, into the lanes of its shape.
+ */
+UTF_CONVERT_TARGET("ssse3")
+inline __m128i decode_u8_ssse3(const u8_decode_table &table,
+                               const u8_decode_index &e,
+                               __m128i                in) {
+    const u8_decode_shuffle &sh    = table.shuffle[e.shuffle];
+    const __m128i            bytes = _mm_and_si128(
+        _mm_shuffle_epi8(in,
+                         _mm_loadu_si128(
+                             reinterpret_cast<const __m128i *>(sh.shuffle))),
+        _mm_loadu_si128(reinterpret_cast<const __m128i *>(sh.mask)));
+
+    if (e.shape == u8_decode_two) {
+        return _mm_or_si128(_mm_and_si128(bytes, _mm_set1_epi16(0x00ff)),
+                            _mm_slli_epi16(_mm_srli_epi16(bytes, 8), 6));
+    }
+
+    __m128i out = _mm_and_si128(bytes, _mm_set1_epi32(0x0000007f));
+    out         = _mm_or_si128(out,
+                       _mm_and_si128(_mm_srli_epi32(bytes, 2),
+                                     _mm_set1_epi32(0x00000fc0)));
+    out         = _mm_or_si128(out,
+                       _mm_and_si128(_mm_srli_epi32(bytes, 4),
+                                     _mm_set1_epi32(0x0003f000)));
+    out         = _mm_or_si128(out,
+                       _mm_and_si128(_mm_srli_epi32(bytes, 6),
+                                     _mm_set1_epi32(0x001c0000)));
+    return out;
+}
+
+/*!
+ * Convert the utf-8 of a block at src to utf-32, up to the first sequence from
+ * byte limit on. The block must have limit + 15 readable bytes, and dst room
+ * for as many characters. Returns the bytes converted, fewer than limit if the
+ * rest is left to the scalar decoder.
+ */
+UTF_CONVERT_TARGET("ssse3")
+inline unsigned u8_to_u32_block_ssse3(const u8_decode_table &table,
+                                      const u8_block_masks & m,
+                                      const uint8_t *        src,
+                                      unsigned               limit,
+                                      char32_t *&            dst,
+                                      bool                   big_endian) {
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i swap =
+        _mm_setr_epi8(3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12);
+
+    unsigned pos = 0;
+    while (pos < limit) {
+        const __m128i in =
+            _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + pos));
+
+        // A run of at least eight ascii bytes is widened whole.
+        const unsigned sign  = _mm_movemask_epi8(in);
+        const unsigned ascii = sign == 0 ? 16 : trailing_zeros(sign);
+        if (ascii >= 8) {
+            const __m128i lo     = _mm_unpacklo_epi8(in, zero);
+            const __m128i hi     = _mm_unpackhi_epi8(in, zero);
+            __m128i       out[4] = {_mm_unpacklo_epi16(lo, zero),
+                              _mm_unpackhi_epi16(lo, zero),
+                              _mm_unpacklo_epi16(hi, zero),
+                              _mm_unpackhi_epi16(hi, zero)};
+            for (int i = 0; i < 4; i++) {
+                if (big_endian)
+                    out[i] = _mm_slli_epi32(out[i], 24);
+                _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i * 4),
+                                 out[i]);
+            }
+            pos += ascii;
+            dst += ascii;
+            continue;
+        }
+
+        const u8_decode_index *e = find_u8_decode_entry(table, m, pos);
+        if (e == NULL)
+            break;
+
+        __m128i out = decode_u8_ssse3(table, *e, in);
+        if (e->shape == u8_decode_two) {
+            __m128i lo = _mm_unpacklo_epi16(out, zero);
+            __m128i hi = _mm_unpackhi_epi16(out, zero);
+            if (big_endian) {
+                lo = _mm_shuffle_epi8(lo, swap);
+                hi = _mm_shuffle_epi8(hi, swap);
+            }
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(dst), lo);
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + 4), hi);
+        } else {
+            if (big_endian)
+                out = _mm_shuffle_epi8(out, swap);
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(dst), out);
+        }
+        pos += e->consumed;
+        dst += e->chars;
+    }
+    return pos;
+}
+
+/*!
+ * Convert the utf-8 of a block at src to utf-16, the same way as
+ * u8_to_u32_block_ssse3.
+ */
+UTF_CONVERT_TARGET("ssse3")
+inline unsigned u8_to_u16_block_ssse3(const u8_decode_table &table,
+                                      const u8_block_masks & m,
+                                      const uint8_t *        src,
+                                      unsigned               limit,
+                                      char16_t *&            dst,
+                                      bool                   big_endian) {
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i pack =
+        big_endian ? _mm_setr_epi8(1, 0, 5, 4, 9, 8, 13, 12, -1, -1, -1, -1,
+                                   -1, -1, -1, -1)
+                   : _mm_setr_epi8(0, 1, 4, 5, 8, 9, 12, 13, -1, -1, -1, -1,
+                                   -1, -1, -1, -1);
+
+    unsigned pos = 0;
+    while (pos < limit) {
+        const __m128i in =
+            _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + pos));
+
+        // A run of at least eight ascii bytes is widened whole.
+        const unsigned sign  = _mm_movemask_epi8(in);
+        const unsigned ascii = sign == 0 ? 16 : trailing_zeros(sign);
+        if (ascii >= 8) {
+            __m128i lo = _mm_unpacklo_epi8(in, zero);
+            __m128i hi = _mm_unpackhi_epi8(in, zero);
+            if (big_endian) {
+                lo = _mm_slli_epi16(lo, 8);
+                hi = _mm_slli_epi16(hi, 8);
+            }
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(dst), lo);
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + 8), hi);
+            pos += ascii;
+            dst += ascii;
+            continue;
+        }
+
+        const u8_decode_index *e = find_u8_decode_entry(table, m, pos);
+        if (e == NULL)
+            break;
+
+        __m128i out = decode_u8_ssse3(table, *e, in);
+        if (e->shape == u8_decode_two) {
+            if (big_endian)
+                out = _mm_or_si128(_mm_slli_epi16(out, 8),
+                                   _mm_srli_epi16(out, 8));
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(dst), out);
+            dst += e->chars;
+        } else if (e->shape == u8_decode_three) {
+            // Characters of up to three bytes take a single unit.
+            _mm_storel_epi64(reinterpret_cast<__m128i *>(dst),
+                             _mm_shuffle_epi8(out, pack));
+            dst += e->chars;
+        } else {
+            if (_mm_movemask_epi8(_mm_cmpgt_epi32(
+                    out, _mm_set1_epi32(0x10ffff))) != 0)
+                break;
+
+            // Characters all from 0x10000 on take a surrogate pair each,
+            // the others are encoded one by one.
+            const unsigned lanes = (1u << e->chars) - 1;
+            if ((_mm_movemask_ps(_mm_castsi128_ps(_mm_cmpgt_epi32(
+                     out, _mm_set1_epi32(0xffff)))) &
+                 lanes) == lanes) {
+                const __m128i value =
+                    _mm_sub_epi32(out, _mm_set1_epi32(0x10000));
+                __m128i units = _mm_or_si128(
+                    _mm_or_si128(_mm_set1_epi32(0xdc00d800),
+                                 _mm_srli_epi32(value, 10)),
+                    _mm_and_si128(_mm_slli_epi32(value, 16),
+                                  _mm_set1_epi32(0x03ff0000)));
+                if (big_endian)
+                    units = _mm_or_si128(_mm_slli_epi16(units, 8),
+                                         _mm_srli_epi16(units, 8));
+                _mm_storeu_si128(reinterpret_cast<__m128i *>(dst), units);
+                dst += e->chars * 2;
+            } else {
+                uint32_t code_points[4];
+                _mm_storeu_si128(reinterpret_cast<__m128i *>(code_points),
+                                 out);
+                for (unsigned i = 0; i < e->chars; i++)
+                    encode_u16_unit(code_points[i], dst, big_endian);
+            }
+        }
+        pos += e->consumed;
+    }
+    return pos;
+}
+
+/*!
+ * Check whether a register has a byte in 0x80 ~ 0x9f, where Windows-1252
+ * differs from Latin-1.
+ */
+UTF_CONVERT_TARGET("ssse3")
+inline bool has_c1_ssse3(__m128i in) {
+    const __m128i c1 =
+        _mm_xor_si128(in, _mm_set1_epi8(static_cast<char>(0x80)));
+    return _mm_movemask_epi8(_mm_cmpeq_epi8(
+               _mm_min_epu8(c1, _mm_set1_epi8(0x1f)), c1)) != 0;
+}
+
+/*!
+ * Narrow the sixteen utf-8 bytes of in at src to Latin-1, or to Windows-1252
+ * if cp1252 is set. They must be ascii or two-byte sequences with the lead
+ * bytes 0xc2 and 0xc3, which hold the characters from 0x80 to 0xff, so that
+ * the scalar decoder reads them the same way. A lead byte at the end is left
+ * for the next register. dst must be followed by room for sixteen bytes.
+ * Returns false, leaving both unchanged, if the scalar code has to convert
+ * the register.
+ */
+UTF_CONVERT_TARGET("ssse3")
+inline bool u8_to_latin1x16_ssse3(const u8_compress_table &table,
+                                  __m128i                  in,
+                                  const uint8_t *&         src,
+                                  char *&                  dst,
+                                  bool                     cp1252) {
+    const __m128i leads = _mm_cmpeq_epi8(
+        _mm_and_si128(in, _mm_set1_epi8(static_cast<char>(0xfe))),
+        _mm_set1_epi8(static_cast<char>(0xc2)));
+    const __m128i conts = _mm_cmpeq_epi8(
+        _mm_and_si128(in, _mm_set1_epi8(static_cast<char>(0xc0))),
+        _mm_set1_epi8(static_cast<char>(0x80)));
+    unsigned       lead = _mm_movemask_epi8(leads);
+    const unsigned cont = _mm_movemask_epi8(conts);
+    if ((lead | cont) != unsigned(_mm_movemask_epi8(in)))
+        return false;
+
+    const unsigned cut = lead & 0x8000;
+    lead &= 0x7fff;
+    if (cont != lead << 1)
+        return false;
+
+    // 110000AB 10CDEFGH -> ABCDEFGH, in the position of the lead byte.
+    const __m128i value = _mm_or_si128(
+        _mm_slli_epi16(_mm_and_si128(in, _mm_set1_epi8(0x03)), 6),
+        _mm_and_si128(_mm_srli_si128(in, 1), _mm_set1_epi8(0x3f)));
+    if (cp1252 && has_c1_ssse3(_mm_and_si128(leads, value)))
+        return false;
+
+    const __m128i out = _mm_or_si128(_mm_and_si128(leads, value),
+                                     _mm_andnot_si128(leads, in));
+    const unsigned           drop = cont | cut;
+    const u8_compress_entry &lo   = table.entry[drop & 0xff];
+    const u8_compress_entry &hi   = table.entry[drop >> 8];
+    _mm_storel_epi64(
+        reinterpret_cast<__m128i *>(dst),
+        _mm_shuffle_epi8(out, _mm_loadu_si128(reinterpret_cast<const __m128i *>(
+                                  lo.shuffle))));
+    _mm_storel_epi64(
+        reinterpret_cast<__m128i *>(dst + lo.length),
+        _mm_shuffle_epi8(_mm_srli_si128(out, 8),
+                         _mm_loadu_si128(reinterpret_cast<const __m128i *>(
+                             hi.shuffle))));
+    src += cut ? 15 : 16;
+    dst += lo.length + hi.length;
+    return true;
+}
+
+inline unsigned count_ones(uint32_t value) {
+#if defined(__GNUC__) || defined(__clang__)
+    return __builtin_popcount(value);
+#else
+    value = value - ((value >> 1) & 0x55555555);
+    value = (value & 0x33333333) + ((value >> 2) & 0x33333333);
+    return (((value + (value >> 4)) & 0x0f0f0f0f) * 0x01010101) >> 24;
+#endif
+}
+
+#endif
+}  // namespace
+
+#endif  // UTF_CONVERT_SIMD_KERNELS_HPP
@@ -0,0 +1,1238 @@
+#include "utf_convert_simd_kernels.hpp"
+
+#if defined(UTF_CONVERT_SIMD_NEON)
+
+namespace {
+// The bits of the bytes of a comparison, like _mm_movemask_epi8.
+inline unsigned movemask_neon(uint8x16_t mask) {
+    static const uint8_t bits[16] = {1, 2, 4, 8, 16, 32, 64, 128,
+                                     1, 2, 4, 8, 16, 32, 64, 128};
+    const uint8x16_t masked = vandq_u8(mask, vld1q_u8(bits));
+    return vaddv_u8(vget_low_u8(masked)) |
+           (unsigned(vaddv_u8(vget_high_u8(masked))) << 8);
+}
+
+// Same as load_u8_block_ssse3.
+inline void load_u8_block_neon(const uint8_t * src,
+                               unsigned        registers,
+                               u8_block_masks &m) {
+    uint64_t sign = 0, two = 0, three = 0, four = 0;
+    for (unsigned i = 0; i < registers; i++) {
+        const uint8x16_t in = vld1q_u8(src + i * 16);
+        if (vmaxvq_u8(in) < 0x80)
+            continue;
+
+        sign |= uint64_t(movemask_neon(vcgeq_u8(in, vdupq_n_u8(0x80))))
+                << (i * 16);
+        two |= uint64_t(movemask_neon(vcgeq_u8(in, vdupq_n_u8(0xc0))))
+               << (i * 16);
+        three |= uint64_t(movemask_neon(vcgeq_u8(in, vdupq_n_u8(0xe0))))
+                 << (i * 16);
+        four |= uint64_t(movemask_neon(vcgeq_u8(in, vdupq_n_u8(0xf0))))
+                << (i * 16);
+    }
+    set_u8_block_masks(m, sign, two, three, four);
+}
+
+// Same as decode_u8_ssse3.
+inline uint32x4_t decode_u8_neon(const u8_decode_table &table,
+                                 const u8_decode_index &e,
+                                 uint8x16_t             in) {
+    const u8_decode_shuffle &sh    = table.shuffle[e.shuffle];
+    const uint8x16_t         bytes = vandq_u8(
+        vqtbl1q_u8(in, vld1q_u8(sh.shuffle)), vld1q_u8(sh.mask));
+
+    if (e.shape == u8_decode_two) {
+        const uint16x8_t pairs = vreinterpretq_u16_u8(bytes);
+        return vreinterpretq_u32_u16(
+            vorrq_u16(vandq_u16(pairs, vdupq_n_u16(0x00ff)),
+                      vshlq_n_u16(vshrq_n_u16(pairs, 8), 6)));
+    }
+
+    const uint32x4_t quads = vreinterpretq_u32_u8(bytes);
+    uint32x4_t       out   = vandq_u32(quads, vdupq_n_u32(0x0000007f));
+    out = vorrq_u32(out,
+                    vandq_u32(vshrq_n_u32(quads, 2), vdupq_n_u32(0x00000fc0)));
+    out = vorrq_u32(out,
+                    vandq_u32(vshrq_n_u32(quads, 4), vdupq_n_u32(0x0003f000)));
+    out = vorrq_u32(out,
+                    vandq_u32(vshrq_n_u32(quads, 6), vdupq_n_u32(0x001c0000)));
+    return out;
+}
+
+// Same as u8_to_u32_block_ssse3.
+inline unsigned u8_to_u32_block_neon(const u8_decode_table &table,
+                                     const u8_block_masks & m,
+                                     const uint8_t *        src,
+                                     unsigned               limit,
+                                     char32_t *&            dst,
+                                     bool                   big_endian) {
+    unsigned pos = 0;
+    while (pos < limit) {
+        const uint8x16_t in = vld1q_u8(src + pos);
+
+        // A run of at least eight ascii bytes is widened whole.
+        const unsigned ascii =
+            vmaxvq_u8(in) < 0x80
+                ? 16
+                : trailing_zeros(
+                      movemask_neon(vcgeq_u8(in, vdupq_n_u8(0x80))));
+        if (ascii >= 8) {
+            const uint16x8_t lo     = vmovl_u8(vget_low_u8(in));
+            const uint16x8_t hi     = vmovl_u8(vget_high_u8(in));
+            uint32x4_t       out[4] = {vmovl_u16(vget_low_u16(lo)),
+                                 vmovl_u16(vget_high_u16(lo)),
+                                 vmovl_u16(vget_low_u16(hi)),
+                                 vmovl_u16(vget_high_u16(hi))};
+            for (int i = 0; i < 4; i++) {
+                if (big_endian)
+                    out[i] = vshlq_n_u32(out[i], 24);
+                vst1q_u32(reinterpret_cast<uint32_t *>(dst + i * 4), out[i]);
+            }
+            pos += ascii;
+            dst += ascii;
+            continue;
+        }
+
+        const u8_decode_index *e = find_u8_decode_entry(table, m, pos);
+        if (e == NULL)
+            break;
+
+        uint32x4_t out = decode_u8_neon(table, *e, in);
+        if (e->shape == u8_decode_two) {
+            const uint16x8_t pairs = vreinterpretq_u16_u32(out);
+            uint32x4_t       lo    = vmovl_u16(vget_low_u16(pairs));
+            uint32x4_t       hi    = vmovl_u16(vget_high_u16(pairs));
+            if (big_endian) {
+                lo = vreinterpretq_u32_u8(vrev32q_u8(vreinterpretq_u8_u32(lo)));
+                hi = vreinterpretq_u32_u8(vrev32q_u8(vreinterpretq_u8_u32(hi)));
+            }
+            vst1q_u32(reinterpret_cast<uint32_t *>(dst), lo);
+            vst1q_u32(reinterpret_cast<uint32_t *>(dst + 4), hi);
+        } else {
+            if (big_endian)
+                out = vreinterpretq_u32_u8(vrev32q_u8(vreinterpretq_u8_u32(out)));
+            vst1q_u32(reinterpret_cast<uint32_t *>(dst), out);
+        }
+        pos += e->consumed;
+        dst += e->chars;
+    }
+    return pos;
+}
+
+void u8_to_u32_neon(const uint8_t *&src,
+                    const uint8_t * end,
+                    char32_t *&     dst,
+                    char32_t *      dst_end,
+                    UTF_ENDIAN      endian) {
+    const u8_decode_table &table = u8_decode_table::get();
+    const bool big_endian = endian == utf_convert::UTF_ENDIAN_BIG_ENDIAN;
+
+    const uint8_t * s = src;
+    char32_t *      d = dst;
+    u8_block_masks  m;
+
+    while (end - s >= 64 && dst_end - d >= 64) {
+        load_u8_block_neon(s, 4, m);
+        const unsigned done =
+            u8_to_u32_block_neon(table, m, s, 48, d, big_endian);
+        s += done;
+        if (done < 48)
+            break;
+    }
+    while (end - s >= 16 && dst_end - d >= 16) {
+        load_u8_block_neon(s, 1, m);
+        const unsigned done =
+            u8_to_u32_block_neon(table, m, s, 1, d, big_endian);
+        if (done == 0)
+            break;
+        s += done;
+    }
+
+    src = s;
+    dst = d;
+}
+
+void u32_to_u8_neon(const char32_t *&src,
+                    const char32_t * end,
+                    char *&          dst,
+                    char *           dst_end,
+                    UTF_ENDIAN       endian) {
+    const u8_encode_table &table = u8_encode_table::get();
+    const bool       big_endian = endian == utf_convert::UTF_ENDIAN_BIG_ENDIAN;
+    const uint32_t   lane_bits[4] = {1, 2, 4, 8};
+    const uint32x4_t lane_bit     = vld1q_u32(lane_bits);
+
+    const char32_t *s = src;
+    char *          d = dst;
+
+    while (end - s >= 4 && dst_end - d >= 16) {
+        uint32x4_t in = vld1q_u32(reinterpret_cast<const uint32_t *>(s));
+        if (big_endian)
+            in = vreinterpretq_u32_u8(vrev32q_u8(vreinterpretq_u8_u32(in)));
+
+        if (end - s >= 8) {
+            uint32x4_t next =
+                vld1q_u32(reinterpret_cast<const uint32_t *>(s + 4));
+            if (big_endian)
+                next = vreinterpretq_u32_u8(
+                    vrev32q_u8(vreinterpretq_u8_u32(next)));
+
+            if (vmaxvq_u32(vorrq_u32(in, next)) < 0x80) {
+                const uint16x8_t words =
+                    vcombine_u16(vmovn_u32(in), vmovn_u32(next));
+                vst1_u8(reinterpret_cast<uint8_t *>(d), vmovn_u16(words));
+                s += 8;
+                d += 8;
+                continue;
+            }
+        }
+
+        if (vmaxvq_u32(in) >= 0x110000)
+            break;
+
+        const uint32x4_t two   = vcgtq_u32(in, vdupq_n_u32(0x7f));
+        const uint32x4_t three = vcgtq_u32(in, vdupq_n_u32(0x7ff));
+        const uint32x4_t four  = vcgtq_u32(in, vdupq_n_u32(0xffff));
+
+        uint32x4_t bytes = vandq_u32(in, vdupq_n_u32(0x0000003f));
+        bytes = vorrq_u32(
+            bytes, vandq_u32(vshlq_n_u32(in, 2), vdupq_n_u32(0x00003f00)));
+        bytes = vorrq_u32(
+            bytes, vandq_u32(vshlq_n_u32(in, 4), vdupq_n_u32(0x003f0000)));
+        bytes = vorrq_u32(
+            bytes, vandq_u32(vshlq_n_u32(in, 6), vdupq_n_u32(0x3f000000)));
+
+        uint32x4_t prefix = vandq_u32(two, vdupq_n_u32(0x0000c080));
+        prefix = veorq_u32(prefix, vandq_u32(three, vdupq_n_u32(0x00e04000)));
+        prefix = veorq_u32(prefix, vandq_u32(four, vdupq_n_u32(0xf0600000)));
+
+        bytes = vbslq_u32(two, vorrq_u32(bytes, prefix), in);
+
+        const unsigned index =
+            u8_encode_spread[vaddvq_u32(vandq_u32(two, lane_bit))] +
+            u8_encode_spread[vaddvq_u32(vandq_u32(three, lane_bit))] +
+            u8_encode_spread[vaddvq_u32(vandq_u32(four, lane_bit))];
+        const u8_encode_entry &e = table.entry[index];
+
+        vst1q_u8(reinterpret_cast<uint8_t *>(d),
+                 vqtbl1q_u8(vreinterpretq_u8_u32(bytes), vld1q_u8(e.shuffle)));
+        s += 4;
+        d += e.length;
+    }
+
+    src = s;
+    dst = d;
+}
+
+// See encode_u16x4_ssse3.
+inline uint32x4_t encode_u16x4_neon(uint32x4_t in,
+                                    uint32x4_t prev,
+                                    unsigned & index) {
+    const uint32_t   lane_bits[4] = {1, 2, 4, 8};
+    const uint32x4_t lane_bit     = vld1q_u32(lane_bits);
+
+    const uint32x4_t two = vcgtq_u32(in, vdupq_n_u32(0x7f));
+    const uint32x4_t surrogate =
+        vceqq_u32(vandq_u32(in, vdupq_n_u32(0xf800)), vdupq_n_u32(0xd800));
+    const uint32x4_t high =
+        vceqq_u32(vandq_u32(in, vdupq_n_u32(0xfc00)), vdupq_n_u32(0xd800));
+    const uint32x4_t three =
+        vbicq_u32(vcgtq_u32(in, vdupq_n_u32(0x7ff)), surrogate);
+
+    uint32x4_t bytes = vandq_u32(in, vdupq_n_u32(0x0000003f));
+    bytes            = vorrq_u32(
+        bytes, vandq_u32(vshlq_n_u32(in, 2), vdupq_n_u32(0x00003f00)));
+    bytes = vorrq_u32(
+        bytes, vandq_u32(vshlq_n_u32(in, 4), vdupq_n_u32(0x003f0000)));
+
+    uint32x4_t prefix = vandq_u32(two, vdupq_n_u32(0x0000c080));
+    prefix = veorq_u32(prefix, vandq_u32(three, vdupq_n_u32(0x00e04000)));
+
+    bytes = vbslq_u32(two, vorrq_u32(bytes, prefix), in);
+
+    const uint32x4_t h =
+        vaddq_u32(vandq_u32(in, vdupq_n_u32(0x3ff)), vdupq_n_u32(0x40));
+    const uint32x4_t high_bytes =
+        vorrq_u32(vorrq_u32(vandq_u32(h, vdupq_n_u32(0x700)),
+                            vandq_u32(vshrq_n_u32(h, 2), vdupq_n_u32(0x3f))),
+                  vdupq_n_u32(0xf080));
+    const uint32x4_t low_bytes = vorrq_u32(
+        vorrq_u32(vshlq_n_u32(vandq_u32(prev, vdupq_n_u32(0x03)), 12),
+                  vandq_u32(vshlq_n_u32(in, 2), vdupq_n_u32(0xf00))),
+        vorrq_u32(vandq_u32(in, vdupq_n_u32(0x3f)), vdupq_n_u32(0x8080)));
+
+    index = u8_encode_spread[vaddvq_u32(vandq_u32(two, lane_bit))] +
+            u8_encode_spread[vaddvq_u32(vandq_u32(three, lane_bit))];
+
+    return vbslq_u32(surrogate, vbslq_u32(high, high_bytes, low_bytes), bytes);
+}
+
+inline uint16x8_t load_u16x8_neon(const char16_t *src, bool big_endian) {
+    const uint16x8_t in = vld1q_u16(reinterpret_cast<const uint16_t *>(src));
+    if (!big_endian)
+        return in;
+    return vreinterpretq_u16_u8(vrev16q_u8(vreinterpretq_u8_u16(in)));
+}
+
+void u16_to_u8_neon(const char16_t *&src,
+                    const char16_t * end,
+                    char *&          dst,
+                    char *           dst_end,
+                    UTF_ENDIAN       endian) {
+    const u8_encode_table &table = u8_encode_table::get();
+    const bool       big_endian = endian == utf_convert::UTF_ENDIAN_BIG_ENDIAN;
+    const uint16_t   unit_bits[8] = {1, 2, 4, 8, 16, 32, 64, 128};
+    const uint16x8_t unit_bit     = vld1q_u16(unit_bits);
+
+    const char16_t *s = src;
+    char *          d = dst;
+
+    bool     pending      = false;
+    uint16_t pending_high = 0;
+
+    while (end - s >= 16 && dst_end - d >= 32) {
+        const uint16x8_t in = load_u16x8_neon(s, big_endian);
+
+        if (!pending) {
+            const uint16x8_t next = load_u16x8_neon(s + 8, big_endian);
+            if (vmaxvq_u16(vorrq_u16(in, next)) < 0x80) {
+                vst1q_u8(reinterpret_cast<uint8_t *>(d),
+                         vcombine_u8(vmovn_u16(in), vmovn_u16(next)));
+                s += 16;
+                d += 16;
+                continue;
+            }
+        }
+
+        // One mask bit per unit.
+        const uint32_t high = vaddvq_u16(vandq_u16(
+            vceqq_u16(vandq_u16(in, vdupq_n_u16(0xfc00)), vdupq_n_u16(0xd800)),
+            unit_bit));
+        const uint32_t low = vaddvq_u16(vandq_u16(
+            vceqq_u16(vandq_u16(in, vdupq_n_u16(0xfc00)), vdupq_n_u16(0xdc00)),
+            unit_bit));
+
+        bool paired = low == (((high << 1) | (pending ? 0x01 : 0)) & 0xff);
+        if (paired && (high & 0x80))
+            paired = (load_u16(s + 8, big_endian) & 0xfc00) == 0xdc00;
+
+        if (paired) {
+            const uint16x8_t prev = vextq_u16(vdupq_n_u16(pending_high), in, 7);
+
+            unsigned   index;
+            uint32x4_t bytes = encode_u16x4_neon(
+                vmovl_u16(vget_low_u16(in)), vmovl_u16(vget_low_u16(prev)), index);
+            const u8_encode_entry *e = &table.entry[index];
+            vst1q_u8(reinterpret_cast<uint8_t *>(d),
+                     vqtbl1q_u8(vreinterpretq_u8_u32(bytes), vld1q_u8(e->shuffle)));
+            d += e->length;
+
+            bytes = encode_u16x4_neon(vmovl_u16(vget_high_u16(in)),
+                                      vmovl_u16(vget_high_u16(prev)),
+                                      index);
+            e     = &table.entry[index];
+            vst1q_u8(reinterpret_cast<uint8_t *>(d),
+                     vqtbl1q_u8(vreinterpretq_u8_u32(bytes), vld1q_u8(e->shuffle)));
+            d += e->length;
+
+            pending      = (high & 0x80) != 0;
+            pending_high = vgetq_lane_u16(in, 7);
+            s += 8;
+            continue;
+        }
+
+        if (pending) {
+            encode_u16_low_surrogate(pending_high, load_u16(s, big_endian), d);
+            pending = false;
+            s++;
+            continue;
+        }
+
+        const char16_t *stop = s + trailing_zeros(high | low) + 1;
+        while (s < stop) {
+            if (!encode_u16_code_point(s, end, d, big_endian))
+                break;
+        }
+        if (s < stop)
+            break;
+    }
+
+    if (pending) {
+        encode_u16_low_surrogate(pending_high, load_u16(s, big_endian), d);
+        s++;
+    }
+
+    src = s;
+    dst = d;
+}
+
+// Same as u8_to_u16_block_ssse3.
+inline unsigned u8_to_u16_block_neon(const u8_decode_table &table,
+                                     const u8_block_masks & m,
+                                     const uint8_t *        src,
+                                     unsigned               limit,
+                                     char16_t *&            dst,
+                                     bool                   big_endian) {
+    unsigned pos = 0;
+    while (pos < limit) {
+        const uint8x16_t in = vld1q_u8(src + pos);
+
+        // A run of at least eight ascii bytes is widened whole.
+        const unsigned ascii =
+            vmaxvq_u8(in) < 0x80
+                ? 16
+                : trailing_zeros(
+                      movemask_neon(vcgeq_u8(in, vdupq_n_u8(0x80))));
+        if (ascii >= 8) {
+            uint16x8_t lo = vmovl_u8(vget_low_u8(in));
+            uint16x8_t hi = vmovl_u8(vget_high_u8(in));
+            if (big_endian) {
+                lo = vshlq_n_u16(lo, 8);
+                hi = vshlq_n_u16(hi, 8);
+            }
+            vst1q_u16(reinterpret_cast<uint16_t *>(dst), lo);
+            vst1q_u16(reinterpret_cast<uint16_t *>(dst + 8), hi);
+            pos += ascii;
+            dst += ascii;
+            continue;
+        }
+
+        const u8_decode_index *e = find_u8_decode_entry(table, m, pos);
+        if (e == NULL)
+            break;
+
+        const uint32x4_t out = decode_u8_neon(table, *e, in);
+        if (e->shape == u8_decode_two) {
+            uint16x8_t units = vreinterpretq_u16_u32(out);
+            if (big_endian)
+                units = vreinterpretq_u16_u8(
+                    vrev16q_u8(vreinterpretq_u8_u16(units)));
+            vst1q_u16(reinterpret_cast<uint16_t *>(dst), units);
+            dst += e->chars;
+        } else if (e->shape == u8_decode_three) {
+            uint16x4_t units = vmovn_u32(out);
+            if (big_endian)
+                units = vreinterpret_u16_u8(vrev16_u8(vreinterpret_u8_u16(units)));
+            vst1_u16(reinterpret_cast<uint16_t *>(dst), units);
+            dst += e->chars;
+        } else {
+            if (vmaxvq_u32(out) >= 0x110000)
+                break;
+
+            // Same as u8_to_u16_block_ssse3, the lane past three characters
+            // is clear.
+            if (vminvq_u32(e->chars == 4 ? out
+                                         : vsetq_lane_u32(0x10000, out, 3)) >=
+                0x10000) {
+                const uint32x4_t value =
+                    vsubq_u32(out, vdupq_n_u32(0x10000));
+                uint16x8_t units = vreinterpretq_u16_u32(vorrq_u32(
+                    vorrq_u32(vdupq_n_u32(0xdc00d800), vshrq_n_u32(value, 10)),
+                    vandq_u32(vshlq_n_u32(value, 16),
+                              vdupq_n_u32(0x03ff0000))));
+                if (big_endian)
+                    units = vreinterpretq_u16_u8(
+                        vrev16q_u8(vreinterpretq_u8_u16(units)));
+                vst1q_u16(reinterpret_cast<uint16_t *>(dst), units);
+                dst += e->chars * 2;
+            } else {
+                uint32_t code_points[4];
+                vst1q_u32(code_points, out);
+                for (unsigned i = 0; i < e->chars; i++)
+                    encode_u16_unit(code_points[i], dst, big_endian);
+            }
+        }
+        pos += e->consumed;
+    }
+    return pos;
+}
+
+void u8_to_u16_neon(const uint8_t *&src,
+                    const uint8_t * end,
+                    char16_t *&     dst,
+                    char16_t *      dst_end,
+                    UTF_ENDIAN      endian) {
+    const u8_decode_table &table = u8_decode_table::get();
+    const bool big_endian = endian == utf_convert::UTF_ENDIAN_BIG_ENDIAN;
+
+    const uint8_t * s = src;
+    char16_t *      d = dst;
+    u8_block_masks  m;
+
+    while (end - s >= 64 && dst_end - d >= 64) {
+        load_u8_block_neon(s, 4, m);
+        const unsigned done =
+            u8_to_u16_block_neon(table, m, s, 48, d, big_endian);
+        s += done;
+        if (done < 48)
+            break;
+    }
+    while (end - s >= 16 && dst_end - d >= 16) {
+        load_u8_block_neon(s, 1, m);
+        const unsigned done =
+            u8_to_u16_block_neon(table, m, s, 1, d, big_endian);
+        if (done == 0)
+            break;
+        s += done;
+    }
+
+    src = s;
+    dst = d;
+}
+
+void u16_to_u32_neon(const char16_t *&src,
+                     const char16_t * end,
+                     char32_t *&      dst,
+                     char32_t *       dst_end,
+                     UTF_ENDIAN       src_endian,
+                     UTF_ENDIAN       dst_endian) {
+    const bool src_big_endian = src_endian == utf_convert::UTF_ENDIAN_BIG_ENDIAN;
+    const bool dst_big_endian = dst_endian == utf_convert::UTF_ENDIAN_BIG_ENDIAN;
+
+    const char16_t *s = src;
+    char32_t *      d = dst;
+
+    while (end - s >= 8 && dst_end - d >= 8) {
+        const uint16x8_t in = load_u16x8_neon(s, src_big_endian);
+        const uint16x8_t surrogate =
+            vceqq_u16(vandq_u16(in, vdupq_n_u16(0xf800)), vdupq_n_u16(0xd800));
+
+        if (vmaxvq_u16(surrogate) == 0) {
+            uint32x4_t lo = vmovl_u16(vget_low_u16(in));
+            uint32x4_t hi = vmovl_u16(vget_high_u16(in));
+            if (dst_big_endian) {
+                lo = vreinterpretq_u32_u8(vrev32q_u8(vreinterpretq_u8_u32(lo)));
+                hi = vreinterpretq_u32_u8(vrev32q_u8(vreinterpretq_u8_u32(hi)));
+            }
+            vst1q_u32(reinterpret_cast<uint32_t *>(d), lo);
+            vst1q_u32(reinterpret_cast<uint32_t *>(d + 4), hi);
+            s += 8;
+            d += 8;
+            continue;
+        }
+
+        const char16_t *stop = s + 8;
+        while (s < stop) {
+            if (!decode_u16_code_point(
+                    s, end, d, src_big_endian, dst_big_endian))
+                break;
+        }
+        if (s < stop)
+            break;
+    }
+
+    src = s;
+    dst = d;
+}
+
+void u32_to_u16_neon(const char32_t *&src,
+                     const char32_t * end,
+                     char16_t *&      dst,
+                     char16_t *       dst_end,
+                     UTF_ENDIAN       src_endian,
+                     UTF_ENDIAN       dst_endian) {
+    const bool src_big_endian = src_endian == utf_convert::UTF_ENDIAN_BIG_ENDIAN;
+    const bool dst_big_endian = dst_endian == utf_convert::UTF_ENDIAN_BIG_ENDIAN;
+
+    const char32_t *s = src;
+    char16_t *      d = dst;
+
+    while (end - s >= 8 && dst_end - d >= 16) {
+        uint32x4_t lo = vld1q_u32(reinterpret_cast<const uint32_t *>(s));
+        uint32x4_t hi = vld1q_u32(reinterpret_cast<const uint32_t *>(s + 4));
+        if (src_big_endian) {
+            lo = vreinterpretq_u32_u8(vrev32q_u8(vreinterpretq_u8_u32(lo)));
+            hi = vreinterpretq_u32_u8(vrev32q_u8(vreinterpretq_u8_u32(hi)));
+        }
+
+        if (vmaxvq_u32(vorrq_u32(lo, hi)) < 0x10000) {
+            uint16x8_t out = vcombine_u16(vmovn_u32(lo), vmovn_u32(hi));
+            if (dst_big_endian)
+                out = vreinterpretq_u16_u8(vrev16q_u8(vreinterpretq_u8_u16(out)));
+            vst1q_u16(reinterpret_cast<uint16_t *>(d), out);
+            s += 8;
+            d += 8;
+            continue;
+        }
+
+        const char32_t *stop = s + 8;
+        for (; s < stop; s++) {
+            if (!encode_u16_unit(load_u32(s, src_big_endian), d, dst_big_endian))
+                break;
+        }
+        if (s < stop)
+            break;
+    }
+
+    src = s;
+    dst = d;
+}
+
+size_t utf32_length_from_utf8_neon(const uint8_t *&src, const uint8_t *end) {
+    const uint8_t *s     = src;
+    size_t         count = 0;
+
+    while (end - s >= 16) {
+        const int8x16_t in = vreinterpretq_s8_u8(vld1q_u8(s));
+        count += vaddvq_u8(vshrq_n_u8(vcgtq_s8(in, vdupq_n_s8(-65)), 7));
+        s += 16;
+    }
+
+    src = s;
+    return count;
+}
+
+size_t utf8_length_from_utf32_neon(const char32_t *&src,
+                                   const char32_t * end,
+                                   UTF_ENDIAN       endian) {
+    const bool big_endian = endian == utf_convert::UTF_ENDIAN_BIG_ENDIAN;
+
+    const char32_t *s     = src;
+    size_t          count = 0;
+
+    while (end - s >= 4) {
+        uint32x4_t in = vld1q_u32(reinterpret_cast<const uint32_t *>(s));
+        if (big_endian)
+            in = vreinterpretq_u32_u8(vrev32q_u8(vreinterpretq_u8_u32(in)));
+
+        // The masks are all ones, so subtracting them adds one per lane.
+        uint32x4_t length = vdupq_n_u32(1);
+        length = vsubq_u32(length, vcgtq_u32(in, vdupq_n_u32(0x7f)));
+        length = vsubq_u32(length, vcgtq_u32(in, vdupq_n_u32(0x7ff)));
+        length = vsubq_u32(length, vcgtq_u32(in, vdupq_n_u32(0xffff)));
+        count += vaddvq_u32(length);
+        s += 4;
+    }
+
+    src = s;
+    return count;
+}
+
+size_t utf8_length_from_utf16_neon(const char16_t *&src,
+                                   const char16_t * end,
+                                   UTF_ENDIAN       endian) {
+    const bool big_endian = endian == utf_convert::UTF_ENDIAN_BIG_ENDIAN;
+
+    const char16_t *s         = src;
+    size_t          count     = 0;
+    uint16_t        prev_unit = 0;
+
+    while (end - s >= 8) {
+        const uint16x8_t in   = load_u16x8_neon(s, big_endian);
+        const uint16x8_t prev = vextq_u16(vdupq_n_u16(prev_unit), in, 7);
+
+        const uint16x8_t surrogate =
+            vceqq_u16(vandq_u16(in, vdupq_n_u16(0xf800)), vdupq_n_u16(0xd800));
+        const uint16x8_t low =
+            vceqq_u16(vandq_u16(in, vdupq_n_u16(0xfc00)), vdupq_n_u16(0xdc00));
+        const uint16x8_t prev_high = vceqq_u16(
+            vandq_u16(prev, vdupq_n_u16(0xfc00)), vdupq_n_u16(0xd800));
+
+        uint16x8_t length = vdupq_n_u16(1);
+        length = vsubq_u16(length, vcgtq_u16(in, vdupq_n_u16(0x7f)));
+        length = vsubq_u16(
+            length, vbicq_u16(vcgtq_u16(in, vdupq_n_u16(0x7ff)), surrogate));
+        length = vsubq_u16(length, vbicq_u16(low, prev_high));
+        count += vaddvq_u16(length);
+
+        prev_unit = vgetq_lane_u16(in, 7);
+        s += 8;
+    }
+
+    src = s;
+    return count;
+}
+
+size_t utf16_length_from_utf8_neon(const uint8_t *&src, const uint8_t *end) {
+    const uint8_t *s     = src;
+    size_t         count = 0;
+
+    while (end - s >= 16) {
+        const uint8x16_t in = vld1q_u8(s);
+        count += vaddvq_u8(vshrq_n_u8(
+            vcgtq_s8(vreinterpretq_s8_u8(in), vdupq_n_s8(-65)), 7));
+        count += vaddvq_u8(vshrq_n_u8(vcgeq_u8(in, vdupq_n_u8(0xf0)), 7));
+        s += 16;
+    }
+
+    src = s;
+    return count;
+}
+
+size_t utf32_length_from_utf16_neon(const char16_t *&src,
+                                    const char16_t * end,
+                                    UTF_ENDIAN       endian) {
+    const bool big_endian = endian == utf_convert::UTF_ENDIAN_BIG_ENDIAN;
+
+    const char16_t *s         = src;
+    size_t          count     = 0;
+    uint16_t        prev_unit = 0;
+
+    while (end - s >= 8) {
+        const uint16x8_t in   = load_u16x8_neon(s, big_endian);
+        const uint16x8_t prev = vextq_u16(vdupq_n_u16(prev_unit), in, 7);
+
+        const uint16x8_t low =
+            vceqq_u16(vandq_u16(in, vdupq_n_u16(0xfc00)), vdupq_n_u16(0xdc00));
+        const uint16x8_t prev_high = vceqq_u16(
+            vandq_u16(prev, vdupq_n_u16(0xfc00)), vdupq_n_u16(0xd800));
+
+        count += 8 - vaddvq_u16(vshrq_n_u16(vandq_u16(low, prev_high), 15));
+
+        prev_unit = vgetq_lane_u16(in, 7);
+        s += 8;
+    }
+
+    src = s;
+    return count;
+}
+
+size_t utf16_length_from_utf32_neon(const char32_t *&src,
+                                    const char32_t * end,
+                                    UTF_ENDIAN       endian) {
+    const bool big_endian = endian == utf_convert::UTF_ENDIAN_BIG_ENDIAN;
+
+    const char32_t *s     = src;
+    size_t          count = 0;
+
+    while (end - s >= 4) {
+        uint32x4_t in = vld1q_u32(reinterpret_cast<const uint32_t *>(s));
+        if (big_endian)
+            in = vreinterpretq_u32_u8(vrev32q_u8(vreinterpretq_u8_u32(in)));
+
+        count += 4 + vaddvq_u32(vshrq_n_u32(vcgtq_u32(in, vdupq_n_u32(0xffff)), 31));
+        s += 4;
+    }
+
+    src = s;
+    return count;
+}
+
+// Same as u8_errors_ssse3.
+inline uint8x16_t u8_errors_neon(uint8x16_t in,
+                                 uint8x16_t prev_in,
+                                 uint8x16_t byte_1_high,
+                                 uint8x16_t byte_1_low,
+                                 uint8x16_t byte_2_high) {
+    const uint8x16_t prev1 = vextq_u8(prev_in, in, 15);
+    const uint8x16_t prev2 = vextq_u8(prev_in, in, 14);
+    const uint8x16_t prev3 = vextq_u8(prev_in, in, 13);
+
+    const uint8x16_t special = vandq_u8(
+        vandq_u8(vqtbl1q_u8(byte_1_high, vshrq_n_u8(prev1, 4)),
+                 vqtbl1q_u8(byte_1_low, vandq_u8(prev1, vdupq_n_u8(0x0f)))),
+        vqtbl1q_u8(byte_2_high, vshrq_n_u8(in, 4)));
+
+    const uint8x16_t must_be_continuation = vandq_u8(
+        vorrq_u8(vqsubq_u8(prev2, vdupq_n_u8(0xe0 - 0x80)),
+                 vqsubq_u8(prev3, vdupq_n_u8(0xf0 - 0x80))),
+        vdupq_n_u8(0x80));
+    return veorq_u8(must_be_continuation, special);
+}
+
+void validate_utf8_neon(const uint8_t *&src, const uint8_t *end) {
+    const uint8x16_t byte_1_high = vld1q_u8(u8_byte_1_high);
+    const uint8x16_t byte_1_low  = vld1q_u8(u8_byte_1_low);
+    const uint8x16_t byte_2_high = vld1q_u8(u8_byte_2_high);
+    static const uint8_t max_bytes[16] = {
+        0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+        0xff, 0xff, 0xf0 - 1, 0xe0 - 1, 0xc0 - 1};
+    const uint8x16_t max_value = vld1q_u8(max_bytes);
+
+    const uint8_t *s               = src;
+    uint8x16_t     prev_in         = vdupq_n_u8(0);
+    uint8x16_t     prev_incomplete = vdupq_n_u8(0);
+
+    while (end - s >= 16) {
+        const uint8x16_t in = vld1q_u8(s);
+
+        uint8x16_t error = prev_incomplete;
+        if (vmaxvq_u8(in) >= 0x80) {
+            error = u8_errors_neon(
+                in, prev_in, byte_1_high, byte_1_low, byte_2_high);
+        }
+        if (vmaxvq_u8(error) != 0)
+            break;
+
+        prev_in         = in;
+        prev_incomplete = vqsubq_u8(in, max_value);
+        s += 16;
+    }
+
+    src = u8_sequence_start(src, s);
+}
+
+// Same as validate_utf16_ssse3, with the bits packed by a multiply.
+void validate_utf16_neon(const char16_t *&src,
+                         const char16_t * end,
+                         UTF_ENDIAN       endian) {
+    const bool big_endian = endian == utf_convert::UTF_ENDIAN_BIG_ENDIAN;
+    static const uint16_t bit_values[8] = {1, 2, 4, 8, 16, 32, 64, 128};
+    const uint16x8_t      bit           = vld1q_u16(bit_values);
+
+    const char16_t *s         = src;
+    uint32_t        prev_high = 0;
+
+    while (end - s >= 8) {
+        const uint16x8_t in =
+            vandq_u16(load_u16x8_neon(s, big_endian), vdupq_n_u16(0xfc00));
+        const uint32_t high =
+            vaddvq_u16(vandq_u16(vceqq_u16(in, vdupq_n_u16(0xd800)), bit));
+        const uint32_t low =
+            vaddvq_u16(vandq_u16(vceqq_u16(in, vdupq_n_u16(0xdc00)), bit));
+        if ((((high << 1) | prev_high) & 0xff) != low)
+            break;
+
+        prev_high = (high >> 7) & 1;
+        s += 8;
+    }
+
+    src = s - prev_high;
+}
+
+void validate_utf32_neon(const char32_t *&src,
+                         const char32_t * end,
+                         UTF_ENDIAN       endian) {
+    const bool big_endian = endian == utf_convert::UTF_ENDIAN_BIG_ENDIAN;
+
+    const char32_t *s = src;
+
+    while (end - s >= 4) {
+        uint32x4_t in = vld1q_u32(reinterpret_cast<const uint32_t *>(s));
+        if (big_endian)
+            in = vreinterpretq_u32_u8(vrev32q_u8(vreinterpretq_u8_u32(in)));
+
+        const uint32x4_t error = vorrq_u32(
+            vcgtq_u32(in, vdupq_n_u32(0x10ffff)),
+            vceqq_u32(vandq_u32(in, vdupq_n_u32(0xfffff800)),
+                      vdupq_n_u32(0xd800)));
+        if (vmaxvq_u32(error) != 0)
+            break;
+        s += 4;
+    }
+
+    src = s;
+}
+
+void ascii_prefix_neon(const uint8_t *&src, const uint8_t *end) {
+    const uint8_t *s = src;
+
+    while (end - s >= 64) {
+        const uint8x16_t any = vorrq_u8(vorrq_u8(vld1q_u8(s), vld1q_u8(s + 16)),
+                                        vorrq_u8(vld1q_u8(s + 32),
+                                                 vld1q_u8(s + 48)));
+        if (vmaxvq_u8(any) >= 0x80)
+            break;
+        s += 64;
+    }
+    while (end - s >= 16) {
+        if (vmaxvq_u8(vld1q_u8(s)) >= 0x80)
+            break;
+        s += 16;
+    }
+
+    src = s;
+}
+
+// Same as has_c1_ssse3.
+inline bool has_c1_neon(uint8x16_t in) {
+    return vmaxvq_u8(vcltq_u8(veorq_u8(in, vdupq_n_u8(0x80)),
+                              vdupq_n_u8(0x20))) != 0;
+}
+
+// Same as store_latin1x8_ssse3.
+inline size_t store_latin1x8_neon(const latin1_encode_table &table,
+                                  uint16x8_t                 lanes,
+                                  uint16x8_t                 lane_bit,
+                                  char *                     dst) {
+    const uint16x8_t lead =
+        vorrq_u16(vshrq_n_u16(lanes, 6), vdupq_n_u16(0xc0));
+    const uint16x8_t cont = vshlq_n_u16(
+        vorrq_u16(vandq_u16(lanes, vdupq_n_u16(0x3f)), vdupq_n_u16(0x80)), 8);
+    const uint16x8_t two   = vcgtq_u16(lanes, vdupq_n_u16(0x7f));
+    const uint16x8_t bytes = vbslq_u16(two, vorrq_u16(lead, cont), lanes);
+
+    const latin1_encode_entry &e =
+        table.entry[vaddvq_u16(vandq_u16(two, lane_bit))];
+    vst1q_u8(reinterpret_cast<uint8_t *>(dst),
+             vqtbl1q_u8(vreinterpretq_u8_u16(bytes), vld1q_u8(e.shuffle)));
+    return e.length;
+}
+
+void latin1_to_u8_neon(const uint8_t *&src,
+                       const uint8_t * end,
+                       char *&         dst,
+                       char *          dst_end,
+                       UTF_CHARSET     charset) {
+    const latin1_encode_table &table = latin1_encode_table::get();
+    const bool       cp1252 = charset == utf_convert::UTF_CHARSET_WINDOWS_1252;
+    const uint16_t   lane_bits[8] = {1, 2, 4, 8, 16, 32, 64, 128};
+    const uint16x8_t lane_bit     = vld1q_u16(lane_bits);
+
+    const uint8_t *s = src;
+    char *         d = dst;
+
+    while (end - s >= 16 && dst_end - d >= 32) {
+        const uint8x16_t in = vld1q_u8(s);
+
+        if (vmaxvq_u8(in) < 0x80) {
+            vst1q_u8(reinterpret_cast<uint8_t *>(d), in);
+            s += 16;
+            d += 16;
+            continue;
+        }
+        if (cp1252 && has_c1_neon(in))
+            break;
+
+        d += store_latin1x8_neon(
+            table, vmovl_u8(vget_low_u8(in)), lane_bit, d);
+        d += store_latin1x8_neon(
+            table, vmovl_u8(vget_high_u8(in)), lane_bit, d);
+        s += 16;
+    }
+
+    src = s;
+    dst = d;
+}
+
+void latin1_to_u16_neon(const uint8_t *&src,
+                        const uint8_t * end,
+                        char16_t *&     dst,
+                        char16_t *      dst_end,
+                        UTF_ENDIAN      endian,
+                        UTF_CHARSET     charset) {
+    const bool big_endian = endian == utf_convert::UTF_ENDIAN_BIG_ENDIAN;
+    const bool cp1252     = charset == utf_convert::UTF_CHARSET_WINDOWS_1252;
+
+    const uint8_t *s = src;
+    char16_t *     d = dst;
+
+    while (end - s >= 16 && dst_end - d >= 16) {
+        const uint8x16_t in = vld1q_u8(s);
+        if (cp1252 && has_c1_neon(in))
+            break;
+
+        uint16x8_t lo = vmovl_u8(vget_low_u8(in));
+        uint16x8_t hi = vmovl_u8(vget_high_u8(in));
+        if (big_endian) {
+            lo = vshlq_n_u16(lo, 8);
+            hi = vshlq_n_u16(hi, 8);
+        }
+        vst1q_u16(reinterpret_cast<uint16_t *>(d), lo);
+        vst1q_u16(reinterpret_cast<uint16_t *>(d + 8), hi);
+        s += 16;
+        d += 16;
+    }
+
+    src = s;
+    dst = d;
+}
+
+void latin1_to_u32_neon(const uint8_t *&src,
+                        const uint8_t * end,
+                        char32_t *&     dst,
+                        char32_t *      dst_end,
+                        UTF_ENDIAN      endian,
+                        UTF_CHARSET     charset) {
+    const bool big_endian = endian == utf_convert::UTF_ENDIAN_BIG_ENDIAN;
+    const bool cp1252     = charset == utf_convert::UTF_CHARSET_WINDOWS_1252;
+
+    const uint8_t *s = src;
+    char32_t *     d = dst;
+
+    while (end - s >= 16 && dst_end - d >= 16) {
+        const uint8x16_t in = vld1q_u8(s);
+        if (cp1252 && has_c1_neon(in))
+            break;
+
+        const uint16x8_t lo     = vmovl_u8(vget_low_u8(in));
+        const uint16x8_t hi     = vmovl_u8(vget_high_u8(in));
+        uint32x4_t       out[4] = {vmovl_u16(vget_low_u16(lo)),
+                             vmovl_u16(vget_high_u16(lo)),
+                             vmovl_u16(vget_low_u16(hi)),
+                             vmovl_u16(vget_high_u16(hi))};
+        for (int i = 0; i < 4; i++) {
+            if (big_endian)
+                out[i] = vshlq_n_u32(out[i], 24);
+            vst1q_u32(reinterpret_cast<uint32_t *>(d + i * 4), out[i]);
+        }
+        s += 16;
+        d += 16;
+    }
+
+    src = s;
+    dst = d;
+}
+
+// Same as u8_to_latin1x16_ssse3.
+inline bool u8_to_latin1x16_neon(const u8_compress_table &table,
+                                 uint8x16_t               in,
+                                 const uint8_t *&         src,
+                                 char *&                  dst,
+                                 bool                     cp1252) {
+    const uint8x16_t leads =
+        vceqq_u8(vandq_u8(in, vdupq_n_u8(0xfe)), vdupq_n_u8(0xc2));
+    const uint8x16_t conts =
+        vceqq_u8(vandq_u8(in, vdupq_n_u8(0xc0)), vdupq_n_u8(0x80));
+    unsigned       lead = movemask_neon(leads);
+    const unsigned cont = movemask_neon(conts);
+    if ((lead | cont) != movemask_neon(vcgeq_u8(in, vdupq_n_u8(0x80))))
+        return false;
+
+    const unsigned cut = lead & 0x8000;
+    lead &= 0x7fff;
+    if (cont != lead << 1)
+        return false;
+
+    const uint8x16_t value =
+        vorrq_u8(vshlq_n_u8(vandq_u8(in, vdupq_n_u8(0x03)), 6),
+                 vandq_u8(vextq_u8(in, vdupq_n_u8(0), 1), vdupq_n_u8(0x3f)));
+    if (cp1252 && has_c1_neon(vandq_u8(leads, value)))
+        return false;
+
+    const uint8x16_t         out  = vbslq_u8(leads, value, in);
+    const unsigned           drop = cont | cut;
+    const u8_compress_entry &lo   = table.entry[drop & 0xff];
+    const u8_compress_entry &hi   = table.entry[drop >> 8];
+    vst1_u8(reinterpret_cast<uint8_t *>(dst),
+            vqtbl1_u8(out, vld1_u8(lo.shuffle)));
+    vst1_u8(reinterpret_cast<uint8_t *>(dst + lo.length),
+            vqtbl1_u8(vextq_u8(out, out, 8), vld1_u8(hi.shuffle)));
+    src += cut ? 15 : 16;
+    dst += lo.length + hi.length;
+    return true;
+}
+
+void u8_to_latin1_neon(const uint8_t *&src,
+                       const uint8_t * end,
+                       char *&         dst,
+                       char *          dst_end,
+                       UTF_CHARSET     charset) {
+    const u8_compress_table &table = u8_compress_table::get();
+    const bool cp1252 = charset == utf_convert::UTF_CHARSET_WINDOWS_1252;
+
+    const uint8_t *s = src;
+    char *         d = dst;
+
+    while (end - s >= 16 && dst_end - d >= 16) {
+        const uint8x16_t in = vld1q_u8(s);
+
+        if (vmaxvq_u8(in) < 0x80) {
+            vst1q_u8(reinterpret_cast<uint8_t *>(d), in);
+            s += 16;
+            d += 16;
+            continue;
+        }
+        if (!u8_to_latin1x16_neon(table, in, s, d, cp1252))
+            break;
+    }
+
+    src = s;
+    dst = d;
+}
+
+void u16_to_latin1_neon(const char16_t *&src,
+                        const char16_t * end,
+                        char *&          dst,
+                        char *           dst_end,
+                        UTF_ENDIAN       endian,
+                        UTF_CHARSET      charset) {
+    const bool big_endian = endian == utf_convert::UTF_ENDIAN_BIG_ENDIAN;
+    const bool cp1252     = charset == utf_convert::UTF_CHARSET_WINDOWS_1252;
+
+    const char16_t *s = src;
+    char *          d = dst;
+
+    while (end - s >= 16 && dst_end - d >= 16) {
+        const uint16x8_t lo = load_u16x8_neon(s, big_endian);
+        const uint16x8_t hi = load_u16x8_neon(s + 8, big_endian);
+        if (vmaxvq_u16(vorrq_u16(lo, hi)) >= 0x100)
+            break;
+
+        const uint8x16_t out = vcombine_u8(vmovn_u16(lo), vmovn_u16(hi));
+        if (cp1252 && has_c1_neon(out))
+            break;
+        vst1q_u8(reinterpret_cast<uint8_t *>(d), out);
+        s += 16;
+        d += 16;
+    }
+
+    src = s;
+    dst = d;
+}
+
+void u32_to_latin1_neon(const char32_t *&src,
+                        const char32_t * end,
+                        char *&          dst,
+                        char *           dst_end,
+                        UTF_ENDIAN       endian,
+                        UTF_CHARSET      charset) {
+    const bool big_endian = endian == utf_convert::UTF_ENDIAN_BIG_ENDIAN;
+    const bool cp1252     = charset == utf_convert::UTF_CHARSET_WINDOWS_1252;
+
+    const char32_t *s = src;
+    char *          d = dst;
+
+    while (end - s >= 16 && dst_end - d >= 16) {
+        uint32x4_t in[4];
+        for (int i = 0; i < 4; i++) {
+            in[i] = vld1q_u32(reinterpret_cast<const uint32_t *>(s + i * 4));
+            if (big_endian)
+                in[i] = vreinterpretq_u32_u8(
+                    vrev32q_u8(vreinterpretq_u8_u32(in[i])));
+        }
+        const uint32x4_t any =
+            vorrq_u32(vorrq_u32(in[0], in[1]), vorrq_u32(in[2], in[3]));
+        if (vmaxvq_u32(any) >= 0x100)
+            break;
+
+        const uint8x16_t out = vcombine_u8(
+            vmovn_u16(vcombine_u16(vmovn_u32(in[0]), vmovn_u32(in[1]))),
+            vmovn_u16(vcombine_u16(vmovn_u32(in[2]), vmovn_u32(in[3]))));
+        if (cp1252 && has_c1_neon(out))
+            break;
+        vst1q_u8(reinterpret_cast<uint8_t *>(d), out);
+        s += 16;
+        d += 16;
+    }
+
+    src = s;
+    dst = d;
+}
+
+void swap_u16_neon(char16_t *&str, char16_t *end) {
+    char16_t *s = str;
+    for (; end - s >= 8; s += 8) {
+        uint8_t *unit = reinterpret_cast<uint8_t *>(s);
+        vst1q_u8(unit, vrev16q_u8(vld1q_u8(unit)));
+    }
+    str = s;
+}
+
+void swap_u32_neon(char32_t *&str, char32_t *end) {
+    char32_t *s = str;
+    for (; end - s >= 4; s += 4) {
+        uint8_t *unit = reinterpret_cast<uint8_t *>(s);
+        vst1q_u8(unit, vrev32q_u8(vld1q_u8(unit)));
+    }
+    str = s;
+}
+
+void fold_u8_neon(char *&str, char *end, UTF_FOLD fold) {
+    const bool latin1 = fold == utf_convert::UTF_FOLD_LATIN1;
+
+    char *     s    = str;
+    uint8x16_t prev = vdupq_n_u8(0);
+    for (; end - s >= 16; s += 16) {
+        uint8_t *        unit = reinterpret_cast<uint8_t *>(s);
+        const uint8x16_t in   = vld1q_u8(unit);
+        uint8x16_t       mask =
+            vcleq_u8(vsubq_u8(in, vdupq_n_u8('A')), vdupq_n_u8(25));
+        if (latin1) {
+            // U+00C0 ~ U+00DE are 0xc3 0x80 ~ 0xc3 0x9e, and only the second
+            // byte changes, like for avx2.
+            const uint8x16_t upper =
+                vbicq_u8(vcleq_u8(vsubq_u8(in, vdupq_n_u8(0x80)),
+                                  vdupq_n_u8(0x1e)),
+                         vceqq_u8(in, vdupq_n_u8(0x97)));
+            mask = vorrq_u8(
+                mask,
+                vandq_u8(upper,
+                         vceqq_u8(vextq_u8(prev, in, 15), vdupq_n_u8(0xc3))));
+            prev = in;
+        }
+        vst1q_u8(unit, vaddq_u8(in, vandq_u8(mask, vdupq_n_u8(0x20))));
+    }
+    str = s;
+}
+
+void fold_u16_neon(char16_t *&str,
+                   char16_t * end,
+                   UTF_ENDIAN endian,
+                   UTF_FOLD   fold) {
+    const bool big    = endian == utf_convert::UTF_ENDIAN_BIG_ENDIAN;
+    const bool latin1 = fold == utf_convert::UTF_FOLD_LATIN1;
+
+    char16_t *s = str;
+    for (; end - s >= 8; s += 8) {
+        uint8_t *  unit = reinterpret_cast<uint8_t *>(s);
+        uint16x8_t in   = vreinterpretq_u16_u8(
+            big ? vrev16q_u8(vld1q_u8(unit)) : vld1q_u8(unit));
+
+        uint16x8_t mask =
+            vcleq_u16(vsubq_u16(in, vdupq_n_u16('A')), vdupq_n_u16(25));
+        if (latin1)
+            mask = vorrq_u16(
+                mask,
+                vbicq_u16(vcleq_u16(vsubq_u16(in, vdupq_n_u16(0xc0)),
+                                    vdupq_n_u16(0x1e)),
+                          vceqq_u16(in, vdupq_n_u16(0xd7))));
+        in = vaddq_u16(in, vandq_u16(mask, vdupq_n_u16(0x20)));
+
+        const uint8x16_t out = vreinterpretq_u8_u16(in);
+        vst1q_u8(unit, big ? vrev16q_u8(out) : out);
+    }
+    str = s;
+}
+
+void fold_u32_neon(char32_t *&str,
+                   char32_t * end,
+                   UTF_ENDIAN endian,
+                   UTF_FOLD   fold) {
+    const bool big    = endian == utf_convert::UTF_ENDIAN_BIG_ENDIAN;
+    const bool latin1 = fold == utf_convert::UTF_FOLD_LATIN1;
+
+    char32_t *s = str;
+    for (; end - s >= 4; s += 4) {
+        uint8_t *  unit = reinterpret_cast<uint8_t *>(s);
+        uint32x4_t in   = vreinterpretq_u32_u8(
+            big ? vrev32q_u8(vld1q_u8(unit)) : vld1q_u8(unit));
+
+        uint32x4_t mask =
+            vcleq_u32(vsubq_u32(in, vdupq_n_u32('A')), vdupq_n_u32(25));
+        if (latin1)
+            mask = vorrq_u32(
+                mask,
+                vbicq_u32(vcleq_u32(vsubq_u32(in, vdupq_n_u32(0xc0)),
+                                    vdupq_n_u32(0x1e)),
+                          vceqq_u32(in, vdupq_n_u32(0xd7))));
+        in = vaddq_u32(in, vandq_u32(mask, vdupq_n_u32(0x20)));
+
+        const uint8x16_t out = vreinterpretq_u8_u32(in);
+        vst1q_u8(unit, big ? vrev32q_u8(out) : out);
+    }
+    str = s;
+}
+}  // namespace
+
+const utf_convert::simd::kernel_table utf_convert::simd::neon_kernels = {
+    u8_to_u32_neon,
+    u32_to_u8_neon,
+    u16_to_u8_neon,
+    u8_to_u16_neon,
+    u16_to_u32_neon,
+    u32_to_u16_neon,
+    utf32_length_from_utf8_neon,
+    utf8_length_from_utf32_neon,
+    utf8_length_from_utf16_neon,
+    utf16_length_from_utf8_neon,
+    utf32_length_from_utf16_neon,
+    utf16_length_from_utf32_neon,
+    validate_utf8_neon,
+    validate_utf16_neon,
+    validate_utf32_neon,
+    ascii_prefix_neon,
+    latin1_to_u8_neon,
+    latin1_to_u16_neon,
+    latin1_to_u32_neon,
+    u8_to_latin1_neon,
+    u16_to_latin1_neon,
+    u32_to_latin1_neon,
+    swap_u16_neon,
+    swap_u32_neon,
+    fold_u8_neon,
+    fold_u16_neon,
+    fold_u32_neon};
+
+#endif
@@ -0,0 +1,1240 @@
+#include "utf_convert_simd_kernels.hpp"
+
+#if defined(UTF_CONVERT_SIMD_X86)
+
+namespace {
+UTF_CONVERT_TARGET("ssse3")
+void u8_to_u32_ssse3(const uint8_t *&src,
+                     const uint8_t * end,
+                     char32_t *&     dst,
+                     char32_t *      dst_end,
+                     UTF_ENDIAN      endian) {
+    const u8_decode_table &table = u8_decode_table::get();
+    const bool big_endian = endian == utf_convert::UTF_ENDIAN_BIG_ENDIAN;
+
+    const uint8_t * s = src;
+    char32_t *      d = dst;
+    u8_block_masks  m;
+
+    /*
+     * Full registers are stored even if only part of them is used, so the
+     * loops stop once the output may not have room for them. The sequences
+     * are taken from blocks of 64 bytes, then from single registers.
+     */
+    while (end - s >= 64 && dst_end - d >= 64) {
+        load_u8_block_ssse3(s, 4, m);
+        const unsigned done =
+            u8_to_u32_block_ssse3(table, m, s, 48, d, big_endian);
+        s += done;
+        if (done < 48)
+            break;
+    }
+    while (end - s >= 16 && dst_end - d >= 16) {
+        load_u8_block_ssse3(s, 1, m);
+        const unsigned done =
+            u8_to_u32_block_ssse3(table, m, s, 1, d, big_endian);
+        if (done == 0)
+            break;  // Left to the scalar decoder to report the error.
+        s += done;
+    }
+
+    src = s;
+    dst = d;
+}
+
+/*!
+ * Spread four characters over their lanes as described in u8_encode_table.
+ * The characters must be below 0x110000. index receives the encode table
+ * index of the four lanes.
+ */
+UTF_CONVERT_TARGET("ssse3")
+inline __m128i encode_u8x4_ssse3(__m128i in, unsigned &index) {
+    const __m128i two   = _mm_cmpgt_epi32(in, _mm_set1_epi32(0x7f));
+    const __m128i three = _mm_cmpgt_epi32(in, _mm_set1_epi32(0x7ff));
+    const __m128i four  = _mm_cmpgt_epi32(in, _mm_set1_epi32(0xffff));
+
+    __m128i bytes = _mm_and_si128(in, _mm_set1_epi32(0x0000003f));
+    bytes         = _mm_or_si128(bytes,
+                         _mm_and_si128(_mm_slli_epi32(in, 2),
+                                       _mm_set1_epi32(0x00003f00)));
+    bytes         = _mm_or_si128(bytes,
+                         _mm_and_si128(_mm_slli_epi32(in, 4),
+                                       _mm_set1_epi32(0x003f0000)));
+    bytes         = _mm_or_si128(bytes,
+                         _mm_and_si128(_mm_slli_epi32(in, 6),
+                                       _mm_set1_epi32(0x3f000000)));
+
+    // The length prefixes, chained with xor since four implies three and two.
+    __m128i prefix = _mm_and_si128(two, _mm_set1_epi32(0x0000c080));
+    prefix = _mm_xor_si128(prefix,
+                           _mm_and_si128(three, _mm_set1_epi32(0x00e04000)));
+    prefix = _mm_xor_si128(prefix,
+                           _mm_and_si128(four, _mm_set1_epi32(0xf0600000)));
+
+    index = u8_encode_spread[_mm_movemask_ps(_mm_castsi128_ps(two))] +
+            u8_encode_spread[_mm_movemask_ps(_mm_castsi128_ps(three))] +
+            u8_encode_spread[_mm_movemask_ps(_mm_castsi128_ps(four))];
+
+    // Ascii characters keep their 7 bits as they are.
+    return _mm_or_si128(_mm_and_si128(two, _mm_or_si128(bytes, prefix)),
+                        _mm_andnot_si128(two, in));
+}
+
+// Pack the lanes spread by encode_u8x4_ssse3 to dst. Returns the length.
+UTF_CONVERT_TARGET("ssse3")
+inline size_t store_u8x4_ssse3(const u8_encode_table &table,
+                               __m128i                bytes,
+                               unsigned               index,
+                               char *                 dst) {
+    const u8_encode_entry &e = table.entry[index];
+    _mm_storeu_si128(
+        reinterpret_cast<__m128i *>(dst),
+        _mm_shuffle_epi8(
+            bytes,
+            _mm_loadu_si128(reinterpret_cast<const __m128i *>(e.shuffle))));
+    return e.length;
+}
+
+// True if all characters in the register are below 0x110000.
+UTF_CONVERT_TARGET("ssse3")
+inline bool u32_in_range_ssse3(__m128i in) {
+    return _mm_movemask_epi8(_mm_cmpgt_epi32(_mm_srli_epi32(in, 16),
+                                             _mm_set1_epi32(0x10))) == 0;
+}
+
+// True if all characters in the register are ascii.
+UTF_CONVERT_TARGET("ssse3")
+inline bool u32_is_ascii_ssse3(__m128i in) {
+    return _mm_movemask_epi8(
+               _mm_cmpeq_epi32(_mm_and_si128(in, _mm_set1_epi32(~0x7f)),
+                               _mm_setzero_si128())) == 0xffff;
+}
+
+UTF_CONVERT_TARGET("ssse3")
+void u32_to_u8_ssse3(const char32_t *&src,
+                     const char32_t * end,
+                     char *&          dst,
+                     char *           dst_end,
+                     UTF_ENDIAN       endian) {
+    const u8_encode_table &table = u8_encode_table::get();
+    const bool    big_endian = endian == utf_convert::UTF_ENDIAN_BIG_ENDIAN;
+    const __m128i swap =
+        _mm_setr_epi8(3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12);
+
+    const char32_t *s = src;
+    char *          d = dst;
+
+    // An ascii run or a 4-character step stores at most 16 bytes.
+    while (end - s >= 4 && dst_end - d >= 16) {
+        if (end - s >= 16) {
+            __m128i in[4];
+            for (int i = 0; i < 4; i++) {
+                in[i] = _mm_loadu_si128(
+                    reinterpret_cast<const __m128i *>(s + i * 4));
+                if (big_endian)
+                    in[i] = _mm_shuffle_epi8(in[i], swap);
+            }
+
+            if (u32_is_ascii_ssse3(_mm_or_si128(_mm_or_si128(in[0], in[1]),
+                                                _mm_or_si128(in[2], in[3])))) {
+                _mm_storeu_si128(
+                    reinterpret_cast<__m128i *>(d),
+                    _mm_packus_epi16(_mm_packs_epi32(in[0], in[1]),
+                                     _mm_packs_epi32(in[2], in[3])));
+                s += 16;
+                d += 16;
+                continue;
+            }
+        }
+
+        __m128i in = _mm_loadu_si128(reinterpret_cast<const __m128i *>(s));
+        if (big_endian)
+            in = _mm_shuffle_epi8(in, swap);
+        if (!u32_in_range_ssse3(in))
+            break;  // Left to the scalar encoder to report the error.
+
+        unsigned      index;
+        const __m128i bytes = encode_u8x4_ssse3(in, index);
+        d += store_u8x4_ssse3(table, bytes, index, d);
+        s += 4;
+    }
+
+    src = s;
+    dst = d;
+}
+
+/*
+ * A surrogate pair takes one lane per unit, two bytes each. With
+ * H = (high & 0x3ff) + 0x40 and L = low & 0x3ff, so that the code point is
+ * (H << 10) | L:
+ *
+ * +-----------+-----------+-----------+-----------+
+ * |  byte 3   |  byte 2   |  byte 1   |  byte 0   |
+ * +-----------+-----------+-----------+-----------+
+ * | 0000 0000 | 0000 0000 | 1111 0HHH | 10HH HHHH |  high surrogate
+ * | 0000 0000 | 0000 0000 | 10HH LLLL | 10LL LLLL |  low surrogate
+ * +-----------+-----------+-----------+-----------+
+ *
+ * The two bits of H wanted by the low surrogate are taken from prev, which
+ * holds the unit before every lane.
+ */
+UTF_CONVERT_TARGET("ssse3")
+inline __m128i encode_u16x4_ssse3(__m128i in, __m128i prev, unsigned &index) {
+    const __m128i two = _mm_cmpgt_epi32(in, _mm_set1_epi32(0x7f));
+    const __m128i surrogate = _mm_cmpeq_epi32(
+        _mm_and_si128(in, _mm_set1_epi32(0xf800)), _mm_set1_epi32(0xd800));
+    const __m128i high = _mm_cmpeq_epi32(
+        _mm_and_si128(in, _mm_set1_epi32(0xfc00)), _mm_set1_epi32(0xd800));
+    const __m128i three = _mm_andnot_si128(
+        surrogate, _mm_cmpgt_epi32(in, _mm_set1_epi32(0x7ff)));
+
+    __m128i bytes = _mm_and_si128(in, _mm_set1_epi32(0x0000003f));
+    bytes         = _mm_or_si128(bytes,
+                         _mm_and_si128(_mm_slli_epi32(in, 2),
+                                       _mm_set1_epi32(0x00003f00)));
+    bytes         = _mm_or_si128(bytes,
+                         _mm_and_si128(_mm_slli_epi32(in, 4),
+                                       _mm_set1_epi32(0x003f0000)));
+
+    __m128i prefix = _mm_and_si128(two, _mm_set1_epi32(0x0000c080));
+    prefix = _mm_xor_si128(prefix,
+                           _mm_and_si128(three, _mm_set1_epi32(0x00e04000)));
+
+    bytes = _mm_or_si128(_mm_and_si128(two, _mm_or_si128(bytes, prefix)),
+                         _mm_andnot_si128(two, in));
+
+    const __m128i h = _mm_add_epi32(_mm_and_si128(in, _mm_set1_epi32(0x3ff)),
+                                    _mm_set1_epi32(0x40));
+    const __m128i high_bytes = _mm_or_si128(
+        _mm_or_si128(_mm_and_si128(h, _mm_set1_epi32(0x700)),
+                     _mm_and_si128(_mm_srli_epi32(h, 2), _mm_set1_epi32(0x3f))),
+        _mm_set1_epi32(0xf080));
+    const __m128i low_bytes = _mm_or_si128(
+        _mm_or_si128(
+            _mm_slli_epi32(_mm_and_si128(prev, _mm_set1_epi32(0x03)), 12),
+            _mm_and_si128(_mm_slli_epi32(in, 2), _mm_set1_epi32(0xf00))),
+        _mm_or_si128(_mm_and_si128(in, _mm_set1_epi32(0x3f)),
+                     _mm_set1_epi32(0x8080)));
+    const __m128i pair_bytes =
+        _mm_or_si128(_mm_and_si128(high, high_bytes),
+                     _mm_andnot_si128(high, low_bytes));
+
+    index = u8_encode_spread[_mm_movemask_ps(_mm_castsi128_ps(two))] +
+            u8_encode_spread[_mm_movemask_ps(_mm_castsi128_ps(three))];
+
+    return _mm_or_si128(_mm_and_si128(surrogate, pair_bytes),
+                        _mm_andnot_si128(surrogate, bytes));
+}
+
+UTF_CONVERT_TARGET("ssse3")
+inline __m128i load_u16x8_ssse3(const char16_t *src, bool big_endian) {
+    const __m128i in = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src));
+    if (!big_endian)
+        return in;
+    return _mm_or_si128(_mm_slli_epi16(in, 8), _mm_srli_epi16(in, 8));
+}
+
+UTF_CONVERT_TARGET("ssse3")
+void u16_to_u8_ssse3(const char16_t *&src,
+                     const char16_t * end,
+                     char *&          dst,
+                     char *           dst_end,
+                     UTF_ENDIAN       endian) {
+    const u8_encode_table &table = u8_encode_table::get();
+    const bool    big_endian = endian == utf_convert::UTF_ENDIAN_BIG_ENDIAN;
+    const __m128i zero       = _mm_setzero_si128();
+
+    const char16_t *s = src;
+    char *          d = dst;
+
+    /*
+     * Set when the previous block ended with a high surrogate. Its low
+     * surrogate at *s still has to be written.
+     */
+    bool     pending      = false;
+    uint16_t pending_high = 0;
+
+    /*
+     * The two 4-unit steps of a block store up to 12 + 16 bytes, and the
+     * scalar steps never write more than 24.
+     */
+    while (end - s >= 16 && dst_end - d >= 32) {
+        const __m128i in = load_u16x8_ssse3(s, big_endian);
+
+        if (!pending) {
+            const __m128i next = load_u16x8_ssse3(s + 8, big_endian);
+            if (_mm_movemask_epi8(_mm_cmpeq_epi16(
+                    _mm_and_si128(_mm_or_si128(in, next),
+                                  _mm_set1_epi16(static_cast<short>(0xff80))),
+                    zero)) == 0xffff) {
+                _mm_storeu_si128(reinterpret_cast<__m128i *>(d),
+                                 _mm_packus_epi16(in, next));
+                s += 16;
+                d += 16;
+                continue;
+            }
+        }
+
+        // Two mask bits per unit.
+        const uint32_t high = _mm_movemask_epi8(_mm_cmpeq_epi16(
+            _mm_and_si128(in, _mm_set1_epi16(static_cast<short>(0xfc00))),
+            _mm_set1_epi16(static_cast<short>(0xd800))));
+        const uint32_t low = _mm_movemask_epi8(_mm_cmpeq_epi16(
+            _mm_and_si128(in, _mm_set1_epi16(static_cast<short>(0xfc00))),
+            _mm_set1_epi16(static_cast<short>(0xdc00))));
+
+        /*
+         * The block is encoded in one go if every low surrogate follows a high
+         * one, and a high surrogate at the end is followed by a low one.
+         */
+        bool paired = low == (((high << 2) | (pending ? 0x03 : 0)) & 0xffff);
+        if (paired && (high & 0x8000))
+            paired = (load_u16(s + 8, big_endian) & 0xfc00) == 0xdc00;
+
+        if (paired) {
+            const __m128i prev =
+                _mm_insert_epi16(_mm_slli_si128(in, 2), pending_high, 0);
+
+            unsigned index;
+            __m128i  bytes = encode_u16x4_ssse3(_mm_unpacklo_epi16(in, zero),
+                                               _mm_unpacklo_epi16(prev, zero),
+                                               index);
+            d += store_u8x4_ssse3(table, bytes, index, d);
+            bytes = encode_u16x4_ssse3(_mm_unpackhi_epi16(in, zero),
+                                       _mm_unpackhi_epi16(prev, zero),
+                                       index);
+            d += store_u8x4_ssse3(table, bytes, index, d);
+
+            pending      = (high & 0x8000) != 0;
+            pending_high = _mm_extract_epi16(in, 7);
+            s += 8;
+            continue;
+        }
+
+        if (pending) {
+            encode_u16_low_surrogate(pending_high, load_u16(s, big_endian), d);
+            pending = false;
+            s++;
+            continue;
+        }
+
+        // Fall back to the scalar encoder up to the first odd surrogate.
+        const char16_t *stop = s + trailing_zeros(high | low) / 2 + 1;
+        while (s < stop) {
+            if (!encode_u16_code_point(s, end, d, big_endian))
+                break;
+        }
+        if (s < stop)
+            break;  // Left to the scalar encoder to report the error.
+    }
+
+    if (pending) {
+        encode_u16_low_surrogate(pending_high, load_u16(s, big_endian), d);
+        s++;
+    }
+
+    src = s;
+    dst = d;
+}
+
+UTF_CONVERT_TARGET("ssse3")
+void u8_to_u16_ssse3(const uint8_t *&src,
+                     const uint8_t * end,
+                     char16_t *&     dst,
+                     char16_t *      dst_end,
+                     UTF_ENDIAN      endian) {
+    const u8_decode_table &table = u8_decode_table::get();
+    const bool big_endian = endian == utf_convert::UTF_ENDIAN_BIG_ENDIAN;
+
+    const uint8_t * s = src;
+    char16_t *      d = dst;
+    u8_block_masks  m;
+
+    // The same blocks as u8_to_u32_ssse3.
+    while (end - s >= 64 && dst_end - d >= 64) {
+        load_u8_block_ssse3(s, 4, m);
+        const unsigned done =
+            u8_to_u16_block_ssse3(table, m, s, 48, d, big_endian);
+        s += done;
+        if (done < 48)
+            break;
+    }
+    while (end - s >= 16 && dst_end - d >= 16) {
+        load_u8_block_ssse3(s, 1, m);
+        const unsigned done =
+            u8_to_u16_block_ssse3(table, m, s, 1, d, big_endian);
+        if (done == 0)
+            break;
+        s += done;
+    }
+
+    src = s;
+    dst = d;
+}
+
+/*
+ * Blocks without surrogates are widened or narrowed in registers. The other
+ * ones are converted one character at a time up to the end of the block, where
+ * a surrogate pair may take the first unit of the next block.
+ */
+UTF_CONVERT_TARGET("ssse3")
+void u16_to_u32_ssse3(const char16_t *&src,
+                      const char16_t * end,
+                      char32_t *&      dst,
+                      char32_t *       dst_end,
+                      UTF_ENDIAN       src_endian,
+                      UTF_ENDIAN       dst_endian) {
+    const bool src_big_endian = src_endian == utf_convert::UTF_ENDIAN_BIG_ENDIAN;
+    const bool dst_big_endian = dst_endian == utf_convert::UTF_ENDIAN_BIG_ENDIAN;
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i swap =
+        _mm_setr_epi8(3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12);
+
+    const char16_t *s = src;
+    char32_t *      d = dst;
+
+    while (end - s >= 8 && dst_end - d >= 8) {
+        const __m128i in = load_u16x8_ssse3(s, src_big_endian);
+        const __m128i surrogate = _mm_cmpeq_epi16(
+            _mm_and_si128(in, _mm_set1_epi16(static_cast<short>(0xf800))),
+            _mm_set1_epi16(static_cast<short>(0xd800)));
+
+        if (_mm_movemask_epi8(surrogate) == 0) {
+            __m128i lo = _mm_unpacklo_epi16(in, zero);
+            __m128i hi = _mm_unpackhi_epi16(in, zero);
+            if (dst_big_endian) {
+                lo = _mm_shuffle_epi8(lo, swap);
+                hi = _mm_shuffle_epi8(hi, swap);
+            }
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(d), lo);
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(d + 4), hi);
+            s += 8;
+            d += 8;
+            continue;
+        }
+
+        const char16_t *stop = s + 8;
+        while (s < stop) {
+            if (!decode_u16_code_point(
+                    s, end, d, src_big_endian, dst_big_endian))
+                break;
+        }
+        if (s < stop)
+            break;
+    }
+
+    src = s;
+    dst = d;
+}
+
+UTF_CONVERT_TARGET("ssse3")
+void u32_to_u16_ssse3(const char32_t *&src,
+                      const char32_t * end,
+                      char16_t *&      dst,
+                      char16_t *       dst_end,
+                      UTF_ENDIAN       src_endian,
+                      UTF_ENDIAN       dst_endian) {
+    const bool src_big_endian = src_endian == utf_convert::UTF_ENDIAN_BIG_ENDIAN;
+    const bool dst_big_endian = dst_endian == utf_convert::UTF_ENDIAN_BIG_ENDIAN;
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i swap =
+        _mm_setr_epi8(3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12);
+    const __m128i pack =
+        dst_big_endian ? _mm_setr_epi8(1, 0, 5, 4, 9, 8, 13, 12, -1, -1, -1, -1,
+                                       -1, -1, -1, -1)
+                       : _mm_setr_epi8(0, 1, 4, 5, 8, 9, 12, 13, -1, -1, -1, -1,
+                                       -1, -1, -1, -1);
+
+    const char32_t *s = src;
+    char16_t *      d = dst;
+
+    // A block with surrogate pairs takes up to twice as many units.
+    while (end - s >= 8 && dst_end - d >= 16) {
+        __m128i lo = _mm_loadu_si128(reinterpret_cast<const __m128i *>(s));
+        __m128i hi = _mm_loadu_si128(reinterpret_cast<const __m128i *>(s + 4));
+        if (src_big_endian) {
+            lo = _mm_shuffle_epi8(lo, swap);
+            hi = _mm_shuffle_epi8(hi, swap);
+        }
+
+        if (_mm_movemask_epi8(_mm_cmpeq_epi32(
+                _mm_srli_epi32(_mm_or_si128(lo, hi), 16), zero)) == 0xffff) {
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(d),
+                             _mm_unpacklo_epi64(_mm_shuffle_epi8(lo, pack),
+                                                _mm_shuffle_epi8(hi, pack)));
+            s += 8;
+            d += 8;
+            continue;
+        }
+
+        const char32_t *stop = s + 8;
+        for (; s < stop; s++) {
+            if (!encode_u16_unit(load_u32(s, src_big_endian), d, dst_big_endian))
+                break;
+        }
+        if (s < stop)
+            break;
+    }
+
+    src = s;
+    dst = d;
+}
+
+UTF_CONVERT_TARGET("ssse3")
+size_t utf32_length_from_utf8_ssse3(const uint8_t *&src, const uint8_t *end) {
+    const uint8_t *s     = src;
+    size_t         count = 0;
+
+    // Signed bytes above -65 (0xbf) are the ones other than 10xx xxxx.
+    while (end - s >= 16) {
+        const __m128i in = _mm_loadu_si128(reinterpret_cast<const __m128i *>(s));
+        count += count_ones(
+            _mm_movemask_epi8(_mm_cmpgt_epi8(in, _mm_set1_epi8(-65))));
+        s += 16;
+    }
+
+    src = s;
+    return count;
+}
+
+UTF_CONVERT_TARGET("ssse3")
+size_t utf8_length_from_utf32_ssse3(const char32_t *&src,
+                                    const char32_t * end,
+                                    UTF_ENDIAN       endian) {
+    const bool    big_endian = endian == utf_convert::UTF_ENDIAN_BIG_ENDIAN;
+    const __m128i swap =
+        _mm_setr_epi8(3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12);
+    // Flip the sign bits so that signed compares order the values unsigned.
+    const __m128i bias = _mm_set1_epi32(0x80000000);
+
+    const char32_t *s     = src;
+    size_t          count = 0;
+
+    while (end - s >= 4) {
+        __m128i in = _mm_loadu_si128(reinterpret_cast<const __m128i *>(s));
+        if (big_endian)
+            in = _mm_shuffle_epi8(in, swap);
+        in = _mm_xor_si128(in, bias);
+
+        count += 4 +
+                 count_ones(_mm_movemask_ps(_mm_castsi128_ps(_mm_cmpgt_epi32(
+                     in, _mm_xor_si128(_mm_set1_epi32(0x7f), bias))))) +
+                 count_ones(_mm_movemask_ps(_mm_castsi128_ps(_mm_cmpgt_epi32(
+                     in, _mm_xor_si128(_mm_set1_epi32(0x7ff), bias))))) +
+                 count_ones(_mm_movemask_ps(_mm_castsi128_ps(_mm_cmpgt_epi32(
+                     in, _mm_xor_si128(_mm_set1_epi32(0xffff), bias)))));
+        s += 4;
+    }
+
+    src = s;
+    return count;
+}
+
+UTF_CONVERT_TARGET("ssse3")
+size_t utf8_length_from_utf16_ssse3(const char16_t *&src,
+                                    const char16_t * end,
+                                    UTF_ENDIAN       endian) {
+    const bool    big_endian = endian == utf_convert::UTF_ENDIAN_BIG_ENDIAN;
+    const __m128i zero       = _mm_setzero_si128();
+
+    const char16_t *s         = src;
+    size_t          count     = 0;
+    uint32_t        prev_high = 0;
+
+    while (end - s >= 8) {
+        const __m128i in = load_u16x8_ssse3(s, big_endian);
+
+        // Two mask bits per unit.
+        const uint32_t two = ~_mm_movemask_epi8(_mm_cmpeq_epi16(
+                                 _mm_and_si128(in,
+                                               _mm_set1_epi16(
+                                                   static_cast<short>(0xff80))),
+                                 zero)) &
+                             0xffff;
+        const uint32_t three = ~_mm_movemask_epi8(_mm_cmpeq_epi16(
+                                   _mm_and_si128(in,
+                                                 _mm_set1_epi16(
+                                                     static_cast<short>(0xf800))),
+                                   zero)) &
+                               0xffff;
+        const uint32_t surrogate = _mm_movemask_epi8(_mm_cmpeq_epi16(
+            _mm_and_si128(in, _mm_set1_epi16(static_cast<short>(0xf800))),
+            _mm_set1_epi16(static_cast<short>(0xd800))));
+        const uint32_t high = _mm_movemask_epi8(_mm_cmpeq_epi16(
+            _mm_and_si128(in, _mm_set1_epi16(static_cast<short>(0xfc00))),
+            _mm_set1_epi16(static_cast<short>(0xd800))));
+        const uint32_t lone_low =
+            surrogate & ~high & ~((high << 2) | prev_high);
+
+        count += 8 + (count_ones(two) + count_ones(three & ~surrogate) +
+                      count_ones(lone_low)) /
+                         2;
+        prev_high = (high & 0x8000) ? 0x03 : 0;
+        s += 8;
+    }
+
+    src = s;
+    return count;
+}
+
+UTF_CONVERT_TARGET("ssse3")
+size_t utf16_length_from_utf8_ssse3(const uint8_t *&src, const uint8_t *end) {
+    const uint8_t *s     = src;
+    size_t         count = 0;
+
+    // Four-byte leads (0xf0 and above) take a second unit.
+    while (end - s >= 16) {
+        const __m128i in = _mm_loadu_si128(reinterpret_cast<const __m128i *>(s));
+        const __m128i four_bytes =
+            _mm_cmpeq_epi8(_mm_max_epu8(in, _mm_set1_epi8(-16)), in);
+        count += count_ones(
+            _mm_movemask_epi8(_mm_cmpgt_epi8(in, _mm_set1_epi8(-65))));
+        count += count_ones(_mm_movemask_epi8(four_bytes));
+        s += 16;
+    }
+
+    src = s;
+    return count;
+}
+
+UTF_CONVERT_TARGET("ssse3")
+size_t utf32_length_from_utf16_ssse3(const char16_t *&src,
+                                     const char16_t * end,
+                                     UTF_ENDIAN       endian) {
+    const bool big_endian = endian == utf_convert::UTF_ENDIAN_BIG_ENDIAN;
+
+    const char16_t *s         = src;
+    size_t          count     = 0;
+    uint32_t        prev_high = 0;
+
+    // Two mask bits per unit, like utf8_length_from_utf16_ssse3.
+    while (end - s >= 8) {
+        const __m128i  in   = load_u16x8_ssse3(s, big_endian);
+        const uint32_t high = _mm_movemask_epi8(_mm_cmpeq_epi16(
+            _mm_and_si128(in, _mm_set1_epi16(static_cast<short>(0xfc00))),
+            _mm_set1_epi16(static_cast<short>(0xd800))));
+        const uint32_t low = _mm_movemask_epi8(_mm_cmpeq_epi16(
+            _mm_and_si128(in, _mm_set1_epi16(static_cast<short>(0xfc00))),
+            _mm_set1_epi16(static_cast<short>(0xdc00))));
+
+        count += 8 - count_ones(low & ((high << 2) | prev_high)) / 2;
+        prev_high = (high & 0x8000) ? 0x03 : 0;
+        s += 8;
+    }
+
+    src = s;
+    return count;
+}
+
+UTF_CONVERT_TARGET("ssse3")
+size_t utf16_length_from_utf32_ssse3(const char32_t *&src,
+                                     const char32_t * end,
+                                     UTF_ENDIAN       endian) {
+    const bool    big_endian = endian == utf_convert::UTF_ENDIAN_BIG_ENDIAN;
+    const __m128i swap =
+        _mm_setr_epi8(3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12);
+    const __m128i bias = _mm_set1_epi32(0x80000000);
+
+    const char32_t *s     = src;
+    size_t          count = 0;
+
+    while (end - s >= 4) {
+        __m128i in = _mm_loadu_si128(reinterpret_cast<const __m128i *>(s));
+        if (big_endian)
+            in = _mm_shuffle_epi8(in, swap);
+
+        count += 4 + count_ones(_mm_movemask_ps(_mm_castsi128_ps(_mm_cmpgt_epi32(
+                         _mm_xor_si128(in, bias),
+                         _mm_xor_si128(_mm_set1_epi32(0xffff), bias)))));
+        s += 4;
+    }
+
+    src = s;
+    return count;
+}
+
+/*!
+ * Errors of the utf-8 bytes in, found with the lookup tables and prev_in, the
+ * register before. A byte of the result is non zero at every error.
+ */
+UTF_CONVERT_TARGET("ssse3")
+inline __m128i u8_errors_ssse3(__m128i in,
+                               __m128i prev_in,
+                               __m128i byte_1_high,
+                               __m128i byte_1_low,
+                               __m128i byte_2_high) {
+    const __m128i nibble = _mm_set1_epi8(0x0f);
+    const __m128i prev1  = _mm_alignr_epi8(in, prev_in, 15);
+    const __m128i prev2  = _mm_alignr_epi8(in, prev_in, 14);
+    const __m128i prev3  = _mm_alignr_epi8(in, prev_in, 13);
+
+    const __m128i special = _mm_and_si128(
+        _mm_and_si128(
+            _mm_shuffle_epi8(byte_1_high,
+                             _mm_and_si128(_mm_srli_epi16(prev1, 4), nibble)),
+            _mm_shuffle_epi8(byte_1_low, _mm_and_si128(prev1, nibble))),
+        _mm_shuffle_epi8(byte_2_high,
+                         _mm_and_si128(_mm_srli_epi16(in, 4), nibble)));
+
+    // The third and fourth bytes of a sequence are the only places where two
+    // continuation bytes may follow each other. The saturated subtractions
+    // keep the high bit exactly for bytes from 0xe0 and from 0xf0 on.
+    const __m128i must_be_continuation = _mm_and_si128(
+        _mm_or_si128(_mm_subs_epu8(prev2, _mm_set1_epi8(0xe0 - 0x80)),
+                     _mm_subs_epu8(prev3, _mm_set1_epi8(0xf0 - 0x80))),
+        _mm_set1_epi8(static_cast<char>(0x80)));
+    return _mm_xor_si128(must_be_continuation, special);
+}
+
+UTF_CONVERT_TARGET("ssse3")
+void validate_utf8_ssse3(const uint8_t *&src, const uint8_t *end) {
+    const __m128i byte_1_high =
+        _mm_loadu_si128(reinterpret_cast<const __m128i *>(u8_byte_1_high));
+    const __m128i byte_1_low =
+        _mm_loadu_si128(reinterpret_cast<const __m128i *>(u8_byte_1_low));
+    const __m128i byte_2_high =
+        _mm_loadu_si128(reinterpret_cast<const __m128i *>(u8_byte_2_high));
+    const __m128i zero = _mm_setzero_si128();
+    // Nothing is left over after the last three bytes below these.
+    const __m128i max_value = _mm_setr_epi8(
+        -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+        static_cast<char>(0xf0 - 1), static_cast<char>(0xe0 - 1),
+        static_cast<char>(0xc0 - 1));
+
+    const uint8_t *s               = src;
+    __m128i        prev_in         = zero;
+    __m128i        prev_incomplete = zero;
+
+    while (end - s >= 16) {
+        const __m128i in = _mm_loadu_si128(reinterpret_cast<const __m128i *>(s));
+
+        // Ascii is only wrong after a sequence cut by the register before.
+        __m128i error = prev_incomplete;
+        if (_mm_movemask_epi8(in) != 0) {
+            error = u8_errors_ssse3(
+                in, prev_in, byte_1_high, byte_1_low, byte_2_high);
+        }
+        if (_mm_movemask_epi8(_mm_cmpeq_epi8(error, zero)) != 0xffff)
+            break;
+
+        prev_in         = in;
+        prev_incomplete = _mm_subs_epu8(in, max_value);
+        s += 16;
+    }
+
+    src = u8_sequence_start(src, s);
+}
+
+/*
+ * In valid utf-16, the units right after high surrogates are exactly the low
+ * surrogates. With one mask bit per unit, the high mask shifted by one unit,
+ * with the last high bit of the register before shifted in, must equal the
+ * low mask.
+ */
+UTF_CONVERT_TARGET("ssse3")
+void validate_utf16_ssse3(const char16_t *&src,
+                          const char16_t * end,
+                          UTF_ENDIAN       endian) {
+    const bool    big_endian = endian == utf_convert::UTF_ENDIAN_BIG_ENDIAN;
+    const __m128i mask = _mm_set1_epi16(static_cast<short>(0xfc00));
+
+    const char16_t *s         = src;
+    uint32_t        prev_high = 0;
+
+    while (end - s >= 8) {
+        const __m128i in   = _mm_and_si128(load_u16x8_ssse3(s, big_endian), mask);
+        const __m128i high = _mm_cmpeq_epi16(
+            in, _mm_set1_epi16(static_cast<short>(0xd800)));
+        const __m128i low = _mm_cmpeq_epi16(
+            in, _mm_set1_epi16(static_cast<short>(0xdc00)));
+
+        // High surrogates in bits 0 to 7, low surrogates in bits 8 to 15.
+        const uint32_t bits = _mm_movemask_epi8(_mm_packs_epi16(high, low));
+        if ((((bits << 1) | prev_high) & 0xff) != bits >> 8)
+            break;
+
+        prev_high = (bits >> 7) & 1;
+        s += 8;
+    }
+
+    // Start over from a high surrogate cut by the end of the last register.
+    src = s - prev_high;
+}
+
+UTF_CONVERT_TARGET("ssse3")
+void validate_utf32_ssse3(const char32_t *&src,
+                          const char32_t * end,
+                          UTF_ENDIAN       endian) {
+    const bool    big_endian = endian == utf_convert::UTF_ENDIAN_BIG_ENDIAN;
+    const __m128i swap =
+        _mm_setr_epi8(3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12);
+    const __m128i bias = _mm_set1_epi32(0x80000000);
+
+    const char32_t *s = src;
+
+    while (end - s >= 4) {
+        __m128i in = _mm_loadu_si128(reinterpret_cast<const __m128i *>(s));
+        if (big_endian)
+            in = _mm_shuffle_epi8(in, swap);
+
+        const __m128i too_large = _mm_cmpgt_epi32(
+            _mm_xor_si128(in, bias),
+            _mm_xor_si128(_mm_set1_epi32(0x10ffff), bias));
+        const __m128i surrogate =
+            _mm_cmpeq_epi32(_mm_and_si128(in, _mm_set1_epi32(0xfffff800)),
+                            _mm_set1_epi32(0xd800));
+        if (_mm_movemask_epi8(_mm_or_si128(too_large, surrogate)) != 0)
+            break;
+        s += 4;
+    }
+
+    src = s;
+}
+
+UTF_CONVERT_TARGET("ssse3")
+void ascii_prefix_ssse3(const uint8_t *&src, const uint8_t *end) {
+    const uint8_t *s = src;
+
+    // Four registers are ORed together first, the high bits survive.
+    while (end - s >= 64) {
+        const __m128i *in  = reinterpret_cast<const __m128i *>(s);
+        const __m128i  any = _mm_or_si128(
+            _mm_or_si128(_mm_loadu_si128(in), _mm_loadu_si128(in + 1)),
+            _mm_or_si128(_mm_loadu_si128(in + 2), _mm_loadu_si128(in + 3)));
+        if (_mm_movemask_epi8(any) != 0)
+            break;
+        s += 64;
+    }
+    while (end - s >= 16) {
+        const __m128i in = _mm_loadu_si128(reinterpret_cast<const __m128i *>(s));
+        if (_mm_movemask_epi8(in) != 0)
+            break;
+        s += 16;
+    }
+
+    src = s;
+}
+
+/*!
+ * Encode the eight Latin-1 bytes widened into lanes, with non_ascii the mask
+ * of the ones from 0x80 on. Returns the number of bytes written, but a whole
+ * register is stored.
+ */
+UTF_CONVERT_TARGET("ssse3")
+inline size_t store_latin1x8_ssse3(const latin1_encode_table &table,
+                                   __m128i                    lanes,
+                                   unsigned                   non_ascii,
+                                   char *                     dst) {
+    const __m128i lead =
+        _mm_or_si128(_mm_srli_epi16(lanes, 6), _mm_set1_epi16(0xc0));
+    const __m128i cont = _mm_slli_epi16(
+        _mm_or_si128(_mm_and_si128(lanes, _mm_set1_epi16(0x3f)),
+                     _mm_set1_epi16(0x80)),
+        8);
+    const __m128i two   = _mm_cmpgt_epi16(lanes, _mm_set1_epi16(0x7f));
+    const __m128i bytes = _mm_or_si128(
+        _mm_and_si128(two, _mm_or_si128(lead, cont)),
+        _mm_andnot_si128(two, lanes));
+
+    const latin1_encode_entry &e = table.entry[non_ascii];
+    _mm_storeu_si128(
+        reinterpret_cast<__m128i *>(dst),
+        _mm_shuffle_epi8(bytes,
+                         _mm_loadu_si128(
+                             reinterpret_cast<const __m128i *>(e.shuffle))));
+    return e.length;
+}
+
+UTF_CONVERT_TARGET("ssse3")
+void latin1_to_u8_ssse3(const uint8_t *&src,
+                        const uint8_t * end,
+                        char *&         dst,
+                        char *          dst_end,
+                        UTF_CHARSET     charset) {
+    const latin1_encode_table &table = latin1_encode_table::get();
+    const bool    cp1252 = charset == utf_convert::UTF_CHARSET_WINDOWS_1252;
+    const __m128i zero   = _mm_setzero_si128();
+
+    const uint8_t *s = src;
+    char *         d = dst;
+
+    // Sixteen bytes take up to 32, the second half is stored after the first.
+    while (end - s >= 16 && dst_end - d >= 32) {
+        const __m128i in = _mm_loadu_si128(reinterpret_cast<const __m128i *>(s));
+        const unsigned non_ascii = _mm_movemask_epi8(in);
+
+        if (non_ascii == 0) {
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(d), in);
+            s += 16;
+            d += 16;
+            continue;
+        }
+        if (cp1252 && has_c1_ssse3(in))
+            break;
+
+        d += store_latin1x8_ssse3(
+            table, _mm_unpacklo_epi8(in, zero), non_ascii & 0xff, d);
+        d += store_latin1x8_ssse3(
+            table, _mm_unpackhi_epi8(in, zero), non_ascii >> 8, d);
+        s += 16;
+    }
+
+    src = s;
+    dst = d;
+}
+
+UTF_CONVERT_TARGET("ssse3")
+void latin1_to_u16_ssse3(const uint8_t *&src,
+                         const uint8_t * end,
+                         char16_t *&     dst,
+                         char16_t *      dst_end,
+                         UTF_ENDIAN      endian,
+                         UTF_CHARSET     charset) {
+    const bool    big_endian = endian == utf_convert::UTF_ENDIAN_BIG_ENDIAN;
+    const bool    cp1252     = charset == utf_convert::UTF_CHARSET_WINDOWS_1252;
+    const __m128i zero       = _mm_setzero_si128();
+
+    const uint8_t *s = src;
+    char16_t *     d = dst;
+
+    /*
+     * Interleaving with zero bytes gives the units, and putting the zero bytes
+     * first gives them in big endian.
+     */
+    while (end - s >= 16 && dst_end - d >= 16) {
+        const __m128i in = _mm_loadu_si128(reinterpret_cast<const __m128i *>(s));
+        if (cp1252 && has_c1_ssse3(in))
+            break;
+
+        const __m128i lo = big_endian ? _mm_unpacklo_epi8(zero, in)
+                                      : _mm_unpacklo_epi8(in, zero);
+        const __m128i hi = big_endian ? _mm_unpackhi_epi8(zero, in)
+                                      : _mm_unpackhi_epi8(in, zero);
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(d), lo);
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(d + 8), hi);
+        s += 16;
+        d += 16;
+    }
+
+    src = s;
+    dst = d;
+}
+
+UTF_CONVERT_TARGET("ssse3")
+void latin1_to_u32_ssse3(const uint8_t *&src,
+                         const uint8_t * end,
+                         char32_t *&     dst,
+                         char32_t *      dst_end,
+                         UTF_ENDIAN      endian,
+                         UTF_CHARSET     charset) {
+    const bool    big_endian = endian == utf_convert::UTF_ENDIAN_BIG_ENDIAN;
+    const bool    cp1252     = charset == utf_convert::UTF_CHARSET_WINDOWS_1252;
+    const __m128i zero       = _mm_setzero_si128();
+
+    const uint8_t *s = src;
+    char32_t *     d = dst;
+
+    while (end - s >= 16 && dst_end - d >= 16) {
+        const __m128i in = _mm_loadu_si128(reinterpret_cast<const __m128i *>(s));
+        if (cp1252 && has_c1_ssse3(in))
+            break;
+
+        const __m128i lo     = _mm_unpacklo_epi8(in, zero);
+        const __m128i hi     = _mm_unpackhi_epi8(in, zero);
+        __m128i       out[4] = {_mm_unpacklo_epi16(lo, zero),
+                          _mm_unpackhi_epi16(lo, zero),
+                          _mm_unpacklo_epi16(hi, zero),
+                          _mm_unpackhi_epi16(hi, zero)};
+        for (int i = 0; i < 4; i++) {
+            if (big_endian)
+                out[i] = _mm_slli_epi32(out[i], 24);
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(d + i * 4), out[i]);
+        }
+        s += 16;
+        d += 16;
+    }
+
+    src = s;
+    dst = d;
+}
+
+UTF_CONVERT_TARGET("ssse3")
+void u8_to_latin1_ssse3(const uint8_t *&src,
+                        const uint8_t * end,
+                        char *&         dst,
+                        char *          dst_end,
+                        UTF_CHARSET     charset) {
+    const u8_compress_table &table = u8_compress_table::get();
+    const bool cp1252 = charset == utf_convert::UTF_CHARSET_WINDOWS_1252;
+
+    const uint8_t *s = src;
+    char *         d = dst;
+
+    while (end - s >= 16 && dst_end - d >= 16) {
+        const __m128i in = _mm_loadu_si128(reinterpret_cast<const __m128i *>(s));
+
+        if (_mm_movemask_epi8(in) == 0) {
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(d), in);
+            s += 16;
+            d += 16;
+            continue;
+        }
+        if (!u8_to_latin1x16_ssse3(table, in, s, d, cp1252))
+            break;
+    }
+
+    src = s;
+    dst = d;
+}
+
+UTF_CONVERT_TARGET("ssse3")
+void u16_to_latin1_ssse3(const char16_t *&src,
+                         const char16_t * end,
+                         char *&          dst,
+                         char *           dst_end,
+                         UTF_ENDIAN       endian,
+                         UTF_CHARSET      charset) {
+    const bool    big_endian = endian == utf_convert::UTF_ENDIAN_BIG_ENDIAN;
+    const bool    cp1252     = charset == utf_convert::UTF_CHARSET_WINDOWS_1252;
+    const __m128i high_byte  = _mm_set1_epi16(static_cast<short>(0xff00));
+
+    const char16_t *s = src;
+    char *          d = dst;
+
+    while (end - s >= 16 && dst_end - d >= 16) {
+        const __m128i lo = load_u16x8_ssse3(s, big_endian);
+        const __m128i hi = load_u16x8_ssse3(s + 8, big_endian);
+        if (_mm_movemask_epi8(_mm_cmpeq_epi16(
+                _mm_and_si128(_mm_or_si128(lo, hi), high_byte),
+                _mm_setzero_si128())) != 0xffff)
+            break;
+
+        const __m128i out = _mm_packus_epi16(lo, hi);
+        if (cp1252 && has_c1_ssse3(out))
+            break;
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(d), out);
+        s += 16;
+        d += 16;
+    }
+
+    src = s;
+    dst = d;
+}
+
+UTF_CONVERT_TARGET("ssse3")
+void u32_to_latin1_ssse3(const char32_t *&src,
+                         const char32_t * end,
+                         char *&          dst,
+                         char *           dst_end,
+                         UTF_ENDIAN       endian,
+                         UTF_CHARSET      charset) {
+    const bool    big_endian = endian == utf_convert::UTF_ENDIAN_BIG_ENDIAN;
+    const bool    cp1252     = charset == utf_convert::UTF_CHARSET_WINDOWS_1252;
+    const __m128i swap =
+        _mm_setr_epi8(3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12);
+    const __m128i high_bytes = _mm_set1_epi32(0xffffff00);
+
+    const char32_t *s = src;
+    char *          d = dst;
+
+    while (end - s >= 16 && dst_end - d >= 16) {
+        __m128i in[4];
+        for (int i = 0; i < 4; i++) {
+            in[i] = _mm_loadu_si128(reinterpret_cast<const __m128i *>(s + i * 4));
+            if (big_endian)
+                in[i] = _mm_shuffle_epi8(in[i], swap);
+        }
+        const __m128i any = _mm_or_si128(_mm_or_si128(in[0], in[1]),
+                                         _mm_or_si128(in[2], in[3]));
+        if (_mm_movemask_epi8(_mm_cmpeq_epi32(_mm_and_si128(any, high_bytes),
+                                              _mm_setzero_si128())) != 0xffff)
+            break;
+
+        // The characters are below 0x100, so the signed saturation keeps them.
+        const __m128i out =
+            _mm_packus_epi16(_mm_packs_epi32(in[0], in[1]),
+                             _mm_packs_epi32(in[2], in[3]));
+        if (cp1252 && has_c1_ssse3(out))
+            break;
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(d), out);
+        s += 16;
+        d += 16;
+    }
+
+    src = s;
+    dst = d;
+}
+
+UTF_CONVERT_TARGET("ssse3")
+void swap_u16_ssse3(char16_t *&str, char16_t *end) {
+    const __m128i swap =
+        _mm_setr_epi8(1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14);
+
+    char16_t *s = str;
+    for (; end - s >= 8; s += 8) {
+        __m128i *unit = reinterpret_cast<__m128i *>(s);
+        _mm_storeu_si128(unit, _mm_shuffle_epi8(_mm_loadu_si128(unit), swap));
+    }
+    str = s;
+}
+
+UTF_CONVERT_TARGET("ssse3")
+void swap_u32_ssse3(char32_t *&str, char32_t *end) {
+    const __m128i swap =
+        _mm_setr_epi8(3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12);
+
+    char32_t *s = str;
+    for (; end - s >= 4; s += 4) {
+        __m128i *unit = reinterpret_cast<__m128i *>(s);
+        _mm_storeu_si128(unit, _mm_shuffle_epi8(_mm_loadu_si128(unit), swap));
+    }
+    str = s;
+}
+
+// All ones in the bytes of in from first to first + count - 1.
+UTF_CONVERT_TARGET("ssse3")
+inline __m128i in_range_u8_ssse3(__m128i in, char first, char count) {
+    const __m128i off = _mm_sub_epi8(in, _mm_set1_epi8(first));
+    return _mm_cmpeq_epi8(_mm_min_epu8(off, _mm_set1_epi8(count - 1)), off);
+}
+
+UTF_CONVERT_TARGET("ssse3")
+void fold_u8_ssse3(char *&str, char *end, UTF_FOLD fold) {
+    const bool    latin1   = fold == utf_convert::UTF_FOLD_LATIN1;
+    const __m128i case_bit = _mm_set1_epi8(0x20);
+
+    char *  s    = str;
+    __m128i prev = _mm_setzero_si128();
+    for (; end - s >= 16; s += 16) {
+        __m128i *     unit = reinterpret_cast<__m128i *>(s);
+        const __m128i in   = _mm_loadu_si128(unit);
+        __m128i       mask = in_range_u8_ssse3(in, 'A', 26);
+        if (latin1) {
+            // U+00C0 ~ U+00DE are 0xc3 0x80 ~ 0xc3 0x9e, and only the second
+            // byte changes, like for avx2.
+            const __m128i before = _mm_alignr_epi8(in, prev, 15);
+            const __m128i upper  = _mm_andnot_si128(
+                _mm_cmpeq_epi8(in, _mm_set1_epi8(char(0x97))),
+                in_range_u8_ssse3(in, char(0x80), 0x1f));
+            mask = _mm_or_si128(
+                mask,
+                _mm_and_si128(
+                    upper, _mm_cmpeq_epi8(before, _mm_set1_epi8(char(0xc3)))));
+            prev = in;
+        }
+        _mm_storeu_si128(unit, _mm_add_epi8(in, _mm_and_si128(mask, case_bit)));
+    }
+    str = s;
+}
+
+// Without the unsigned comparisons of sse4.1, the ranges are compared signed
+// after flipping the top bits.
+UTF_CONVERT_TARGET("ssse3")
+void fold_u16_ssse3(char16_t *&str,
+                    char16_t * end,
+                    UTF_ENDIAN endian,
+                    UTF_FOLD   fold) {
+    const bool    big    = endian == utf_convert::UTF_ENDIAN_BIG_ENDIAN;
+    const bool    latin1 = fold == utf_convert::UTF_FOLD_LATIN1;
+    const __m128i swap =
+        _mm_setr_epi8(1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14);
+    const __m128i bias = _mm_set1_epi16(short(0x8000));
+
+    char16_t *s = str;
+    for (; end - s >= 8; s += 8) {
+        __m128i *unit = reinterpret_cast<__m128i *>(s);
+        __m128i  in   = _mm_loadu_si128(unit);
+        if (big)
+            in = _mm_shuffle_epi8(in, swap);
+
+        __m128i mask = _mm_cmplt_epi16(
+            _mm_xor_si128(_mm_sub_epi16(in, _mm_set1_epi16('A')), bias),
+            _mm_set1_epi16(short(0x8000 + 26)));
+        if (latin1)
+            mask = _mm_or_si128(
+                mask,
+                _mm_andnot_si128(
+                    _mm_cmpeq_epi16(in, _mm_set1_epi16(0xd7)),
+                    _mm_cmplt_epi16(
+                        _mm_xor_si128(_mm_sub_epi16(in, _mm_set1_epi16(0xc0)),
+                                      bias),
+                        _mm_set1_epi16(short(0x8000 + 0x1f)))));
+        in = _mm_add_epi16(in, _mm_and_si128(mask, _mm_set1_epi16(0x20)));
+
+        if (big)
+            in = _mm_shuffle_epi8(in, swap);
+        _mm_storeu_si128(unit, in);
+    }
+    str = s;
+}
+
+UTF_CONVERT_TARGET("ssse3")
+void fold_u32_ssse3(char32_t *&str,
+                    char32_t * end,
+                    UTF_ENDIAN endian,
+                    UTF_FOLD   fold) {
+    const bool    big    = endian == utf_convert::UTF_ENDIAN_BIG_ENDIAN;
+    const bool    latin1 = fold == utf_convert::UTF_FOLD_LATIN1;
+    const __m128i swap =
+        _mm_setr_epi8(3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12);
+    const __m128i bias = _mm_set1_epi32(int(0x80000000u));
+
+    char32_t *s = str;
+    for (; end - s >= 4; s += 4) {
+        __m128i *unit = reinterpret_cast<__m128i *>(s);
+        __m128i  in   = _mm_loadu_si128(unit);
+        if (big)
+            in = _mm_shuffle_epi8(in, swap);
+
+        __m128i mask = _mm_cmplt_epi32(
+            _mm_xor_si128(_mm_sub_epi32(in, _mm_set1_epi32('A')), bias),
+            _mm_set1_epi32(int(0x80000000u + 26)));
+        if (latin1)
+            mask = _mm_or_si128(
+                mask,
+                _mm_andnot_si128(
+                    _mm_cmpeq_epi32(in, _mm_set1_epi32(0xd7)),
+                    _mm_cmplt_epi32(
+                        _mm_xor_si128(_mm_sub_epi32(in, _mm_set1_epi32(0xc0)),
+                                      bias),
+                        _mm_set1_epi32(int(0x80000000u + 0x1f)))));
+        in = _mm_add_epi32(in, _mm_and_si128(mask, _mm_set1_epi32(0x20)));
+
+        if (big)
+            in = _mm_shuffle_epi8(in, swap);
+        _mm_storeu_si128(unit, in);
+    }
+    str = s;
+}
+}  // namespace
+
+const utf_convert::simd::kernel_table utf_convert::simd::ssse3_kernels = {
+    u8_to_u32_ssse3,
+    u32_to_u8_ssse3,
+    u16_to_u8_ssse3,
+    u8_to_u16_ssse3,
+    u16_to_u32_ssse3,
+    u32_to_u16_ssse3,
+    utf32_length_from_utf8_ssse3,
+    utf8_length_from_utf32_ssse3,
+    utf8_length_from_utf16_ssse3,
+    utf16_length_from_utf8_ssse3,
+    utf32_length_from_utf16_ssse3,
+    utf16_length_from_utf32_ssse3,
+    validate_utf8_ssse3,
+    validate_utf16_ssse3,
+    validate_utf32_ssse3,
+    ascii_prefix_ssse3,
+    latin1_to_u8_ssse3,
+    latin1_to_u16_ssse3,
+    latin1_to_u32_ssse3,
+    u8_to_latin1_ssse3,
+    u16_to_latin1_ssse3,
+    u32_to_latin1_ssse3,
+    swap_u16_ssse3,
+    swap_u32_ssse3,
+    fold_u8_ssse3,
+    fold_u16_ssse3,
+    fold_u32_ssse3};
+
+#endif
@@ -0,0 +1,195 @@
+#include "utf_convert_stats.hpp"
+
+#include <cstring>
+
+#if defined(UTF_CONVERT_STATS)
+#include <atomic>
+#include <mutex>
+#endif
+
+namespace {
+using utf_convert::conversion_stats;
+using utf_convert::UTF_CONVERSION_COUNT;
+
+/*
+ * Counters are kept as arrays in the order of the fields of conversion_stats,
+ * which are all uint64_t.
+ */
+const size_t field_count = sizeof(conversion_stats) / sizeof(uint64_t);
+
+enum {
+    field_calls,
+    field_bytes_in,
+    field_bytes_out,
+    field_kernel_bytes_in,
+    field_scalar_fallbacks,
+    field_invalid_sequences,
+    field_output_too_small,
+    field_other_errors,
+};
+
+typedef uint64_t totals[UTF_CONVERSION_COUNT][field_count];
+
+utf_convert::stats make_stats(const totals &values, const totals &baseline) {
+    utf_convert::stats res;
+    for (size_t c = 0; c < UTF_CONVERSION_COUNT; c++) {
+        uint64_t fields[field_count];
+        for (size_t f = 0; f < field_count; f++) {
+            fields[f] = values[c][f] - baseline[c][f];
+        }
+        std::memcpy(&res.conversions[c], fields, sizeof(fields));
+    }
+    res.implementation = utf_convert::active_implementation();
+    return res;
+}
+
+#if defined(UTF_CONVERT_STATS)
+
+struct thread_counters;
+
+/*!
+ * The counters of the running threads, and the sums of the ended ones.
+ */
+struct registry {
+    registry() : threads(NULL) {
+        std::memset(retired, 0, sizeof(retired));
+        std::memset(baseline, 0, sizeof(baseline));
+    }
+
+    std::mutex       mutex;
+    thread_counters *threads;
+    totals           retired;
+    totals           baseline;  // Sums at the last reset.
+};
+
+registry &get_registry() {
+    static registry instance;
+    return instance;
+}
+
+/*!
+ * Counters of one thread. Only the thread writes them, with plain relaxed
+ * loads and stores, and snapshots read them from other threads. They are
+ * linked into the registry for their lifetime, and added to its sums of the
+ * ended threads when the thread ends.
+ */
+struct thread_counters {
+    thread_counters() : prev(NULL) {
+        for (size_t c = 0; c < UTF_CONVERSION_COUNT; c++) {
+            for (size_t f = 0; f < field_count; f++) {
+                values[c][f].store(0, std::memory_order_relaxed);
+            }
+        }
+
+        registry &                  reg = get_registry();
+        std::lock_guard<std::mutex> lock(reg.mutex);
+        next = reg.threads;
+        if (next != NULL)
+            next->prev = this;
+        reg.threads = this;
+    }
+
+    ~thread_counters() {
+        registry &                  reg = get_registry();
+        std::lock_guard<std::mutex> lock(reg.mutex);
+        add_to(reg.retired);
+        if (prev != NULL)
+            prev->next = next;
+        else
+            reg.threads = next;
+        if (next != NULL)
+            next->prev = prev;
+    }
+
+    void add(size_t conversion, size_t field, uint64_t value) {
+        std::atomic<uint64_t> &counter = values[conversion][field];
+        counter.store(counter.load(std::memory_order_relaxed) + value,
+                      std::memory_order_relaxed);
+    }
+
+    void add_to(totals &sums) const {
+        for (size_t c = 0; c < UTF_CONVERSION_COUNT; c++) {
+            for (size_t f = 0; f < field_count; f++) {
+                sums[c][f] += values[c][f].load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    std::atomic<uint64_t> values[UTF_CONVERSION_COUNT][field_count];
+    thread_counters *     prev;
+    thread_counters *     next;
+};
+
+thread_counters &local_counters() {
+    static thread_local thread_counters counters;
+    return counters;
+}
+
+/*!
+ * Sum the counters of all threads. The registry must be locked.
+ */
+void sum_counters(const registry &reg, totals &sums) {
+    std::memcpy(sums, reg.retired, sizeof(sums));
+    for (const thread_counters *t = reg.threads; t != NULL; t = t->next) {
+        t->add_to(sums);
+    }
+}
+
+#endif
+}  // namespace
+
+#if defined(UTF_CONVERT_STATS)
+
+void utf_convert::stats_detail::record(UTF_CONVERSION conversion,
+                                       UTF_ERROR      error,
+                                       uint64_t       bytes_in,
+                                       uint64_t       bytes_out,
+                                       uint64_t       kernel_bytes_in,
+                                       uint64_t       fallbacks) {
+    thread_counters &counters = local_counters();
+
+    counters.add(conversion, field_calls, 1);
+    counters.add(conversion, field_bytes_in, bytes_in);
+    counters.add(conversion, field_bytes_out, bytes_out);
+    counters.add(conversion, field_kernel_bytes_in, kernel_bytes_in);
+    counters.add(conversion, field_scalar_fallbacks, fallbacks);
+    if (error == UTF_ERROR_INVALID_SEQUENCE)
+        counters.add(conversion, field_invalid_sequences, 1);
+    else if (error == UTF_ERROR_OUTPUT_TOO_SMALL)
+        counters.add(conversion, field_output_too_small, 1);
+    else if (error != UTF_ERROR_NONE)
+        counters.add(conversion, field_other_errors, 1);
+}
+
+void utf_convert::stats_detail::record_invalid(UTF_CONVERSION conversion) {
+    local_counters().add(conversion, field_invalid_sequences, 1);
+}
+
+bool utf_convert::stats_enabled() { return true; }
+
+utf_convert::stats utf_convert::stats_snapshot() {
+    registry &                  reg = get_registry();
+    std::lock_guard<std::mutex> lock(reg.mutex);
+    totals                      sums;
+    sum_counters(reg, sums);
+    return make_stats(sums, reg.baseline);
+}
+
+void utf_convert::reset_stats() {
+    registry &                  reg = get_registry();
+    std::lock_guard<std::mutex> lock(reg.mutex);
+    sum_counters(reg, reg.baseline);
+}
+
+#else
+
+bool utf_convert::stats_enabled() { return false; }
+
+utf_convert::stats utf_convert::stats_snapshot() {
+    const totals zero = {};
+    return make_stats(zero, zero);
+}
+
+void utf_convert::reset_stats() {}
+
+#endif
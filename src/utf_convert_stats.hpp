@@ -0,0 +1,99 @@
+#ifndef UTF_CONVERT_STATS_HPP
+#define UTF_CONVERT_STATS_HPP
+
+#include <cstddef>
+#include <cstdint>
+
+#include "utf_convert.hpp"
+
+namespace utf_convert {
+namespace stats_detail {
+
+#if defined(UTF_CONVERT_STATS)
+
+/*!
+ * Add one run of a conversion to the counters of the calling thread.
+ *
+ * @param conversion the conversion which ran.
+ * @param error what it returned.
+ * @param bytes_in input bytes converted.
+ * @param bytes_out output bytes written.
+ * @param kernel_bytes_in input bytes the vectorized kernels took.
+ * @param fallbacks times a kernel left input to the scalar code.
+ */
+void record(UTF_CONVERSION conversion,
+            UTF_ERROR      error,
+            uint64_t       bytes_in,
+            uint64_t       bytes_out,
+            uint64_t       kernel_bytes_in,
+            uint64_t       fallbacks);
+
+/*!
+ * Count an ill-formed sequence which a strict conversion stopped at, or a
+ * replacing one replaced.
+ */
+void record_invalid(UTF_CONVERSION conversion);
+
+/*!
+ * Counting of one run of a converter, from where it starts to where it stops.
+ */
+template <typename In, typename Out>
+class run_stats {
+public:
+    run_stats(UTF_CONVERSION conversion, const In *src, const Out *dst)
+        : conversion_(conversion),
+          src_(src),
+          dst_(dst),
+          kernel_units_(0),
+          fallbacks_(0) {}
+
+    /*!
+     * Count a kernel which went from begin to src, with end as the end of
+     * the input.
+     */
+    void kernel(const In *begin, const In *src, const In *end) {
+        kernel_units_ += src - begin;
+        fallbacks_ += src < end;
+    }
+
+    UTF_ERROR finish(UTF_ERROR error, const In *src, const Out *dst) const {
+        record(conversion_,
+               error,
+               uint64_t(src - src_) * sizeof(In),
+               uint64_t(dst - dst_) * sizeof(Out),
+               uint64_t(kernel_units_) * sizeof(In),
+               fallbacks_);
+        return error;
+    }
+
+private:
+    UTF_CONVERSION conversion_;
+    const In *     src_;
+    const Out *    dst_;
+    size_t         kernel_units_;
+    uint64_t       fallbacks_;
+};
+
+#else
+
+// Without the statistics, the same calls compile to nothing.
+inline void record_invalid(UTF_CONVERSION) {}
+
+template <typename In, typename Out>
+class run_stats {
+public:
+    run_stats(UTF_CONVERSION, const In *, const Out *) {}
+
+    void kernel(const In *, const In *, const In *) {}
+
+    UTF_ERROR finish(UTF_ERROR error, const In *, const Out *) const {
+        return error;
+    }
+};
+
+#endif
+
+}  // namespace stats_detail
+}  // namespace utf_convert
+
+#endif  // UTF_CONVERT_STATS_HPP
@@ -0,0 +1,177 @@
+#undef NDEBUG
+
+#include <cassert>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "utf_convert_arena.hpp"
+
+using namespace utf_convert;
+
+template <typename T>
+bool is_aligned(const T *p) {
+    return reinterpret_cast<uintptr_t>(p) % alignof(T) == 0;
+}
+
+/*!
+ * Bump allocation, large allocations and reset.
+ */
+void arena_test() {
+    arena a(256);
+    assert(a.capacity() == 0);
+
+    char *c = static_cast<char *>(a.allocate(1, 1));
+    void *d = a.allocate(sizeof(double), alignof(double));
+    assert(reinterpret_cast<uintptr_t>(d) % alignof(double) == 0);
+    assert(static_cast<char *>(d) > c);
+    assert(a.capacity() == 256);
+
+    // A large allocation gets a block of its own, and the small ones go on in
+    // the block before.
+    char *big = static_cast<char *>(a.allocate(1000, 1));
+    big[999]  = 1;
+    assert(a.capacity() == 256 + 1000);
+    char *next = static_cast<char *>(a.allocate(1, 1));
+    assert(next > c && next < c + 256);
+
+    // The block is full, a new one is started.
+    for (size_t i = 0; i < 300; i++) {
+        *static_cast<char *>(a.allocate(1, 1)) = 'x';
+    }
+    assert(a.capacity() == 256 + 1000 + 256);
+
+    a.reset();
+    assert(a.capacity() == 256);
+    assert(a.allocate(0, 1) != NULL);
+}
+
+/*!
+ * The conversions into arena strings must give what those into the standard
+ * strings give, also with BOM and on failure.
+ */
+void string_test() {
+    const UTF_ENDIAN endians[] = {UTF_ENDIAN_LITTLE_ENDIAN,
+                                  UTF_ENDIAN_BIG_ENDIAN};
+    const std::string inputs[] = {
+        "", "abc", "a\xc3\xa9\xe4\xbd\xa0\xf0\x9f\x98\x80z",
+        "ok\xe4\xbd",  // Cut sequence.
+        std::string(1000, 'a') + "\xc3\xa9",
+    };
+
+    arena a(128);
+    for (size_t e = 0; e < 2; e++) {
+        const UTF_ENDIAN endian = endians[e];
+        for (size_t i = 0; i < sizeof(inputs) / sizeof(inputs[0]); i++) {
+            for (int bom = 0; bom < 2; bom++) {
+                std::u16string  u16;
+                std::u32string  u32;
+                arena_string    a8((arena_allocator<char>(a)));
+                arena_u16string a16((arena_allocator<char16_t>(a)));
+                arena_u32string a32((arena_allocator<char32_t>(a)));
+                a8.assign(inputs[i].begin(), inputs[i].end());
+
+                bool ok = to_u16string(inputs[i], u16, endian, bom != 0);
+                assert(to_u16string(a8, a16, endian, bom != 0) == ok);
+                assert(std::u16string(a16.begin(), a16.end()) == u16);
+                assert(is_aligned(a16.data()));
+
+                ok = to_u32string(inputs[i], u32, endian, bom != 0);
+                assert(to_u32string(a8, a32, endian, bom != 0) == ok);
+                assert(std::u32string(a32.begin(), a32.end()) == u32);
+                assert(is_aligned(a32.data()));
+                if (!ok || bom)
+                    continue;
+
+                // Back to utf-8, and between utf-16 and utf-32.
+                arena_string back((arena_allocator<char>(a)));
+                assert(to_u8string(a16, endian, back) && back == a8);
+                assert(to_u8string(a32, endian, back) && back == a8);
+
+                for (size_t f = 0; f < 2; f++) {
+                    std::u16string  u16_res;
+                    std::u32string  u32_res;
+                    arena_u16string a16_res((arena_allocator<char16_t>(a)));
+                    arena_u32string a32_res((arena_allocator<char32_t>(a)));
+                    to_u16string(u32, endian, u16_res, endians[f], true);
+                    to_u32string(u16, endian, u32_res, endians[f], true);
+                    assert(to_u16string(a32, endian, a16_res, endians[f],
+                                        true));
+                    assert(to_u32string(a16, endian, a32_res, endians[f],
+                                        true));
+                    assert(std::u16string(a16_res.begin(), a16_res.end()) ==
+                           u16_res);
+                    assert(std::u32string(a32_res.begin(), a32_res.end()) ==
+                           u32_res);
+                }
+            }
+        }
+        a.reset();
+    }
+
+    // Other containers can draw from the arena too.
+    std::vector<size_t, arena_allocator<size_t> > offsets(
+        (arena_allocator<size_t>(a)));
+    for (size_t i = 0; i < 100; i++) {
+        offsets.push_back(i);
+    }
+    assert(offsets[99] == 99 && is_aligned(offsets.data()));
+}
+
+/*!
+ * The BOM is U+FEFF in the target endian whatever the mode and fold, which
+ * convert through the any allocator templates for the standard strings too.
+ */
+void bom_test() {
+    const UTF_ENDIAN  endians[] = {UTF_ENDIAN_LITTLE_ENDIAN,
+                                   UTF_ENDIAN_BIG_ENDIAN};
+    const UTF_MODE    modes[] = {UTF_MODE_LENIENT, UTF_MODE_STRICT,
+                                 UTF_MODE_REPLACE};
+    const std::string u8str   = "Caf\xc3\xa9 \xf0\x9f\x98\x80";
+    std::u16string    u16str;
+    std::u32string    u32str;
+    assert(to_u16string(u8str, u16str, UTF_ENDIAN_NATIVE));
+    assert(to_u32string(u8str, u32str, UTF_ENDIAN_NATIVE));
+
+    arena a(128);
+    for (size_t e = 0; e < 2; e++) {
+        const char16_t bom16 =
+            endians[e] == UTF_ENDIAN_NATIVE ? 0xfeff : 0xfffe;
+        const char32_t bom32 =
+            endians[e] == UTF_ENDIAN_NATIVE ? 0xfeff : 0xfffe0000;
+        for (size_t m = 0; m < 3; m++) {
+            for (int fold = 0; fold < 2; fold++) {
+                const UTF_FOLD f = fold ? UTF_FOLD_LATIN1 : UTF_FOLD_NONE;
+                std::u16string u16;
+                std::u32string u32;
+                assert(to_u16string(u8str, u16, endians[e], true, modes[m], f));
+                assert(u16[0] == bom16);
+                assert(to_u16string(u32str, UTF_ENDIAN_NATIVE, u16, endians[e],
+                                    true, modes[m], f));
+                assert(u16[0] == bom16);
+                assert(to_u32string(u8str, u32, endians[e], true, modes[m], f));
+                assert(u32[0] == bom32);
+                assert(to_u32string(u16str, UTF_ENDIAN_NATIVE, u32, endians[e],
+                                    true, modes[m], f));
+                assert(u32[0] == bom32);
+
+                arena_string    a8((arena_allocator<char>(a)));
+                arena_u16string a16((arena_allocator<char16_t>(a)));
+                arena_u32string a32((arena_allocator<char32_t>(a)));
+                a8.assign(u8str.begin(), u8str.end());
+                assert(to_u16string(a8, a16, endians[e], true, modes[m], f));
+                assert(a16[0] == bom16);
+                assert(to_u32string(a8, a32, endians[e], true, modes[m], f));
+                assert(a32[0] == bom32);
+            }
+        }
+        a.reset();
+    }
+}
+
+int main() {
+    arena_test();
+    string_test();
+    bom_test();
+    return 0;
+}
@@ -0,0 +1,141 @@
+#undef NDEBUG
+
+#include <cassert>
+#include <cstdint>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include "test_util.hpp"
+#include "utf_convert.hpp"
+
+using namespace utf_convert;
+
+/*!
+ * Reference encoder of utf-16, giving the code units in the byte order of
+ * endian.
+ */
+void append_u16(std::u16string &str, uint32_t value, UTF_ENDIAN endian) {
+    if (value < 0x10000) {
+        str.push_back(make_u16(value, endian));
+    } else {
+        value -= 0x10000;
+        str.push_back(make_u16(0xd800 | (value >> 10), endian));
+        str.push_back(make_u16(0xdc00 | (value & 0x3ff), endian));
+    }
+}
+
+/*!
+ * Convert the characters every way between utf-8 and the other encodings.
+ */
+void check(const std::vector<uint32_t> &chars) {
+    const UTF_ENDIAN endians[] = {UTF_ENDIAN_LITTLE_ENDIAN,
+                                  UTF_ENDIAN_BIG_ENDIAN};
+
+    std::string u8;
+    bool        ascii = true;
+    for (size_t i = 0; i < chars.size(); i++) {
+        append_u8(u8, chars[i]);
+        ascii = ascii && chars[i] < 0x80;
+    }
+    assert(is_ascii(u8.data(), u8.size()) == ascii);
+
+    for (size_t e = 0; e < 2; e++) {
+        std::u16string u16;
+        std::u32string u32;
+        for (size_t i = 0; i < chars.size(); i++) {
+            append_u16(u16, chars[i], endians[e]);
+            u32.push_back(make_u32(chars[i], endians[e]));
+        }
+
+        std::u16string u16_res;
+        std::u32string u32_res;
+        std::string    u8_res;
+        assert(to_u16string(u8, u16_res, endians[e]) && u16_res == u16);
+        assert(to_u32string(u8, u32_res, endians[e]) && u32_res == u32);
+        assert(to_u8string(u16, endians[e], u8_res) && u8_res == u8);
+        assert(to_u8string(u32, endians[e], u8_res) && u8_res == u8);
+    }
+}
+
+/*!
+ * The fast paths must stop where the output buffer ends, like the others.
+ */
+void buffer_test() {
+    const std::string    u8(20, 'a');
+    const std::u16string u16(20, make_u16('a', UTF_ENDIAN_BIG_ENDIAN));
+    const std::u32string u32(20, make_u32('a', UTF_ENDIAN_BIG_ENDIAN));
+
+    for (size_t cap = 0; cap < u8.size(); cap++) {
+        char32_t out32[20];
+        result   res = convert_utf8_to_utf32(
+            u8.data(), u8.size(), out32, cap, UTF_ENDIAN_BIG_ENDIAN);
+        assert(res.error == UTF_ERROR_OUTPUT_TOO_SMALL && res.count == cap);
+        assert(std::u32string(out32, cap) == u32.substr(0, cap));
+
+        char16_t out16[20];
+        res = convert_utf8_to_utf16(
+            u8.data(), u8.size(), out16, cap, UTF_ENDIAN_BIG_ENDIAN);
+        assert(res.error == UTF_ERROR_OUTPUT_TOO_SMALL && res.count == cap);
+        assert(std::u16string(out16, cap) == u16.substr(0, cap));
+
+        char out8[20];
+        res = convert_utf16_to_utf8(
+            u16.data(), u16.size(), out8, cap, UTF_ENDIAN_BIG_ENDIAN);
+        assert(res.error == UTF_ERROR_OUTPUT_TOO_SMALL && res.count == cap);
+        assert(std::string(out8, cap) == u8.substr(0, cap));
+
+        res = convert_utf32_to_utf8(
+            u32.data(), u32.size(), out8, cap, UTF_ENDIAN_BIG_ENDIAN);
+        assert(res.error == UTF_ERROR_OUTPUT_TOO_SMALL && res.count == cap);
+        assert(std::string(out8, cap) == u8.substr(0, cap));
+    }
+}
+
+int main() {
+    buffer_test();
+
+    // One byte from 0x80 on at every position of every short length, on both
+    // sides of the word and register boundaries.
+    for (size_t length = 0; length < 80; length++) {
+        std::string str(length, 'x');
+        assert(is_ascii(str.data(), str.size()));
+        for (size_t i = 0; i < length; i++) {
+            str[i] = '\x80';
+            assert(!is_ascii(str.data(), str.size()));
+            assert(is_ascii(str.data(), i));
+            str[i] = '\x7f';
+        }
+    }
+
+    const uint32_t others[] = {0x80, 0xe9, 0x7ff, 0x4f60, 0xffff, 0x1f600};
+    for (size_t length = 0; length < 40; length++) {
+        std::vector<uint32_t> chars(length);
+        for (size_t i = 0; i < length; i++) {
+            chars[i] = 'a' + i % 26;
+        }
+        check(chars);
+        for (size_t i = 0; i < length; i++) {
+            for (size_t k = 0; k < sizeof(others) / sizeof(others[0]); k++) {
+                const uint32_t old = chars[i];
+                chars[i]           = others[k];
+                check(chars);
+                chars[i] = old;
+            }
+        }
+    }
+
+    // Random short strings, mostly ascii.
+    std::srand(1);
+    for (size_t round = 0; round < 2000; round++) {
+        std::vector<uint32_t> chars(std::rand() % 100);
+        for (size_t i = 0; i < chars.size(); i++) {
+            if (std::rand() % 16 == 0)
+                chars[i] = others[std::rand() % 6];
+            else
+                chars[i] = std::rand() % 0x80;
+        }
+        check(chars);
+    }
+    return 0;
+}
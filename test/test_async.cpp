@@ -0,0 +1,243 @@
+#undef NDEBUG
+
+#include <cassert>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <stdexcept>
+#include <string>
+
+#include "utf_convert.hpp"
+#include "utf_convert_async.hpp"
+
+using namespace utf_convert;
+
+/*!
+ * Single threaded event loop, which runs the completions of the reads in
+ * order.
+ */
+struct event_loop {
+    std::deque<std::function<void()>> queue;
+
+    void run() {
+        while (!queue.empty()) {
+            std::function<void()> completion = queue.front();
+            queue.pop_front();
+            completion();
+        }
+    }
+};
+
+/*!
+ * Source which completes each read later in the event loop, or right away
+ * when synchronous, with at most max_read bytes at a time.
+ */
+struct test_source {
+    event_loop &       loop;
+    const std::string &data;
+    size_t             max_read;
+    bool               synchronous = false;
+    size_t             throw_at    = std::string::npos;
+    size_t             pos         = 0;
+    size_t             started     = 0;  // Reads started.
+    size_t             completed   = 0;  // Reads which have their bytes.
+
+    size_t fill(char *buffer, size_t capacity, bool &failed) {
+        completed++;
+        failed = pos >= throw_at;
+        if (failed)
+            return 0;
+
+        size_t size = data.size() - pos;
+        size        = size < capacity ? size : capacity;
+        size        = size < max_read ? size : max_read;
+        std::memcpy(buffer, data.data() + pos, size);
+        pos += size;
+        return size;
+    }
+
+    struct awaiter {
+        test_source &source;
+        char *       buffer;
+        size_t       capacity;
+        size_t       size;
+        bool         failed;
+
+        bool await_ready() {
+            if (!source.synchronous)
+                return false;
+            size = source.fill(buffer, capacity, failed);
+            return true;
+        }
+
+        void await_suspend(std::coroutine_handle<> handle) {
+            source.loop.queue.push_back([this, handle] {
+                size = source.fill(buffer, capacity, failed);
+                handle.resume();
+            });
+        }
+
+        size_t await_resume() {
+            if (failed)
+                throw std::runtime_error("read failed");
+            return size;
+        }
+    };
+
+    awaiter read(char *buffer, size_t capacity) {
+        started++;
+        return awaiter{*this, buffer, capacity, 0, false};
+    }
+};
+
+/*!
+ * Coroutine which starts at once and is not awaited, to start the others from
+ * main.
+ */
+struct detached {
+    struct promise_type {
+        detached           get_return_object() { return {}; }
+        std::suspend_never initial_suspend() noexcept { return {}; }
+        std::suspend_never final_suspend() noexcept { return {}; }
+        void               return_void() {}
+        void               unhandled_exception() { std::abort(); }
+    };
+};
+
+template <typename String>
+detached consume(test_source &source,
+                 size_t       chunk_size,
+                 String &     target,
+                 UTF_ERROR &  error,
+                 bool &       done) {
+    async_transcoder<test_source, String> transcoder(
+        source, UTF_ENDIAN_BIG_ENDIAN, chunk_size);
+    while (co_await transcoder.next()) {
+        // The next read is running while the chunk is consumed.
+        assert(source.started == source.completed + 1 || source.synchronous);
+        target += transcoder.chunk();
+    }
+    target += transcoder.chunk();
+    error = transcoder.error();
+    assert(!source.synchronous || source.started == source.completed);
+    done = true;
+}
+
+template <typename String>
+UTF_ERROR transcode(const std::string &u8str,
+                    size_t             chunk_size,
+                    size_t             max_read,
+                    bool               synchronous,
+                    String &           target) {
+    event_loop  loop;
+    test_source source{loop, u8str, max_read, synchronous};
+    UTF_ERROR   error = UTF_ERROR_NONE;
+    bool        done  = false;
+
+    target.clear();
+    consume(source, chunk_size, target, error, done);
+    loop.run();
+    assert(done && source.started == source.completed);
+    return error;
+}
+
+/*!
+ * Chunks of every size split the sequences anywhere.
+ */
+void chunk_test() {
+    const char *const chars[] = {"a", "\xc3\xa9", "\xe4\xbd\xa0",
+                                 "\xf0\x9f\x98\x80"};
+    std::string       u8str;
+    for (size_t i = 0; i < 3000; i++)
+        u8str += chars[std::rand() % 4];
+
+    std::u16string u16expected, u16str;
+    std::u32string u32expected, u32str;
+    assert(to_u16string(u8str, u16expected, UTF_ENDIAN_BIG_ENDIAN));
+    assert(to_u32string(u8str, u32expected, UTF_ENDIAN_BIG_ENDIAN));
+
+    const size_t sizes[] = {1, 2, 3, 5, 64, 1000, 100000};
+    for (size_t s = 0; s < 7; s++) {
+        for (size_t synchronous = 0; synchronous < 2; synchronous++) {
+            assert(transcode(u8str, sizes[s], 777, synchronous, u16str) ==
+                   UTF_ERROR_NONE);
+            assert(u16str == u16expected);
+            assert(transcode(u8str, 4096, sizes[s], synchronous, u32str) ==
+                   UTF_ERROR_NONE);
+            assert(u32str == u32expected);
+        }
+    }
+
+    assert(transcode(std::string(), 16, 16, false, u16str) == UTF_ERROR_NONE);
+    assert(u16str.empty());
+}
+
+/*!
+ * Invalid input stops at the invalid sequence, and a cut one at the end.
+ */
+void error_test() {
+    std::u16string target;
+    for (size_t synchronous = 0; synchronous < 2; synchronous++) {
+        std::string u8str =
+            std::string(100, 'a') + "\xff" + std::string(100, 'b');
+        assert(transcode(u8str, 7, 64, synchronous, target) ==
+               UTF_ERROR_INVALID_SEQUENCE);
+        assert(target.size() == 100);
+
+        u8str = std::string(50, 'a') + "\xe4\xbd";
+        assert(transcode(u8str, 16, 16, synchronous, target) ==
+               UTF_ERROR_INVALID_SEQUENCE);
+        assert(target.size() == 50);
+    }
+}
+
+detached stop_early(test_source &source, bool &closed, bool &done) {
+    async_transcoder<test_source> transcoder(source, UTF_ENDIAN_LITTLE_ENDIAN,
+                                             4);
+    assert(co_await transcoder.next());
+    assert(transcoder.chunk() == u"abcd");
+    closed = co_await transcoder.close();
+    assert(!co_await transcoder.next());
+    done = true;
+}
+
+detached read_error(test_source &source, bool &thrown) {
+    async_transcoder<test_source> transcoder(source, UTF_ENDIAN_LITTLE_ENDIAN,
+                                             4);
+    try {
+        while (co_await transcoder.next()) {
+        }
+    } catch (const std::runtime_error &) {
+        thrown = true;
+    }
+}
+
+/*!
+ * Stopping before the end waits for the running read, and the errors of the
+ * source reach the caller.
+ */
+void close_test() {
+    const std::string u8str = "abcdefghijklmnopqrstuvwxyz";
+    event_loop        loop;
+    test_source       source{loop, u8str, 100};
+    bool              closed = false, done = false;
+    stop_early(source, closed, done);
+    loop.run();
+    assert(closed && done && source.started == 2 && source.completed == 2);
+
+    for (size_t synchronous = 0; synchronous < 2; synchronous++) {
+        test_source failing{loop, u8str, 100, bool(synchronous), 12};
+        bool        thrown = false;
+        read_error(failing, thrown);
+        loop.run();
+        assert(thrown);
+    }
+}
+
+int main() {
+    chunk_test();
+    error_test();
+    close_test();
+    return 0;
+}
@@ -0,0 +1,150 @@
+#undef NDEBUG
+
+#include <cassert>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include "utf_convert.hpp"
+
+using namespace utf_convert;
+
+const UTF_ENDIAN endians[] = {UTF_ENDIAN_LITTLE_ENDIAN, UTF_ENDIAN_BIG_ENDIAN};
+
+/*!
+ * Pointers and lengths of strings, as the batch functions take them.
+ */
+template <typename String>
+void split(const std::vector<String> &                      strs,
+           std::vector<const typename String::value_type *> &data,
+           std::vector<size_t> &                             lengths) {
+    data.clear();
+    lengths.clear();
+    for (size_t i = 0; i < strs.size(); i++) {
+        data.push_back(strs[i].data());
+        lengths.push_back(strs[i].size());
+    }
+}
+
+/*!
+ * Every string of the batch must be what the one-string functions give.
+ */
+template <typename String>
+void check_offsets(const String &             target,
+                   const std::vector<size_t> &offsets,
+                   const std::vector<String> &expected) {
+    assert(offsets.size() == expected.size() + 1);
+    assert(offsets[0] == 0 && offsets.back() == target.size());
+    for (size_t i = 0; i < expected.size(); i++) {
+        assert(target.substr(offsets[i], offsets[i + 1] - offsets[i]) ==
+               expected[i]);
+    }
+}
+
+void check(const std::vector<std::string> &u8strs) {
+    for (size_t e = 0; e < 2; e++) {
+        std::vector<const char *> data;
+        std::vector<size_t>       lengths;
+        split(u8strs, data, lengths);
+
+        std::vector<std::u16string> u16strs(u8strs.size());
+        std::vector<std::u32string> u32strs(u8strs.size());
+        for (size_t i = 0; i < u8strs.size(); i++) {
+            assert(to_u16string(u8strs[i], u16strs[i], endians[e]));
+            assert(to_u32string(u8strs[i], u32strs[i], endians[e]));
+        }
+
+        std::u16string      u16;
+        std::u32string      u32;
+        std::string         u8;
+        std::vector<size_t> offsets;
+        assert(batch_to_u16string(data.data(), lengths.data(), data.size(),
+                                  u16, offsets, endians[e]));
+        check_offsets(u16, offsets, u16strs);
+        assert(batch_to_u32string(data.data(), lengths.data(), data.size(),
+                                  u32, offsets, endians[e], UTF_MODE_STRICT));
+        check_offsets(u32, offsets, u32strs);
+
+        std::vector<const char16_t *> data16;
+        split(u16strs, data16, lengths);
+        assert(batch_to_u8string(data16.data(), lengths.data(), data16.size(),
+                                 endians[e], u8, offsets));
+        check_offsets(u8, offsets, u8strs);
+
+        std::vector<const char32_t *> data32;
+        split(u32strs, data32, lengths);
+        assert(batch_to_u8string(data32.data(), lengths.data(), data32.size(),
+                                 endians[e], u8, offsets));
+        check_offsets(u8, offsets, u8strs);
+    }
+}
+
+/*!
+ * A failing string ends the batch after the strings before it.
+ */
+void failure_test() {
+    std::vector<std::string> u8strs;
+    u8strs.push_back("ab");
+    u8strs.push_back("\xe4\xbd\xa0");
+    u8strs.push_back("c\xe4\xbd");  // Cut sequence.
+    u8strs.push_back("d");
+
+    std::vector<const char *> data;
+    std::vector<size_t>       lengths;
+    split(u8strs, data, lengths);
+
+    std::u16string      u16;
+    std::vector<size_t> offsets;
+    assert(!batch_to_u16string(data.data(), lengths.data(), data.size(), u16,
+                               offsets, UTF_ENDIAN_LITTLE_ENDIAN));
+    assert(offsets.size() == 3 && offsets[2] == 3 && u16.size() == 3);
+
+    // Lenient mode reads a surrogate, strict mode stops at it.
+    u8strs[2] = "\xed\xa0\x80";
+    split(u8strs, data, lengths);
+    std::u32string u32;
+    assert(batch_to_u32string(data.data(), lengths.data(), data.size(), u32,
+                              offsets, UTF_ENDIAN_LITTLE_ENDIAN));
+    assert(offsets.size() == 5);
+    assert(!batch_to_u32string(data.data(), lengths.data(), data.size(), u32,
+                               offsets, UTF_ENDIAN_LITTLE_ENDIAN,
+                               UTF_MODE_STRICT));
+    assert(offsets.size() == 3 && u32.size() == 3);
+
+    // An unpaired high surrogate at the end of a utf-16 string is an error,
+    // even though the next string could complete it.
+    std::u16string pair;
+    to_u16string("\xf0\x9f\x98\x80", pair, UTF_ENDIAN_LITTLE_ENDIAN);
+    const char16_t *data16[2]    = {pair.data(), pair.data() + 1};
+    const size_t    lengths16[2] = {1, 1};
+    std::string     u8;
+    assert(!batch_to_u8string(data16, lengths16, 2, UTF_ENDIAN_LITTLE_ENDIAN,
+                              u8, offsets));
+    assert(offsets.size() == 1 && u8.empty());
+}
+
+int main() {
+    failure_test();
+
+    std::vector<std::string> u8strs;
+    check(u8strs);
+    u8strs.push_back("");
+    check(u8strs);
+
+    // Random table cells, with empty ones in between.
+    const char *pieces[] = {"a", "key", "\xc3\xa9", "\xe4\xbd\xa0", "42",
+                            "\xf0\x9f\x98\x80", " "};
+    std::srand(1);
+    for (size_t round = 0; round < 200; round++) {
+        u8strs.resize(std::rand() % 50);
+        for (size_t i = 0; i < u8strs.size(); i++) {
+            u8strs[i].clear();
+            size_t n = std::rand() % 6;
+            for (size_t k = 0; k < n; k++) {
+                u8strs[i] += pieces[std::rand() % 7];
+            }
+        }
+        check(u8strs);
+    }
+    return 0;
+}
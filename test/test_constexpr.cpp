@@ -0,0 +1,63 @@
+#undef NDEBUG
+
+#include <cassert>
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+#include "utf_convert.hpp"
+#include "utf_convert_constexpr.hpp"
+
+using namespace utf_convert;
+
+// a, é, 你, 😀
+#define SAMPLE "a\xc3\xa9\xe4\xbd\xa0\xf0\x9f\x98\x80"
+
+constexpr auto u16_sample = to_u16<SAMPLE>();
+constexpr auto u32_sample = to_u32<SAMPLE>();
+
+static_assert(u16_sample.size() == 6, "one unit each and a surrogate pair");
+static_assert(u16_sample[0] == u'a' && u16_sample[1] == 0xe9 &&
+                  u16_sample[2] == 0x4f60 && u16_sample[3] == 0xd83d &&
+                  u16_sample[4] == 0xde00 && u16_sample[5] == 0,
+              "utf-16 units");
+
+static_assert(u32_sample.size() == 5, "four characters");
+static_assert(u32_sample[0] == U'a' && u32_sample[1] == 0xe9 &&
+                  u32_sample[2] == 0x4f60 && u32_sample[3] == 0x1f600 &&
+                  u32_sample[4] == 0,
+              "utf-32 characters");
+
+static_assert(to_u16<"">().size() == 1 && to_u16<"">()[0] == 0, "empty");
+static_assert(to_u32<u8"é">()[0] == 0xe9, "char8_t literal");
+
+constexpr auto u16_macro = UTF_CONVERT_U16_LITERAL(SAMPLE);
+constexpr auto u32_macro = UTF_CONVERT_U32_LITERAL(SAMPLE);
+static_assert(u16_macro == u16_sample, "macro and template agree");
+static_assert(u32_macro == u32_sample, "macro and template agree");
+
+static_assert(literal::utf16_length("\xf4\x8f\xbf\xbf", 4) == 2,
+              "last character");
+static_assert(literal::utf32_length("\xef\xbf\xbf", 3) == 1, "last bmp");
+
+/*!
+ * The byte order the constants are in.
+ */
+UTF_ENDIAN native_endian() {
+    const uint16_t value = 1;
+    unsigned char  bytes[2];
+    std::memcpy(bytes, &value, sizeof(value));
+    return bytes[0] == 1 ? UTF_ENDIAN_LITTLE_ENDIAN : UTF_ENDIAN_BIG_ENDIAN;
+}
+
+int main() {
+    // The constants must be what the library gives at run time.
+    const std::string u8 = SAMPLE;
+    std::u16string    u16;
+    std::u32string    u32;
+    assert(to_u16string(u8, u16, native_endian()));
+    assert(to_u32string(u8, u32, native_endian()));
+    assert(u16 == std::u16string(u16_sample.data()));
+    assert(u32 == std::u32string(u32_sample.data()));
+    return 0;
+}
@@ -0,0 +1,187 @@
+#undef NDEBUG
+
+#include <cassert>
+#include <cstring>
+#include <string>
+
+#include "utf_convert.hpp"
+
+using namespace utf_convert;
+
+/*!
+ * Bytes of a utf-16 or utf-32 string, as they would be read from a file.
+ */
+template <typename String>
+std::string bytes_of(const String &str) {
+    return std::string(reinterpret_cast<const char *>(str.data()),
+                       str.size() * sizeof(typename String::value_type));
+}
+
+/*!
+ * Detect bytes both where the string keeps them and one byte off, where the
+ * utf-16 and utf-32 units are misaligned, and convert them back.
+ */
+void check(const std::string &bytes,
+           UTF_ENCODING       expected,
+           size_t             expected_bom,
+           const std::string &u8str) {
+    std::string buffer = " " + bytes;
+    for (size_t offset = 0; offset < 2; offset++) {
+        const char *data = offset == 0 ? bytes.data() : buffer.data() + 1;
+
+        size_t bom = 99;
+        assert(detect_encoding(data, bytes.size(), &bom) == expected);
+        assert(bom == expected_bom);
+
+        std::string  target;
+        UTF_ENCODING encoding = UTF_ENCODING_UTF8;
+        assert(convert_any_to_utf8(data, bytes.size(), target,
+                                   UTF_MODE_STRICT, &encoding));
+        assert(encoding == expected && target == u8str);
+    }
+}
+
+void check_all(const std::string &u8str) {
+    const UTF_ENDIAN endians[] = {UTF_ENDIAN_LITTLE_ENDIAN,
+                                  UTF_ENDIAN_BIG_ENDIAN};
+    const UTF_ENCODING u16_encodings[] = {UTF_ENCODING_UTF16_LITTLE_ENDIAN,
+                                          UTF_ENCODING_UTF16_BIG_ENDIAN};
+    const UTF_ENCODING u32_encodings[] = {UTF_ENCODING_UTF32_LITTLE_ENDIAN,
+                                          UTF_ENCODING_UTF32_BIG_ENDIAN};
+
+    check(u8str, UTF_ENCODING_UTF8, 0, u8str);
+    check("\xef\xbb\xbf" + u8str, UTF_ENCODING_UTF8, 3, u8str);
+
+    for (size_t e = 0; e < 2; e++) {
+        std::u16string u16str;
+        std::u32string u32str;
+        assert(to_u16string(u8str, u16str, endians[e], true));
+        assert(to_u32string(u8str, u32str, endians[e], true));
+        check(bytes_of(u16str), u16_encodings[e], 2, u8str);
+        check(bytes_of(u32str), u32_encodings[e], 4, u8str);
+
+        // The BOM overloads tell the endian from the first unit.
+        std::string target;
+        assert(to_u8string(u16str, target) && target == u8str);
+        assert(to_u8string(u32str, target) && target == u8str);
+    }
+}
+
+/*!
+ * Without a BOM, the zero bytes tell utf-16 and utf-32 apart and give their
+ * endian.
+ */
+void no_bom_test() {
+    const std::string latin = "plain text, caf\xc3\xa9 \xe2\x82\xac 100";
+    const UTF_ENDIAN  endians[] = {UTF_ENDIAN_LITTLE_ENDIAN,
+                                   UTF_ENDIAN_BIG_ENDIAN};
+    const UTF_ENCODING u16_encodings[] = {UTF_ENCODING_UTF16_LITTLE_ENDIAN,
+                                          UTF_ENCODING_UTF16_BIG_ENDIAN};
+    const UTF_ENCODING u32_encodings[] = {UTF_ENCODING_UTF32_LITTLE_ENDIAN,
+                                          UTF_ENCODING_UTF32_BIG_ENDIAN};
+
+    for (size_t e = 0; e < 2; e++) {
+        std::u16string u16str;
+        std::u32string u32str;
+        assert(to_u16string(latin, u16str, endians[e]));
+        assert(to_u32string(latin, u32str, endians[e]));
+        check(bytes_of(u16str), u16_encodings[e], 0, latin);
+        check(bytes_of(u32str), u32_encodings[e], 0, latin);
+    }
+
+    // Hangul text in utf-16 has no zero bytes and is not valid utf-8.
+    const std::string cjk = "\xed\x95\x9c\xea\xb5\xad\xec\x96\xb4";
+    std::u16string    u16str;
+    assert(to_u16string(cjk, u16str, UTF_ENDIAN_LITTLE_ENDIAN));
+    check(bytes_of(u16str), UTF_ENCODING_UTF16_LITTLE_ENDIAN, 0, cjk);
+    // Swapped, it is valid little endian too, which is taken first.
+    assert(to_u16string(cjk, u16str, UTF_ENDIAN_BIG_ENDIAN));
+    assert(detect_encoding(u16str.data(), u16str.size() * 2) ==
+           UTF_ENCODING_UTF16_LITTLE_ENDIAN);
+
+    // Utf-16 with a surrogate pair cut by a copied chunk, as validated when
+    // misaligned.
+    std::string u8str(4095, 'a');
+    u8str += "\xf0\x9f\x98\x80";
+    for (size_t e = 0; e < 2; e++) {
+        assert(to_u16string(u8str, u16str, endians[e]));
+        check(bytes_of(u16str), u16_encodings[e], 0, u8str);
+    }
+}
+
+/*!
+ * Utf-8 text with a few zero bytes, which is also valid utf-16, stays utf-8.
+ */
+void zero_test() {
+    const std::string texts[] = {
+        std::string("hello world\0", 12),
+        std::string("key=value\0next", 14),
+        std::string("Hello, \xe4\xb8\x96\xe7\x95\x8c!\0", 15),
+        std::string("Hi, \xe4\xb8\x96\xe7\x95\x8c!\0", 12),
+        std::string("\0\0\0\0 four zero bytes\0", 21),
+    };
+    for (size_t i = 0; i < sizeof(texts) / sizeof(texts[0]); i++) {
+        check(texts[i], UTF_ENCODING_UTF8, 0, texts[i]);
+    }
+
+    // Zeros at most of the high bytes are utf-16 even when valid utf-8.
+    const std::string u16str("a\0b\0c\0\xe9\0", 8);
+    check(u16str, UTF_ENCODING_UTF16_LITTLE_ENDIAN, 0, "abc\xc3\xa9");
+    // Few zeros in text which is no utf-8 are still utf-16.
+    const std::string cjk("\x60\x4f\x7d\x59\x2c\x00\x20\x00\x3d\xd8"
+                          "\x00\xde\x21\x00",
+                          14);
+    check(cjk, UTF_ENCODING_UTF16_LITTLE_ENDIAN, 0,
+          "\xe4\xbd\xa0\xe5\xa5\xbd, \xf0\x9f\x98\x80!");
+}
+
+/*!
+ * Text which fits no encoding is utf-8, and the modes apply to it.
+ */
+void invalid_test() {
+    // Every even number of bytes without surrogates is valid utf-16, so the
+    // text here has an odd size.
+    const std::string bad("a\xff\x00", 3);
+    assert(detect_encoding(bad.data(), bad.size()) == UTF_ENCODING_UTF8);
+
+    std::string target;
+    assert(convert_any_to_utf8(bad.data(), bad.size(), target));
+    assert(target == bad);
+    assert(!convert_any_to_utf8(bad.data(), bad.size(), target,
+                                UTF_MODE_STRICT));
+    assert(convert_any_to_utf8(bad.data(), bad.size(), target,
+                               UTF_MODE_REPLACE));
+    assert(target == std::string("a\xef\xbf\xbd\x00", 5));
+
+    // A utf-16 text with a BOM and a cut unit at the end.
+    const char cut[] = "\xff\xfe"
+                       "a\x00"
+                       "b";
+    assert(!convert_any_to_utf8(cut, 5, target) && target == "a");
+    assert(!convert_any_to_utf8(cut, 5, target, UTF_MODE_STRICT));
+    assert(convert_any_to_utf8(cut, 5, target, UTF_MODE_REPLACE));
+    assert(target == "a\xef\xbf\xbd");
+
+    // An unpaired surrogate in utf-16 text.
+    const char lone[] = "\xfe\xff"
+                        "\x00"
+                        "a"
+                        "\xd8\x00";
+    assert(!convert_any_to_utf8(lone, 6, target, UTF_MODE_STRICT));
+    assert(convert_any_to_utf8(lone, 6, target, UTF_MODE_REPLACE));
+    assert(target == "a\xef\xbf\xbd");
+}
+
+int main() {
+    size_t bom = 99;
+    assert(detect_encoding("", 0, &bom) == UTF_ENCODING_UTF8 && bom == 0);
+    std::string target = "x";
+    assert(convert_any_to_utf8("", 0, target) && target.empty());
+
+    check_all("ascii only");
+    check_all("\xe4\xbd\xa0\xe5\xa5\xbd, \xf0\x9f\x98\x80!");
+    no_bom_test();
+    zero_test();
+    invalid_test();
+    return 0;
+}
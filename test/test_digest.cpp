@@ -0,0 +1,138 @@
+#undef NDEBUG
+
+#include <cassert>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+#include "utf_convert.hpp"
+
+using namespace utf_convert;
+
+const UTF_ENDIAN endians[] = {UTF_ENDIAN_LITTLE_ENDIAN, UTF_ENDIAN_BIG_ENDIAN};
+
+uint64_t hash_of(const std::string &str, uint64_t seed = 0) {
+    utf8_digest digest(seed);
+    digest.update(str.data(), str.size());
+    return digest.hash();
+}
+
+/*!
+ * Known XXH64 values, and the same hash whatever the bytes are split into.
+ */
+void hash_test() {
+    assert(hash_of("") == 0xef46db3751d8e999ULL);
+    assert(hash_of("a") == 0xd24ec4f1a98c6e5bULL);
+    assert(hash_of("abc") == 0x44bc2cf5ad770999ULL);
+    assert(hash_of("Nobody inspects the spammish repetition") ==
+           0xfbcea83c8a378bf1ULL);
+    assert(hash_of("abc", 1) != hash_of("abc"));
+
+    std::string text;
+    for (size_t i = 0; i < 1000; i++) {
+        text += "\xe4\xbd\xa0\xe5\xa5\xbd abc \xf0\x9f\x98\x80" [i % 16];
+    }
+    for (size_t step = 1; step < 70; step += 3) {
+        utf8_digest digest(7);
+        for (size_t pos = 0; pos < text.size(); pos += step) {
+            digest.update(text.data() + pos,
+                          std::min(step, text.size() - pos));
+        }
+        assert(digest.hash() == hash_of(text, 7));
+        assert(digest.codepoints() ==
+               utf32_length_from_utf8(text.data(), text.size()));
+    }
+
+    utf8_digest digest;
+    digest.update(text.data(), text.size());
+    digest.reset(7);
+    assert(digest.codepoints() == 0 && digest.hash() == hash_of("", 7));
+}
+
+/*!
+ * The fused conversions write what the plain ones do and digest it exactly.
+ */
+void convert_test() {
+    std::string u8str;
+    for (size_t i = 0; i < 5000; i++) {
+        const int kind = std::rand() % 4;
+        u8str += kind == 0   ? "a"
+                 : kind == 1 ? "\xc3\xa9"
+                 : kind == 2 ? "\xe4\xb8\x96"
+                             : "\xf0\x9f\x98\x80";
+    }
+    // Put a surrogate pair across the end of the first block.
+    u8str = std::string(2047, 'x') + "\xf0\x9f\x98\x80" + u8str;
+
+    for (size_t e = 0; e < 2; e++) {
+        std::u16string u16str;
+        std::u32string u32str;
+        assert(to_u16string(u8str, u16str, endians[e]));
+        assert(to_u32string(u8str, u32str, endians[e]));
+
+        std::string out(u8str.size(), '\0');
+        utf8_digest digest;
+        result      res = convert_utf16_to_utf8(u16str.data(), u16str.size(),
+                                           &out[0], out.size(), endians[e],
+                                           digest, UTF_MODE_STRICT);
+        assert(res.error == UTF_ERROR_NONE && res.count == u8str.size());
+        assert(out == u8str && digest.hash() == hash_of(u8str));
+        assert(digest.codepoints() == u32str.size());
+
+        digest.reset();
+        res = convert_utf32_to_utf8(u32str.data(), u32str.size(), &out[0],
+                                    out.size(), endians[e], digest);
+        assert(res.error == UTF_ERROR_NONE && out == u8str);
+        assert(digest.hash() == hash_of(u8str));
+
+        // A conversion continued after a full buffer adds up to the whole.
+        std::string part(u8str.size(), '\0');
+        digest.reset();
+        res = convert_utf16_to_utf8(u16str.data(), u16str.size(), &part[0],
+                                    5000, endians[e], digest);
+        assert(res.error == UTF_ERROR_OUTPUT_TOO_SMALL);
+        const size_t written =
+            utf8_length_from_utf16(u16str.data(), res.count, endians[e]);
+        res = convert_utf16_to_utf8(u16str.data() + res.count,
+                                    u16str.size() - res.count,
+                                    &part[written], part.size() - written,
+                                    endians[e], digest);
+        assert(res.error == UTF_ERROR_NONE && part == u8str);
+        assert(digest.hash() == hash_of(u8str));
+        assert(digest.codepoints() == u32str.size());
+    }
+}
+
+/*!
+ * An ill-formed input stops with the part before it in the digest, or is
+ * replaced.
+ */
+void invalid_test() {
+    std::u16string u16str(3000, u'a');
+    u16str[2500] = 0xdc00;
+
+    std::string out(3 * u16str.size(), '\0');
+    utf8_digest digest;
+    result res = convert_utf16_to_utf8(u16str.data(), u16str.size(), &out[0],
+                                       out.size(), UTF_ENDIAN_LITTLE_ENDIAN,
+                                       digest, UTF_MODE_STRICT);
+    assert(res.error == UTF_ERROR_INVALID_SEQUENCE && res.count == 2500);
+    assert(digest.hash() == hash_of(std::string(2500, 'a')));
+
+    digest.reset();
+    res = convert_utf16_to_utf8(u16str.data(), u16str.size(), &out[0],
+                                out.size(), UTF_ENDIAN_LITTLE_ENDIAN, digest,
+                                UTF_MODE_REPLACE);
+    const std::string expected =
+        std::string(2500, 'a') + "\xef\xbf\xbd" + std::string(499, 'a');
+    assert(res.error == UTF_ERROR_NONE && res.count == expected.size());
+    assert(digest.hash() == hash_of(expected));
+    assert(digest.codepoints() == 3000);
+}
+
+int main() {
+    hash_test();
+    convert_test();
+    invalid_test();
+    return 0;
+}
@@ -0,0 +1,50 @@
+#undef NDEBUG
+
+#include <cassert>
+#include <cstring>
+#include <string>
+
+#include "utf_convert.hpp"
+
+using namespace utf_convert;
+
+/*!
+ * Round trip text through all the encodings, with long enough runs of ascii
+ * and of other characters for the kernels to take.
+ */
+void round_trip_test() {
+    std::string u8str;
+    for (size_t i = 0; i < 64; i++) {
+        u8str += "ascii text \xc3\xa9\xe4\xbd\xa0\xf0\x9f\x98\x80";
+    }
+
+    std::u16string u16str;
+    std::u32string u32str;
+    std::string    target;
+    assert(to_u16string(u8str, u16str, UTF_ENDIAN_LITTLE_ENDIAN));
+    assert(to_u32string(u8str, u32str, UTF_ENDIAN_BIG_ENDIAN));
+    assert(to_u8string(u16str, UTF_ENDIAN_LITTLE_ENDIAN, target));
+    assert(target == u8str);
+    assert(to_u8string(u32str, UTF_ENDIAN_BIG_ENDIAN, target));
+    assert(target == u8str);
+    assert(validate_utf8(u8str.data(), u8str.size()).error == UTF_ERROR_NONE);
+}
+
+/*!
+ * The first argument, if any, is the implementation which must be active,
+ * as chosen with UTF_CONVERT_IMPLEMENTATION.
+ */
+int main(int argc, char **argv) {
+    round_trip_test();
+
+    const char *name = active_implementation();
+    assert(name != NULL);
+    assert(std::strcmp(name, "avx2") == 0 || std::strcmp(name, "ssse3") == 0 ||
+           std::strcmp(name, "neon") == 0 || std::strcmp(name, "scalar") == 0);
+    if (argc > 1)
+        assert(std::strcmp(name, argv[1]) == 0);
+
+    // The choice is made once.
+    assert(active_implementation() == name);
+    return 0;
+}
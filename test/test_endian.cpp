@@ -0,0 +1,81 @@
+#undef NDEBUG
+
+#include <cassert>
+#include <cstdlib>
+#include <string>
+
+#include "utf_convert.hpp"
+
+using namespace utf_convert;
+
+/*!
+ * Every length from none to a few registers, at every offset from an
+ * aligned start, against swapping unit by unit.
+ */
+void swap_test() {
+    std::u16string u16str;
+    std::u32string u32str;
+    for (size_t i = 0; i < 100; i++) {
+        u16str.push_back(std::rand() & 0xffff);
+        u32str.push_back(std::rand());
+    }
+
+    for (size_t offset = 0; offset < 8; offset++) {
+        for (size_t length = 0; offset + length <= u16str.size(); length++) {
+            std::u16string u16swapped = u16str;
+            std::u32string u32swapped = u32str;
+            swap_endian_inplace(&u16swapped[offset], length);
+            swap_endian_inplace(&u32swapped[offset], length);
+
+            for (size_t i = 0; i < u16str.size(); i++) {
+                const bool     in    = i >= offset && i < offset + length;
+                const uint16_t unit  = u16str[i];
+                const uint32_t unit4 = u32str[i];
+                assert(u16swapped[i] ==
+                       (in ? char16_t((unit >> 8) | (unit << 8)) : unit));
+                assert(u32swapped[i] ==
+                       (in ? char32_t((unit4 >> 24) | ((unit4 >> 8) & 0xff00) |
+                                      ((unit4 << 8) & 0xff0000) |
+                                      (unit4 << 24))
+                           : unit4));
+            }
+        }
+    }
+}
+
+/*!
+ * The native endian is the one of the string literals, and a string swapped
+ * from the other endian is the same as one converted to the native endian.
+ */
+void native_test() {
+    const std::string u8str = "na\xc3\xaf" "ve \xf0\x9f\x98\x80";
+    const UTF_ENDIAN  other = UTF_ENDIAN_NATIVE == UTF_ENDIAN_LITTLE_ENDIAN
+                                  ? UTF_ENDIAN_BIG_ENDIAN
+                                  : UTF_ENDIAN_LITTLE_ENDIAN;
+
+    std::u16string u16str;
+    std::u32string u32str;
+    assert(to_u16string(u8str, u16str, UTF_ENDIAN_NATIVE));
+    assert(u16str == u"na\u00efve \U0001f600");
+    assert(to_u32string(u8str, u32str, UTF_ENDIAN_NATIVE));
+    assert(u32str == U"na\u00efve \U0001f600");
+
+    std::u16string u16other;
+    std::u32string u32other;
+    assert(to_u16string(u8str, u16other, other));
+    assert(to_u32string(u8str, u32other, other));
+    assert(u16other != u16str && u32other != u32str);
+    swap_endian_inplace(u16other);
+    swap_endian_inplace(u32other);
+    assert(u16other == u16str && u32other == u32str);
+
+    std::u16string empty;
+    swap_endian_inplace(empty);
+    assert(empty.empty());
+}
+
+int main() {
+    swap_test();
+    native_test();
+    return 0;
+}
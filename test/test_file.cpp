@@ -0,0 +1,192 @@
+#undef NDEBUG
+
+#include <cassert>
+#include <cstdio>
+#include <string>
+
+#include "utf_convert.hpp"
+
+using namespace utf_convert;
+
+std::string read_file(const char *path) {
+    FILE *file = std::fopen(path, "rb");
+    assert(file != NULL);
+
+    std::string data;
+    char        buffer[4096];
+    for (size_t n; (n = std::fread(buffer, 1, sizeof(buffer), file)) > 0;) {
+        data.append(buffer, n);
+    }
+    std::fclose(file);
+    return data;
+}
+
+void write_file(const char *path, const std::string &data) {
+    FILE *file = std::fopen(path, "wb");
+    assert(file != NULL);
+    std::fwrite(data.data(), 1, data.size(), file);
+    std::fclose(file);
+}
+
+template <typename String>
+std::string to_bytes(const String &str) {
+    return std::string(reinterpret_cast<const char *>(str.data()),
+                       str.size() * sizeof(typename String::value_type));
+}
+
+void invalid_test() {
+    // Conversion stops at the stray continuation byte.
+    write_file("file_invalid.txt", "ab\x80" "cd");
+    result res = convert_file("file_invalid.txt", "file_out.txt",
+                              UTF_ENCODING_UTF8,
+                              UTF_ENCODING_UTF32_LITTLE_ENDIAN);
+    assert(res.error == UTF_ERROR_INVALID_SEQUENCE && res.count == 2);
+    assert(read_file("file_out.txt") == to_bytes(std::u32string(U"ab")));
+
+    // A trailing partial code unit is reported after the rest is converted.
+    write_file("file_invalid.txt", std::string("a\0b", 3));
+    res = convert_file("file_invalid.txt", "file_out.txt",
+                       UTF_ENCODING_UTF16_LITTLE_ENDIAN, UTF_ENCODING_UTF8);
+    assert(res.error == UTF_ERROR_INVALID_SEQUENCE && res.count == 1);
+    assert(read_file("file_out.txt") == "a");
+    res = convert_file("file_invalid.txt", "file_out.txt",
+                       UTF_ENCODING_UTF16_LITTLE_ENDIAN, UTF_ENCODING_UTF8,
+                       UTF_MODE_REPLACE);
+    assert(res.error == UTF_ERROR_NONE && res.count == 4);
+    assert(read_file("file_out.txt") == "a\xef\xbf\xbd");
+    res = convert_file("file_invalid.txt", "file_out.txt",
+                       UTF_ENCODING_UTF16_LITTLE_ENDIAN,
+                       UTF_ENCODING_UTF16_BIG_ENDIAN, UTF_MODE_REPLACE);
+    assert(res.error == UTF_ERROR_NONE && res.count == 2);
+    assert(read_file("file_out.txt") == std::string("\0a\xff\xfd", 4));
+
+    write_file("file_invalid.txt", "");
+    res = convert_file("file_invalid.txt", "file_out.txt", UTF_ENCODING_UTF8,
+                       UTF_ENCODING_UTF16_BIG_ENDIAN);
+    assert(res.error == UTF_ERROR_NONE && res.count == 0);
+    assert(read_file("file_out.txt").empty());
+
+    res = convert_file("file_missing.txt", "file_out.txt", UTF_ENCODING_UTF8,
+                       UTF_ENCODING_UTF16_BIG_ENDIAN);
+    assert(res.error == UTF_ERROR_FILE_IO);
+
+    // Converting a file onto itself fails and leaves it as it was.
+    write_file("file_invalid.txt", "same file");
+    res = convert_file("file_invalid.txt", "file_invalid.txt",
+                       UTF_ENCODING_UTF8, UTF_ENCODING_UTF16_LITTLE_ENDIAN);
+    assert(res.error == UTF_ERROR_FILE_IO);
+    res = convert_file("file_invalid.txt", "./file_invalid.txt",
+                       UTF_ENCODING_UTF8, UTF_ENCODING_UTF8);
+    assert(res.error == UTF_ERROR_FILE_IO);
+    assert(read_file("file_invalid.txt") == "same file");
+
+    std::remove("file_invalid.txt");
+    std::remove("file_out.txt");
+}
+
+/*!
+ * Outside of UTF_MODE_LENIENT, units copied to the same unit size are checked
+ * and replaced like in the other conversions.
+ */
+void mode_test() {
+    const char16_t lone[] = {0x61, 0xdc00, 0x62};
+    write_file("file_mode.txt", to_bytes(std::u16string(lone, 3)));
+    result res = convert_file("file_mode.txt", "file_out.txt",
+                              UTF_ENCODING_UTF16_LITTLE_ENDIAN,
+                              UTF_ENCODING_UTF16_BIG_ENDIAN);
+    assert(res.error == UTF_ERROR_NONE && res.count == 3);
+    assert(read_file("file_out.txt") == std::string("\0a\xdc\0\0b", 6));
+    res = convert_file("file_mode.txt", "file_out.txt",
+                       UTF_ENCODING_UTF16_LITTLE_ENDIAN,
+                       UTF_ENCODING_UTF16_BIG_ENDIAN, UTF_MODE_STRICT);
+    assert(res.error == UTF_ERROR_INVALID_SEQUENCE && res.count == 1);
+    assert(read_file("file_out.txt") == std::string("\0a", 2));
+    res = convert_file("file_mode.txt", "file_out.txt",
+                       UTF_ENCODING_UTF16_LITTLE_ENDIAN,
+                       UTF_ENCODING_UTF16_BIG_ENDIAN, UTF_MODE_REPLACE);
+    assert(res.error == UTF_ERROR_NONE && res.count == 3);
+    assert(read_file("file_out.txt") == std::string("\0a\xff\xfd\0b", 6));
+    res = convert_file("file_mode.txt", "file_out.txt",
+                       UTF_ENCODING_UTF16_LITTLE_ENDIAN, UTF_ENCODING_UTF8,
+                       UTF_MODE_REPLACE);
+    assert(res.error == UTF_ERROR_NONE);
+    assert(read_file("file_out.txt") == "a\xef\xbf\xbd" "b");
+
+    const char32_t large[] = {0x61, 0x110000, 0x62};
+    write_file("file_mode.txt", to_bytes(std::u32string(large, 3)));
+    res = convert_file("file_mode.txt", "file_out.txt",
+                       UTF_ENCODING_UTF32_LITTLE_ENDIAN,
+                       UTF_ENCODING_UTF32_LITTLE_ENDIAN, UTF_MODE_STRICT);
+    assert(res.error == UTF_ERROR_INVALID_SEQUENCE && res.count == 1);
+    assert(read_file("file_out.txt") == to_bytes(std::u32string(U"a")));
+    res = convert_file("file_mode.txt", "file_out.txt",
+                       UTF_ENCODING_UTF32_LITTLE_ENDIAN,
+                       UTF_ENCODING_UTF32_LITTLE_ENDIAN, UTF_MODE_REPLACE);
+    assert(res.error == UTF_ERROR_NONE && res.count == 3);
+    assert(read_file("file_out.txt") ==
+           to_bytes(std::u32string(U"a\ufffd" U"b")));
+
+    // An overlong form, which is two ill-formed bytes.
+    write_file("file_mode.txt", "a\xc0\xaf" "b");
+    res = convert_file("file_mode.txt", "file_out.txt", UTF_ENCODING_UTF8,
+                       UTF_ENCODING_UTF8);
+    assert(res.error == UTF_ERROR_NONE && res.count == 4);
+    res = convert_file("file_mode.txt", "file_out.txt", UTF_ENCODING_UTF8,
+                       UTF_ENCODING_UTF8, UTF_MODE_STRICT);
+    assert(res.error == UTF_ERROR_INVALID_SEQUENCE && res.count == 1);
+    assert(read_file("file_out.txt") == "a");
+    res = convert_file("file_mode.txt", "file_out.txt", UTF_ENCODING_UTF8,
+                       UTF_ENCODING_UTF8, UTF_MODE_REPLACE);
+    assert(res.error == UTF_ERROR_NONE && res.count == 8);
+    assert(read_file("file_out.txt") == "a\xef\xbf\xbd\xef\xbf\xbd" "b");
+
+    std::remove("file_mode.txt");
+    std::remove("file_out.txt");
+}
+
+int main(int argc, char **argv) {
+    invalid_test();
+    mode_test();
+
+    if (argc != 2)
+        return 0;
+
+    const std::string u8 = read_file(argv[1]);
+
+    std::u16string u16;
+    std::u32string u32;
+    assert(to_u16string(u8, u16, UTF_ENDIAN_LITTLE_ENDIAN));
+    assert(to_u32string(u8, u32, UTF_ENDIAN_BIG_ENDIAN));
+
+    result res = convert_file(argv[1], "file_u16le.txt", UTF_ENCODING_UTF8,
+                              UTF_ENCODING_UTF16_LITTLE_ENDIAN);
+    assert(res.error == UTF_ERROR_NONE && res.count == u16.size());
+    assert(read_file("file_u16le.txt") == to_bytes(u16));
+
+    res = convert_file("file_u16le.txt", "file_u32be.txt",
+                       UTF_ENCODING_UTF16_LITTLE_ENDIAN,
+                       UTF_ENCODING_UTF32_BIG_ENDIAN);
+    assert(res.error == UTF_ERROR_NONE && res.count == u32.size());
+    assert(read_file("file_u32be.txt") == to_bytes(u32));
+
+    res = convert_file("file_u32be.txt", "file_u8.txt",
+                       UTF_ENCODING_UTF32_BIG_ENDIAN, UTF_ENCODING_UTF8);
+    assert(res.error == UTF_ERROR_NONE && res.count == u8.size());
+    assert(read_file("file_u8.txt") == u8);
+
+    // Same code unit size, only the endian changes.
+    res = convert_file("file_u16le.txt", "file_u16be.txt",
+                       UTF_ENCODING_UTF16_LITTLE_ENDIAN,
+                       UTF_ENCODING_UTF16_BIG_ENDIAN);
+    assert(res.error == UTF_ERROR_NONE);
+    res = convert_file("file_u16be.txt", "file_u8.txt",
+                       UTF_ENCODING_UTF16_BIG_ENDIAN, UTF_ENCODING_UTF8);
+    assert(res.error == UTF_ERROR_NONE);
+    assert(read_file("file_u8.txt") == u8);
+
+    std::remove("file_u16le.txt");
+    std::remove("file_u16be.txt");
+    std::remove("file_u32be.txt");
+    std::remove("file_u8.txt");
+    return 0;
+}
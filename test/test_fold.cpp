@@ -0,0 +1,189 @@
+#undef NDEBUG
+
+#include <cassert>
+#include <cstdlib>
+#include <string>
+
+#include "utf_convert.hpp"
+
+using namespace utf_convert;
+
+const UTF_ENDIAN other_endian = UTF_ENDIAN_NATIVE == UTF_ENDIAN_LITTLE_ENDIAN
+                                    ? UTF_ENDIAN_BIG_ENDIAN
+                                    : UTF_ENDIAN_LITTLE_ENDIAN;
+
+/*!
+ * The fold of one character, to check the converters against.
+ */
+char32_t fold_char(char32_t ch, UTF_FOLD fold) {
+    if (fold == UTF_FOLD_NONE)
+        return ch;
+    if (ch >= 'A' && ch <= 'Z')
+        return ch + 0x20;
+    if (fold == UTF_FOLD_LATIN1 && ch >= 0xc0 && ch <= 0xde && ch != 0xd7)
+        return ch + 0x20;
+    return ch;
+}
+
+std::u32string fold_string(const std::u32string &str, UTF_FOLD fold) {
+    std::u32string res;
+    for (size_t i = 0; i < str.size(); i++) {
+        res.push_back(fold_char(str[i], fold));
+    }
+    return res;
+}
+
+/*!
+ * Only the characters of the fold change, whatever the encoding is.
+ */
+void example_test() {
+    const std::u32string u32str = U"Gr\u00dc\u00dfE \u00c0\u00d7\u00de\u00df "
+                                  U"\u00b5\u00ff\u0178 \u0100Z\U0001f600";
+
+    std::string    u8str;
+    std::u16string u16str;
+    std::u32string u32folded;
+    assert(to_u8string(u32str, UTF_ENDIAN_NATIVE, u8str, UTF_MODE_LENIENT,
+                       UTF_FOLD_ASCII));
+    assert(u8str == "gr\xc3\x9c\xc3\x9f" "e \xc3\x80\xc3\x97\xc3\x9e\xc3\x9f "
+                    "\xc2\xb5\xc3\xbf\xc5\xb8 \xc4\x80z\xf0\x9f\x98\x80");
+    assert(to_u16string(u32str, UTF_ENDIAN_NATIVE, u16str, UTF_ENDIAN_NATIVE,
+                        false, UTF_MODE_STRICT, UTF_FOLD_LATIN1));
+    assert(u16str == u"gr\u00fc\u00dfe \u00e0\u00d7\u00fe\u00df "
+                     u"\u00b5\u00ff\u0178 \u0100z\U0001f600");
+    assert(to_u32string(u8str, u32folded, UTF_ENDIAN_NATIVE, false,
+                        UTF_MODE_LENIENT, UTF_FOLD_LATIN1));
+    assert(u32folded == fold_string(u32str, UTF_FOLD_LATIN1));
+}
+
+/*!
+ * Random strings of characters around the folded ones, of lengths across the
+ * registers of the kernels and the blocks of the converters, in every
+ * encoding and endian, against the strings folded character by character.
+ */
+void random_test() {
+    const char32_t pool[] = {'A',   'M',   'Z',    'a',   'z',    '@',    '[',
+                             '0',   0x80,  0xb5,   0xbf,  0xc0,   0xc3,   0xd6,
+                             0xd7,  0xd8,  0xde,   0xdf,  0xe0,   0xff,   0x100,
+                             0x178, 0x4e2d, 0xfeff, 0x1f600};
+    const size_t   lengths[] = {0, 1, 7, 15, 16, 17, 31, 33, 100, 4095, 5000};
+    const UTF_FOLD folds[]   = {UTF_FOLD_ASCII, UTF_FOLD_LATIN1};
+    const UTF_MODE modes[]   = {UTF_MODE_LENIENT, UTF_MODE_STRICT,
+                                UTF_MODE_REPLACE};
+    const UTF_ENDIAN endians[] = {UTF_ENDIAN_NATIVE, other_endian};
+
+    const size_t pool_size = sizeof(pool) / sizeof(pool[0]);
+
+    for (size_t l = 0; l < sizeof(lengths) / sizeof(lengths[0]); l++) {
+        std::u32string u32str;
+        for (size_t i = 0; i < lengths[l]; i++) {
+            u32str.push_back(pool[std::rand() % pool_size]);
+        }
+        std::string    u8str;
+        std::u16string u16str;
+        assert(to_u8string(u32str, UTF_ENDIAN_NATIVE, u8str));
+        assert(to_u16string(u32str, UTF_ENDIAN_NATIVE, u16str,
+                            UTF_ENDIAN_NATIVE));
+
+        for (size_t f = 0; f < 2; f++) {
+            const std::u32string folded32 = fold_string(u32str, folds[f]);
+            std::string          folded8;
+            std::u16string       folded16;
+            assert(to_u8string(folded32, UTF_ENDIAN_NATIVE, folded8));
+            assert(to_u16string(folded32, UTF_ENDIAN_NATIVE, folded16,
+                                UTF_ENDIAN_NATIVE));
+
+            for (size_t m = 0; m < 3; m++) {
+                for (size_t e = 0; e < 2; e++) {
+                    const UTF_ENDIAN endian = endians[e];
+                    std::u16string   in16   = u16str;
+                    std::u32string   in32   = u32str;
+                    if (endian != UTF_ENDIAN_NATIVE) {
+                        swap_endian_inplace(in16);
+                        swap_endian_inplace(in32);
+                    }
+
+                    std::string    out8;
+                    std::u16string out16;
+                    std::u32string out32;
+                    assert(to_u8string(in32, endian, out8, modes[m], folds[f]));
+                    assert(out8 == folded8);
+                    assert(to_u8string(in16, endian, out8, modes[m], folds[f]));
+                    assert(out8 == folded8);
+
+                    assert(to_u16string(u8str, out16, endian, false, modes[m],
+                                        folds[f]));
+                    if (endian != UTF_ENDIAN_NATIVE)
+                        swap_endian_inplace(out16);
+                    assert(out16 == folded16);
+                    assert(to_u16string(in32, endian, out16, endian, false,
+                                        modes[m], folds[f]));
+                    if (endian != UTF_ENDIAN_NATIVE)
+                        swap_endian_inplace(out16);
+                    assert(out16 == folded16);
+
+                    assert(to_u32string(u8str, out32, endian, false, modes[m],
+                                        folds[f]));
+                    if (endian != UTF_ENDIAN_NATIVE)
+                        swap_endian_inplace(out32);
+                    assert(out32 == folded32);
+                    assert(to_u32string(in16, endian, out32, endian, false,
+                                        modes[m], folds[f]));
+                    if (endian != UTF_ENDIAN_NATIVE)
+                        swap_endian_inplace(out32);
+                    assert(out32 == folded32);
+                }
+            }
+        }
+    }
+}
+
+/*!
+ * Ill-formed input stops or is replaced at the same place as without the
+ * fold, and what was written before is folded.
+ */
+void invalid_test() {
+    std::string u8str;
+    for (size_t i = 0; i < 5000; i++) {
+        u8str += i % 3 == 0 ? "\xc3\x89" : "Q";
+    }
+    u8str[4500] = '\xc3';  // Lead byte without its continuation byte.
+    u8str[4501] = 'Q';
+
+    std::u32string out(u8str.size(), 0);
+    result         res = convert_utf8_to_utf32(
+        u8str.data(), u8str.size(), &out[0], out.size(), UTF_ENDIAN_NATIVE,
+        UTF_MODE_STRICT, UTF_FOLD_LATIN1);
+    assert(res.error == UTF_ERROR_INVALID_SEQUENCE && res.count == 4500);
+    std::u32string prefix;
+    assert(to_u32string(u8str.substr(0, 4500), prefix, UTF_ENDIAN_NATIVE));
+    assert(out.compare(0, prefix.size(),
+                       fold_string(prefix, UTF_FOLD_LATIN1)) == 0);
+
+    std::u32string replaced;
+    std::u32string folded;
+    assert(to_u32string(u8str, replaced, UTF_ENDIAN_NATIVE, false,
+                        UTF_MODE_REPLACE));
+    assert(to_u32string(u8str, folded, UTF_ENDIAN_NATIVE, false,
+                        UTF_MODE_REPLACE, UTF_FOLD_ASCII));
+    assert(folded == fold_string(replaced, UTF_FOLD_ASCII));
+
+    // A full buffer stops at the same place too.
+    std::string u8out(100, 0);
+    res = convert_utf32_to_utf8(&replaced[0], replaced.size(), &u8out[0],
+                                u8out.size(), UTF_ENDIAN_NATIVE,
+                                UTF_MODE_LENIENT, UTF_FOLD_LATIN1);
+    assert(res.error == UTF_ERROR_OUTPUT_TOO_SMALL);
+    std::string expected;
+    assert(to_u8string(fold_string(replaced.substr(0, res.count),
+                                   UTF_FOLD_LATIN1),
+                       UTF_ENDIAN_NATIVE, expected));
+    assert(u8out.compare(0, expected.size(), expected) == 0);
+}
+
+int main() {
+    example_test();
+    random_test();
+    invalid_test();
+    return 0;
+}
@@ -0,0 +1,85 @@
+#undef NDEBUG
+
+#include <cassert>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include "utf_convert.hpp"
+
+using namespace utf_convert;
+
+/*!
+ * Random text of 1 to 4 byte code points, with the offset of each one and
+ * the size at the end.
+ */
+std::string make_text(size_t count, std::vector<size_t> &offsets) {
+    const char *const chars[] = {"a", "\xc3\xa9", "\xe4\xbd\xa0",
+                                 "\xf0\x9f\x98\x80"};
+    std::string text;
+    offsets.clear();
+    for (size_t i = 0; i < count; i++) {
+        offsets.push_back(text.size());
+        // Runs of ascii between the others, for the blocks of the kernels.
+        text += chars[std::rand() % 3 == 0 ? std::rand() % 4 : 0];
+    }
+    offsets.push_back(text.size());
+    return text;
+}
+
+void offset_test() {
+    std::vector<size_t> offsets;
+    const std::string   text = make_text(3000, offsets);
+
+    for (size_t cp = 0; cp < offsets.size() + 5; cp++) {
+        const size_t expected = cp < offsets.size() ? offsets[cp] : text.size();
+        assert(codepoint_offset(text.data(), text.size(), cp) == expected);
+    }
+
+    const size_t samples[] = {0, 1, 3, 64, 5000};
+    for (size_t s = 0; s < 5; s++) {
+        const utf8_index index(text.data(), text.size(), samples[s]);
+        assert(index.size() == 3000);
+        for (size_t cp = 0; cp < offsets.size() + 5; cp++) {
+            const size_t expected =
+                cp < offsets.size() ? offsets[cp] : text.size();
+            assert(index.offset(cp) == expected);
+        }
+        assert(index.substr(10, 20) == text.substr(offsets[10],
+                                                   offsets[30] - offsets[10]));
+        assert(index.substr(2990) == text.substr(offsets[2990]));
+        assert(index.substr(2990, 1000) == text.substr(offsets[2990]));
+        assert(index.substr(5000).empty());
+    }
+}
+
+void substr_test() {
+    const std::string str = "caf\xc3\xa9 \xe4\xbd\xa0\xe5\xa5\xbd \xf0\x9f\x98\x80!";
+
+    assert(substr_codepoints(str, 0, 4) == "caf\xc3\xa9");
+    assert(substr_codepoints(str, 5, 2) == "\xe4\xbd\xa0\xe5\xa5\xbd");
+    assert(substr_codepoints(str, 8) == "\xf0\x9f\x98\x80!");
+    assert(substr_codepoints(str, 9, 0).empty());
+    assert(substr_codepoints(str, 10).empty());
+    assert(substr_codepoints(str, 100, 3).empty());
+    assert(substr_codepoints("", 0).empty());
+
+    const utf8_index empty("", 0);
+    assert(empty.size() == 0 && empty.offset(0) == 0 && empty.offset(7) == 0);
+
+    // Ill-formed bytes are counted like utf32_length_from_utf8 counts them:
+    // the continuation bytes go with the code point before them.
+    const std::string bad = "\x80\x80" "a\xff\xbf" "b";
+    assert(codepoint_offset(bad.data(), bad.size(), 0) == 2);
+    assert(codepoint_offset(bad.data(), bad.size(), 2) == 5);
+    assert(substr_codepoints(bad, 1, 1) == "\xff\xbf");
+    const utf8_index index(bad.data(), bad.size(), 2);
+    assert(index.size() == utf32_length_from_utf8(bad.data(), bad.size()));
+    assert(index.offset(1) == 3 && index.offset(2) == 5);
+}
+
+int main() {
+    offset_test();
+    substr_test();
+    return 0;
+}
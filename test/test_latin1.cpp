@@ -0,0 +1,232 @@
+#undef NDEBUG
+
+#include <cassert>
+#include <cstdint>
+#include <cstdlib>
+#include <string>
+
+#include "test_util.hpp"
+#include "utf_convert.hpp"
+
+using namespace utf_convert;
+
+const UTF_ENDIAN  endians[]  = {UTF_ENDIAN_LITTLE_ENDIAN, UTF_ENDIAN_BIG_ENDIAN};
+const UTF_CHARSET charsets[] = {UTF_CHARSET_LATIN1, UTF_CHARSET_WINDOWS_1252};
+
+// Windows-1252 0x80 ~ 0x9f, from the mapping table of the Unicode Consortium.
+const uint32_t cp1252[32] = {
+    0x20ac, 0x81,   0x201a, 0x0192, 0x201e, 0x2026, 0x2020, 0x2021,
+    0x02c6, 0x2030, 0x0160, 0x2039, 0x0152, 0x8d,   0x017d, 0x8f,
+    0x90,   0x2018, 0x2019, 0x201c, 0x201d, 0x2022, 0x2013, 0x2014,
+    0x02dc, 0x2122, 0x0161, 0x203a, 0x0153, 0x9d,   0x017e, 0x0178};
+
+uint32_t decode(unsigned char byte, UTF_CHARSET charset) {
+    if (charset == UTF_CHARSET_WINDOWS_1252 && byte >= 0x80 && byte < 0xa0)
+        return cp1252[byte - 0x80];
+    return byte;
+}
+
+/*!
+ * Convert str both ways in every encoding and check it against the
+ * conversion byte by byte.
+ */
+void check(const std::string &str, UTF_CHARSET charset) {
+    std::string    u8str;
+    std::u16string u16str[2];
+    std::u32string u32str[2];
+    for (size_t i = 0; i < str.size(); i++) {
+        const uint32_t value = decode(str[i], charset);
+        append_u8(u8str, value);
+        for (size_t e = 0; e < 2; e++) {
+            u16str[e].push_back(make_u16(value, endians[e]));
+            u32str[e].push_back(make_u32(value, endians[e]));
+        }
+    }
+
+    std::string target;
+    assert(utf8_length_from_latin1(str.data(), str.size(), charset) ==
+           u8str.size());
+    assert(latin1_to_utf8(str, target, charset) && target == u8str);
+    assert(utf8_to_latin1(u8str, target, UTF_MODE_STRICT, charset));
+    assert(target == str);
+
+    for (size_t e = 0; e < 2; e++) {
+        std::u16string u16target;
+        std::u32string u32target;
+        assert(latin1_to_utf16(str, u16target, endians[e], charset));
+        assert(u16target == u16str[e]);
+        assert(latin1_to_utf32(str, u32target, endians[e], charset));
+        assert(u32target == u32str[e]);
+
+        assert(utf16_to_latin1(u16str[e], endians[e], target,
+                               UTF_MODE_LENIENT, charset));
+        assert(target == str);
+        assert(utf32_to_latin1(u32str[e], endians[e], target,
+                               UTF_MODE_STRICT, charset));
+        assert(target == str);
+    }
+}
+
+/*!
+ * Every byte, on its own and in long strings where the kernels and the scalar
+ * code take turns.
+ */
+void round_trip_test() {
+    for (size_t c = 0; c < 2; c++) {
+        std::string all;
+        for (int byte = 0; byte < 256; byte++)
+            all.push_back(byte);
+        check(all, charsets[c]);
+
+        std::string text;
+        for (size_t i = 0; i < 5000; i++) {
+            const int kind = std::rand() % 8;
+            text.push_back(kind == 0   ? 0x80 + std::rand() % 32
+                           : kind == 1 ? 0xa0 + std::rand() % 96
+                                       : 0x20 + std::rand() % 96);
+        }
+        for (size_t offset = 0; offset < 4; offset++)
+            check(text.substr(offset), charsets[c]);
+
+        // Long runs of Latin-1 letters between Windows-1252 punctuation.
+        std::string runs;
+        for (size_t i = 0; i < 40; i++) {
+            runs += std::string(std::rand() % 200, '\xe9');
+            runs += std::string(std::rand() % 200, 'a');
+            runs += '\x93';
+        }
+        check(runs, charsets[c]);
+    }
+}
+
+/*!
+ * Characters out of the character set stop the conversion, or are replaced.
+ */
+void out_of_range_test() {
+    const std::string u8str = "caf\xc3\xa9 \xe2\x82\xac 5 \xc2\x80!";
+    std::string       target;
+
+    // The euro sign is only in Windows-1252, U+0080 only in Latin-1.
+    assert(!utf8_to_latin1(u8str, target) && target == "caf\xe9 ");
+    assert(!utf8_to_latin1(u8str, target, UTF_MODE_LENIENT,
+                           UTF_CHARSET_WINDOWS_1252));
+    assert(target == "caf\xe9 \x80 5 ");
+    assert(utf8_to_latin1(u8str, target, UTF_MODE_REPLACE));
+    assert(target == "caf\xe9 ? 5 \x80!");
+    assert(utf8_to_latin1(u8str, target, UTF_MODE_REPLACE,
+                          UTF_CHARSET_WINDOWS_1252));
+    assert(target == "caf\xe9 \x80 5 ?!");
+
+    // Sequences cut by the registers, and bytes out of range in long text.
+    for (size_t pos = 0; pos < 70; pos++) {
+        std::string long_str(100, 'a'), expected(99, 'a');
+        long_str.replace(pos, 2, "\xc3\xa9");
+        expected[pos] = '\xe9';
+        assert(utf8_to_latin1(long_str, target, UTF_MODE_STRICT));
+        assert(target == expected);
+
+        long_str.replace(pos, 2, "\xc4\x80");
+        const result res = convert_utf8_to_latin1(
+            long_str.data(), long_str.size(), &target[0], target.size());
+        assert(res.error == UTF_ERROR_INVALID_SEQUENCE && res.count == pos);
+        long_str.replace(pos, 2, "a\x80");
+        assert(!utf8_to_latin1(long_str, target, UTF_MODE_STRICT));
+        assert(target == std::string(pos + 1, 'a'));
+    }
+
+    char         out[32];
+    const result res = convert_utf8_to_latin1(u8str.data(), u8str.size(), out,
+                                              sizeof(out));
+    assert(res.error == UTF_ERROR_INVALID_SEQUENCE && res.count == 6);
+
+    // Each maximal subpart of an ill-formed sequence is a single '?'.
+    const std::string bad = "a\xff\xe2\x82z\xc3";
+    assert(!utf8_to_latin1(bad, target, UTF_MODE_STRICT) && target == "a");
+    assert(utf8_to_latin1(bad, target, UTF_MODE_REPLACE) && target == "a??z?");
+
+    for (size_t e = 0; e < 2; e++) {
+        // A surrogate pair is one character, and a lone surrogate is one too.
+        std::u16string u16str;
+        u16str.push_back(make_u16('x', endians[e]));
+        u16str.push_back(make_u16(0xd83d, endians[e]));
+        u16str.push_back(make_u16(0xde00, endians[e]));
+        u16str.push_back(make_u16(0xdc00, endians[e]));
+        u16str.push_back(make_u16(0x0152, endians[e]));
+        assert(!utf16_to_latin1(u16str, endians[e], target) && target == "x");
+        assert(utf16_to_latin1(u16str, endians[e], target, UTF_MODE_REPLACE));
+        assert(target == "x???");
+        assert(utf16_to_latin1(u16str, endians[e], target, UTF_MODE_REPLACE,
+                               UTF_CHARSET_WINDOWS_1252));
+        assert(target == "x??\x8c");
+
+        std::u32string u32str;
+        u32str.push_back(make_u32(0xff, endians[e]));
+        u32str.push_back(make_u32(0x110000, endians[e]));
+        u32str.push_back(make_u32(0x100, endians[e]));
+        assert(!utf32_to_latin1(u32str, endians[e], target) &&
+               target == "\xff");
+        assert(!utf32_to_latin1(u32str, endians[e], target, UTF_MODE_STRICT));
+        assert(utf32_to_latin1(u32str, endians[e], target, UTF_MODE_REPLACE));
+        assert(target == "\xff??");
+    }
+}
+
+/*!
+ * A full buffer stops the conversion where it can be continued.
+ */
+void buffer_test() {
+    std::string str;
+    for (size_t i = 0; i < 300; i++)
+        str.push_back(i % 3 ? 'a' + i % 26 : 0x80 + i % 128);
+
+    for (size_t c = 0; c < 2; c++) {
+        std::string expected;
+        assert(latin1_to_utf8(str, expected, charsets[c]));
+
+        for (size_t cap = 1; cap < expected.size(); cap += 37) {
+            std::string out(expected.size(), '\0');
+            result      res = convert_latin1_to_utf8(
+                str.data(), str.size(), &out[0], cap, charsets[c]);
+            assert(res.error == UTF_ERROR_OUTPUT_TOO_SMALL);
+
+            const size_t written =
+                utf8_length_from_latin1(str.data(), res.count, charsets[c]);
+            assert(written <= cap);
+            res = convert_latin1_to_utf8(str.data() + res.count,
+                                         str.size() - res.count,
+                                         &out[written],
+                                         out.size() - written,
+                                         charsets[c]);
+            assert(res.error == UTF_ERROR_NONE && out == expected);
+        }
+
+        std::u16string u16str(str.size(), 0);
+        result res = convert_latin1_to_utf16(str.data(), str.size(), &u16str[0],
+                                             100, UTF_ENDIAN_BIG_ENDIAN,
+                                             charsets[c]);
+        assert(res.error == UTF_ERROR_OUTPUT_TOO_SMALL && res.count == 100);
+
+        char narrow[64];
+        res = convert_utf8_to_latin1(expected.data(), expected.size(), narrow,
+                                     sizeof(narrow), UTF_MODE_LENIENT,
+                                     charsets[c]);
+        assert(res.error == UTF_ERROR_OUTPUT_TOO_SMALL);
+        assert(utf32_length_from_utf8(expected.data(), res.count) == 64);
+        assert(std::memcmp(narrow, str.data(), sizeof(narrow)) == 0);
+    }
+
+    const result res = convert_latin1_to_utf32(
+        str.data(), str.size(), NULL, 0, static_cast<UTF_ENDIAN>(2));
+    assert(res.error == UTF_ERROR_UNSUPPORTED_ENDIAN);
+}
+
+int main() {
+    std::string target = "x";
+    assert(latin1_to_utf8("", target) && target.empty());
+    assert(utf8_to_latin1("", target) && target.empty());
+
+    round_trip_test();
+    out_of_range_test();
+    buffer_test();
+    return 0;
+}
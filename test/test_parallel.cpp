@@ -0,0 +1,105 @@
+#undef NDEBUG
+
+#include <cassert>
+#include <string>
+
+#include "utf_convert.hpp"
+
+using namespace utf_convert;
+
+const size_t thread_counts[] = {1, 3, 4};
+
+void u8_test(const std::string &u8) {
+    std::u32string ans;
+    bool           ok = to_u32string(u8, ans, UTF_ENDIAN_BIG_ENDIAN);
+
+    for (size_t i = 0; i < sizeof(thread_counts) / sizeof(size_t); i++) {
+        std::u32string u32;
+        assert(parallel_to_u32string(u8, u32, UTF_ENDIAN_BIG_ENDIAN,
+                                     thread_counts[i]) == ok);
+        assert(u32 == ans);
+    }
+}
+
+void u16_test(const std::u16string &u16, UTF_ENDIAN endian) {
+    std::string    u8_ans;
+    std::u32string u32_ans;
+    bool           u8_ok  = to_u8string(u16, endian, u8_ans);
+    bool           u32_ok = to_u32string(u16, endian, u32_ans,
+                                         UTF_ENDIAN_LITTLE_ENDIAN);
+
+    for (size_t i = 0; i < sizeof(thread_counts) / sizeof(size_t); i++) {
+        std::string    u8;
+        std::u32string u32;
+        assert(parallel_to_u8string(u16, endian, u8, thread_counts[i]) ==
+               u8_ok);
+        assert(u8 == u8_ans);
+        assert(parallel_to_u32string(u16, endian, u32,
+                                     UTF_ENDIAN_LITTLE_ENDIAN,
+                                     thread_counts[i]) == u32_ok);
+        assert(u32 == u32_ans);
+    }
+}
+
+void u32_test(const std::u32string &u32, UTF_ENDIAN endian) {
+    std::string ans;
+    bool        ok = to_u8string(u32, endian, ans);
+
+    for (size_t i = 0; i < sizeof(thread_counts) / sizeof(size_t); i++) {
+        std::string u8;
+        assert(parallel_to_u8string(u32, endian, u8, thread_counts[i]) == ok);
+        assert(u8 == ans);
+    }
+}
+
+int main() {
+    // Large enough to be split into several chunks.
+    std::string u8;
+    while (u8.size() < (4 << 20) + 32) {
+        u8 += "text \xc3\xa9\xe4\xbd\xa0\xf0\x9f\x98\x80 ";
+    }
+    u8_test(u8);
+
+    std::u16string u16_little, u16_big;
+    std::u32string u32_little, u32_big;
+    assert(to_u16string(u8, u16_little, UTF_ENDIAN_LITTLE_ENDIAN));
+    assert(to_u16string(u8, u16_big, UTF_ENDIAN_BIG_ENDIAN));
+    assert(to_u32string(u8, u32_little, UTF_ENDIAN_LITTLE_ENDIAN));
+    assert(to_u32string(u8, u32_big, UTF_ENDIAN_BIG_ENDIAN));
+    u16_test(u16_little, UTF_ENDIAN_LITTLE_ENDIAN);
+    u16_test(u16_big, UTF_ENDIAN_BIG_ENDIAN);
+    u32_test(u32_little, UTF_ENDIAN_LITTLE_ENDIAN);
+    u32_test(u32_big, UTF_ENDIAN_BIG_ENDIAN);
+
+    // Sequences the lenient decoder accepts across natural split points, and
+    // failures inside a later chunk.
+    std::string lenient = u8;
+    for (size_t i = 1; i < 7; i++) {
+        lenient.replace(lenient.size() / 7 * i - 1, 3, "\xe4" "ab");
+    }
+    u8_test(lenient);
+
+    std::string invalid = u8;
+    invalid[invalid.size() / 4 * 3 + 1] = '\x80';
+    u8_test(invalid);
+    invalid[invalid.size() / 2] = '\xf0';
+    u8_test(invalid);
+
+    std::u16string u16 = u16_little;
+    for (size_t i = 1; i < 7; i++) {
+        u16[u16.size() / 7 * i] = 0xdc00;
+    }
+    u16_test(u16, UTF_ENDIAN_LITTLE_ENDIAN);
+    u16[u16.size() / 3 * 2] = 0xd800;
+    u16[u16.size() / 3 * 2 + 1] = u'x';
+    u16_test(u16, UTF_ENDIAN_LITTLE_ENDIAN);
+
+    std::u32string u32 = u32_little;
+    u32[u32.size() / 5 * 4] = 0x110000;
+    u32_test(u32, UTF_ENDIAN_LITTLE_ENDIAN);
+
+    // Small strings are converted on the calling thread.
+    u8_test("Hello, \xe4\xb8\x96\xe7\x95\x8c");
+    u8_test("bad \x80");
+    return 0;
+}
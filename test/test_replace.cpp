@@ -0,0 +1,306 @@
+#undef NDEBUG
+
+#include <cassert>
+#include <cstdint>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include "test_util.hpp"
+#include "utf_convert.hpp"
+
+using namespace utf_convert;
+
+const UTF_ENDIAN endians[] = {UTF_ENDIAN_LITTLE_ENDIAN, UTF_ENDIAN_BIG_ENDIAN};
+
+/*!
+ * The utf-8 decoder of the WHATWG Encoding Standard, byte by byte, giving the
+ * input with every maximal subpart of an ill-formed sequence replaced.
+ */
+std::string whatwg_decode(const std::string &in) {
+    std::string res;
+    uint32_t    value  = 0;
+    size_t      needed = 0;
+    size_t      seen   = 0;
+    uint8_t     lower  = 0x80;
+    uint8_t     upper  = 0xbf;
+    for (size_t i = 0; i < in.size(); i++) {
+        const uint8_t b = in[i];
+        if (needed == 0) {
+            if (b < 0x80) {
+                res.push_back(b);
+            } else if (b >= 0xc2 && b <= 0xdf) {
+                needed = 1;
+                value  = b & 0x1f;
+            } else if (b >= 0xe0 && b <= 0xef) {
+                lower  = b == 0xe0 ? 0xa0 : 0x80;
+                upper  = b == 0xed ? 0x9f : 0xbf;
+                needed = 2;
+                value  = b & 0x0f;
+            } else if (b >= 0xf0 && b <= 0xf4) {
+                lower  = b == 0xf0 ? 0x90 : 0x80;
+                upper  = b == 0xf4 ? 0x8f : 0xbf;
+                needed = 3;
+                value  = b & 0x07;
+            } else {
+                append_u8(res, 0xfffd);
+            }
+            continue;
+        }
+
+        if (b < lower || b > upper) {
+            value = needed = seen = 0;
+            lower                 = 0x80;
+            upper                 = 0xbf;
+            append_u8(res, 0xfffd);
+            i--;  // The byte starts over.
+            continue;
+        }
+        lower = 0x80;
+        upper = 0xbf;
+        value = (value << 6) | (b & 0x3f);
+        if (++seen == needed) {
+            append_u8(res, value);
+            value = needed = seen = 0;
+        }
+    }
+    if (needed != 0)
+        append_u8(res, 0xfffd);
+    return res;
+}
+
+/*!
+ * Convert ill-formed utf-8 with replacement, through the buffer API and the
+ * string wrappers, and compare with the reference decoder.
+ */
+void check_u8(const std::string &in) {
+    const std::string expected = whatwg_decode(in);
+    assert(validate_utf8(expected.data(), expected.size()).error ==
+           UTF_ERROR_NONE);
+
+    for (size_t e = 0; e < 2; e++) {
+        std::u16string expected16;
+        std::u32string expected32;
+        to_u16string(expected, expected16, endians[e]);
+        to_u32string(expected, expected32, endians[e]);
+
+        // One unit per byte is always enough.
+        std::vector<char16_t> out16(in.size());
+        result res = convert_utf8_to_utf16(in.data(), in.size(), out16.data(),
+                                           out16.size(), endians[e],
+                                           UTF_MODE_REPLACE);
+        assert(res.error == UTF_ERROR_NONE);
+        assert(std::u16string(out16.data(), res.count) == expected16);
+
+        std::vector<char32_t> out32(in.size());
+        res = convert_utf8_to_utf32(in.data(), in.size(), out32.data(),
+                                    out32.size(), endians[e],
+                                    UTF_MODE_REPLACE);
+        assert(res.error == UTF_ERROR_NONE);
+        assert(std::u32string(out32.data(), res.count) == expected32);
+
+        std::u16string u16;
+        std::u32string u32;
+        assert(to_u16string(in, u16, endians[e], true, UTF_MODE_REPLACE));
+        assert(u16.substr(1) == expected16);
+        assert(to_u32string(in, u32, endians[e], false, UTF_MODE_REPLACE));
+        assert(u32 == expected32);
+    }
+}
+
+/*!
+ * A full buffer stops the conversion where it can be continued, also right
+ * at a replacement.
+ */
+void resume_test() {
+    const std::string in = "a\xe4\xbd" "b\xff\xff" "c";
+    for (size_t cap = 0; cap < 8; cap++) {
+        std::u32string out;
+        size_t         pos = 0;
+        while (pos < in.size()) {
+            std::vector<char32_t> buf(cap + 1);
+            const result          res = convert_utf8_to_utf32(
+                in.data() + pos, in.size() - pos, buf.data(), cap + 1,
+                UTF_ENDIAN_LITTLE_ENDIAN, UTF_MODE_REPLACE);
+            if (res.error == UTF_ERROR_NONE) {
+                out.append(buf.data(), res.count);
+                break;
+            }
+            assert(res.error == UTF_ERROR_OUTPUT_TOO_SMALL);
+            // The units written so far are those of the input before count.
+            std::u32string part;
+            to_u32string(in.substr(pos, res.count), part,
+                         UTF_ENDIAN_LITTLE_ENDIAN, false, UTF_MODE_REPLACE);
+            out += part;
+            pos += res.count;
+        }
+
+        std::u32string expected;
+        to_u32string(whatwg_decode(in), expected, UTF_ENDIAN_LITTLE_ENDIAN);
+        assert(out == expected);
+    }
+}
+
+/*!
+ * The utf-16 units of values, in the host's order. Values below 0x10000,
+ * surrogates included, are one unit on their own.
+ */
+std::vector<uint32_t> u16_units(const std::vector<uint32_t> &values) {
+    std::vector<uint32_t> res;
+    for (size_t i = 0; i < values.size(); i++) {
+        const uint32_t value = values[i];
+        if (value >= 0x10000) {
+            res.push_back(0xd800 | ((value - 0x10000) >> 10));
+            res.push_back(0xdc00 | (value & 0x3ff));
+        } else {
+            res.push_back(value);
+        }
+    }
+    return res;
+}
+
+/*!
+ * Unpaired surrogates and invalid utf-32 characters.
+ */
+void check_u16_u32(const std::vector<uint32_t> &values) {
+    // Reference conversions to utf-8. Lone surrogates next to each other may
+    // still make a pair in utf-16.
+    std::string expected32;
+    for (size_t i = 0; i < values.size(); i++) {
+        const uint32_t value = values[i];
+        const bool     valid =
+            value < 0xd800 || (value >= 0xe000 && value <= 0x10ffff);
+        append_u8(expected32, valid ? value : 0xfffd);
+    }
+
+    std::vector<uint32_t> units;
+    for (size_t i = 0; i < values.size(); i++) {
+        if (values[i] <= 0x10ffff)
+            units.push_back(values[i]);
+    }
+    units = u16_units(units);
+    std::string expected16;
+    for (size_t i = 0; i < units.size(); i++) {
+        const uint32_t unit = units[i];
+        if (unit >= 0xd800 && unit < 0xdc00 && i + 1 < units.size() &&
+            units[i + 1] >= 0xdc00 && units[i + 1] < 0xe000) {
+            append_u8(expected16, 0x10000 + ((unit - 0xd800) << 10) +
+                                      (units[i + 1] - 0xdc00));
+            i++;
+        } else {
+            append_u8(expected16,
+                      unit >= 0xd800 && unit < 0xe000 ? 0xfffd : unit);
+        }
+    }
+
+    for (size_t e = 0; e < 2; e++) {
+        const UTF_ENDIAN endian = endians[e];
+        std::u16string   u16;
+        std::u32string   u32;
+        for (size_t i = 0; i < units.size(); i++) {
+            u16.push_back(make_u16(units[i], endian));
+        }
+        for (size_t i = 0; i < values.size(); i++) {
+            u32.push_back(make_u32(values[i], endian));
+        }
+
+        std::string u8;
+        assert(to_u8string(u16, endian, u8, UTF_MODE_REPLACE));
+        assert(u8 == expected16);
+        assert(to_u8string(u32, endian, u8, UTF_MODE_REPLACE));
+        assert(u8 == expected32);
+
+        for (size_t f = 0; f < 2; f++) {
+            std::u16string u16_res;
+            std::u16string u16_expected;
+            assert(to_u16string(u32, endian, u16_res, endians[f], false,
+                                UTF_MODE_REPLACE));
+            to_u16string(expected32, u16_expected, endians[f]);
+            assert(u16_res == u16_expected);
+
+            std::u32string u32_res;
+            std::u32string u32_expected;
+            assert(to_u32string(u16, endian, u32_res, endians[f], false,
+                                UTF_MODE_REPLACE));
+            to_u32string(expected16, u32_expected, endians[f]);
+            assert(u32_res == u32_expected);
+        }
+    }
+}
+
+int main() {
+    // The examples of the Unicode Standard, section 3.9, and the WHATWG
+    // Encoding Standard.
+    const std::string example = "\x61\xf1\x80\x80\xe1\x80\xc2\x62\x80\x63\x80"
+                                "\xbf\x64";
+    assert(whatwg_decode(example) ==
+           "a\xef\xbf\xbd\xef\xbf\xbd\xef\xbf\xbd"
+           "b\xef\xbf\xbd"
+           "c\xef\xbf\xbd\xef\xbf\xbd"
+           "d");
+    check_u8(example);
+
+    const char *cases[] = {"\xc0\xaf",         "\xe0\x80\xaf",
+                           "\xed\xa0\x80",     "\xf4\x90\x80\x80",
+                           "\xf0\x9f\x98",     "\xff",
+                           "\xe4\xbd",         "\xf8\x88\x80\x80\x80",
+                           "\xf0\x9f\x98\x80", ""};
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+        check_u8(cases[i]);
+    }
+
+    // Strict mode still stops at the first error.
+    std::u16string u16;
+    assert(!to_u16string(example, u16, UTF_ENDIAN_LITTLE_ENDIAN, false,
+                         UTF_MODE_STRICT));
+    assert(u16.size() == 1);
+
+    resume_test();
+
+    // Batches are sized for the replacements too, lone high surrogates
+    // included.
+    std::u16string highs;
+    for (uint32_t unit = 0xd800; unit < 0xd803; unit++) {
+        highs.push_back(make_u16(unit, UTF_ENDIAN_LITTLE_ENDIAN));
+    }
+    const char16_t *    strs[]    = {highs.data(), highs.data() + 1};
+    const size_t        lengths[] = {1, 2};
+    std::string         u8;
+    std::vector<size_t> offsets;
+    assert(batch_to_u8string(strs, lengths, 2, UTF_ENDIAN_LITTLE_ENDIAN, u8,
+                             offsets, UTF_MODE_REPLACE));
+    assert(u8 == "\xef\xbf\xbd\xef\xbf\xbd\xef\xbf\xbd" && offsets[1] == 3);
+
+    // Random bytes, mostly well-formed, long enough for the vectorized
+    // kernels and for several validation blocks.
+    const char *pieces[] = {"a", "\xc3\xa9", "\xe4\xbd\xa0", "\xf0\x9f\x98\x80",
+                            "\x80", "\xe4\xbd", "\xed\xa0\x80", "\xff"};
+    std::srand(1);
+    for (size_t round = 0; round < 300; round++) {
+        std::string in;
+        size_t      n = std::rand() % (round % 10 == 0 ? 6000 : 100);
+        for (size_t i = 0; i < n; i++) {
+            const size_t k = std::rand() % 32;
+            in += pieces[k < 24 ? k % 4 : 4 + k % 4];
+        }
+        check_u8(in);
+    }
+
+    for (size_t round = 0; round < 300; round++) {
+        const size_t          n = std::rand() % (round % 10 == 0 ? 3000 : 50);
+        std::vector<uint32_t> values(n);
+        for (size_t i = 0; i < values.size(); i++) {
+            const int kind = std::rand() % 16;
+            if (kind == 0)
+                values[i] = 0xd800 + std::rand() % 0x800;
+            else if (kind == 1)
+                values[i] = 0x110000 + std::rand() % 100;
+            else if (kind == 2)
+                values[i] = 0x10000 + std::rand() % 0x100000;
+            else
+                values[i] = std::rand() % 0x800;
+        }
+        check_u16_u32(values);
+    }
+    return 0;
+}
@@ -0,0 +1,184 @@
+#undef NDEBUG
+
+#include <cassert>
+#include <cstdio>
+#include <cstdlib>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "utf_convert.hpp"
+
+using namespace utf_convert;
+
+/*!
+ * Sink keeping the output and the size of each block, which stops after
+ * limit blocks.
+ */
+struct collect_sink {
+    std::string         output;
+    std::vector<size_t> blocks;
+    size_t              limit = size_t(-1);
+
+    bool operator()(const char *data, size_t size) {
+        if (blocks.size() == limit)
+            return false;
+        output.append(data, size);
+        blocks.push_back(size);
+        return true;
+    }
+};
+
+std::string make_text() {
+    const char *const chars[] = {"a", "\xc3\xa9", "\xe4\xbd\xa0",
+                                 "\xf0\x9f\x98\x80"};
+    std::string       u8str;
+    while (u8str.size() < 5 * sink_block_size)
+        u8str += chars[std::rand() % 4];
+    return u8str;
+}
+
+/*!
+ * The output comes in blocks of at most sink_block_size bytes, cut between
+ * characters, and adds up to the whole conversion.
+ */
+void block_test() {
+    const std::string u8str = make_text();
+    const UTF_ENDIAN  endians[] = {UTF_ENDIAN_LITTLE_ENDIAN,
+                                   UTF_ENDIAN_BIG_ENDIAN};
+
+    for (size_t e = 0; e < 2; e++) {
+        std::u16string u16str;
+        std::u32string u32str;
+        assert(to_u16string(u8str, u16str, endians[e]));
+        assert(to_u32string(u8str, u32str, endians[e]));
+
+        collect_sink sink;
+        result       res = write_utf16_as_utf8(u16str.data(), u16str.size(),
+                                               endians[e], sink);
+        assert(res.error == UTF_ERROR_NONE && res.count == u8str.size());
+        assert(sink.output == u8str && sink.blocks.size() > 4);
+        for (size_t i = 0; i + 1 < sink.blocks.size(); i++)
+            assert(sink.blocks[i] <= sink_block_size &&
+                   sink.blocks[i] > sink_block_size - 4);
+        assert(sink.blocks.back() <= sink_block_size);
+
+        collect_sink u32sink;
+        res = write_utf32_as_utf8(u32str.data(), u32str.size(), endians[e],
+                                  u32sink, UTF_MODE_STRICT);
+        assert(res.error == UTF_ERROR_NONE && res.count == u8str.size());
+        assert(u32sink.output == u8str);
+    }
+
+    collect_sink empty;
+    const result res =
+        write_utf16_as_utf8(u"", 0, UTF_ENDIAN_LITTLE_ENDIAN, empty);
+    assert(res.error == UTF_ERROR_NONE && res.count == 0);
+    assert(empty.blocks.empty());
+}
+
+/*!
+ * The modes apply as with a buffer, and a sink can stop the conversion.
+ */
+void error_test() {
+    std::u16string u16str(sink_block_size + 10, u'x');
+    u16str[sink_block_size + 5] = 0xdc00;
+
+    collect_sink sink;
+    result       res = write_utf16_as_utf8(u16str.data(), u16str.size(),
+                                           UTF_ENDIAN_NATIVE, sink,
+                                           UTF_MODE_STRICT);
+    assert(res.error == UTF_ERROR_INVALID_SEQUENCE);
+    assert(res.count == sink_block_size + 5);
+    assert(sink.output == std::string(sink_block_size + 5, 'x'));
+
+    sink = collect_sink();
+    res  = write_utf16_as_utf8(u16str.data(), u16str.size(), UTF_ENDIAN_NATIVE,
+                               sink, UTF_MODE_REPLACE);
+    assert(res.error == UTF_ERROR_NONE && res.count == u16str.size() + 2);
+    assert(sink.output.substr(sink_block_size + 5, 4) == "\xef\xbf\xbdx");
+
+    const std::string u8str = make_text();
+    std::u32string    u32str;
+    assert(to_u32string(u8str, u32str, UTF_ENDIAN_NATIVE));
+    sink       = collect_sink();
+    sink.limit = 2;
+    res = write_utf32_as_utf8(u32str.data(), u32str.size(), UTF_ENDIAN_NATIVE,
+                              sink);
+    assert(res.error == UTF_ERROR_FILE_IO);
+    assert(utf8_length_from_utf32(u32str.data(), res.count,
+                                  UTF_ENDIAN_NATIVE) == sink.output.size());
+    assert(u8str.compare(0, sink.output.size(), sink.output) == 0);
+}
+
+/*!
+ * The sinks of the library, and a plain function.
+ */
+bool count_bytes(void *context, const char *, size_t size) {
+    *static_cast<size_t *>(context) += size;
+    return true;
+}
+
+void stream_test() {
+    const std::string u8str = make_text();
+    std::u16string    u16str;
+    assert(to_u16string(u8str, u16str, UTF_ENDIAN_LITTLE_ENDIAN));
+
+    std::ostringstream stream;
+    ostream_sink       stream_sink(stream);
+    assert(write_utf16_as_utf8(u16str.data(), u16str.size(),
+                               UTF_ENDIAN_LITTLE_ENDIAN, stream_sink)
+               .error == UTF_ERROR_NONE);
+    assert(stream.str() == u8str);
+
+    // Round trip through a file: what file_sink wrote converts back to the
+    // input, from utf-16 and from utf-32.
+    std::u32string u32str;
+    assert(to_u32string(u8str, u32str, UTF_ENDIAN_BIG_ENDIAN));
+    for (size_t i = 0; i < 2; i++) {
+        std::FILE *file = std::tmpfile();
+        assert(file != NULL);
+        file_sink sink(file);
+        const result written =
+            i == 0 ? write_utf16_as_utf8(u16str.data(), u16str.size(),
+                                         UTF_ENDIAN_LITTLE_ENDIAN, sink)
+                   : write_utf32_as_utf8(u32str.data(), u32str.size(),
+                                         UTF_ENDIAN_BIG_ENDIAN, sink);
+        assert(written.error == UTF_ERROR_NONE &&
+               written.count == u8str.size());
+        std::rewind(file);
+        std::string content(u8str.size() + 1, '\0');
+        assert(std::fread(&content[0], 1, content.size(), file) ==
+               u8str.size());
+        content.resize(u8str.size());
+        std::fclose(file);
+
+        assert(content == u8str);
+        std::u16string u16back;
+        std::u32string u32back;
+        assert(to_u16string(content, u16back, UTF_ENDIAN_LITTLE_ENDIAN));
+        assert(to_u32string(content, u32back, UTF_ENDIAN_BIG_ENDIAN));
+        assert(u16back == u16str && u32back == u32str);
+    }
+
+    size_t       count = 0;
+    const result res   = write_utf16_as_utf8(u16str.data(), u16str.size(),
+                                             UTF_ENDIAN_LITTLE_ENDIAN,
+                                             count_bytes, &count);
+    assert(res.error == UTF_ERROR_NONE && count == u8str.size());
+
+    // A failing stream stops the conversion.
+    std::ostringstream failed;
+    failed.setstate(std::ios::badbit);
+    ostream_sink failed_sink(failed);
+    assert(write_utf16_as_utf8(u16str.data(), u16str.size(),
+                               UTF_ENDIAN_LITTLE_ENDIAN, failed_sink)
+               .error == UTF_ERROR_FILE_IO);
+}
+
+int main() {
+    block_test();
+    error_test();
+    stream_test();
+    return 0;
+}
@@ -0,0 +1,116 @@
+#undef NDEBUG
+
+#include <cassert>
+#include <cstring>
+#include <string>
+#include <thread>
+
+#include "utf_convert.hpp"
+
+using namespace utf_convert;
+
+const conversion_stats &of(const stats &s, UTF_CONVERSION conversion) {
+    return s.conversions[conversion];
+}
+
+/*!
+ * Without the statistics, every counter stays zero.
+ */
+void disabled_test() {
+    std::u16string u16str;
+    assert(to_u16string("some text", u16str, UTF_ENDIAN_LITTLE_ENDIAN));
+
+    const stats      s    = stats_snapshot();
+    conversion_stats zero = {};
+    for (size_t c = 0; c < UTF_CONVERSION_COUNT; c++) {
+        assert(std::memcmp(&s.conversions[c], &zero, sizeof(zero)) == 0);
+    }
+    assert(std::strcmp(s.implementation, active_implementation()) == 0);
+}
+
+/*!
+ * The counters of a conversion, which the vectorized kernels take the long
+ * ascii run of, and leave the rest of to the scalar code.
+ */
+void counters_test() {
+    const std::string u8str = std::string(1000, 'a') + "\xc3\xa9t\xc3\xa9";
+    std::u16string    u16str;
+
+    reset_stats();
+    assert(to_u16string(u8str, u16str, UTF_ENDIAN_BIG_ENDIAN));
+
+    stats s = stats_snapshot();
+    const conversion_stats &u8_to_u16 = of(s, UTF_CONVERSION_UTF8_TO_UTF16);
+    assert(u8_to_u16.calls == 1);
+    assert(u8_to_u16.bytes_in == u8str.size());
+    assert(u8_to_u16.bytes_out == 2 * u16str.size());
+    assert(u8_to_u16.kernel_bytes_in <= u8_to_u16.bytes_in);
+    if (std::strcmp(s.implementation, "scalar") != 0) {
+        assert(u8_to_u16.kernel_bytes_in >= 992);
+        assert(u8_to_u16.scalar_fallbacks == 1);
+    } else {
+        assert(u8_to_u16.kernel_bytes_in == 0);
+    }
+    assert(of(s, UTF_CONVERSION_UTF8_TO_UTF32).calls == 0);
+
+    // Ill-formed input, stopped at, replaced or out of the buffer.
+    const std::string bad = "a\xff" "b\xfe";
+    std::string       target;
+    reset_stats();
+    assert(!to_u16string(bad, u16str, UTF_ENDIAN_LITTLE_ENDIAN, false,
+                         UTF_MODE_STRICT));
+    assert(to_u16string(bad, u16str, UTF_ENDIAN_LITTLE_ENDIAN, false,
+                        UTF_MODE_REPLACE));
+    char16_t out[4];
+    assert(convert_utf8_to_utf16(u8str.data(), u8str.size(), out, 4,
+                                 UTF_ENDIAN_LITTLE_ENDIAN)
+               .error == UTF_ERROR_OUTPUT_TOO_SMALL);
+    assert(convert_utf32_to_utf8(U"x", 1, &target[0], 0,
+                                 static_cast<UTF_ENDIAN>(2))
+               .error == UTF_ERROR_UNSUPPORTED_ENDIAN);
+
+    s = stats_snapshot();
+    assert(of(s, UTF_CONVERSION_UTF8_TO_UTF16).invalid_sequences == 3);
+    assert(of(s, UTF_CONVERSION_UTF8_TO_UTF16).output_too_small == 1);
+    assert(of(s, UTF_CONVERSION_UTF32_TO_UTF8).other_errors == 1);
+
+    reset_stats();
+    s = stats_snapshot();
+    assert(of(s, UTF_CONVERSION_UTF8_TO_UTF16).calls == 0);
+}
+
+/*!
+ * The counters of other threads are summed, also after they end.
+ */
+void thread_test() {
+    reset_stats();
+
+    std::thread threads[4];
+    for (size_t i = 0; i < 4; i++) {
+        threads[i] = std::thread([] {
+            std::string target;
+            for (size_t k = 0; k < 100; k++) {
+                assert(latin1_to_utf8("caf\xe9", target));
+            }
+        });
+    }
+    for (size_t i = 0; i < 4; i++) {
+        threads[i].join();
+    }
+
+    const stats s = stats_snapshot();
+    assert(of(s, UTF_CONVERSION_LATIN1_TO_UTF8).calls == 400);
+    assert(of(s, UTF_CONVERSION_LATIN1_TO_UTF8).bytes_in == 1600);
+    assert(of(s, UTF_CONVERSION_LATIN1_TO_UTF8).bytes_out == 2000);
+}
+
+int main() {
+    if (!stats_enabled()) {
+        disabled_test();
+        return 0;
+    }
+
+    counters_test();
+    thread_test();
+    return 0;
+}
@@ -0,0 +1,126 @@
+#undef NDEBUG
+
+#include <algorithm>
+#include <cassert>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <string>
+
+#include "test_util.hpp"
+#include "utf_convert.hpp"
+
+using namespace utf_convert;
+
+/*!
+ * Decode u8 in chunks of every size from 1 to max_chunk in turn.
+ */
+void decode_test(const std::string &u8, size_t max_chunk) {
+    std::u32string u32_ans;
+    std::u16string u16_ans;
+    assert(to_u32string(u8, u32_ans, UTF_ENDIAN_LITTLE_ENDIAN));
+    assert(to_u16string(u8, u16_ans, UTF_ENDIAN_BIG_ENDIAN));
+
+    stream_decoder u32_decoder;
+    stream_decoder u16_decoder(UTF_ENDIAN_BIG_ENDIAN);
+    std::u32string u32, u32_chunk;
+    std::u16string u16, u16_chunk;
+
+    for (size_t pos = 0, size = 1; pos < u8.size(); size = size % max_chunk + 1) {
+        const size_t length = std::min(size, u8.size() - pos);
+        assert(u32_decoder.decode(u8.data() + pos, length, u32_chunk));
+        assert(u16_decoder.decode(u8.data() + pos, length, u16_chunk));
+        u32 += u32_chunk;
+        u16 += u16_chunk;
+        pos += length;
+    }
+    assert(u32_decoder.finish());
+    assert(u16_decoder.finish());
+    assert(u32 == u32_ans);
+    assert(u16 == u16_ans);
+}
+
+void encode_test(const std::u16string &u16, size_t max_chunk) {
+    std::string ans;
+    assert(to_u8string(u16, UTF_ENDIAN_LITTLE_ENDIAN, ans));
+
+    stream_encoder encoder(UTF_ENDIAN_LITTLE_ENDIAN);
+    std::string    u8, chunk;
+
+    for (size_t pos = 0, size = 1; pos < u16.size(); size = size % max_chunk + 1) {
+        const size_t length = std::min(size, u16.size() - pos);
+        assert(encoder.encode(u16.data() + pos, length, chunk));
+        u8 += chunk;
+        pos += length;
+    }
+    assert(encoder.finish());
+    assert(u8 == ans);
+}
+
+int main(int argc, char **argv) {
+    std::string    u8;
+    std::u16string u16;
+    for (size_t i = 0; i < 20; i++) {
+        u8 += "ascii \xc3\xa9\xe4\xbd\xa0\xf0\x9f\x98\x80 text";
+        u16 += u"ascii é你\U0001f600 text";
+    }
+    for (size_t max_chunk = 1; max_chunk < 40; max_chunk++) {
+        decode_test(u8, max_chunk);
+        encode_test(u16, max_chunk);
+    }
+
+    // A four-byte sequence split over three chunks.
+    stream_decoder decoder;
+    std::u32string u32;
+    assert(decoder.decode("a\xf0\x9f", 3, u32) && u32 == U"a");
+    assert(decoder.decode("\x98", 1, u32) && u32.empty());
+    assert(decoder.decode("\x80z", 2, u32) && u32 == U"\U0001f600z");
+    assert(decoder.finish());
+
+    // The input ends in the middle of a sequence.
+    assert(decoder.decode("b\xe4\xbd", 3, u32) && u32 == U"b");
+    assert(!decoder.finish());
+
+    // Invalid input still fails, keeping the characters before it.
+    assert(!decoder.decode("cd\x80", 3, u32) && u32 == U"cd");
+    assert(decoder.finish());
+
+    // A surrogate pair split over two chunks, and a high surrogate at the end.
+    stream_encoder encoder;
+    const char16_t pair[] = {u'a', 0xd83d, 0xde00};
+    std::string    chunk;
+    assert(encoder.encode(pair, 2, chunk) && chunk == "a");
+    assert(encoder.encode(pair + 2, 1, chunk) && chunk == "\xf0\x9f\x98\x80");
+    assert(encoder.encode(pair, 2, chunk) && chunk == "a");
+    assert(!encoder.finish());
+
+    // A high surrogate followed by a character other than a low surrogate.
+    assert(encoder.encode(pair, 2, chunk) && chunk == "a");
+    assert(!encoder.encode(pair, 1, chunk) && chunk.empty());
+
+    if (argc != 3)
+        return 0;
+
+    FILE *u8_file = std::fopen(argv[1], "rb");
+    char  buffer[4096];
+    u8.clear();
+    for (size_t n; (n = std::fread(buffer, 1, sizeof(buffer), u8_file)) > 0;) {
+        u8.append(buffer, n);
+    }
+    std::fclose(u8_file);
+
+    std::fstream u16_file(argv[2]);
+    std::string  temp;
+    u16.clear();
+    while (u16_file >> temp) {
+        const uint32_t value = read_hex(temp);
+        if (value > 0xffff)
+            u16.push_back(value >> 16);
+        u16.push_back(value & 0xffff);
+    }
+    u16_file.close();
+
+    decode_test(u8, 4096);
+    encode_test(u16, 4096);
+    return 0;
+}
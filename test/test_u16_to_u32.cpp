@@ -0,0 +1,136 @@
+#undef NDEBUG
+
+#include <cassert>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "test_util.hpp"
+#include "utf_convert.hpp"
+
+using namespace utf_convert;
+
+/*!
+ * Convert both ways between every combination of endians.
+ */
+void simple_test(const std::u16string &u16, const std::u32string &u32) {
+    std::u16string u16_big;
+    std::u32string u32_big;
+    for (size_t i = 0; i < u16.size(); i++) {
+        u16_big.push_back(swap_endian(u16[i]));
+    }
+    for (size_t i = 0; i < u32.size(); i++) {
+        u32_big.push_back(swap_endian(u32[i]));
+    }
+
+    assert(utf32_length_from_utf16(u16.data(), u16.size(),
+                                   UTF_ENDIAN_LITTLE_ENDIAN) == u32.size());
+    assert(utf32_length_from_utf16(u16_big.data(), u16_big.size(),
+                                   UTF_ENDIAN_BIG_ENDIAN) == u32.size());
+    assert(utf16_length_from_utf32(u32.data(), u32.size(),
+                                   UTF_ENDIAN_LITTLE_ENDIAN) == u16.size());
+    assert(utf16_length_from_utf32(u32_big.data(), u32_big.size(),
+                                   UTF_ENDIAN_BIG_ENDIAN) == u16.size());
+
+    std::u32string res32;
+    assert(to_u32string(u16, UTF_ENDIAN_LITTLE_ENDIAN, res32,
+                        UTF_ENDIAN_LITTLE_ENDIAN));
+    assert(res32 == u32);
+    assert(to_u32string(u16_big, UTF_ENDIAN_BIG_ENDIAN, res32,
+                        UTF_ENDIAN_LITTLE_ENDIAN));
+    assert(res32 == u32);
+    assert(to_u32string(u16, UTF_ENDIAN_LITTLE_ENDIAN, res32,
+                        UTF_ENDIAN_BIG_ENDIAN, true));
+    assert(res32 == std::u32string(1, swap_endian(char32_t(0xfeff))) + u32_big);
+
+    std::u16string res16;
+    assert(to_u16string(u32, UTF_ENDIAN_LITTLE_ENDIAN, res16,
+                        UTF_ENDIAN_LITTLE_ENDIAN));
+    assert(res16 == u16);
+    assert(to_u16string(u32_big, UTF_ENDIAN_BIG_ENDIAN, res16,
+                        UTF_ENDIAN_LITTLE_ENDIAN, true));
+    assert(res16 == std::u16string(1, 0xfeff) + u16);
+    assert(to_u16string(u32, UTF_ENDIAN_LITTLE_ENDIAN, res16,
+                        UTF_ENDIAN_BIG_ENDIAN));
+    assert(res16 == u16_big);
+}
+
+void invalid_test() {
+    // An unpaired high surrogate fails after the valid prefix is converted.
+    std::u16string u16(40, u'x');
+    u16.push_back(0xd800);
+    u16 += std::u16string(40, u'y');
+
+    std::u32string u32;
+    assert(!to_u32string(u16, UTF_ENDIAN_LITTLE_ENDIAN, u32,
+                         UTF_ENDIAN_LITTLE_ENDIAN));
+    assert(u32 == std::u32string(40, U'x'));
+
+    // A lone low surrogate is kept as it is, like to_u8string does.
+    u16[40] = 0xdc00;
+    assert(to_u32string(u16, UTF_ENDIAN_LITTLE_ENDIAN, u32,
+                        UTF_ENDIAN_LITTLE_ENDIAN));
+    assert(u32.size() == 81 && u32[40] == 0xdc00);
+
+    // Characters above 0x10ffff can not be encoded.
+    u32[60] = 0x110000;
+    std::u16string converted;
+    assert(!to_u16string(u32, UTF_ENDIAN_LITTLE_ENDIAN, converted,
+                         UTF_ENDIAN_LITTLE_ENDIAN));
+    assert(converted == u16.substr(0, 60));
+
+    // The buffer API reports where it stopped.
+    std::vector<char16_t> buffer(u16.size());
+    result                res = convert_utf32_to_utf16(
+        u32.data(), u32.size(), buffer.data(), buffer.size(),
+        UTF_ENDIAN_LITTLE_ENDIAN, UTF_ENDIAN_LITTLE_ENDIAN);
+    assert(res.error == UTF_ERROR_INVALID_SEQUENCE && res.count == 60);
+
+    std::vector<char32_t> out(20);
+    res = convert_utf16_to_utf32(u16.data(), u16.size(), out.data(), out.size(),
+                                 UTF_ENDIAN_LITTLE_ENDIAN,
+                                 UTF_ENDIAN_LITTLE_ENDIAN);
+    assert(res.error == UTF_ERROR_OUTPUT_TOO_SMALL && res.count == 20);
+}
+
+int main(int argc, char **argv) {
+    simple_test(u"Hello, world!", U"Hello, world!");
+    simple_test(u"你好，世界！", U"你好，世界！");
+
+    // Long enough to go through the vectorized kernels.
+    std::u16string u16;
+    std::u32string u32;
+    for (size_t i = 0; i < 100; i++) {
+        u16 += u"ascii é߿ࠀ￿\U00010000\U0010ffff text";
+        u32 += U"ascii é߿ࠀ￿\U00010000\U0010ffff text";
+        simple_test(u16, u32);
+    }
+
+    invalid_test();
+
+    if (argc != 3)
+        return 0;
+
+    std::fstream u16_file(argv[1]);
+    std::string  temp;
+    u16.clear();
+    while (u16_file >> temp) {
+        const uint32_t value = read_hex(temp);
+        if (value > 0xffff)
+            u16.push_back(value >> 16);
+        u16.push_back(value & 0xffff);
+    }
+    u16_file.close();
+
+    std::fstream u32_file(argv[2]);
+    u32.clear();
+    while (u32_file >> temp) {
+        u32.push_back(read_hex(temp));
+    }
+    u32_file.close();
+
+    simple_test(u16, u32);
+    return 0;
+}
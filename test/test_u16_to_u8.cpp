@@ -1,3 +1,5 @@
+#undef NDEBUG
+
 #include <array>
 #include <cassert>
 #include <cstdio>
@@ -7,24 +9,11 @@
 #include <string>
 #include <vector>
 
+#include "test_util.hpp"
 #include "utf_convert.hpp"
 
 using namespace utf_convert;
 
-uint32_t read_hex(const std::string &str) {
-    uint32_t res = 0;
-    for (size_t i = 0; i < str.size(); i++) {
-        if (str[i] >= '0' && str[i] <= '9') {
-            res = res * 16 + str[i] - '0';
-        } else if (str[i] >= 'a' && str[i] <= 'f') {
-            res = res * 16 + str[i] - 'a' + 10;
-        } else if (str[i] >= 'A' && str[i] <= 'F') {
-            res = res * 16 + str[i] - 'A' + 10;
-        }
-    }
-    return res;
-}
-
 void simple_test(const std::vector<int> &arr, const std::string &ans) {
     std::u16string u16;
     for (size_t i = 0; i < arr.size(); i++) {
@@ -46,7 +35,89 @@ void simple_test(const std::vector<int> &arr, const std::string &ans) {
     assert(u8 == ans);
 }
 
+void vector_test() {
+    // Long enough to go through the vectorized encoders, with surrogate pairs
+    // and lone low surrogates at every position of a block.
+    const uint32_t chars[] = {0x41, 0x7f, 0xe9, 0x7ff, 0x800, 0x4f60, 0xffff,
+                              0x10000, 0x1f600, 0x10ffff, 0xdc00};
+    std::u16string u16, u16_big;
+    std::string    ans;
+    uint32_t       seed = 1;
+    for (size_t i = 0; i < 1000; i++) {
+        seed             = seed * 1103515245 + 12345;
+        const uint32_t c = chars[(seed >> 16) % 11];
+        if (c >= 0x10000) {
+            u16.push_back(0xd800 + ((c - 0x10000) >> 10));
+            u16.push_back(0xdc00 + ((c - 0x10000) & 0x3ff));
+        } else {
+            u16.push_back(c);
+        }
+        append_u8(ans, c);
+
+        if (i % 50 == 0 || i > 950) {
+            assert(utf8_length_from_utf16(u16.data(), u16.size(),
+                                          UTF_ENDIAN_LITTLE_ENDIAN) ==
+                   ans.size());
+
+            std::string u8;
+            assert(to_u8string(u16, UTF_ENDIAN_LITTLE_ENDIAN, u8));
+            assert(u8 == ans);
+
+            u16_big.clear();
+            for (size_t j = 0; j < u16.size(); j++) {
+                u16_big.push_back((u16[j] << 8) | (u16[j] >> 8));
+            }
+            assert(utf8_length_from_utf16(u16_big.data(), u16_big.size(),
+                                          UTF_ENDIAN_BIG_ENDIAN) == ans.size());
+            assert(to_u8string(u16_big, UTF_ENDIAN_BIG_ENDIAN, u8));
+            assert(u8 == ans);
+        }
+    }
+
+    // A high surrogate without a low one fails after the valid prefix.
+    std::u16string invalid(40, u'x');
+    invalid.push_back(0xd800);
+    invalid += std::u16string(40, u'y');
+
+    std::string u8;
+    assert(!to_u8string(invalid, UTF_ENDIAN_LITTLE_ENDIAN, u8));
+    assert(u8 == std::string(40, 'x'));
+}
+
+void buffer_test() {
+    // "a" U+00e9 U+4f60 U+1f600 "z" takes 1 + 2 + 3 + 4 + 1 bytes.
+    const char16_t u16[] = {0x0061, 0x00e9, 0x4f60, 0xd83d, 0xde00, 0x007a};
+    const char    ans[]  = "a\xc3\xa9\xe4\xbd\xa0\xf0\x9f\x98\x80z";
+    char          out[16];
+
+    result res =
+        convert_utf16_to_utf8(u16, 6, out, sizeof(out), UTF_ENDIAN_LITTLE_ENDIAN);
+    assert(res.error == UTF_ERROR_NONE && res.count == 11);
+    assert(std::string(out, res.count) == ans);
+
+    // Stops before the surrogate pair which does not fit, and resumes there.
+    res = convert_utf16_to_utf8(u16, 6, out, 8, UTF_ENDIAN_LITTLE_ENDIAN);
+    assert(res.error == UTF_ERROR_OUTPUT_TOO_SMALL && res.count == 3);
+    res = convert_utf16_to_utf8(
+        u16 + 3, 3, out + 6, sizeof(out) - 6, UTF_ENDIAN_LITTLE_ENDIAN);
+    assert(res.error == UTF_ERROR_NONE && res.count == 5);
+    assert(std::string(out, 11) == ans);
+
+    // The position of an unpaired high surrogate is reported.
+    const char16_t invalid[] = {0x0061, 0xd83d, 0x0062};
+    res = convert_utf16_to_utf8(
+        invalid, 3, out, sizeof(out), UTF_ENDIAN_LITTLE_ENDIAN);
+    assert(res.error == UTF_ERROR_INVALID_SEQUENCE && res.count == 1);
+
+    res = convert_utf16_to_utf8(
+        u16, 6, out, sizeof(out), static_cast<UTF_ENDIAN>(2));
+    assert(res.error == UTF_ERROR_UNSUPPORTED_ENDIAN);
+}
+
 int main(int argc, char **argv) {
+    vector_test();
+    buffer_test();
+
     std::vector<int> vec1{0x0048,
                           0x0065,
                           0x006c,
@@ -0,0 +1,119 @@
+#undef NDEBUG
+
+#include <cassert>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "test_util.hpp"
+#include "utf_convert.hpp"
+
+using namespace utf_convert;
+
+void simple_test(const std::u32string &u32, const std::string &ans) {
+    assert(utf8_length_from_utf32(u32.data(), u32.size(),
+                                  UTF_ENDIAN_LITTLE_ENDIAN) == ans.size());
+
+    std::string u8;
+    assert(to_u8string(u32, UTF_ENDIAN_LITTLE_ENDIAN, u8));
+    assert(u8 == ans);
+
+    std::u32string u32_big;
+    for (size_t i = 0; i < u32.size(); i++) {
+        u32_big.push_back(swap_endian(u32[i]));
+    }
+    assert(utf8_length_from_utf32(u32_big.data(), u32_big.size(),
+                                  UTF_ENDIAN_BIG_ENDIAN) == ans.size());
+    assert(to_u8string(u32_big, UTF_ENDIAN_BIG_ENDIAN, u8));
+    assert(u8 == ans);
+}
+
+void buffer_test() {
+    std::u32string u32;
+    std::string    ans;
+    for (size_t i = 0; i < 20; i++) {
+        u32 += U"text \u00e9\u4f60\U0001f600";
+        ans += "text \xc3\xa9\xe4\xbd\xa0\xf0\x9f\x98\x80";
+    }
+
+    // Convert through a small buffer piece by piece.
+    std::string u8;
+    size_t      pos = 0;
+    char        out[7];
+    for (;;) {
+        result res = convert_utf32_to_utf8(u32.data() + pos, u32.size() - pos,
+                                           out, sizeof(out),
+                                           UTF_ENDIAN_LITTLE_ENDIAN);
+        if (res.error == UTF_ERROR_NONE) {
+            u8.append(out, res.count);
+            break;
+        }
+        assert(res.error == UTF_ERROR_OUTPUT_TOO_SMALL && res.count > 0);
+        u8.append(out, utf8_length_from_utf32(u32.data() + pos, res.count,
+                                              UTF_ENDIAN_LITTLE_ENDIAN));
+        pos += res.count;
+    }
+    assert(u8 == ans);
+
+    std::vector<char> buffer(ans.size());
+    result            res = convert_utf32_to_utf8(u32.data(), u32.size(),
+                                       buffer.data(), buffer.size(),
+                                       UTF_ENDIAN_LITTLE_ENDIAN);
+    assert(res.error == UTF_ERROR_NONE && res.count == ans.size());
+    assert(std::string(buffer.begin(), buffer.end()) == ans);
+
+    u32[50] = 0x110000;
+    res     = convert_utf32_to_utf8(u32.data(), u32.size(), buffer.data(),
+                                buffer.size(), UTF_ENDIAN_LITTLE_ENDIAN);
+    assert(res.error == UTF_ERROR_INVALID_SEQUENCE && res.count == 50);
+}
+
+int main(int argc, char **argv) {
+    simple_test(U"Hello, world!", "Hello, world!");
+    simple_test(U"你好，世界！", "你好，世界！");
+    buffer_test();
+
+    // Long enough to go through the vectorized encoders.
+    std::u32string u32;
+    std::string    ans;
+    for (size_t i = 0; i < 100; i++) {
+        u32 += U"ascii \u00e9\u07ff\u0800\uffff\U00010000\U0010ffff text";
+        ans += "ascii \xc3\xa9\xdf\xbf\xe0\xa0\x80\xef\xbf\xbf"
+               "\xf0\x90\x80\x80\xf4\x8f\xbf\xbf text";
+        simple_test(u32, ans);
+    }
+
+    // Out of range characters fail after the valid prefix is converted.
+    std::u32string invalid(40, U'x');
+    invalid.push_back(0x110000);
+    invalid += std::u32string(40, U'y');
+
+    std::string u8;
+    assert(!to_u8string(invalid, UTF_ENDIAN_LITTLE_ENDIAN, u8));
+    assert(u8 == std::string(40, 'x'));
+
+    if (argc != 3)
+        return 0;
+
+    std::fstream   u32_file(argv[1]);
+    std::string    temp;
+    std::u32string u32_data;
+
+    while (u32_file >> temp) {
+        u32_data.push_back(read_hex(temp));
+    }
+    u32_file.close();
+
+    std::string u8_data;
+    assert(to_u8string(u32_data, UTF_ENDIAN_LITTLE_ENDIAN, u8_data));
+    FILE *out = std::fopen("out.txt", "w");
+    std::fwrite(u8_data.data(), 1, u8_data.size(), out);
+    std::fclose(out);
+
+    std::string cmd = "diff out.txt ";
+    cmd += std::string(argv[2]);
+    assert(!std::system(cmd.c_str()));
+    return 0;
+}
@@ -0,0 +1,103 @@
+#undef NDEBUG
+
+#include <cassert>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "test_util.hpp"
+#include "utf_convert.hpp"
+
+using namespace utf_convert;
+
+void simple_test(const std::string &u8, const std::u16string &ans) {
+    assert(utf16_length_from_utf8(u8.data(), u8.size()) == ans.size());
+
+    std::u16string u16;
+    assert(to_u16string(u8, u16, UTF_ENDIAN_LITTLE_ENDIAN));
+    assert(u16 == ans);
+
+    std::u16string u16_big;
+    u16_big.push_back(0xfffe);
+    for (size_t i = 0; i < ans.size(); i++) {
+        u16_big.push_back(swap_endian(ans[i]));
+    }
+    assert(to_u16string(u8, u16, UTF_ENDIAN_BIG_ENDIAN, true));
+    assert(u16 == u16_big);
+}
+
+void buffer_test() {
+    std::string    u8;
+    std::u16string ans;
+    for (size_t i = 0; i < 30; i++) {
+        u8 += "text \xc3\xa9\xe4\xbd\xa0\xf0\x9f\x98\x80";
+        ans += u"text é你\U0001f600";
+    }
+
+    std::u16string out(ans.size(), 0);
+    result         res = convert_utf8_to_utf16(u8.data(), u8.size(), &out[0],
+                                       out.size(), UTF_ENDIAN_LITTLE_ENDIAN);
+    assert(res.error == UTF_ERROR_NONE && res.count == ans.size());
+    assert(out == ans);
+
+    // The last surrogate pair does not fit.
+    res = convert_utf8_to_utf16(u8.data(), u8.size(), &out[0], out.size() - 1,
+                                UTF_ENDIAN_LITTLE_ENDIAN);
+    assert(res.error == UTF_ERROR_OUTPUT_TOO_SMALL);
+    assert(res.count == u8.size() - 4);
+}
+
+int main(int argc, char **argv) {
+    simple_test("Hello, world!", u"Hello, world!");
+    simple_test("你好，世界！", u"你好，世界！");
+    simple_test("\xf0\x9f\x98\x80\xf4\x8f\xbf\xbf", u"\U0001f600\U0010ffff");
+
+    // Long enough to go through the vectorized decoders.
+    std::string    u8;
+    std::u16string ans;
+    for (size_t i = 0; i < 100; i++) {
+        u8 += "ascii \xc3\xa9\xdf\xbf\xe0\xa0\x80\xef\xbf\xbf"
+              "\xf0\x90\x80\x80\xf4\x8f\xbf\xbf text";
+        ans += u"ascii é߿ࠀ￿\U00010000\U0010ffff text";
+        simple_test(u8, ans);
+    }
+
+    buffer_test();
+
+    // Characters above 0x10ffff fail after the valid prefix is converted.
+    std::string invalid(40, 'x');
+    invalid += "\xf4\x90\x80\x80";
+    invalid += std::string(40, 'y');
+
+    std::u16string u16;
+    assert(!to_u16string(invalid, u16, UTF_ENDIAN_LITTLE_ENDIAN));
+    assert(u16 == std::u16string(40, u'x'));
+
+    if (argc != 3)
+        return 0;
+
+    FILE *u8_file = std::fopen(argv[1], "rb");
+    char  buffer[4096];
+    u8.clear();
+    for (size_t n; (n = std::fread(buffer, 1, sizeof(buffer), u8_file)) > 0;) {
+        u8.append(buffer, n);
+    }
+    std::fclose(u8_file);
+
+    std::fstream u16_file(argv[2]);
+    std::string  temp;
+    ans.clear();
+    while (u16_file >> temp) {
+        const uint32_t value = read_hex(temp);
+        if (value > 0xffff)
+            ans.push_back(value >> 16);
+        ans.push_back(value & 0xffff);
+    }
+    u16_file.close();
+
+    assert(to_u16string(u8, u16, UTF_ENDIAN_LITTLE_ENDIAN));
+    assert(u16 == ans);
+    return 0;
+}
@@ -1,15 +1,94 @@
+#undef NDEBUG
+
 #include <cassert>
 #include <cstdio>
 #include <cstdlib>
 #include <string>
 
+#include "test_util.hpp"
 #include "utf_convert.hpp"
 
 using namespace utf_convert;
 
 char s[1024];
 
+void simple_test(const std::u32string &ans) {
+    std::string u8;
+    for (size_t i = 0; i < ans.size(); i++) {
+        append_u8(u8, ans[i]);
+    }
+
+    assert(utf32_length_from_utf8(u8.data(), u8.size()) == ans.size());
+
+    std::u32string converted;
+    assert(to_u32string(u8, converted, UTF_ENDIAN_LITTLE_ENDIAN));
+    assert(converted == ans);
+
+    assert(to_u32string(u8, converted, UTF_ENDIAN_BIG_ENDIAN, true));
+    assert(converted.size() == ans.size() + 1);
+    for (size_t i = 0; i < ans.size(); i++) {
+        assert(swap_endian(converted[i + 1]) == ans[i]);
+    }
+}
+
+void vector_test() {
+    // Mixed lengths, long enough to go through the vectorized decoders.
+    const char32_t chars[] = {0x41, 0x7f, 0xe9, 0x7ff, 0x4f60, 0xffff, 0x10000,
+                              0x1f600, 0x10ffff};
+    std::u32string ans;
+    for (size_t i = 0; i < 300; i++) {
+        ans.push_back(chars[(i * 7 + i / 5) % 9]);
+        simple_test(ans);
+    }
+
+    std::u32string ascii(100, U'a');
+    ascii += U"\u4f60\u597d";
+    ascii += std::u32string(100, U'b');
+    simple_test(ascii);
+
+    // A stray continuation byte fails after the valid prefix is converted.
+    std::string u8(40, 'x');
+    u8.push_back(0x80);
+    u8 += std::string(40, 'y');
+
+    std::u32string converted;
+    assert(!to_u32string(u8, converted, UTF_ENDIAN_LITTLE_ENDIAN));
+    assert(converted == std::u32string(40, U'x'));
+}
+
+void buffer_test() {
+    std::string    u8;
+    std::u32string ans;
+    for (size_t i = 0; i < 40; i++) {
+        ans += U"ab\u00e9\u4f60\U0001f600";
+    }
+    for (size_t i = 0; i < ans.size(); i++) {
+        append_u8(u8, ans[i]);
+    }
+
+    std::u32string out(ans.size(), 0);
+    result         res = convert_utf8_to_utf32(u8.data(), u8.size(), &out[0],
+                                       out.size(), UTF_ENDIAN_LITTLE_ENDIAN);
+    assert(res.error == UTF_ERROR_NONE && res.count == ans.size());
+    assert(out == ans);
+
+    // One character short, stops before the last one.
+    res = convert_utf8_to_utf32(u8.data(), u8.size(), &out[0], out.size() - 1,
+                                UTF_ENDIAN_LITTLE_ENDIAN);
+    assert(res.error == UTF_ERROR_OUTPUT_TOO_SMALL);
+    assert(res.count == u8.size() - 4);
+
+    // A stray continuation byte is reported at its position.
+    u8[100] = '\x80';
+    res     = convert_utf8_to_utf32(u8.data(), u8.size(), &out[0], out.size(),
+                                UTF_ENDIAN_BIG_ENDIAN);
+    assert(res.error == UTF_ERROR_INVALID_SEQUENCE && res.count == 100);
+}
+
 int main(int argc, char **argv) {
+    buffer_test();
+    vector_test();
+
     if (argc != 3) {
         return 0;
     }
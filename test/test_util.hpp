@@ -0,0 +1,80 @@
+#ifndef UTF_CONVERT_TEST_UTIL_HPP
+#define UTF_CONVERT_TEST_UTIL_HPP
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+#include "utf_convert.hpp"
+
+/*
+ * Reference code shared by the tests, written plainly to check the library
+ * against.
+ */
+
+inline uint32_t read_hex(const std::string &str) {
+    uint32_t res = 0;
+    for (size_t i = 0; i < str.size(); i++) {
+        if (str[i] >= '0' && str[i] <= '9') {
+            res = res * 16 + str[i] - '0';
+        } else if (str[i] >= 'a' && str[i] <= 'f') {
+            res = res * 16 + str[i] - 'a' + 10;
+        } else if (str[i] >= 'A' && str[i] <= 'F') {
+            res = res * 16 + str[i] - 'A' + 10;
+        }
+    }
+    return res;
+}
+
+inline char16_t swap_endian(char16_t ch) {
+    return ((ch & 0x00ff) << 8) | ((ch & 0xff00) >> 8);
+}
+
+inline char32_t swap_endian(char32_t ch) {
+    return ((ch & 0x000000ff) << 24) | ((ch & 0x0000ff00) << 8) |
+           ((ch & 0x00ff0000) >> 8) | ((ch & 0xff000000) >> 24);
+}
+
+/*!
+ * Reference encoders, giving the code units in the byte order of endian.
+ */
+inline char16_t make_u16(uint32_t value, utf_convert::UTF_ENDIAN endian) {
+    unsigned char bytes[2];
+    bytes[endian == utf_convert::UTF_ENDIAN_BIG_ENDIAN ? 1 : 0] = value & 0xff;
+    bytes[endian == utf_convert::UTF_ENDIAN_BIG_ENDIAN ? 0 : 1] = value >> 8;
+    char16_t unit;
+    std::memcpy(&unit, bytes, sizeof(unit));
+    return unit;
+}
+
+inline char32_t make_u32(uint32_t value, utf_convert::UTF_ENDIAN endian) {
+    unsigned char bytes[4];
+    for (size_t k = 0; k < 4; k++) {
+        size_t shift =
+            endian == utf_convert::UTF_ENDIAN_BIG_ENDIAN ? 24 - 8 * k : 8 * k;
+        bytes[k] = (value >> shift) & 0xff;
+    }
+    char32_t ch;
+    std::memcpy(&ch, bytes, sizeof(ch));
+    return ch;
+}
+
+inline void append_u8(std::string &str, uint32_t value) {
+    if (value < 0x80) {
+        str.push_back(value);
+    } else if (value < 0x800) {
+        str.push_back(0xc0 | (value >> 6));
+        str.push_back(0x80 | (value & 0x3f));
+    } else if (value < 0x10000) {
+        str.push_back(0xe0 | (value >> 12));
+        str.push_back(0x80 | ((value >> 6) & 0x3f));
+        str.push_back(0x80 | (value & 0x3f));
+    } else {
+        str.push_back(0xf0 | (value >> 18));
+        str.push_back(0x80 | ((value >> 12) & 0x3f));
+        str.push_back(0x80 | ((value >> 6) & 0x3f));
+        str.push_back(0x80 | (value & 0x3f));
+    }
+}
+
+#endif
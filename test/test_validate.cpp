@@ -0,0 +1,318 @@
+#undef NDEBUG
+
+#include <cassert>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+
+#include "test_util.hpp"
+#include "utf_convert.hpp"
+
+using namespace utf_convert;
+
+/*!
+ * Reference validator after the table of well-formed byte sequences in the
+ * Unicode standard, returning the position of the first ill-formed sequence
+ * or the length.
+ */
+size_t reference_utf8(const std::string &str) {
+    const unsigned char *s = reinterpret_cast<const unsigned char *>(str.data());
+    const size_t         n = str.size();
+
+    for (size_t i = 0; i < n;) {
+        unsigned char lead = s[i];
+        size_t        size;
+        unsigned char low = 0x80, high = 0xbf;
+        if (lead < 0x80) {
+            i++;
+            continue;
+        } else if (lead >= 0xc2 && lead <= 0xdf) {
+            size = 2;
+        } else if (lead >= 0xe0 && lead <= 0xef) {
+            size = 3;
+            if (lead == 0xe0)
+                low = 0xa0;
+            if (lead == 0xed)
+                high = 0x9f;
+        } else if (lead >= 0xf0 && lead <= 0xf4) {
+            size = 4;
+            if (lead == 0xf0)
+                low = 0x90;
+            if (lead == 0xf4)
+                high = 0x8f;
+        } else {
+            return i;
+        }
+
+        if (n - i < size || s[i + 1] < low || s[i + 1] > high)
+            return i;
+        for (size_t k = 2; k < size; k++) {
+            if (s[i + k] < 0x80 || s[i + k] > 0xbf)
+                return i;
+        }
+        i += size;
+    }
+    return n;
+}
+
+void check(const std::string &str) {
+    const size_t ans = reference_utf8(str);
+    const result res = validate_utf8(str.data(), str.size());
+    if (ans == str.size()) {
+        assert(res.error == UTF_ERROR_NONE && res.count == str.size());
+    } else {
+        assert(res.error == UTF_ERROR_INVALID_SEQUENCE && res.count == ans);
+    }
+}
+
+template <typename String>
+String swap_endian(const String &str) {
+    String res;
+    for (size_t i = 0; i < str.size(); i++) {
+        res.push_back(swap_endian(str[i]));
+    }
+    return res;
+}
+
+size_t reference_utf16(const std::u16string &str) {
+    for (size_t i = 0; i < str.size(); i++) {
+        if (str[i] >= 0xdc00 && str[i] < 0xe000)
+            return i;
+        if (str[i] >= 0xd800 && str[i] < 0xdc00) {
+            if (i + 1 == str.size() || str[i + 1] < 0xdc00 ||
+                str[i + 1] >= 0xe000)
+                return i;
+            i++;
+        }
+    }
+    return str.size();
+}
+
+size_t reference_utf32(const std::u32string &str) {
+    for (size_t i = 0; i < str.size(); i++) {
+        if (str[i] > 0x10ffff || (str[i] >= 0xd800 && str[i] < 0xe000))
+            return i;
+    }
+    return str.size();
+}
+
+void check_result(result res, size_t ans, size_t length) {
+    if (ans == length) {
+        assert(res.error == UTF_ERROR_NONE && res.count == length);
+    } else {
+        assert(res.error == UTF_ERROR_INVALID_SEQUENCE && res.count == ans);
+    }
+}
+
+void check(const std::u16string &str) {
+    const size_t ans = reference_utf16(str);
+    check_result(validate_utf16(str.data(), str.size(), UTF_ENDIAN_LITTLE_ENDIAN),
+                 ans, str.size());
+    const std::u16string big = swap_endian(str);
+    check_result(validate_utf16(big.data(), big.size(), UTF_ENDIAN_BIG_ENDIAN),
+                 ans, str.size());
+}
+
+void check(const std::u32string &str) {
+    const size_t ans = reference_utf32(str);
+    check_result(validate_utf32(str.data(), str.size(), UTF_ENDIAN_LITTLE_ENDIAN),
+                 ans, str.size());
+    const std::u32string big = swap_endian(str);
+    check_result(validate_utf32(big.data(), big.size(), UTF_ENDIAN_BIG_ENDIAN),
+                 ans, str.size());
+}
+
+void utf16_utf32_test() {
+    const char16_t u16_units[] = {u'a', 0x00e9, 0x4f60, 0xd83d, 0xde00,
+                                  0xd800, 0xdbff, 0xdc00, 0xdfff, 0xe000};
+    const char32_t u32_units[] = {U'a', 0x00e9, 0xd7ff, 0xd800, 0xdfff,
+                                  0xe000, 0x10ffff, 0x110000, 0xffffffff};
+
+    std::srand(2);
+    for (size_t round = 0; round < 3000; round++) {
+        std::u16string u16;
+        std::u32string u32;
+        const size_t   length = std::rand() % 100;
+        while (u16.size() < length) {
+            if (std::rand() % 48 == 0) {
+                u16.push_back(u16_units[std::rand() % 10]);
+                u32.push_back(u32_units[std::rand() % 9]);
+            } else {
+                // Mostly valid text, with surrogate pairs.
+                u16 += std::rand() % 4 ? u"x\u00e9" : u"\U0001f600";
+                u32 += std::rand() % 4 ? U"x\u00e9" : U"\U0001f600";
+            }
+        }
+        check(u16);
+        check(u32);
+    }
+
+    assert(validate_utf16(u"a", 1, static_cast<UTF_ENDIAN>(2)).error ==
+           UTF_ERROR_UNSUPPORTED_ENDIAN);
+    assert(validate_utf32(U"a", 1, static_cast<UTF_ENDIAN>(2)).error ==
+           UTF_ERROR_UNSUPPORTED_ENDIAN);
+}
+
+/*!
+ * The strict converters give the lenient result for valid input, and stop
+ * where validation fails otherwise.
+ */
+void strict_test() {
+    std::string u8;
+    while (u8.size() < 20000) {
+        u8 += "text \xc3\xa9\xe4\xbd\xa0\xf0\x9f\x98\x80 ";
+    }
+    std::u16string u16;
+    std::u32string u32;
+    const bool     u16_ok = to_u16string(u8, u16, UTF_ENDIAN_LITTLE_ENDIAN);
+    const bool     u32_ok = to_u32string(u8, u32, UTF_ENDIAN_LITTLE_ENDIAN);
+    assert(u16_ok && u32_ok);
+    assert(u16.size() > 9001 && u32.size() > 7000);
+
+    std::u32string u32_out(u32.size(), 0);
+    std::u16string u16_out(u16.size(), 0);
+    std::string    u8_out(u8.size(), 0);
+
+    result res = convert_utf8_to_utf32(u8.data(), u8.size(), &u32_out[0],
+                                       u32_out.size(), UTF_ENDIAN_LITTLE_ENDIAN,
+                                       UTF_MODE_STRICT);
+    assert(res.error == UTF_ERROR_NONE && u32_out == u32);
+    res = convert_utf16_to_utf8(u16.data(), u16.size(), &u8_out[0],
+                                u8_out.size(), UTF_ENDIAN_LITTLE_ENDIAN,
+                                UTF_MODE_STRICT);
+    assert(res.error == UTF_ERROR_NONE && u8_out == u8);
+    res = convert_utf32_to_utf16(u32.data(), u32.size(), &u16_out[0],
+                                 u16_out.size(), UTF_ENDIAN_LITTLE_ENDIAN,
+                                 UTF_ENDIAN_LITTLE_ENDIAN, UTF_MODE_STRICT);
+    assert(res.error == UTF_ERROR_NONE && u16_out == u16);
+
+    // An overlong form the lenient decoder accepts, past the first blocks.
+    std::string bad_u8 = u8;
+    bad_u8.replace(15000, 2, "\xc0\xaf");
+    const size_t u8_error = reference_utf8(bad_u8);
+    res = convert_utf8_to_utf16(bad_u8.data(), bad_u8.size(), &u16_out[0],
+                                u16_out.size(), UTF_ENDIAN_LITTLE_ENDIAN);
+    assert(res.error == UTF_ERROR_NONE);
+    res = convert_utf8_to_utf16(bad_u8.data(), bad_u8.size(), &u16_out[0],
+                                u16_out.size(), UTF_ENDIAN_LITTLE_ENDIAN,
+                                UTF_MODE_STRICT);
+    assert(res.error == UTF_ERROR_INVALID_SEQUENCE && res.count == u8_error);
+    std::u16string prefix;
+    const bool     prefix_ok = to_u16string(bad_u8.substr(0, u8_error), prefix,
+                                        UTF_ENDIAN_LITTLE_ENDIAN);
+    assert(prefix_ok);
+    assert(u16_out.compare(0, prefix.size(), prefix) == 0);
+
+    // A lone low surrogate, which the lenient encoder writes in three bytes.
+    std::u16string bad_u16 = u16;
+    bad_u16[9001]          = 0xdc00;
+    const size_t u16_error = reference_utf16(bad_u16);
+    res = convert_utf16_to_utf32(bad_u16.data(), bad_u16.size(), &u32_out[0],
+                                 u32_out.size(), UTF_ENDIAN_LITTLE_ENDIAN,
+                                 UTF_ENDIAN_LITTLE_ENDIAN, UTF_MODE_STRICT);
+    assert(res.error == UTF_ERROR_INVALID_SEQUENCE && res.count == u16_error);
+
+    // A surrogate in utf-32.
+    std::u32string bad_u32 = u32;
+    bad_u32[7000]          = 0xdfff;
+    res = convert_utf32_to_utf8(bad_u32.data(), bad_u32.size(), &u8_out[0],
+                                u8_out.size(), UTF_ENDIAN_LITTLE_ENDIAN,
+                                UTF_MODE_STRICT);
+    assert(res.error == UTF_ERROR_INVALID_SEQUENCE && res.count == 7000);
+
+    // A full buffer is reported the same way as in lenient mode.
+    char small[10];
+    res = convert_utf32_to_utf8(u32.data(), u32.size(), small, sizeof(small),
+                                UTF_ENDIAN_LITTLE_ENDIAN, UTF_MODE_STRICT);
+    result lenient = convert_utf32_to_utf8(
+        u32.data(), u32.size(), small, sizeof(small), UTF_ENDIAN_LITTLE_ENDIAN);
+    assert(res.error == UTF_ERROR_OUTPUT_TOO_SMALL);
+    assert(res.count == lenient.count);
+}
+
+int main() {
+    utf16_utf32_test();
+    strict_test();
+
+    const char *valid[] = {
+        "",
+        "Hello, world!",
+        "\xc2\x80\xdf\xbf",
+        "\xe0\xa0\x80\xed\x9f\xbf\xee\x80\x80\xef\xbf\xbf",
+        "\xf0\x90\x80\x80\xf4\x8f\xbf\xbf",
+        "\xe4\xbd\xa0\xe5\xa5\xbd\xef\xbc\x8c\xe4\xb8\x96\xe7\x95\x8c",
+    };
+    for (size_t i = 0; i < sizeof(valid) / sizeof(valid[0]); i++) {
+        const result res = validate_utf8(valid[i], std::string(valid[i]).size());
+        assert(res.error == UTF_ERROR_NONE);
+    }
+
+    // Ill-formed sequences and the position of their first byte.
+    struct {
+        const char *str;
+        size_t      position;
+    } invalid[] = {
+        {"ab\x80", 2},                  // stray continuation byte
+        {"ab\xc3", 2},                  // truncated at the end
+        {"ab\xe4\xbd" "c", 2},          // truncated in the middle
+        {"\xc0\xaf", 0},                // overlong two bytes
+        {"x\xe0\x9f\xbf", 1},           // overlong three bytes
+        {"xy\xf0\x8f\xbf\xbf", 2},      // overlong four bytes
+        {"\xed\xa0\x80", 0},            // surrogate
+        {"\xf4\x90\x80\x80", 0},        // above 0x10ffff
+        {"\xf8\x88\x80\x80\x80", 0},    // five byte form
+        {"\xc3\xa9\xc3\xa9\xff", 4},    // invalid byte
+        {"\xc3\xa9\x80\x80", 2},        // too many continuation bytes
+    };
+    for (size_t i = 0; i < sizeof(invalid) / sizeof(invalid[0]); i++) {
+        const std::string str(invalid[i].str);
+        const result      res = validate_utf8(str.data(), str.size());
+        assert(res.error == UTF_ERROR_INVALID_SEQUENCE);
+        assert(res.count == invalid[i].position);
+        assert(reference_utf8(str) == invalid[i].position);
+    }
+
+    // Every piece at every offset around the register boundaries, between
+    // ascii and between other sequences.
+    const char *pieces[] = {
+        "\xc3\xa9", "\xe4\xbd\xa0", "\xf0\x9f\x98\x80", "\x80", "\xbf",
+        "\xc3", "\xe4\xbd", "\xf0\x9f\x98", "\xc1\xbf", "\xe0\x80\x80",
+        "\xed\xbf\xbf", "\xf4\x90\x80\x80", "\xf5\x80\x80\x80", "\xfe",
+        "\xff", "\xc3\xa9\xa9", "\xf0\x80\x80\x80",
+    };
+    const char *fillers[] = {"a", "\xc3\xa9", "\xe4\xbd\xa0"};
+    for (size_t f = 0; f < sizeof(fillers) / sizeof(fillers[0]); f++) {
+        std::string filler;
+        while (filler.size() < 200) {
+            filler += fillers[f];
+        }
+        for (size_t p = 0; p < sizeof(pieces) / sizeof(pieces[0]); p++) {
+            for (size_t offset = 0; offset < 100; offset++) {
+                std::string str = filler;
+                str.insert(offset - offset % std::string(fillers[f]).size(),
+                           pieces[p]);
+                check(str);
+                check(str.substr(0, offset + 3));
+            }
+        }
+    }
+
+    // Random bytes biased towards utf-8 sequences.
+    std::srand(1);
+    const char *units[] = {
+        "a", "z", "\xc3\xa9", "\xe4\xbd\xa0", "\xf0\x9f\x98\x80",
+        "\xed\x9f\xbf", "\xee\x80\x80", "\xf4\x8f\xbf\xbf",
+    };
+    for (size_t round = 0; round < 2000; round++) {
+        std::string str;
+        const size_t length = std::rand() % 300;
+        while (str.size() < length) {
+            if (std::rand() % 64 == 0)
+                str.push_back(static_cast<char>(std::rand() % 256));
+            else
+                str += units[std::rand() % (sizeof(units) / sizeof(units[0]))];
+        }
+        check(str);
+    }
+    return 0;
+}
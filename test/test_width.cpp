@@ -0,0 +1,136 @@
+#undef NDEBUG
+
+#include <cassert>
+#include <cstdlib>
+#include <string>
+
+#include "utf_convert.hpp"
+
+using namespace utf_convert;
+
+const UTF_ENDIAN other_endian = UTF_ENDIAN_NATIVE == UTF_ENDIAN_LITTLE_ENDIAN
+                                    ? UTF_ENDIAN_BIG_ENDIAN
+                                    : UTF_ENDIAN_LITTLE_ENDIAN;
+
+size_t width_of(const std::string &u8str) {
+    return display_width(u8str.data(), u8str.size());
+}
+
+/*!
+ * The edges of the ranges of the table, and of the characters before it.
+ */
+void codepoint_test() {
+    assert(codepoint_width(0) == 0);
+    assert(codepoint_width('\t') == 0);
+    assert(codepoint_width(' ') == 1);
+    assert(codepoint_width('~') == 1);
+    assert(codepoint_width(0x7f) == 0);
+    assert(codepoint_width(0x9f) == 0);
+    assert(codepoint_width(0xa0) == 1);
+    assert(codepoint_width(0xad) == 1);
+    assert(codepoint_width(0x2ff) == 1);
+    assert(codepoint_width(0x300) == 0);      // Combining grave accent.
+    assert(codepoint_width(0x36f) == 0);
+    assert(codepoint_width(0x370) == 1);
+    assert(codepoint_width(0x10ff) == 1);
+    assert(codepoint_width(0x1100) == 2);     // Hangul choseong.
+    assert(codepoint_width(0x115f) == 2);
+    assert(codepoint_width(0x1160) == 0);     // Hangul jungseong.
+    assert(codepoint_width(0x11ff) == 0);
+    assert(codepoint_width(0x1200) == 1);
+    assert(codepoint_width(0x200b) == 0);     // Zero width space.
+    assert(codepoint_width(0x200d) == 0);     // Zero width joiner.
+    assert(codepoint_width(0x3000) == 2);     // Ideographic space.
+    assert(codepoint_width(0x4e2d) == 2);
+    assert(codepoint_width(0xac00) == 2);     // Hangul syllable.
+    assert(codepoint_width(0xd7a3) == 2);
+    assert(codepoint_width(0xd7b0) == 0);
+    assert(codepoint_width(0xd800) == 1);
+    assert(codepoint_width(0xfe0f) == 0);     // Variation selector 16.
+    assert(codepoint_width(0xff21) == 2);     // Fullwidth A.
+    assert(codepoint_width(0xff61) == 1);     // Halfwidth ideographic stop.
+    assert(codepoint_width(0x1f600) == 2);
+    assert(codepoint_width(0x20000) == 2);
+    assert(codepoint_width(0xe0001) == 0);    // Language tag.
+    assert(codepoint_width(0x10ffff) == 1);
+    assert(codepoint_width(0x110000) == 1);
+}
+
+void string_test() {
+    assert(width_of("") == 0);
+    assert(width_of("hello, world") == 12);
+    assert(width_of("tab\there\r\n") == 7);
+    assert(width_of("\xe4\xbd\xa0\xe5\xa5\xbd") == 4);
+    assert(width_of("e\xcc\x81") == 1);
+    assert(width_of("\xe1\x84\x92\xe1\x85\xa1\xe1\x86\xab") == 2);
+    assert(width_of("\xf0\x9f\x91\x8d\xf0\x9f\x8f\xbd") == 4);
+    assert(width_of("\xe2\x9d\xa4\xef\xb8\x8f") == 1);
+
+    // Each maximal subpart of an ill-formed sequence is a column.
+    assert(width_of("\xff") == 1);
+    assert(width_of("a\xe4\xbd") == 2);
+    assert(width_of("\xed\xa0\x80") == 3);
+    assert(width_of("\xf0\x9f\x98") == 1);
+    assert(width_of("\xe4\xbd" "b\xe4\xbd\xa0") == 4);
+
+    const std::u16string u16str   = u"\u4f60\u597d, \U0001f600!";
+    std::u16string       u16other = u16str;
+    swap_endian_inplace(u16other);
+    assert(display_width(u16str.data(), u16str.size(), UTF_ENDIAN_NATIVE) ==
+           9);
+    assert(display_width(u16other.data(), u16other.size(), other_endian) == 9);
+    assert(count_codepoints_utf16(u16str.data(), u16str.size(),
+                                  UTF_ENDIAN_NATIVE) == 6);
+    assert(count_codepoints_utf16(u16other.data(), u16other.size(),
+                                  other_endian) == 6);
+
+    // Unpaired surrogates take a column each.
+    const char16_t unpaired[] = {0xdc00, 'a', 0xd800, 0xd800, 0xdc00, 0xd800};
+    assert(display_width(unpaired, 6, UTF_ENDIAN_NATIVE) == 5);
+    assert(count_codepoints_utf16(unpaired, 6, UTF_ENDIAN_NATIVE) == 5);
+}
+
+/*!
+ * Random text with ascii runs across the registers of the kernels, against
+ * the widths of its characters one by one.
+ */
+void random_test() {
+    const char32_t pool[] = {'a',    ' ',     '\t',   0x7f,   0xe9,
+                             0x301,  0x4e2d,  0xac00, 0x1161, 0x200d,
+                             0xfe0f, 0xff21,  0xff61, 0x1f600, 0x20000};
+    const size_t   pool_size = sizeof(pool) / sizeof(pool[0]);
+
+    for (size_t length = 0; length < 300; length += 7) {
+        std::u32string u32str;
+        size_t         expected = 0;
+        for (size_t i = 0; i < length; i++) {
+            const char32_t ch =
+                std::rand() % 2 == 0 ? 'a' : pool[std::rand() % pool_size];
+            u32str.push_back(ch);
+            expected += codepoint_width(ch);
+        }
+
+        std::string    u8str;
+        std::u16string u16str;
+        assert(to_u8string(u32str, UTF_ENDIAN_NATIVE, u8str));
+        assert(to_u16string(u32str, UTF_ENDIAN_NATIVE, u16str,
+                            UTF_ENDIAN_NATIVE));
+        assert(width_of(u8str) == expected);
+        assert(count_codepoints_utf8(u8str.data(), u8str.size()) == length);
+        assert(display_width(u16str.data(), u16str.size(),
+                             UTF_ENDIAN_NATIVE) == expected);
+        assert(count_codepoints_utf16(u16str.data(), u16str.size(),
+                                      UTF_ENDIAN_NATIVE) == length);
+
+        swap_endian_inplace(u16str);
+        assert(display_width(u16str.data(), u16str.size(), other_endian) ==
+               expected);
+    }
+}
+
+int main() {
+    codepoint_test();
+    string_test();
+    random_test();
+    return 0;
+}
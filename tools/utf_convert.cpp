@@ -0,0 +1,109 @@
+#include <cstdio>
+#include <cstring>
+
+#include "utf_convert.hpp"
+
+using namespace utf_convert;
+
+namespace {
+struct encoding_name {
+    const char * name;
+    UTF_ENCODING encoding;
+};
+
+const encoding_name encoding_names[] = {
+    {"utf-8", UTF_ENCODING_UTF8},
+    {"utf8", UTF_ENCODING_UTF8},
+    {"utf-16le", UTF_ENCODING_UTF16_LITTLE_ENDIAN},
+    {"utf16le", UTF_ENCODING_UTF16_LITTLE_ENDIAN},
+    {"utf-16be", UTF_ENCODING_UTF16_BIG_ENDIAN},
+    {"utf16be", UTF_ENCODING_UTF16_BIG_ENDIAN},
+    {"utf-32le", UTF_ENCODING_UTF32_LITTLE_ENDIAN},
+    {"utf32le", UTF_ENCODING_UTF32_LITTLE_ENDIAN},
+    {"utf-32be", UTF_ENCODING_UTF32_BIG_ENDIAN},
+    {"utf32be", UTF_ENCODING_UTF32_BIG_ENDIAN},
+};
+
+bool parse_encoding(const char *name, UTF_ENCODING &encoding) {
+    char lower[16];
+    size_t i = 0;
+    for (; name[i] != '\0' && i + 1 < sizeof(lower); i++) {
+        lower[i] = name[i] >= 'A' && name[i] <= 'Z' ? name[i] - 'A' + 'a'
+                                                    : name[i];
+    }
+    lower[i] = '\0';
+
+    for (size_t j = 0; j < sizeof(encoding_names) / sizeof(encoding_names[0]);
+         j++) {
+        if (std::strcmp(lower, encoding_names[j].name) == 0) {
+            encoding = encoding_names[j].encoding;
+            return true;
+        }
+    }
+    return false;
+}
+
+void usage(const char *program) {
+    std::fprintf(stderr,
+                 "usage: %s -f FROM -t TO INPUT OUTPUT\n"
+                 "encodings: utf-8, utf-16le, utf-16be, utf-32le, utf-32be\n",
+                 program);
+}
+}  // namespace
+
+int main(int argc, char **argv) {
+    const char *from_name = NULL;
+    const char *to_name   = NULL;
+    const char *paths[2]  = {NULL, NULL};
+    int         path_count = 0;
+
+    for (int i = 1; i < argc; i++) {
+        if (std::strcmp(argv[i], "-f") == 0 && i + 1 < argc) {
+            from_name = argv[++i];
+        } else if (std::strcmp(argv[i], "-t") == 0 && i + 1 < argc) {
+            to_name = argv[++i];
+        } else if (argv[i][0] != '-' && path_count < 2) {
+            paths[path_count++] = argv[i];
+        } else {
+            usage(argv[0]);
+            return 2;
+        }
+    }
+
+    UTF_ENCODING from;
+    UTF_ENCODING to;
+    if (from_name == NULL || to_name == NULL || path_count != 2) {
+        usage(argv[0]);
+        return 2;
+    }
+    if (!parse_encoding(from_name, from)) {
+        std::fprintf(stderr, "%s: unknown encoding %s\n", argv[0], from_name);
+        return 2;
+    }
+    if (!parse_encoding(to_name, to)) {
+        std::fprintf(stderr, "%s: unknown encoding %s\n", argv[0], to_name);
+        return 2;
+    }
+
+    const result res = convert_file(paths[0], paths[1], from, to);
+    switch (res.error) {
+    case UTF_ERROR_NONE:
+        return 0;
+
+    case UTF_ERROR_FILE_IO:
+        std::fprintf(stderr,
+                     "%s: can not convert %s to %s\n",
+                     argv[0],
+                     paths[0],
+                     paths[1]);
+        return 1;
+
+    default:
+        std::fprintf(stderr,
+                     "%s: invalid input at code unit %zu of %s\n",
+                     argv[0],
+                     res.count,
+                     paths[0]);
+        return 1;
+    }
+}